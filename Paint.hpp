@@ -6,8 +6,10 @@
 
 #include "canvas/Canvas.hpp"
 #include "canvas/Layer.hpp"
+#include "canvas/ThreadPool.hpp"
 #include "tools/Tool.hpp"
 #include "editor/Editor.hpp"
+#include "editor/FrameScheduler.hpp"
 #include "ui/UI.hpp"
 
 // External library headers - SDL for graphics, ImGui for UI
@@ -54,6 +56,7 @@ namespace Paint {
         GetEditor().cleanup();
         GetToolManager().cleanup();
         GetCanvas().cleanup();
+        GetThreadPool().shutdown();
 
         TTF_Quit();
         IMG_Quit();
@@ -0,0 +1,68 @@
+#include "Adjustment.hpp"
+#include "TileBuffer.hpp"
+#include <algorithm>
+
+Adjustment::Adjustment(AdjustmentType type, float amount) : m_type(type), m_amount(amount) {
+    switch (type) {
+        case AdjustmentType::BRIGHTNESS: {
+            // Whole 8-bit steps, like it always was
+            int brightness = static_cast<int>(amount * 255.0f);
+            if (brightness != 0) m_tones.addBrightness(brightness / 255.0f);
+            break;
+        }
+        case AdjustmentType::CONTRAST:
+            if (amount != 0.0f) m_tones.addContrast(amount * 255.0f);
+            break;
+        case AdjustmentType::GAMMA:
+            if (amount != 0.0f) m_tones.addGamma(std::max(1.0f + amount, 0.1f));
+            break;
+        default:
+            break;
+    }
+    if (!m_tones.isEmpty()) m_table = m_tones.buildTable(ToneChain::getTableSize(PixelDepth::RGBA8));
+}
+
+void Adjustment::apply(Uint32* pixels, int count) const {
+    if (!m_tones.isEmpty()) {
+        m_table.applyRow8(pixels, count);
+    } else if (m_type == AdjustmentType::HUE_SATURATION && m_amount != 0.0f) {
+        PointOps::runRow8(hueShiftOp(m_amount * 360.0f), pixels, count);
+    }
+}
+
+void Adjustment::applyWeighted(Uint32* pixels, const Uint8* weights, int count) const {
+    // A row at a time through a copy, then each pixel moves that far towards it. The adjustment
+    // leaves alpha alone, so the premultiplied channels can just be mixed.
+    Uint32 adjusted[TileBuffer::TILE_SIZE];
+    for (int start = 0; start < count; start += TileBuffer::TILE_SIZE) {
+        const int n = std::min(count - start, TileBuffer::TILE_SIZE);
+        Uint32* line = pixels + start;
+        std::copy(line, line + n, adjusted);
+        apply(adjusted, n);
+        for (int i = 0; i < n; i++) {
+            const int w = weights[start + i];
+            if (w == 0 || line[i] == adjusted[i]) continue;
+            if (w == 255) {
+                line[i] = adjusted[i];
+                continue;
+            }
+            Uint32 mixed = line[i] & 0xFF;
+            for (int shift = 8; shift < 32; shift += 8) {
+                int from = (line[i] >> shift) & 0xFF;
+                int to = (adjusted[i] >> shift) & 0xFF;
+                mixed |= static_cast<Uint32>(from + ((to - from) * w + (to >= from ? 127 : -127)) / 255) << shift;
+            }
+            line[i] = mixed;
+        }
+    }
+}
+
+const char* Adjustment::getTypeName(AdjustmentType type) {
+    switch (type) {
+        case AdjustmentType::BRIGHTNESS: return "Brightness";
+        case AdjustmentType::CONTRAST: return "Contrast";
+        case AdjustmentType::HUE_SATURATION: return "Hue";
+        case AdjustmentType::GAMMA: return "Gamma";
+        default: return "None";
+    }
+}
@@ -0,0 +1,469 @@
+#include "BlendEngine.hpp"
+#include "TileBuffer.hpp"
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <utility>
+
+// The SIMD kernels use per-function target attributes so the rest of the program can still be
+// built for plain x86-64 (and the Makefile builds everything in one go, no per-file flags).
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#define BLEND_HAS_X86 1
+#include <immintrin.h>
+#define BLEND_SSE2 __attribute__((target("sse2")))
+#define BLEND_AVX2 __attribute__((target("avx2")))
+#endif
+
+// Pixels are 0xRRGGBBAA, so in memory (little endian) a pixel is the bytes A, B, G, R.
+// Unpacked to 16 bits that's 4 lanes per pixel with alpha in the first one.
+
+// (x + 128) / 255 without the divide, exact for anything up to 255 * 255 and fits in 16 bits
+static inline Uint32 div255(Uint32 x) {
+    x += 128;
+    return (x + (x >> 8)) >> 8;
+}
+
+// Dodge, burn and soft light need a divide or a sqrt per channel, so they're precomputed into
+// 256x256 tables indexed by (backdrop << 8 | source). Scalar and SIMD read the same tables.
+enum { LUT_DODGE, LUT_BURN, LUT_SOFT_LIGHT, LUT_COUNT };
+static Uint8 s_lut[LUT_COUNT][256 * 256];
+
+static void buildTables() {
+    for (int b = 0; b < 256; b++) {
+        for (int s = 0; s < 256; s++) {
+            float cb = b / 255.0f;
+            float cs = s / 255.0f;
+
+            float dodge = b == 0 ? 0.0f : (s == 255 ? 1.0f : std::min(1.0f, cb / (1.0f - cs)));
+            float burn = b == 255 ? 1.0f : (s == 0 ? 0.0f : 1.0f - std::min(1.0f, (1.0f - cb) / cs));
+
+            // Soft light the W3C way, not the cheap pegtop approximation
+            float d = cb <= 0.25f ? ((16.0f * cb - 12.0f) * cb + 4.0f) * cb : std::sqrt(cb);
+            float soft = cs <= 0.5f ? cb - (1.0f - 2.0f * cs) * cb * (1.0f - cb)
+                                    : cb + (2.0f * cs - 1.0f) * (d - cb);
+
+            int index = (b << 8) | s;
+            s_lut[LUT_DODGE][index] = static_cast<Uint8>(dodge * 255.0f + 0.5f);
+            s_lut[LUT_BURN][index] = static_cast<Uint8>(burn * 255.0f + 0.5f);
+            s_lut[LUT_SOFT_LIGHT][index] = static_cast<Uint8>(std::clamp(soft, 0.0f, 1.0f) * 255.0f + 0.5f);
+        }
+    }
+}
+
+static constexpr int lutFor(int mode) {
+    return mode == BLEND_COLOR_DODGE ? LUT_DODGE : mode == BLEND_COLOR_BURN ? LUT_BURN : LUT_SOFT_LIGHT;
+}
+static constexpr bool usesLut(int mode) {
+    return mode == BLEND_COLOR_DODGE || mode == BLEND_COLOR_BURN || mode == BLEND_SOFT_LIGHT;
+}
+
+// ---------------------------------------------------------------------------------------------
+// Scalar. This is the reference, the SIMD kernels below must match it bit for bit.
+
+// Premultiplied "over": source times opacity plus what's left of the backdrop, the same on all
+// four channels. No divides and no special case for see-through backdrops.
+static inline Uint32 blendNormalScalar(Uint32 dst, Uint32 src, int opacity) {
+    if (src == 0) return dst;
+    Uint32 sa = div255((src & 0xFF) * static_cast<Uint32>(opacity));
+    Uint32 out = 0;
+    for (int shift = 0; shift <= 24; shift += 8) {
+        Uint32 s = (src >> shift) & 0xFF;
+        Uint32 d = (dst >> shift) & 0xFF;
+        if (opacity < 255) s = div255(s * static_cast<Uint32>(opacity));
+        out |= std::min(s + div255(d * (255 - sa)), 255u) << shift;
+    }
+    return out;
+}
+
+// One colour channel, b is the backdrop and s the layer, both 0-255
+template <int Mode>
+static inline Uint32 blendChannel(Uint32 b, Uint32 s) {
+    if constexpr (Mode == BLEND_MULTIPLY) return div255(b * s);
+    else if constexpr (Mode == BLEND_SCREEN) return b + s - div255(b * s);
+    else if constexpr (Mode == BLEND_OVERLAY) return b < 128 ? div255(2 * b * s) : 255 - div255(2 * (255 - b) * (255 - s));
+    else if constexpr (Mode == BLEND_HARD_LIGHT) return s < 128 ? div255(2 * b * s) : 255 - div255(2 * (255 - b) * (255 - s));
+    else if constexpr (Mode == BLEND_DARKEN) return std::min(b, s);
+    else if constexpr (Mode == BLEND_LIGHTEN) return std::max(b, s);
+    else if constexpr (Mode == BLEND_DIFFERENCE) return b > s ? b - s : s - b;
+    else if constexpr (Mode == BLEND_EXCLUSION) return b + s - 2 * div255(b * s);
+    else if constexpr (Mode == BLEND_ADD) return std::min(b + s, 255u);
+    else if constexpr (usesLut(Mode)) return s_lut[lutFor(Mode)][(b << 8) | s];
+    else return s; // Normal
+}
+
+template <int Mode>
+static inline Uint32 blendPixelScalar(Uint32 dst, Uint32 src, int opacity) {
+    Uint32 sa = div255((src & 0xFF) * static_cast<Uint32>(opacity));
+    if (sa == 0) return dst;
+
+    Uint32 ab = dst & 0xFF;
+    Uint32 out = 0;
+    if (ab == 255) {
+        // Opaque backdrop, the common case and the only one the SIMD paths do
+        for (int shift = 8; shift <= 24; shift += 8) {
+            Uint32 b = (dst >> shift) & 0xFF;
+            Uint32 s = (src >> shift) & 0xFF;
+            out |= div255(blendChannel<Mode>(b, s) * sa + b * (255 - sa)) << shift;
+        }
+        return out | 0xFF;
+    }
+
+    // See-through backdrop: like the spec, mix the blended colour with the plain source by the
+    // backdrop alpha, then a normal straight alpha "over"
+    Uint32 dstWeight = div255(ab * (255 - sa));
+    Uint32 outA = sa + dstWeight;
+    for (int shift = 8; shift <= 24; shift += 8) {
+        Uint32 b = (dst >> shift) & 0xFF;
+        Uint32 s = (src >> shift) & 0xFF;
+        Uint32 c = Mode == BLEND_NORMAL ? s : div255(s * (255 - ab) + blendChannel<Mode>(b, s) * ab);
+        out |= ((c * sa + b * dstWeight + outA / 2) / outA) << shift;
+    }
+    return out | outA;
+}
+
+// The straight alpha formulas above on a premultiplied backdrop, src is already straight.
+// Over an opaque backdrop both conversions do nothing, which is what the SIMD paths rely on.
+template <int Mode>
+static inline Uint32 blendStraightSource(Uint32 dst, Uint32 src, int opacity) {
+    return TileBuffer::premultiply(blendPixelScalar<Mode>(TileBuffer::unpremultiply(dst), src, opacity));
+}
+
+// Premultiplied in and out, what blendPixel hands out
+template <int Mode>
+static Uint32 blendPixelPremultiplied(Uint32 dst, Uint32 src, int opacity) {
+    if constexpr (Mode == BLEND_NORMAL) return blendNormalScalar(dst, src, opacity);
+    else return blendStraightSource<Mode>(dst, TileBuffer::unpremultiply(src), opacity);
+}
+
+static void blendNormalRowScalar(Uint32* dst, const Uint32* src, int count, int opacity) {
+    for (int i = 0; i < count; i++) {
+        dst[i] = blendNormalScalar(dst[i], src[i], opacity);
+    }
+}
+
+// Row kernels for the other modes take a straight source, see BlendEngine::blendRow
+template <int Mode>
+static void blendRowScalar(Uint32* dst, const Uint32* src, int count, int opacity) {
+    for (int i = 0; i < count; i++) {
+        dst[i] = blendStraightSource<Mode>(dst[i], src[i], opacity);
+    }
+}
+
+#ifdef BLEND_HAS_X86
+// ---------------------------------------------------------------------------------------------
+// SSE2, 4 pixels at a time (2 per 16-bit register half)
+
+BLEND_SSE2 static inline __m128i div255x8(__m128i x) {
+    x = _mm_add_epi16(x, _mm_set1_epi16(128));
+    return _mm_srli_epi16(_mm_add_epi16(x, _mm_srli_epi16(x, 8)), 8);
+}
+
+BLEND_SSE2 static inline __m128i lookupx8(int lut, __m128i b, __m128i s) {
+    alignas(16) Uint16 bl[8], sl[8], out[8];
+    _mm_store_si128(reinterpret_cast<__m128i*>(bl), b);
+    _mm_store_si128(reinterpret_cast<__m128i*>(sl), s);
+    for (int k = 0; k < 8; k++) out[k] = s_lut[lut][(bl[k] << 8) | sl[k]];
+    return _mm_load_si128(reinterpret_cast<const __m128i*>(out));
+}
+
+// Both branches of overlay/hard light get computed and the wrong one masked off. The wrong one
+// can overflow 16 bits but it's thrown away anyway.
+BLEND_SSE2 static inline __m128i hardLightx8(__m128i b, __m128i s, __m128i low) {
+    const __m128i full = _mm_set1_epi16(255);
+    __m128i dark = div255x8(_mm_mullo_epi16(_mm_add_epi16(b, b), s));
+    __m128i inv = _mm_mullo_epi16(_mm_add_epi16(_mm_sub_epi16(full, b), _mm_sub_epi16(full, b)), _mm_sub_epi16(full, s));
+    __m128i light = _mm_sub_epi16(full, div255x8(inv));
+    return _mm_or_si128(_mm_and_si128(low, dark), _mm_andnot_si128(low, light));
+}
+
+template <int Mode>
+BLEND_SSE2 static inline __m128i blendChannelsx8(__m128i b, __m128i s) {
+    const __m128i half = _mm_set1_epi16(128);
+    if constexpr (Mode == BLEND_MULTIPLY) return div255x8(_mm_mullo_epi16(b, s));
+    else if constexpr (Mode == BLEND_SCREEN) return _mm_sub_epi16(_mm_add_epi16(b, s), div255x8(_mm_mullo_epi16(b, s)));
+    else if constexpr (Mode == BLEND_OVERLAY) return hardLightx8(b, s, _mm_cmplt_epi16(b, half));
+    else if constexpr (Mode == BLEND_HARD_LIGHT) return hardLightx8(b, s, _mm_cmplt_epi16(s, half));
+    else if constexpr (Mode == BLEND_DARKEN) return _mm_min_epi16(b, s);
+    else if constexpr (Mode == BLEND_LIGHTEN) return _mm_max_epi16(b, s);
+    else if constexpr (Mode == BLEND_DIFFERENCE) return _mm_sub_epi16(_mm_max_epi16(b, s), _mm_min_epi16(b, s));
+    else if constexpr (Mode == BLEND_EXCLUSION) {
+        __m128i m = div255x8(_mm_mullo_epi16(b, s));
+        return _mm_sub_epi16(_mm_add_epi16(b, s), _mm_add_epi16(m, m));
+    }
+    else if constexpr (Mode == BLEND_ADD) return _mm_min_epi16(_mm_add_epi16(b, s), _mm_set1_epi16(255));
+    else if constexpr (usesLut(Mode)) return lookupx8(lutFor(Mode), b, s);
+    else return s;
+}
+
+// Two pixels unpacked to 16 bits over an opaque backdrop. Same formula as the scalar opaque case.
+template <int Mode>
+BLEND_SSE2 static inline __m128i blendOpaquex8(__m128i d, __m128i s, __m128i opacity) {
+    const __m128i full = _mm_set1_epi16(255);
+    __m128i a = _mm_shufflehi_epi16(_mm_shufflelo_epi16(s, 0), 0); // alpha into all 4 lanes
+    __m128i sa = div255x8(_mm_mullo_epi16(a, opacity));
+    __m128i c = blendChannelsx8<Mode>(d, s);
+    return div255x8(_mm_add_epi16(_mm_mullo_epi16(c, sa), _mm_mullo_epi16(d, _mm_sub_epi16(full, sa))));
+}
+
+template <int Mode>
+BLEND_SSE2 static void blendRowSSE2(Uint32* dst, const Uint32* src, int count, int opacity) {
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i alphaMask = _mm_set1_epi32(0xFF);
+    const __m128i op = _mm_set1_epi16(static_cast<short>(opacity));
+
+    int i = 0;
+    for (; i + 4 <= count; i += 4) {
+        __m128i s = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+        __m128i sAlpha = _mm_and_si128(s, alphaMask);
+        if (_mm_movemask_epi8(_mm_cmpeq_epi32(sAlpha, zero)) == 0xFFFF) continue; // nothing to draw
+
+        __m128i d = _mm_loadu_si128(reinterpret_cast<const __m128i*>(dst + i));
+        __m128i dOpaque = _mm_cmpeq_epi32(_mm_and_si128(d, alphaMask), alphaMask);
+        if (_mm_movemask_epi8(dOpaque) != 0xFFFF) {
+            for (int k = i; k < i + 4; k++) dst[k] = blendStraightSource<Mode>(dst[k], src[k], opacity);
+            continue;
+        }
+
+        __m128i lo = blendOpaquex8<Mode>(_mm_unpacklo_epi8(d, zero), _mm_unpacklo_epi8(s, zero), op);
+        __m128i hi = blendOpaquex8<Mode>(_mm_unpackhi_epi8(d, zero), _mm_unpackhi_epi8(s, zero), op);
+        __m128i out = _mm_or_si128(_mm_packus_epi16(lo, hi), alphaMask);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), out);
+    }
+    for (; i < count; i++) {
+        dst[i] = blendStraightSource<Mode>(dst[i], src[i], opacity);
+    }
+}
+
+// Premultiplied over on two unpacked pixels, any backdrop
+BLEND_SSE2 static inline __m128i blendNormalx8(__m128i d, __m128i s, __m128i opacity, bool scale) {
+    if (scale) s = div255x8(_mm_mullo_epi16(s, opacity));
+    __m128i sa = _mm_shufflehi_epi16(_mm_shufflelo_epi16(s, 0), 0);
+    return _mm_add_epi16(s, div255x8(_mm_mullo_epi16(d, _mm_sub_epi16(_mm_set1_epi16(255), sa))));
+}
+
+BLEND_SSE2 static void blendNormalRowSSE2(Uint32* dst, const Uint32* src, int count, int opacity) {
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i alphaMask = _mm_set1_epi32(0xFF);
+    const __m128i op = _mm_set1_epi16(static_cast<short>(opacity));
+    const bool scale = opacity < 255;
+
+    int i = 0;
+    for (; i + 4 <= count; i += 4) {
+        __m128i s = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+        if (_mm_movemask_epi8(_mm_cmpeq_epi32(s, zero)) == 0xFFFF) continue; // nothing to draw
+        if (!scale && _mm_movemask_epi8(_mm_cmpeq_epi32(_mm_and_si128(s, alphaMask), alphaMask)) == 0xFFFF) {
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), s); // opaque covers whatever was there
+            continue;
+        }
+
+        __m128i d = _mm_loadu_si128(reinterpret_cast<const __m128i*>(dst + i));
+        __m128i lo = blendNormalx8(_mm_unpacklo_epi8(d, zero), _mm_unpacklo_epi8(s, zero), op, scale);
+        __m128i hi = blendNormalx8(_mm_unpackhi_epi8(d, zero), _mm_unpackhi_epi8(s, zero), op, scale);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), _mm_packus_epi16(lo, hi));
+    }
+    for (; i < count; i++) {
+        dst[i] = blendNormalScalar(dst[i], src[i], opacity);
+    }
+}
+
+// ---------------------------------------------------------------------------------------------
+// AVX2, 8 pixels at a time. Line for line the SSE2 kernel with wider registers. Unpack and pack
+// both work per 128-bit half, so the pixel order comes back out the way it went in.
+
+BLEND_AVX2 static inline __m256i div255x16(__m256i x) {
+    x = _mm256_add_epi16(x, _mm256_set1_epi16(128));
+    return _mm256_srli_epi16(_mm256_add_epi16(x, _mm256_srli_epi16(x, 8)), 8);
+}
+
+BLEND_AVX2 static inline __m256i lookupx16(int lut, __m256i b, __m256i s) {
+    alignas(32) Uint16 bl[16], sl[16], out[16];
+    _mm256_store_si256(reinterpret_cast<__m256i*>(bl), b);
+    _mm256_store_si256(reinterpret_cast<__m256i*>(sl), s);
+    for (int k = 0; k < 16; k++) out[k] = s_lut[lut][(bl[k] << 8) | sl[k]];
+    return _mm256_load_si256(reinterpret_cast<const __m256i*>(out));
+}
+
+BLEND_AVX2 static inline __m256i hardLightx16(__m256i b, __m256i s, __m256i low) {
+    const __m256i full = _mm256_set1_epi16(255);
+    __m256i dark = div255x16(_mm256_mullo_epi16(_mm256_add_epi16(b, b), s));
+    __m256i invB = _mm256_sub_epi16(full, b);
+    __m256i inv = _mm256_mullo_epi16(_mm256_add_epi16(invB, invB), _mm256_sub_epi16(full, s));
+    __m256i light = _mm256_sub_epi16(full, div255x16(inv));
+    return _mm256_blendv_epi8(light, dark, low);
+}
+
+template <int Mode>
+BLEND_AVX2 static inline __m256i blendChannelsx16(__m256i b, __m256i s) {
+    // No unsigned 16-bit compare, but everything is 0-255 so signed is fine
+    const __m256i below = _mm256_set1_epi16(128);
+    if constexpr (Mode == BLEND_MULTIPLY) return div255x16(_mm256_mullo_epi16(b, s));
+    else if constexpr (Mode == BLEND_SCREEN) return _mm256_sub_epi16(_mm256_add_epi16(b, s), div255x16(_mm256_mullo_epi16(b, s)));
+    else if constexpr (Mode == BLEND_OVERLAY) return hardLightx16(b, s, _mm256_cmpgt_epi16(below, b));
+    else if constexpr (Mode == BLEND_HARD_LIGHT) return hardLightx16(b, s, _mm256_cmpgt_epi16(below, s));
+    else if constexpr (Mode == BLEND_DARKEN) return _mm256_min_epu16(b, s);
+    else if constexpr (Mode == BLEND_LIGHTEN) return _mm256_max_epu16(b, s);
+    else if constexpr (Mode == BLEND_DIFFERENCE) return _mm256_sub_epi16(_mm256_max_epu16(b, s), _mm256_min_epu16(b, s));
+    else if constexpr (Mode == BLEND_EXCLUSION) {
+        __m256i m = div255x16(_mm256_mullo_epi16(b, s));
+        return _mm256_sub_epi16(_mm256_add_epi16(b, s), _mm256_add_epi16(m, m));
+    }
+    else if constexpr (Mode == BLEND_ADD) return _mm256_min_epu16(_mm256_add_epi16(b, s), _mm256_set1_epi16(255));
+    else if constexpr (usesLut(Mode)) return lookupx16(lutFor(Mode), b, s);
+    else return s;
+}
+
+template <int Mode>
+BLEND_AVX2 static inline __m256i blendOpaquex16(__m256i d, __m256i s, __m256i opacity) {
+    const __m256i full = _mm256_set1_epi16(255);
+    __m256i a = _mm256_shufflehi_epi16(_mm256_shufflelo_epi16(s, 0), 0);
+    __m256i sa = div255x16(_mm256_mullo_epi16(a, opacity));
+    __m256i c = blendChannelsx16<Mode>(d, s);
+    return div255x16(_mm256_add_epi16(_mm256_mullo_epi16(c, sa), _mm256_mullo_epi16(d, _mm256_sub_epi16(full, sa))));
+}
+
+template <int Mode>
+BLEND_AVX2 static void blendRowAVX2(Uint32* dst, const Uint32* src, int count, int opacity) {
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i alphaMask = _mm256_set1_epi32(0xFF);
+    const __m256i op = _mm256_set1_epi16(static_cast<short>(opacity));
+
+    int i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m256i s = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i));
+        __m256i sAlpha = _mm256_and_si256(s, alphaMask);
+        if (_mm256_movemask_epi8(_mm256_cmpeq_epi32(sAlpha, zero)) == -1) continue;
+
+        __m256i d = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(dst + i));
+        __m256i dOpaque = _mm256_cmpeq_epi32(_mm256_and_si256(d, alphaMask), alphaMask);
+        if (_mm256_movemask_epi8(dOpaque) != -1) {
+            for (int k = i; k < i + 8; k++) dst[k] = blendStraightSource<Mode>(dst[k], src[k], opacity);
+            continue;
+        }
+
+        __m256i lo = blendOpaquex16<Mode>(_mm256_unpacklo_epi8(d, zero), _mm256_unpacklo_epi8(s, zero), op);
+        __m256i hi = blendOpaquex16<Mode>(_mm256_unpackhi_epi8(d, zero), _mm256_unpackhi_epi8(s, zero), op);
+        __m256i out = _mm256_or_si256(_mm256_packus_epi16(lo, hi), alphaMask);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i), out);
+    }
+    for (; i < count; i++) {
+        dst[i] = blendStraightSource<Mode>(dst[i], src[i], opacity);
+    }
+}
+
+BLEND_AVX2 static inline __m256i blendNormalx16(__m256i d, __m256i s, __m256i opacity, bool scale) {
+    if (scale) s = div255x16(_mm256_mullo_epi16(s, opacity));
+    __m256i sa = _mm256_shufflehi_epi16(_mm256_shufflelo_epi16(s, 0), 0);
+    return _mm256_add_epi16(s, div255x16(_mm256_mullo_epi16(d, _mm256_sub_epi16(_mm256_set1_epi16(255), sa))));
+}
+
+BLEND_AVX2 static void blendNormalRowAVX2(Uint32* dst, const Uint32* src, int count, int opacity) {
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i alphaMask = _mm256_set1_epi32(0xFF);
+    const __m256i op = _mm256_set1_epi16(static_cast<short>(opacity));
+    const bool scale = opacity < 255;
+
+    int i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m256i s = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i));
+        if (_mm256_movemask_epi8(_mm256_cmpeq_epi32(s, zero)) == -1) continue;
+        if (!scale && _mm256_movemask_epi8(_mm256_cmpeq_epi32(_mm256_and_si256(s, alphaMask), alphaMask)) == -1) {
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i), s);
+            continue;
+        }
+
+        __m256i d = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(dst + i));
+        __m256i lo = blendNormalx16(_mm256_unpacklo_epi8(d, zero), _mm256_unpacklo_epi8(s, zero), op, scale);
+        __m256i hi = blendNormalx16(_mm256_unpackhi_epi8(d, zero), _mm256_unpackhi_epi8(s, zero), op, scale);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i), _mm256_packus_epi16(lo, hi));
+    }
+    for (; i < count; i++) {
+        dst[i] = blendNormalScalar(dst[i], src[i], opacity);
+    }
+}
+#endif
+
+// ---------------------------------------------------------------------------------------------
+
+using RowFn = void (*)(Uint32* dst, const Uint32* src, int count, int opacity);
+using PixelFn = Uint32 (*)(Uint32 dst, Uint32 src, int opacity);
+
+template <size_t... Modes>
+static std::array<PixelFn, BLEND_MODE_COUNT> pixelTable(std::index_sequence<Modes...>) {
+    return {blendPixelPremultiplied<Modes>...};
+}
+template <size_t... Modes>
+static std::array<RowFn, BLEND_MODE_COUNT> scalarTable(std::index_sequence<Modes...>) {
+    return {blendRowScalar<Modes>...};
+}
+#ifdef BLEND_HAS_X86
+template <size_t... Modes>
+static std::array<RowFn, BLEND_MODE_COUNT> sse2Table(std::index_sequence<Modes...>) {
+    return {blendRowSSE2<Modes>...};
+}
+template <size_t... Modes>
+static std::array<RowFn, BLEND_MODE_COUNT> avx2Table(std::index_sequence<Modes...>) {
+    return {blendRowAVX2<Modes>...};
+}
+#endif
+
+static std::array<PixelFn, BLEND_MODE_COUNT> s_pixelFns;
+static std::array<RowFn, BLEND_MODE_COUNT> s_rowFns;
+static RowFn s_normalRowFn = blendNormalRowScalar;
+
+BlendEngine& BlendEngine::getInstance() {
+    static BlendEngine instance;
+    return instance;
+}
+
+BlendEngine::BlendEngine() {
+    buildTables();
+
+    auto modes = std::make_index_sequence<BLEND_MODE_COUNT>();
+    s_pixelFns = pixelTable(modes);
+    s_rowFns = scalarTable(modes);
+    m_kernel = Kernel::SCALAR;
+
+#ifdef BLEND_HAS_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        s_rowFns = avx2Table(modes);
+        s_normalRowFn = blendNormalRowAVX2;
+        m_kernel = Kernel::AVX2;
+    } else if (__builtin_cpu_supports("sse2")) {
+        s_rowFns = sse2Table(modes);
+        s_normalRowFn = blendNormalRowSSE2;
+        m_kernel = Kernel::SSE2;
+    }
+#endif
+}
+
+void BlendEngine::blendRow(int mode, Uint32* dst, const Uint32* src, int count, int opacity) const {
+    if (count <= 0 || opacity <= 0) return;
+    if (mode <= BLEND_NORMAL || mode >= BLEND_MODE_COUNT) {
+        s_normalRowFn(dst, src, count, std::min(opacity, 255));
+        return;
+    }
+
+    // The rest want straight colour, so the source goes through a small straight copy first.
+    // Opaque source pixels (most of them) convert to themselves.
+    Uint32 straight[256];
+    for (int start = 0; start < count; start += 256) {
+        int n = std::min(256, count - start);
+        for (int i = 0; i < n; i++) straight[i] = TileBuffer::unpremultiply(src[start + i]);
+        s_rowFns[mode](dst + start, straight, n, std::min(opacity, 255));
+    }
+}
+
+Uint32 BlendEngine::blendPixel(int mode, Uint32 dst, Uint32 src, int opacity) const {
+    if (opacity <= 0) return dst;
+    if (mode < 0 || mode >= BLEND_MODE_COUNT) mode = BLEND_NORMAL;
+    return s_pixelFns[mode](dst, src, std::min(opacity, 255));
+}
+
+const char* BlendEngine::getKernelName() const {
+    switch (m_kernel) {
+        case Kernel::AVX2: return "AVX2";
+        case Kernel::SSE2: return "SSE2";
+        default: return "Scalar";
+    }
+}
@@ -0,0 +1,331 @@
+#include "BlurEngine.hpp"
+#include "ThreadPool.hpp"
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+// SSE2 is part of x86-64, so unlike the blend engine there's nothing to check at runtime
+#if defined(__SSE2__)
+#define BLUR_HAS_SSE2 1
+#include <emmintrin.h>
+#endif
+
+namespace {
+
+// Rows per job for the horizontal pass, and columns per strip for the vertical one. A strip of
+// 16 is 256 bytes of floats per row, a few cache lines that the pass walks down in order.
+constexpr int ROWS_PER_JOB = 8;
+constexpr int STRIP_WIDTH = 16;
+
+// ---------------------------------------------------------------------------------------------
+// One pixel, all four channels. The passes below only ever add, subtract and scale these.
+
+#ifdef BLUR_HAS_SSE2
+struct Vec4 { __m128 v; };
+inline Vec4 load4(const float* p) { return {_mm_loadu_ps(p)}; }
+inline void store4(float* p, Vec4 a) { _mm_storeu_ps(p, a.v); }
+inline Vec4 splat(float f) { return {_mm_set1_ps(f)}; }
+inline Vec4 operator+(Vec4 a, Vec4 b) { return {_mm_add_ps(a.v, b.v)}; }
+inline Vec4 operator-(Vec4 a, Vec4 b) { return {_mm_sub_ps(a.v, b.v)}; }
+inline Vec4 operator*(Vec4 a, Vec4 b) { return {_mm_mul_ps(a.v, b.v)}; }
+
+inline void loadPixel(Uint32 pixel, float* out) {
+    const __m128i zero = _mm_setzero_si128();
+    __m128i v = _mm_cvtsi32_si128(static_cast<int>(pixel));
+    v = _mm_unpacklo_epi16(_mm_unpacklo_epi8(v, zero), zero);
+    _mm_storeu_ps(out, _mm_cvtepi32_ps(v));
+}
+
+// Rounds, clamps to 0-255 and colour to alpha (lane 0 in memory order), packs
+inline Uint32 storePixel(const float* in) {
+    __m128 v = _mm_add_ps(_mm_loadu_ps(in), _mm_set1_ps(0.5f));
+    v = _mm_min_ps(_mm_max_ps(v, _mm_setzero_ps()), _mm_set1_ps(255.0f));
+    v = _mm_min_ps(v, _mm_shuffle_ps(v, v, _MM_SHUFFLE(0, 0, 0, 0)));
+    __m128i i = _mm_cvttps_epi32(v);
+    i = _mm_packs_epi32(i, i);
+    i = _mm_packus_epi16(i, i);
+    return static_cast<Uint32>(_mm_cvtsi128_si32(i));
+}
+// The row pass result, kept at 8.8 fixed point (1/256 of a level) for the column pass so a thin
+// line spread over a wide box doesn't round away to nothing in between
+inline void storeWide(const float* in, Uint16* out) {
+    __m128 v = _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(in), _mm_set1_ps(256.0f)), _mm_set1_ps(0.5f));
+    v = _mm_min_ps(_mm_max_ps(v, _mm_setzero_ps()), _mm_set1_ps(65535.0f));
+    // No unsigned 32 to 16 bit pack in SSE2, go through the signed one shifted down by 32768
+    __m128i i = _mm_sub_epi32(_mm_cvttps_epi32(v), _mm_set1_epi32(32768));
+    i = _mm_xor_si128(_mm_packs_epi32(i, i), _mm_set1_epi16(static_cast<short>(0x8000)));
+    _mm_storel_epi64(reinterpret_cast<__m128i*>(out), i);
+}
+
+inline void loadWide(const Uint16* in, float* out) {
+    __m128i v = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(in));
+    v = _mm_unpacklo_epi16(v, _mm_setzero_si128());
+    _mm_storeu_ps(out, _mm_mul_ps(_mm_cvtepi32_ps(v), _mm_set1_ps(1.0f / 256.0f)));
+}
+#else
+struct Vec4 { float v[4]; };
+inline Vec4 load4(const float* p) { return {{p[0], p[1], p[2], p[3]}}; }
+inline void store4(float* p, Vec4 a) { for (int c = 0; c < 4; c++) p[c] = a.v[c]; }
+inline Vec4 splat(float f) { return {{f, f, f, f}}; }
+inline Vec4 operator+(Vec4 a, Vec4 b) { for (int c = 0; c < 4; c++) a.v[c] += b.v[c]; return a; }
+inline Vec4 operator-(Vec4 a, Vec4 b) { for (int c = 0; c < 4; c++) a.v[c] -= b.v[c]; return a; }
+inline Vec4 operator*(Vec4 a, Vec4 b) { for (int c = 0; c < 4; c++) a.v[c] *= b.v[c]; return a; }
+
+inline void loadPixel(Uint32 pixel, float* out) {
+    for (int c = 0; c < 4; c++) out[c] = static_cast<float>((pixel >> (c * 8)) & 0xFF);
+}
+
+inline Uint32 storePixel(const float* in) {
+    float v[4];
+    for (int c = 0; c < 4; c++) v[c] = std::min(std::max(in[c] + 0.5f, 0.0f), 255.0f);
+    Uint32 pixel = 0;
+    for (int c = 0; c < 4; c++) pixel |= static_cast<Uint32>(std::min(v[c], v[0])) << (c * 8);
+    return pixel;
+}
+
+inline void storeWide(const float* in, Uint16* out) {
+    for (int c = 0; c < 4; c++) out[c] = static_cast<Uint16>(std::min(std::max(in[c] * 256.0f + 0.5f, 0.0f), 65535.0f));
+}
+
+inline void loadWide(const Uint16* in, float* out) {
+    for (int c = 0; c < 4; c++) out[c] = in[c] * (1.0f / 256.0f);
+}
+#endif
+
+// ---------------------------------------------------------------------------------------------
+// What a blur turns into: up to three box radii, or the recursive filter's coefficients
+
+struct Plan {
+    BlurMode mode = BlurMode::BOX;
+    int radii[3] = {};
+    int passes = 0;
+    // Young & van Vliet, already divided by b0: y[n] = B x[n] + b1 y[n-1] + b2 y[n-2] + b3 y[n-3]
+    float B = 1.0f, b1 = 0.0f, b2 = 0.0f, b3 = 0.0f;
+};
+
+// The Gaussians take the radius as 2 sigma, that looks about as soft as a box of that radius
+float sigmaFor(int radius) {
+    return std::max(radius * 0.5f, 0.5f);
+}
+
+// Past this the recursive filter's poles get so close to 1 that float rounding piles up along the
+// line (a flat colour drifts, at a few hundred pixels alpha falls apart), the 3 box plan takes over
+constexpr float MAX_RECURSIVE_SIGMA = 40.0f;
+
+Plan makePlan(BlurMode mode, int radius) {
+    Plan plan;
+    plan.mode = mode;
+    if (mode == BlurMode::BOX) {
+        plan.radii[0] = radius;
+        plan.passes = 1;
+    } else if (mode == BlurMode::GAUSSIAN_BOX3 || sigmaFor(radius) > MAX_RECURSIVE_SIGMA) {
+        plan.mode = BlurMode::GAUSSIAN_BOX3;
+        // Box widths whose variances add up to sigma^2 (Kovesi, "Fast almost-Gaussian filtering"):
+        // the first few passes take the odd width just under the ideal one, the rest the next one up
+        const float sigma = sigmaFor(radius);
+        const int n = 3;
+        const float ideal = std::sqrt(12.0f * sigma * sigma / n + 1.0f);
+        int lower = static_cast<int>(ideal);
+        if (lower % 2 == 0) lower--;
+        const int upper = lower + 2;
+        const int m = static_cast<int>(std::lround((12.0f * sigma * sigma - n * lower * lower - 4.0f * n * lower - 3.0f * n) / (-4.0f * lower - 4.0f)));
+        for (int i = 0; i < n; i++) plan.radii[i] = ((i < m ? lower : upper) - 1) / 2;
+        // Small radii round down to nothing, a 3 wide box is the least blur there is
+        plan.radii[n - 1] = std::max(plan.radii[n - 1], 1);
+        plan.passes = n;
+    } else {
+        const float sigma = sigmaFor(radius);
+        const float q = sigma >= 2.5f ? 0.98711f * sigma - 0.96330f
+                                      : 3.97156f - 4.14554f * std::sqrt(1.0f - 0.26891f * sigma);
+        const float q2 = q * q, q3 = q2 * q;
+        const float b0 = 1.57825f + 2.44413f * q + 1.4281f * q2 + 0.422205f * q3;
+        plan.b1 = (2.44413f * q + 2.85619f * q2 + 1.26661f * q3) / b0;
+        plan.b2 = -(1.4281f * q2 + 1.26661f * q3) / b0;
+        plan.b3 = 0.422205f * q3 / b0;
+        plan.B = 1.0f - (plan.b1 + plan.b2 + plan.b3);
+    }
+    return plan;
+}
+
+// 1 / (what the recursive filter makes of a line of ones), for each spot on a line of n. Outside
+// the line is zero going in, so this is how much of the kernel landed inside.
+// Done in double, it's once per line length and shouldn't add its own rounding to the pixels'.
+std::vector<float> recursiveNorm(const Plan& plan, int n) {
+    std::vector<double> w(n);
+    double y1 = 0.0, y2 = 0.0, y3 = 0.0;
+    for (int i = 0; i < n; i++) {
+        w[i] = plan.B + plan.b1 * y1 + plan.b2 * y2 + plan.b3 * y3;
+        y3 = y2; y2 = y1; y1 = w[i];
+    }
+    y1 = y2 = y3 = 0.0;
+    for (int i = n - 1; i >= 0; i--) {
+        w[i] = plan.B * w[i] + plan.b1 * y1 + plan.b2 * y2 + plan.b3 * y3;
+        y3 = y2; y2 = y1; y1 = w[i];
+    }
+    std::vector<float> norm(n);
+    for (int i = 0; i < n; i++) norm[i] = static_cast<float>(1.0 / w[i]);
+    return norm;
+}
+
+// ---------------------------------------------------------------------------------------------
+// Line passes. A line is n elements of `lanes` floats (one pixel in the row pass, a strip's worth
+// in the column pass), lanes a multiple of 4.
+
+// Running sum over 2 * radius + 1 elements, divided by however many of those are on the line
+void boxPass(const float* in, float* out, int n, int lanes, int radius, float* sums) {
+    std::fill(sums, sums + lanes, 0.0f);
+    const int first = std::min(radius, n - 1);
+    for (int i = 0; i <= first; i++) {
+        for (int l = 0; l < lanes; l += 4) store4(sums + l, load4(sums + l) + load4(in + i * lanes + l));
+    }
+
+    for (int i = 0; i < n; i++) {
+        const int count = std::min(n - 1, i + radius) - std::max(0, i - radius) + 1;
+        const Vec4 scale = splat(1.0f / count);
+        const float* add = i + radius + 1 < n ? in + (i + radius + 1) * lanes : nullptr;
+        const float* sub = i - radius >= 0 ? in + (i - radius) * lanes : nullptr;
+        float* dst = out + i * lanes;
+        for (int l = 0; l < lanes; l += 4) {
+            Vec4 sum = load4(sums + l);
+            store4(dst + l, sum * scale);
+            if (add) sum = sum + load4(add + l);
+            if (sub) sum = sum - load4(sub + l);
+            store4(sums + l, sum);
+        }
+    }
+}
+
+// Forward then backward in place, then the edge correction. zeros has `lanes` zeros, it stands
+// in for the elements past either end.
+void recursivePass(float* line, int n, int lanes, const Plan& plan, const float* norm, const float* zeros) {
+    const Vec4 B = splat(plan.B), b1 = splat(plan.b1), b2 = splat(plan.b2), b3 = splat(plan.b3);
+
+    for (int i = 0; i < n; i++) {
+        const float* p1 = i >= 1 ? line + (i - 1) * lanes : zeros;
+        const float* p2 = i >= 2 ? line + (i - 2) * lanes : zeros;
+        const float* p3 = i >= 3 ? line + (i - 3) * lanes : zeros;
+        float* dst = line + i * lanes;
+        for (int l = 0; l < lanes; l += 4) {
+            store4(dst + l, B * load4(dst + l) + b1 * load4(p1 + l) + b2 * load4(p2 + l) + b3 * load4(p3 + l));
+        }
+    }
+
+    for (int i = n - 1; i >= 0; i--) {
+        const float* p1 = i + 1 < n ? line + (i + 1) * lanes : zeros;
+        const float* p2 = i + 2 < n ? line + (i + 2) * lanes : zeros;
+        const float* p3 = i + 3 < n ? line + (i + 3) * lanes : zeros;
+        float* dst = line + i * lanes;
+        for (int l = 0; l < lanes; l += 4) {
+            store4(dst + l, B * load4(dst + l) + b1 * load4(p1 + l) + b2 * load4(p2 + l) + b3 * load4(p3 + l));
+        }
+    }
+
+    // After both directions, so the next element back still saw the unscaled value
+    for (int i = 0; i < n; i++) {
+        const Vec4 scale = splat(norm[i]);
+        float* dst = line + i * lanes;
+        for (int l = 0; l < lanes; l += 4) store4(dst + l, load4(dst + l) * scale);
+    }
+}
+
+// Per-thread buffers for one line: two to ping-pong the box passes between, sums or zeros
+struct Scratch {
+    std::vector<float> a, b, extra;
+    void reserve(size_t floats, int lanes) {
+        a.resize(floats);
+        b.resize(floats);
+        extra.assign(lanes, 0.0f);
+    }
+};
+
+// Blurs scratch.a and returns wherever the result ended up
+float* runPasses(const Plan& plan, Scratch& scratch, int n, int lanes, const float* norm) {
+    if (plan.mode == BlurMode::GAUSSIAN) {
+        std::fill(scratch.extra.begin(), scratch.extra.end(), 0.0f);
+        recursivePass(scratch.a.data(), n, lanes, plan, norm, scratch.extra.data());
+        return scratch.a.data();
+    }
+    float* in = scratch.a.data();
+    float* out = scratch.b.data();
+    for (int p = 0; p < plan.passes; p++) {
+        if (plan.radii[p] <= 0) continue;
+        boxPass(in, out, n, lanes, plan.radii[p], scratch.extra.data());
+        std::swap(in, out);
+    }
+    return in;
+}
+
+} // namespace
+
+void BlurEngine::blur(Uint32* pixels, int width, int height, int pitch, BlurMode mode, int radius) {
+    if (!pixels || width <= 0 || height <= 0 || radius <= 0) return;
+
+    const Plan plan = makePlan(mode, radius);
+    std::vector<float> rowNorm, columnNorm;
+    if (plan.mode == BlurMode::GAUSSIAN) {
+        rowNorm = recursiveNorm(plan, width);
+        columnNorm = recursiveNorm(plan, height);
+    }
+
+    ThreadPool& pool = GetThreadPool();
+    std::vector<Uint16> rows(static_cast<size_t>(width) * height * 4);
+
+    pool.parallelFor((height + ROWS_PER_JOB - 1) / ROWS_PER_JOB, [&](int job) {
+        Scratch scratch;
+        scratch.reserve(static_cast<size_t>(width) * 4, 4);
+        const int endY = std::min(height, (job + 1) * ROWS_PER_JOB);
+        for (int y = job * ROWS_PER_JOB; y < endY; y++) {
+            Uint32* row = pixels + static_cast<size_t>(y) * pitch;
+            for (int x = 0; x < width; x++) loadPixel(row[x], scratch.a.data() + x * 4);
+            const float* result = runPasses(plan, scratch, width, 4, rowNorm.data());
+            Uint16* wide = rows.data() + static_cast<size_t>(y) * width * 4;
+            for (int x = 0; x < width; x++) storeWide(result + x * 4, wide + x * 4);
+        }
+    });
+
+    pool.parallelFor((width + STRIP_WIDTH - 1) / STRIP_WIDTH, [&](int strip) {
+        const int startX = strip * STRIP_WIDTH;
+        const int stripWidth = std::min(STRIP_WIDTH, width - startX);
+        const int lanes = stripWidth * 4;
+        Scratch scratch;
+        scratch.reserve(static_cast<size_t>(height) * lanes, lanes);
+
+        for (int y = 0; y < height; y++) {
+            const Uint16* wide = rows.data() + (static_cast<size_t>(y) * width + startX) * 4;
+            float* dst = scratch.a.data() + static_cast<size_t>(y) * lanes;
+            for (int x = 0; x < stripWidth; x++) loadWide(wide + x * 4, dst + x * 4);
+        }
+        const float* result = runPasses(plan, scratch, height, lanes, columnNorm.data());
+        for (int y = 0; y < height; y++) {
+            Uint32* row = pixels + static_cast<size_t>(y) * pitch + startX;
+            const float* src = result + static_cast<size_t>(y) * lanes;
+            for (int x = 0; x < stripWidth; x++) row[x] = storePixel(src + x * 4);
+        }
+    });
+}
+
+int BlurEngine::getHalo(BlurMode mode, int radius) {
+    if (radius <= 0) return 0;
+    const Plan plan = makePlan(mode, radius);
+    if (plan.mode == BlurMode::GAUSSIAN) return static_cast<int>(std::ceil(3.0f * sigmaFor(radius)));
+    int halo = 0;
+    for (int p = 0; p < plan.passes; p++) halo += plan.radii[p];
+    return halo;
+}
+
+const char* BlurEngine::getModeName(BlurMode mode) {
+    switch (mode) {
+        case BlurMode::BOX: return "Box";
+        case BlurMode::GAUSSIAN_BOX3: return "Gaussian (3 box passes)";
+        case BlurMode::GAUSSIAN: return "Gaussian";
+        default: return "Unknown";
+    }
+}
+
+const char* BlurEngine::getKernelName() {
+#ifdef BLUR_HAS_SSE2
+    return "SSE2";
+#else
+    return "Scalar";
+#endif
+}
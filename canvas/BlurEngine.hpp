@@ -0,0 +1,33 @@
+#pragma once
+#include <SDL2/SDL.h>
+
+// Blur kinds, same order as the combo in the blur dialog
+enum class BlurMode : int {
+    BOX = 0,       // flat average over a square, what the old kernel did
+    GAUSSIAN_BOX3, // three box passes, close to a Gaussian and the cheapest smooth one
+    GAUSSIAN,      // recursive (IIR) Gaussian, Young & van Vliet
+    COUNT
+};
+
+// Separable blurs whose cost per pixel doesn't depend on the radius: the box passes keep a running
+// sum, the Gaussian is a recursive filter. Rows first, then columns in strips a few pixels wide
+// so the vertical pass walks memory in order too. Both go over the thread pool.
+// All four channels of a pixel are one SSE vector. Pixels are premultiplied like the tiles, so
+// a plain average is right for soft edges too. The row pass goes into a 16-bit per channel copy
+// (8.8 fixed point) for the column pass, rounding it to 8 bits in between lost thin lines once a
+// wide blur spread them below one level.
+// Nothing outside the buffer counts: near an edge the average is over what's there (the old
+// kernel did the same), for the Gaussian that's the filter run on all ones divided out.
+class BlurEngine {
+public:
+    // Blurs width x height pixels in place, pitch is in pixels. radius is in pixels, for the
+    // Gaussians it's 2 sigma, about as soft looking as a box of that radius. Past sigma 40 the
+    // recursive Gaussian loses precision and GAUSSIAN runs as GAUSSIAN_BOX3 instead.
+    static void blur(Uint32* pixels, int width, int height, int pitch, BlurMode mode, int radius);
+    // How far a blur spreads pixels out, the layer has to grow by that much first
+    static int getHalo(BlurMode mode, int radius);
+
+    static const char* getModeName(BlurMode mode);
+    // "SSE2" or "Scalar"
+    static const char* getKernelName();
+};
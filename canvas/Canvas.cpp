@@ -1,5 +1,13 @@
 #include "Canvas.hpp"
 #include "Layer.hpp"
+#include "BlendEngine.hpp"
+#include "BlurEngine.hpp"
+#include "ParallelFilter.hpp"
+#include "PointOps.hpp"
+#include "ToneChain.hpp"
+#include "MipPyramid.hpp"
+#include "ThreadPool.hpp"
+#include "TileSwap.hpp"
 #include "../tools/Tool.hpp"
 #include "../editor/Editor.hpp"
 #include <algorithm>
@@ -9,6 +17,254 @@
 #include <cmath>
 #include <cstring>
 
+// The 8-bit half of forEachColor below, for things that take a row of tile pixels at a time rather
+// than a PointOps op: rowFn(Uint32* pixels, int count).
+template <typename RowFn>
+static void forEachRow8(Layer& layer, RowFn rowFn) {
+    TileBuffer& pixels = layer.getPixels();
+    ParallelFilter::forEachTile(pixels, [&](int i) {
+        if (pixels.isTileUniform(i)) {
+            Uint32 color = pixels.getTileColor(i);
+            if (color == 0) return;
+            rowFn(&color, 1);
+            pixels.setTileColor(i, color);
+            return;
+        }
+        SDL_Rect tileRect = pixels.getTileRect(i);
+        Uint32* tile = pixels.editTile(i);
+        for (int y = 0; y < tileRect.h; y++) {
+            rowFn(tile + y * TileBuffer::TILE_SIZE, tileRect.w);
+        }
+    });
+}
+
+// Runs op on every pixel of the layer in place, one tile per job on the thread pool. No GPU
+// readback and no re-upload, the touched tiles just get flagged so the compositor redoes only those.
+// Empty tiles are skipped, a point op can't make transparent pixels visible anyway.
+// A single colour tile only needs op once.
+// op is a PointOps op: it gets straight colour (1 is full intensity) a few pixels at a time and
+// changes it in place, the unpremultiplying and rounding happen in PointOps. In an 8-bit document
+// that's right on the tiles.
+// Otherwise op runs on the layer's deep pixels and only the result gets rounded into the tiles,
+// so a chain of adjustments is quantised once instead of after every step. Half float keeps
+// colour past 1, the integer depths clamp it.
+template <typename ColorOp>
+static void forEachColor(Layer& layer, PixelDepth depth, ColorOp op) {
+    if (depth == PixelDepth::RGBA8) {
+        forEachRow8(layer, [&op](Uint32* row, int count) { PointOps::runRow8(op, row, count); });
+        return;
+    }
+
+    TileBuffer& pixels = layer.getPixels();
+    // Syncing touches the whole layer, the tiles after that are independent again
+    const bool clampColor = depth != PixelDepth::RGBA16F;
+    DeepBuffer& deep = layer.syncDeep(depth);
+    ParallelFilter::forEachTile(pixels, [&](int i) {
+        float row[TileBuffer::TILE_SIZE * 4];
+        if (!deep.hasTile(i) && pixels.isTileUniform(i) && pixels.getTileColor(i) == 0) return;
+        deep.prepareTile(i, pixels);
+        if (deep.isTileUniform(i)) {
+            DeepBuffer::Pixel color = deep.getTileColor(i);
+            if (color == 0) return;
+            DeepBuffer::loadRow(depth, &color, row, 1);
+            PointOps::runRowFloat(op, row, 1, clampColor);
+            DeepBuffer::storeRow(depth, row, &color, 1);
+            deep.setTileColor(i, color);
+        } else {
+            SDL_Rect tileRect = pixels.getTileRect(i);
+            DeepBuffer::Pixel* tile = deep.editTile(i);
+            for (int y = 0; y < tileRect.h; y++) {
+                DeepBuffer::Pixel* line = tile + y * TileBuffer::TILE_SIZE;
+                DeepBuffer::loadRow(depth, line, row, tileRect.w);
+                PointOps::runRowFloat(op, row, tileRect.w, clampColor);
+                DeepBuffer::storeRow(depth, row, line, tileRect.w);
+            }
+        }
+        deep.narrowTile(i, pixels);
+    });
+}
+
+// A chain of tone steps in one pass: three table lookups per pixel on the integer depths however
+// long the chain is, the steps one after the other on half float. The 16-bit table is gathered a
+// lane at a time, for a single step running it directly is cheaper.
+static void applyTones(Layer& layer, PixelDepth depth, const ToneChain& tones) {
+    if (tones.isEmpty()) return;
+    const int tableSize = ToneChain::getTableSize(depth);
+    if (depth == PixelDepth::RGBA8) {
+        const ToneChain::Table table = tones.buildTable(tableSize);
+        forEachRow8(layer, [&table](Uint32* row, int count) { table.applyRow8(row, count); });
+        return;
+    }
+    if (tableSize == 0 || tones.getStepCount() == 1) {
+        const bool clampSteps = tableSize != 0;
+        forEachColor(layer, depth, [&tones, clampSteps](auto& r, auto& g, auto& b) { tones.apply(r, g, b, clampSteps); });
+        return;
+    }
+    const ToneChain::Table table = tones.buildTable(tableSize);
+    forEachColor(layer, depth, [&table](auto& r, auto& g, auto& b) { table.apply(r, g, b); });
+}
+
+// The colour grading ops that aren't per channel, on their own so the bit depth benchmark can run
+// the real thing (curves is a ToneChain step, see applyCurves)
+static auto shadowsHighlightsOp(float shadows, float highlights) {
+    return [shadows, highlights](auto& r, auto& g, auto& b) {
+        // Luminance decides if pixel is shadow or highlight
+        auto lum = r;
+        PointOps::luminance(lum, r, g, b);
+        auto shadowMask = 1.0f - lum;  // More effect on dark pixels
+        auto highlightMask = lum;      // More effect on bright pixels
+        auto adjust = shadows * shadowMask + highlights * highlightMask;
+        r += adjust;
+        g += adjust;
+        b += adjust;
+    };
+}
+
+static auto vibranceOp(float vibrance) {
+    return [vibrance](auto& r, auto& g, auto& b) {
+        auto maxVal = r, minVal = r;
+        PointOps::max(maxVal, g);
+        PointOps::max(maxVal, b);
+        PointOps::min(minVal, g);
+        PointOps::min(minVal, b);
+        auto saturation = maxVal <= 0.0f ? 0.0f : (maxVal - minVal) / maxVal;
+
+        // Vibrance effect - less effect on already saturated colors
+        auto adjustment = vibrance * (1.0f - saturation);
+
+        // Apply adjustment (simplified)
+        auto mid = (r + g + b) / 3.0f;
+        r = mid + (r - mid) * (1.0f + adjustment);
+        g = mid + (g - mid) * (1.0f + adjustment);
+        b = mid + (b - mid) * (1.0f + adjustment);
+    };
+}
+
+// ---------------------------------------------------------------------------------------------
+// Neighbourhood filters, one tile per job through ParallelFilter. Loops and maths are the ones the
+// apply* functions had on the flat buffer, in layer coordinates.
+
+// Unsharp mask kernel. The canvas' outermost pixels keep their colour, the kernel needs a full
+// 3x3 neighbourhood. Past the layer's frame is still canvas, it just reads as transparent.
+static void sharpenLayer(Layer& layer, int strength) {
+    static const int kernel[3][3] = {
+        { 0, -1,  0},
+        {-1,  5, -1},
+        { 0, -1,  0}
+    };
+
+    ParallelFilter::forEachTileWithHalo(layer, 1, true, false, [strength](const ParallelFilter::Block& block) {
+        const SDL_Rect& r = block.rect;
+        int x0 = std::max(r.x, 1 - block.layerX), x1 = std::min(r.x + r.w, block.canvasWidth - 1 - block.layerX);
+        int y0 = std::max(r.y, 1 - block.layerY), y1 = std::min(r.y + r.h, block.canvasHeight - 1 - block.layerY);
+        for (int y = y0; y < y1; y++) {
+            for (int x = x0; x < x1; x++) {
+                int rSum = 0, gSum = 0, bSum = 0;
+                for (int ky = -1; ky <= 1; ky++) {
+                    for (int kx = -1; kx <= 1; kx++) {
+                        Uint8 pr, pg, pb, pa;
+                        TileBuffer::unpackRGBA(block.read(x + kx, y + ky), pr, pg, pb, pa);
+                        int kernelValue = kernel[ky + 1][kx + 1];
+                        rSum += pr * kernelValue;
+                        gSum += pg * kernelValue;
+                        bSum += pb * kernelValue;
+                    }
+                }
+
+                rSum = (rSum * strength) / 4;
+                gSum = (gSum * strength) / 4;
+                bSum = (bSum * strength) / 4;
+
+                // Premultiplied colour can't go past its own alpha
+                Uint8 alpha = TileBuffer::alphaOf(block.read(x, y));
+                rSum = std::max(0, std::min<int>(alpha, rSum));
+                gSum = std::max(0, std::min<int>(alpha, gSum));
+                bSum = std::max(0, std::min<int>(alpha, bSum));
+
+                block.write(x, y) = TileBuffer::packRGBA((Uint8)rSum, (Uint8)gSum, (Uint8)bSum, alpha);
+            }
+        }
+    });
+}
+
+// Sobel on luminance, inverted so edges come out dark on white. The canvas' outermost pixels go
+// transparent.
+static void detectEdges(Layer& layer) {
+    // Sobel edge detection kernels - these are the magic numbers that make it work
+    // Don't ask me why these specific values, I found them in a computer vision textbook
+    static const int sobelKernelX[3][3] = {{-1, 0, 1},
+                                           {-2, 0, 2},
+                                           {-1, 0, 1}};
+    static const int sobelKernelY[3][3] = {{-1, -2, -1},
+                                           { 0,  0,  0},
+                                           { 1,  2,  1}};
+
+    ParallelFilter::forEachTileWithHalo(layer, 1, true, false, [](const ParallelFilter::Block& block) {
+        const SDL_Rect& r = block.rect;
+        for (int y = r.y; y < r.y + r.h; y++) {
+            for (int x = r.x; x < r.x + r.w; x++) {
+                if (!block.onCanvas(x, y, 1)) {
+                    block.write(x, y) = 0;
+                    continue;
+                }
+                int gradientX = 0, gradientY = 0;
+                for (int ky = -1; ky <= 1; ky++) {
+                    for (int kx = -1; kx <= 1; kx++) {
+                        Uint8 red, green, blue, alpha;
+                        TileBuffer::unpackRGBA(TileBuffer::unpremultiply(block.read(x + kx, y + ky)), red, green, blue, alpha);
+                        // Convert RGB to grayscale using standard luminance weights
+                        int grayscaleValue = static_cast<int>(0.299f * red + 0.587f * green + 0.114f * blue);
+                        gradientX += grayscaleValue * sobelKernelX[ky + 1][kx + 1];
+                        gradientY += grayscaleValue * sobelKernelY[ky + 1][kx + 1];
+                    }
+                }
+
+                // Calculate edge magnitude using Pythagorean theorem
+                int edgeMagnitude = static_cast<int>(std::sqrt(gradientX * gradientX + gradientY * gradientY));
+                edgeMagnitude = std::min(255, edgeMagnitude);
+
+                // Invert the result because white edges on black background looks way cooler
+                // than black edges on white - learned this from playing with Instagram filters
+                edgeMagnitude = 255 - edgeMagnitude;
+
+                // Preserve the original alpha channel so transparency is maintained
+                Uint8 originalAlphaValue = TileBuffer::alphaOf(block.read(x, y));
+                block.write(x, y) = TileBuffer::premultiply(
+                    TileBuffer::packRGBA(static_cast<Uint8>(edgeMagnitude), static_cast<Uint8>(edgeMagnitude),
+                                         static_cast<Uint8>(edgeMagnitude), originalAlphaValue));
+            }
+        }
+    });
+}
+
+// Averages 2 * distance + 1 samples along the angle, over the ones inside the canvas
+static void motionBlurLayer(Layer& layer, int angle, int distance) {
+    float radians = angle * M_PI / 180.0f;
+    float dx = cos(radians) * distance;
+    float dy = sin(radians) * distance;
+
+    // A uniform neighbourhood averages to its own colour, those tiles stay as they are
+    ParallelFilter::forEachTileWithHalo(layer, distance, true, true, [=](const ParallelFilter::Block& block) {
+        const SDL_Rect& r = block.rect;
+        for (int y = r.y; y < r.y + r.h; y++) {
+            for (int x = r.x; x < r.x + r.w; x++) {
+                int sr = 0, sg = 0, sb = 0, sa = 0, count = 0;
+                for (int i = -distance; i <= distance; i++) {
+                    int nx = x + (int)(dx * i / distance);
+                    int ny = y + (int)(dy * i / distance);
+                    if (block.onCanvas(nx, ny)) {
+                        Uint8 pr, pg, pb, pa;
+                        TileBuffer::unpackRGBA(block.read(nx, ny), pr, pg, pb, pa);
+                        sr += pr; sg += pg; sb += pb; sa += pa;
+                        count++;
+                    }
+                }
+                block.write(x, y) = count > 0 ? TileBuffer::packRGBA(sr / count, sg / count, sb / count, sa / count) : 0;
+            }
+        }
+    });
+}
+
 [[nodiscard("This is a singleton so it needs to be referenced.")]]Canvas& Canvas::getInstance() {
     static Canvas instance;
     return instance;
@@ -21,7 +277,6 @@ Canvas::Canvas()
     m_height(720),
       m_activeLayerIndex(0),
       m_hasSelection(false),
-      m_selectionTexture(nullptr),
       m_resizeCorner(-1) {
 }
 
@@ -39,12 +294,19 @@ void Canvas::cleanup() {
         SDL_DestroyTexture(m_canvasBuffer);
         m_canvasBuffer = nullptr;
     }
-
-    if (m_selectionTexture) {
-        SDL_DestroyTexture(m_selectionTexture);
-        m_selectionTexture = nullptr;
+    if (m_levelTexture) {
+        SDL_DestroyTexture(m_levelTexture);
+        m_levelTexture = nullptr;
     }
+    m_composite = TileBuffer();
+    m_levelComposite = TileBuffer();
+    m_levelDamaged.clear();
+    m_belowCache = TileBuffer();
+    m_aboveCache = TileBuffer();
+    m_cachedActiveLayer = nullptr;
+    m_tileState.clear();
 
+    clearSelectionBuffer();
     cleanupFilterBuffer();
     clearFontCache();
 }
@@ -86,63 +348,27 @@ TTF_Font* Canvas::getFont(int size, bool bold, bool italic) {
 }
 
 void Canvas::createLayerTexture(Layer& layer) {
-    if (layer.getTexture()) {
-        SDL_DestroyTexture(layer.getTexture());
-    }
-
-    SDL_Texture* texture = SDL_CreateTexture(
-        m_renderer,
-        SDL_PIXELFORMAT_RGBA8888,
-        SDL_TEXTUREACCESS_TARGET,
-        m_width,
-        m_height
-    );
-
-    if (!texture) {
-        std::cerr << "Error creating layer texture: " << SDL_GetError() << std::endl;
-        return;
-    }
-
-    SDL_SetTextureBlendMode(texture, SDL_BLENDMODE_BLEND);
-    SDL_SetRenderTarget(m_renderer, texture);
-    SDL_SetRenderDrawColor(m_renderer, 0, 0, 0, 0);
-    SDL_RenderClear(m_renderer);
-    SDL_SetRenderTarget(m_renderer, nullptr);
-
+    // Layers keep their pixels in a tile store now and have no texture at all,
+    // the canvas composites them on the CPU. The store starts out empty and grows with
+    // whatever gets painted, groups get sized to the canvas when they're first rebuilt.
+    layer.setCanvasSize(m_width, m_height);
+    layer.resize(0, 0);
     layer.setBlendMode(0);
-
-    layer.setTexture(texture);
 }
 
-void Canvas::setupNewCanvas(int width, int height) {
+void Canvas::setupNewCanvas(int width, int height, PixelDepth depth) {
     m_width = width;
     m_height = height;
+    m_pixelDepth = depth;
 
     m_layers.clear();
 
-    if (m_canvasBuffer) {
-        SDL_DestroyTexture(m_canvasBuffer);
-    }
-
-    m_canvasBuffer = SDL_CreateTexture(
-        m_renderer,
-        SDL_PIXELFORMAT_RGBA8888,
-        SDL_TEXTUREACCESS_TARGET,
-        width,
-        height
-    );
-
-    if (!m_canvasBuffer) {
-        std::cerr << "Error creating canvas buffer: " << SDL_GetError() << std::endl;
-    }
+    // The canvas texture gets (re)created at the right size by the next render
+    damageAll();
 
     m_hasSelection = false;
     m_selectionRect = {0, 0, 0, 0};
-
-    if (m_selectionTexture) {
-        SDL_DestroyTexture(m_selectionTexture);
-        m_selectionTexture = nullptr;
-    }
+    clearSelectionBuffer();
 }
 
 void Canvas::addLayer(const std::string& name, bool /* isTextLayer */) {
@@ -160,23 +386,52 @@ void Canvas::addLayer(const std::string& name, bool /* isTextLayer */) {
 
 void Canvas::moveLayer(int fromIndex, int toIndex) {
     if (fromIndex < 0 || fromIndex >= static_cast<int>(m_layers.size()) ||
-        toIndex < 0 || toIndex >= static_cast<int>(m_layers.size())) {
+        toIndex < 0 || toIndex >= static_cast<int>(m_layers.size()) || fromIndex == toIndex) {
         return;
     }
 
-    int activeLayerIndex = m_activeLayerIndex;
-
-    auto layer = std::move(m_layers[fromIndex]);
-    m_layers.erase(m_layers.begin() + fromIndex);
-    m_layers.insert(m_layers.begin() + toIndex, std::move(layer));
+    // Lands next to the target layer and in the same group as it. Going up it ends up over the
+    // target, going down under it (and under everything in it if the target is a group).
+    const Layer* target = m_layers[toIndex].get();
+    if (toIndex > fromIndex) {
+        moveBlock(fromIndex, toIndex + 1, target->getParent());
+    } else {
+        moveBlock(fromIndex, getBlockStart(toIndex), target->getParent());
+    }
+}
 
-    if (activeLayerIndex == fromIndex) {
-        m_activeLayerIndex = toIndex;
-    } else if (activeLayerIndex > fromIndex && activeLayerIndex <= toIndex) {
-        m_activeLayerIndex--;
-    } else if (activeLayerIndex < fromIndex && activeLayerIndex >= toIndex) {
-        m_activeLayerIndex++;
+void Canvas::moveIntoGroup(int index, int groupIndex) {
+    if (index < 0 || index >= static_cast<int>(m_layers.size()) ||
+        groupIndex < 0 || groupIndex >= static_cast<int>(m_layers.size()) || !m_layers[groupIndex]->isGroup()) {
+        return;
     }
+    moveBlock(index, groupIndex, m_layers[groupIndex].get());
+}
+
+void Canvas::moveBlock(int index, int before, Layer* parent) {
+    int start = getBlockStart(index);
+    Layer* top = m_layers[index].get();
+    // A group can't go into itself, and a target inside the block moves with it
+    if (parent && (parent == top || parent->isInside(top))) return;
+    if (before > start && before <= index) return;
+
+    Layer* active = getActiveLayer();
+    SDL_Rect bounds = top->getBounds();
+    // The stacking order only changes where the moved layers are
+    damageLayerArea(top->getParent(), bounds);
+
+    std::vector<std::unique_ptr<Layer>> block;
+    for (int i = start; i <= index; i++) {
+        block.push_back(std::move(m_layers[i]));
+    }
+    m_layers.erase(m_layers.begin() + start, m_layers.begin() + index + 1);
+    if (before > index) before -= static_cast<int>(block.size());
+    m_layers.insert(m_layers.begin() + before, std::make_move_iterator(block.begin()),
+                    std::make_move_iterator(block.end()));
+
+    top->setParent(parent);
+    damageLayerArea(parent, bounds);
+    m_activeLayerIndex = indexOf(active);
 }
 
 void Canvas::duplicateLayer(int index) {
@@ -184,29 +439,129 @@ void Canvas::duplicateLayer(int index) {
         return;
     }
 
-    auto newLayer = std::make_unique<Layer>();
-    m_layers[index]->duplicate(*newLayer);
-    createLayerTexture(*newLayer);
+    // A group comes along with everything in it, the copy goes right over the original
+    int start = getBlockStart(index);
+    std::vector<std::unique_ptr<Layer>> copies;
+    for (int i = start; i <= index; i++) {
+        auto newLayer = std::make_unique<Layer>();
+        m_layers[i]->duplicate(*newLayer);
+        if (i < index) newLayer->setName(m_layers[i]->getName());
+        // Copy-on-write: the duplicate shares every tile until one of the two gets painted on.
+        // A group's cached tiles are just as valid for the copy.
+        newLayer->setPixels(m_layers[i]->getPixels());
+        newLayer->shareDeep(*m_layers[i]);
+        newLayer->setBlendMode(m_layers[i]->getBlendMode());
+        copies.push_back(std::move(newLayer));
+    }
+    // Parents inside the block become the matching copies
+    for (int i = start; i <= index; i++) {
+        Layer* parent = m_layers[i]->getParent();
+        if (i < index) {
+            parent = copies[indexOf(parent) - start].get();
+        }
+        copies[i - start]->setParent(parent);
+    }
 
-    SDL_SetRenderTarget(m_renderer, newLayer->getTexture());
-    SDL_RenderCopy(m_renderer, m_layers[index]->getTexture(), nullptr, nullptr);
-    SDL_SetRenderTarget(m_renderer, nullptr);
+    int count = static_cast<int>(copies.size());
+    m_layers.insert(m_layers.begin() + index + 1, std::make_move_iterator(copies.begin()),
+                    std::make_move_iterator(copies.end()));
+    m_activeLayerIndex = index + count;
+}
 
-    newLayer->setBlendMode(m_layers[index]->getBlendMode());
+void Canvas::removeLayer(int index) {
+    if (index < 0 || index >= static_cast<int>(m_layers.size())) {
+        return;
+    }
 
-    m_layers.insert(m_layers.begin() + index + 1, std::move(newLayer));
-    m_activeLayerIndex = index + 1;
+    // A group takes its children with it, but something has to be left over
+    int start = getBlockStart(index);
+    if (index - start + 1 >= static_cast<int>(m_layers.size())) {
+        return;
+    }
+
+    Layer* top = m_layers[index].get();
+    Layer* active = getActiveLayer();
+    bool activeRemoved = active == top || (active && active->isInside(top));
+
+    // The layer can't report its own damage once it's gone
+    damageLayerArea(top->getParent(), top->getBounds());
+    m_layers.erase(m_layers.begin() + start, m_layers.begin() + index + 1);
+
+    if (activeRemoved) {
+        m_activeLayerIndex = std::min(start, static_cast<int>(m_layers.size()) - 1);
+    } else {
+        m_activeLayerIndex = indexOf(active);
+    }
 }
 
-void Canvas::removeLayer(int index) {
-    if (index < 0 || index >= static_cast<int>(m_layers.size()) || m_layers.size() <= 1) {
+void Canvas::groupLayer(int index) {
+    if (index < 0 || index >= static_cast<int>(m_layers.size())) {
         return;
     }
 
+    Layer* layer = m_layers[index].get();
+    auto group = std::make_unique<Layer>("Group");
+    group->setGroup(true);
+    createLayerTexture(*group);
+    group->setParent(layer->getParent());
+    Layer* active = getActiveLayer();
+
+    // Where the layer was, now the group covers it
+    layer->setParent(group.get());
+    m_layers.insert(m_layers.begin() + index + 1, std::move(group));
+    m_activeLayerIndex = indexOf(active);
+}
+
+void Canvas::ungroupLayer(int index) {
+    if (index < 0 || index >= static_cast<int>(m_layers.size()) || !m_layers[index]->isGroup()) {
+        return;
+    }
+
+    Layer* group = m_layers[index].get();
+    int start = getBlockStart(index);
+    for (int i = start; i < index; i++) {
+        if (m_layers[i]->getParent() == group) {
+            m_layers[i]->setParent(group->getParent());
+        }
+    }
+
+    // The group's opacity and blend mode go with it, so whatever it covered looks different now
+    Layer* active = getActiveLayer() == group ? nullptr : getActiveLayer();
+    damageLayerArea(group->getParent(), group->getBounds());
     m_layers.erase(m_layers.begin() + index);
+    // The group's top child takes its place as the active one
+    m_activeLayerIndex = active ? indexOf(active) : std::max(0, index - 1);
+}
+
+int Canvas::getBlockStart(int index) const {
+    const Layer* top = m_layers[index].get();
+    int start = index;
+    while (start > 0 && m_layers[start - 1]->isInside(top)) {
+        start--;
+    }
+    return start;
+}
+
+int Canvas::getRootIndex(int index) const {
+    const Layer* root = m_layers[index].get();
+    while (root->getParent()) root = root->getParent();
+    // Groups are above their children, so it can only be further up
+    while (m_layers[index].get() != root) index++;
+    return index;
+}
+
+int Canvas::indexOf(const Layer* layer) const {
+    for (int i = 0; i < static_cast<int>(m_layers.size()); i++) {
+        if (m_layers[i].get() == layer) return i;
+    }
+    return -1;
+}
 
-    if (m_activeLayerIndex >= static_cast<int>(m_layers.size())) {
-        m_activeLayerIndex = m_layers.size() - 1;
+void Canvas::damageLayerArea(Layer* parent, const SDL_Rect& rect) {
+    if (parent) {
+        parent->markGroupStale(rect);
+    } else {
+        damageRect(rect);
     }
 }
 
@@ -288,41 +643,10 @@ void Canvas::importImage(const char* filePath) {
         return;
     }
 
-    SDL_Texture* layerTexture = SDL_CreateTexture(
-        m_renderer,
-        SDL_PIXELFORMAT_RGBA8888,
-        SDL_TEXTUREACCESS_TARGET,
-        m_width, m_height
-    );
-
-    if (!layerTexture) {
-        std::cerr << "Failed to create layer texture: " << SDL_GetError() << std::endl;
-        SDL_FreeSurface(convertedSurface);
-        return;
-    }
-
-    SDL_SetRenderTarget(m_renderer, layerTexture);
-    SDL_SetRenderDrawColor(m_renderer, 0, 0, 0, 0);
-    SDL_RenderClear(m_renderer);
-
-    SDL_Texture* importedTexture = SDL_CreateTextureFromSurface(m_renderer, convertedSurface);
-    SDL_FreeSurface(convertedSurface);
-
-    if (!importedTexture) {
-        std::cerr << "Failed to create texture: " << SDL_GetError() << std::endl;
-        SDL_DestroyTexture(layerTexture);
-        return;
-    }
-
-    SDL_SetTextureBlendMode(importedTexture, SDL_BLENDMODE_BLEND);
-
+    // Straight into the layer's tiles, no temporary textures needed any more
     SDL_Rect destRect = {offsetX, offsetY, newWidth, newHeight};
-    SDL_RenderCopy(m_renderer, importedTexture, NULL, &destRect);
-
-    SDL_DestroyTexture(importedTexture);
-
-    SDL_SetRenderTarget(m_renderer, nullptr);
-    activeLayer->setTexture(layerTexture);
+    LayerPixels(*activeLayer).blitSurface(convertedSurface, destRect, false);
+    SDL_FreeSurface(convertedSurface);
 
     Editor::getInstance().addRecentFile(std::string(filePath));
 }
@@ -340,57 +664,32 @@ void Canvas::exportImage(const char* filePath, const char* format) {
         return;
     }
 
-    SDL_Texture* tempTexture = SDL_CreateTexture(
-        m_renderer,
-        SDL_PIXELFORMAT_RGBA8888,
-        SDL_TEXTUREACCESS_TARGET,
-        m_width,
-        m_height
-    );
+    // Flatten on the CPU from the layer tiles, nothing has to come back from the GPU.
+    // Same blend kernels as the screen, just on transparent instead of white.
+    TileBuffer composite(m_width, m_height);
+    compositeAll(composite);
 
-    if (!tempTexture) {
-        std::cerr << "Failed to create texture for export: " << SDL_GetError() << std::endl;
-        SDL_FreeSurface(surface);
-        return;
-    }
-
-    SDL_SetRenderTarget(m_renderer, tempTexture);
-    SDL_SetRenderDrawColor(m_renderer, 0, 0, 0, 0);
-    SDL_RenderClear(m_renderer);
-
-    for (const auto& layer : m_layers) {
-        if (layer->isVisible()) {
-            SDL_SetTextureAlphaMod(layer->getTexture(), static_cast<Uint8>(layer->getOpacity() * 255));
-            SDL_RenderCopy(m_renderer, layer->getTexture(), nullptr, nullptr);
-        }
-    }
-
-    Uint32* pixels = new Uint32[m_width * m_height];
-    SDL_RenderReadPixels(
-        m_renderer,
-        nullptr,
-        SDL_PIXELFORMAT_RGBA8888,
-        pixels,
-        m_width * 4
-    );
-
-   
     SDL_LockSurface(surface);
-    Uint32* surfacePixels = static_cast<Uint32*>(surface->pixels);
-    for (int i = 0; i < m_width * m_height; i++) {
-        Uint32 rgba = pixels[i];
-        Uint8 r = (rgba >> 0) & 0xFF;
-        Uint8 g = (rgba >> 8) & 0xFF;
-        Uint8 b = (rgba >> 16) & 0xFF;
-        Uint8 a = (rgba >> 24) & 0xFF;
-        surfacePixels[i] = (a << 24) | (r << 16) | (g << 8) | b;
+    for (int i = 0; i < composite.getTileCount(); i++) {
+        SDL_Rect tileRect = composite.getTileRect(i);
+        // Solid areas come out of the compositor as single colour tiles, convert those once
+        Uint32 solid = TileBuffer::unpremultiply(composite.getTileColor(i));
+        solid = (solid >> 8) | (solid << 24);
+        for (int y = tileRect.y; y < tileRect.y + tileRect.h; y++) {
+            Uint32* row = reinterpret_cast<Uint32*>(static_cast<Uint8*>(surface->pixels) + y * surface->pitch) + tileRect.x;
+            if (composite.isTileUniform(i)) {
+                std::fill(row, row + tileRect.w, solid);
+                continue;
+            }
+            composite.readRect({tileRect.x, y, tileRect.w, 1}, row, tileRect.w);
+            for (int x = 0; x < tileRect.w; x++) {
+                Uint32 pixel = TileBuffer::unpremultiply(row[x]);
+                row[x] = (pixel >> 8) | (pixel << 24);
+            }
+        }
     }
     SDL_UnlockSurface(surface); // Basically we had this funny color channel bug that changed image appearence on export. What
-    // we do is convert RGBA pixels to ARGB, as clearly seen above.
-    delete[] pixels;
-
-    SDL_SetRenderTarget(m_renderer, nullptr);
-    SDL_DestroyTexture(tempTexture);
+    // we do is convert RGBA pixels to ARGB, as clearly seen above. Files get straight alpha, the tiles are premultiplied.
 
     std::string formatStr = format ? format : "PNG";
     int result = 0;
@@ -415,73 +714,45 @@ void Canvas::exportImage(const char* filePath, const char* format) {
 void Canvas::render() {
     if (!m_renderer || m_layers.empty()) return;
 
-    SDL_Texture* originalTarget = SDL_GetRenderTarget(m_renderer);
-
-    SDL_SetRenderTarget(m_renderer, m_canvasBuffer);
-    SDL_SetRenderDrawColor(m_renderer, 255, 255, 255, 255);
-    SDL_RenderClear(m_renderer);
-
-    for (const auto& layer : m_layers) {
-        if (!layer->isVisible() || !layer->getTexture()) continue;
-
-        SDL_SetTextureAlphaMod(layer->getTexture(), static_cast<Uint8>(layer->getOpacity() * 255));
-
-            SDL_BlendMode blendMode = SDL_BLENDMODE_BLEND;
-
-            switch(layer->getBlendMode()) {
-                case 0:
-                    blendMode = SDL_BLENDMODE_BLEND;
-                    break;
-                case 1:
-                    blendMode = SDL_ComposeCustomBlendMode(
-                        SDL_BLENDFACTOR_DST_COLOR, SDL_BLENDFACTOR_ZERO, SDL_BLENDOPERATION_ADD,
-                        SDL_BLENDFACTOR_ONE, SDL_BLENDFACTOR_ONE, SDL_BLENDOPERATION_ADD);
-                    break;
-                case 2:
-                    blendMode = SDL_ComposeCustomBlendMode(
-                        SDL_BLENDFACTOR_ONE, SDL_BLENDFACTOR_ONE_MINUS_SRC_COLOR, SDL_BLENDOPERATION_ADD,
-                        SDL_BLENDFACTOR_ONE, SDL_BLENDFACTOR_ONE, SDL_BLENDOPERATION_ADD);
-                    break;
-                case 3:
-                    blendMode = SDL_ComposeCustomBlendMode(
-                        SDL_BLENDFACTOR_DST_COLOR, SDL_BLENDFACTOR_ONE, SDL_BLENDOPERATION_ADD,
-                        SDL_BLENDFACTOR_ONE, SDL_BLENDFACTOR_ONE, SDL_BLENDOPERATION_ADD);
-                    break;
-                case 4:
-                    blendMode = SDL_ComposeCustomBlendMode(
-                        SDL_BLENDFACTOR_DST_COLOR, SDL_BLENDFACTOR_ONE_MINUS_SRC_COLOR, SDL_BLENDOPERATION_ADD,
-                        SDL_BLENDFACTOR_ONE, SDL_BLENDFACTOR_ONE, SDL_BLENDOPERATION_ADD);
-                    break;
-                case 5:
-                    blendMode = SDL_ComposeCustomBlendMode(
-                        SDL_BLENDFACTOR_ONE, SDL_BLENDFACTOR_DST_COLOR, SDL_BLENDOPERATION_ADD,
-                        SDL_BLENDFACTOR_ONE, SDL_BLENDFACTOR_ONE, SDL_BLENDOPERATION_ADD);
-                    break;
-                case 6:
-                    blendMode = SDL_ComposeCustomBlendMode(
-                        SDL_BLENDFACTOR_DST_COLOR, SDL_BLENDFACTOR_ONE, SDL_BLENDOPERATION_ADD,
-                        SDL_BLENDFACTOR_ONE, SDL_BLENDFACTOR_ONE, SDL_BLENDOPERATION_ADD);
-                    break;
-                default:
-                    blendMode = SDL_BLENDMODE_BLEND;
-                    break;
-            }
-            SDL_SetTextureBlendMode(layer->getTexture(), blendMode);
-
-            int textureWidth, textureHeight;
-            SDL_QueryTexture(layer->getTexture(), nullptr, nullptr, &textureWidth, &textureHeight);
-
-            SDL_Rect destRect = {layer->getX(), layer->getY(), textureWidth, textureHeight};
+    // Between frames nothing is compositing, so this is where tiles over the budget get paged out
+    GetTileSwap().enforceBudget();
+
+    if (m_viewportArea.w <= 0 || m_viewportArea.h <= 0) {
+        int outputW = 0, outputH = 0;
+        SDL_GetRendererOutputSize(m_renderer, &outputW, &outputH);
+        setViewportArea({0, 0, outputW, outputH});
+    }
+
+    // Only damaged tiles that are actually on screen get recomposited and re-uploaded. The rest
+    // keep their damage and get done once they scroll into view. A frame where nothing changed
+    // is just the RenderCopy below.
+    // Zoomed out it's the small composite from the layer pyramids instead, and the full size
+    // one just keeps collecting damage until we zoom back in.
+    SDL_Rect visible = getVisibleCanvasRect();
+    int level = getDisplayLevel();
+    updateComposite(visible);
+    SDL_Rect source = level > 0 ? MipPyramid::levelRect(visible, level) : visible;
+    SDL_Texture* texture = nullptr;
+    if (level > 0) {
+        uploadTiles(m_levelComposite, m_levelTexture, source);
+        texture = m_levelTexture;
+    } else {
+        uploadTiles(m_composite, m_canvasBuffer, source);
+        texture = m_canvasBuffer;
+    }
 
-            if (layer->isUsingMask() && layer->getMask()) {
-                SDL_SetTextureAlphaMod(layer->getTexture(), 128);
-                SDL_RenderCopy(m_renderer, layer->getTexture(), nullptr, &destRect);
-                SDL_SetTextureAlphaMod(layer->getTexture(), static_cast<Uint8>(layer->getOpacity() * 255));
-            } else {
-                SDL_RenderCopy(m_renderer, layer->getTexture(), nullptr, &destRect);
-            }
+    SDL_RenderSetClipRect(m_renderer, &m_viewportArea);
+    if (texture && source.w > 0 && source.h > 0) {
+        SDL_FPoint origin = snappedOrigin();
+        float scale = m_viewZoom * static_cast<float>(1 << level);
+        SDL_FRect dest = {origin.x + source.x * scale, origin.y + source.y * scale,
+                          source.w * scale, source.h * scale};
+        SDL_RenderCopyF(m_renderer, texture, &source, &dest);
     }
+    SDL_RenderSetClipRect(m_renderer, nullptr);
 
+    // Overlays go straight to the screen on top, they're never part of the composite
+    beginCanvasSpace();
     if (m_hasSelection) {
         SDL_SetRenderDrawColor(m_renderer, 0, 120, 215, 128);
         SDL_SetRenderDrawBlendMode(m_renderer, SDL_BLENDMODE_BLEND);
@@ -494,17 +765,739 @@ void Canvas::render() {
 
     drawTransformBox(m_renderer);
 
-    SDL_RenderFlush(m_renderer);
-
     Tool* currentTool = ToolManager::getInstance().getCurrentTool();
     if (currentTool && currentTool->isDrawing()) {
         currentTool->render(m_renderer);
     }
-
-    SDL_SetRenderTarget(m_renderer, originalTarget);
-
-    SDL_Rect canvasRect = {0, 0, m_width, m_height};
-    SDL_RenderCopy(m_renderer, m_canvasBuffer, nullptr, &canvasRect);
+    endCanvasSpace();
+}
+
+void Canvas::setViewportArea(const SDL_Rect& area) {
+    if (area.x == m_viewportArea.x && area.y == m_viewportArea.y &&
+        area.w == m_viewportArea.w && area.h == m_viewportArea.h) return;
+    m_viewportArea = area;
+    if (!m_viewTouched) {
+        m_viewOrigin = {static_cast<float>(area.x), static_cast<float>(area.y)};
+    }
+}
+
+void Canvas::setZoom(float zoom, float anchorX, float anchorY) {
+    zoom = std::clamp(zoom, MIN_ZOOM, MAX_ZOOM);
+    SDL_FPoint anchor = screenToCanvas(anchorX, anchorY);
+    m_viewZoom = zoom;
+    m_viewOrigin = {anchorX - anchor.x * zoom, anchorY - anchor.y * zoom};
+    m_viewTouched = true;
+}
+
+void Canvas::zoomBy(float factor) {
+    zoomBy(factor, m_viewportArea.x + m_viewportArea.w / 2.0f, m_viewportArea.y + m_viewportArea.h / 2.0f);
+}
+
+void Canvas::panBy(float dx, float dy) {
+    m_viewOrigin.x += dx;
+    m_viewOrigin.y += dy;
+    m_viewTouched = true;
+}
+
+void Canvas::fitToView() {
+    if (m_width <= 0 || m_height <= 0 || m_viewportArea.w <= 0 || m_viewportArea.h <= 0) return;
+    m_viewZoom = std::clamp(std::min(static_cast<float>(m_viewportArea.w) / m_width,
+                                     static_cast<float>(m_viewportArea.h) / m_height), MIN_ZOOM, MAX_ZOOM);
+    m_viewOrigin = {m_viewportArea.x + (m_viewportArea.w - m_width * m_viewZoom) / 2.0f,
+                    m_viewportArea.y + (m_viewportArea.h - m_height * m_viewZoom) / 2.0f};
+    m_viewTouched = true;
+}
+
+void Canvas::resetView() {
+    m_viewZoom = 1.0f;
+    m_viewOrigin = {m_viewportArea.x + (m_viewportArea.w - m_width) / 2.0f,
+                    m_viewportArea.y + (m_viewportArea.h - m_height) / 2.0f};
+    m_viewTouched = true;
+}
+
+void Canvas::centerViewOn(float canvasX, float canvasY) {
+    m_viewOrigin = {m_viewportArea.x + m_viewportArea.w / 2.0f - canvasX * m_viewZoom,
+                    m_viewportArea.y + m_viewportArea.h / 2.0f - canvasY * m_viewZoom};
+    m_viewTouched = true;
+}
+
+int Canvas::getDisplayLevel() const {
+    // Level n is drawn at zoom * 2^n, so this keeps that between 0.5 and 1. Never magnified.
+    if (m_viewZoom > 0.5f) return 0;
+    int level = static_cast<int>(std::floor(std::log2(1.0f / m_viewZoom)));
+    return std::clamp(level, 0, MAX_DISPLAY_LEVEL);
+}
+
+SDL_FPoint Canvas::snappedOrigin() const {
+    // The overlays go through SDL's viewport, which only takes whole (scaled) units. Snap the
+    // image to the same grid or the selection box drifts off the pixels when zoomed in.
+    return {std::round(m_viewOrigin.x / m_viewZoom) * m_viewZoom,
+            std::round(m_viewOrigin.y / m_viewZoom) * m_viewZoom};
+}
+
+SDL_FPoint Canvas::screenToCanvas(float x, float y) const {
+    SDL_FPoint origin = snappedOrigin();
+    return {(x - origin.x) / m_viewZoom, (y - origin.y) / m_viewZoom};
+}
+
+SDL_FPoint Canvas::canvasToScreen(float x, float y) const {
+    SDL_FPoint origin = snappedOrigin();
+    return {origin.x + x * m_viewZoom, origin.y + y * m_viewZoom};
+}
+
+SDL_Point Canvas::getMouseCanvasPos() const {
+    int mouseX = 0, mouseY = 0;
+    SDL_GetMouseState(&mouseX, &mouseY);
+    SDL_FPoint p = screenToCanvas(static_cast<float>(mouseX), static_cast<float>(mouseY));
+    return {static_cast<int>(std::floor(p.x)), static_cast<int>(std::floor(p.y))};
+}
+
+SDL_Rect Canvas::getVisibleCanvasRect() const {
+    SDL_FPoint topLeft = screenToCanvas(static_cast<float>(m_viewportArea.x), static_cast<float>(m_viewportArea.y));
+    SDL_FPoint bottomRight = screenToCanvas(static_cast<float>(m_viewportArea.x + m_viewportArea.w),
+                                            static_cast<float>(m_viewportArea.y + m_viewportArea.h));
+    int x0 = std::max(0, static_cast<int>(std::floor(topLeft.x)));
+    int y0 = std::max(0, static_cast<int>(std::floor(topLeft.y)));
+    int x1 = std::min(m_width, static_cast<int>(std::ceil(bottomRight.x)));
+    int y1 = std::min(m_height, static_cast<int>(std::ceil(bottomRight.y)));
+    return {x0, y0, std::max(0, x1 - x0), std::max(0, y1 - y0)};
+}
+
+SDL_Event Canvas::toCanvasEvent(const SDL_Event& event) const {
+    SDL_Event mapped = event;
+    if (event.type == SDL_MOUSEBUTTONDOWN || event.type == SDL_MOUSEBUTTONUP) {
+        SDL_FPoint p = screenToCanvas(static_cast<float>(event.button.x), static_cast<float>(event.button.y));
+        mapped.button.x = static_cast<int>(std::floor(p.x));
+        mapped.button.y = static_cast<int>(std::floor(p.y));
+    } else if (event.type == SDL_MOUSEMOTION) {
+        SDL_FPoint p = screenToCanvas(static_cast<float>(event.motion.x), static_cast<float>(event.motion.y));
+        SDL_FPoint prev = screenToCanvas(static_cast<float>(event.motion.x - event.motion.xrel),
+                                         static_cast<float>(event.motion.y - event.motion.yrel));
+        mapped.motion.x = static_cast<int>(std::floor(p.x));
+        mapped.motion.y = static_cast<int>(std::floor(p.y));
+        mapped.motion.xrel = mapped.motion.x - static_cast<int>(std::floor(prev.x));
+        mapped.motion.yrel = mapped.motion.y - static_cast<int>(std::floor(prev.y));
+    }
+    return mapped;
+}
+
+bool Canvas::handleViewEvent(const SDL_Event& event) {
+    bool ctrl = (SDL_GetModState() & KMOD_CTRL) != 0;
+    switch (event.type) {
+        case SDL_MOUSEWHEEL: {
+            if (ctrl) {
+                int mouseX = 0, mouseY = 0;
+                SDL_GetMouseState(&mouseX, &mouseY);
+                zoomBy(event.wheel.y > 0 ? 1.25f : 0.8f, static_cast<float>(mouseX), static_cast<float>(mouseY));
+            } else if (SDL_GetModState() & KMOD_SHIFT) {
+                panBy(event.wheel.y * 40.0f, 0.0f);
+            } else {
+                panBy(event.wheel.x * -40.0f, event.wheel.y * 40.0f);
+            }
+            return true;
+        }
+        case SDL_MOUSEBUTTONDOWN:
+            if (event.button.button == SDL_BUTTON_MIDDLE) {
+                m_isPanning = true;
+                return true;
+            }
+            break;
+        case SDL_MOUSEBUTTONUP:
+            if (event.button.button == SDL_BUTTON_MIDDLE && m_isPanning) {
+                m_isPanning = false;
+                return true;
+            }
+            break;
+        case SDL_MOUSEMOTION:
+            if (m_isPanning) {
+                panBy(static_cast<float>(event.motion.xrel), static_cast<float>(event.motion.yrel));
+                return true;
+            }
+            break;
+        case SDL_KEYDOWN:
+            if (!ctrl) break;
+            switch (event.key.keysym.sym) {
+                case SDLK_0: fitToView(); return true;
+                case SDLK_1: resetView(); return true;
+                case SDLK_EQUALS:
+                case SDLK_PLUS:
+                case SDLK_KP_PLUS: zoomBy(1.25f); return true;
+                case SDLK_MINUS:
+                case SDLK_KP_MINUS: zoomBy(0.8f); return true;
+                default: break;
+            }
+            break;
+        default:
+            break;
+    }
+    return false;
+}
+
+void Canvas::beginCanvasSpace() {
+    // SDL scales the viewport and clip rect along with everything else, so both are given in
+    // zoomed units. The clip keeps overlays off the menu bar and sidebar.
+    SDL_FPoint origin = snappedOrigin();
+    SDL_RenderSetScale(m_renderer, m_viewZoom, m_viewZoom);
+    int viewX = static_cast<int>(std::lround(origin.x / m_viewZoom));
+    int viewY = static_cast<int>(std::lround(origin.y / m_viewZoom));
+    int areaRight = static_cast<int>(std::ceil((m_viewportArea.x + m_viewportArea.w) / m_viewZoom));
+    int areaBottom = static_cast<int>(std::ceil((m_viewportArea.y + m_viewportArea.h) / m_viewZoom));
+    SDL_Rect viewport = {viewX, viewY, std::max(0, areaRight - viewX), std::max(0, areaBottom - viewY)};
+    SDL_RenderSetViewport(m_renderer, &viewport);
+    int areaLeft = static_cast<int>(std::floor(m_viewportArea.x / m_viewZoom));
+    int areaTop = static_cast<int>(std::floor(m_viewportArea.y / m_viewZoom));
+    SDL_Rect clip = {areaLeft - viewX, areaTop - viewY, areaRight - areaLeft, areaBottom - areaTop};
+    SDL_RenderSetClipRect(m_renderer, &clip);
+}
+
+void Canvas::endCanvasSpace() {
+    SDL_RenderSetClipRect(m_renderer, nullptr);
+    SDL_RenderSetViewport(m_renderer, nullptr);
+    SDL_RenderSetScale(m_renderer, 1.0f, 1.0f);
+}
+
+void Canvas::damageRect(const SDL_Rect& rect) {
+    // We don't know which layer this came from, so both caches have to go too
+    markTiles(rect, TILE_ALL);
+    markLevelDamage(rect);
+    m_contentVersion++;
+}
+
+void Canvas::damageAll() {
+    std::fill(m_tileState.begin(), m_tileState.end(), TILE_ALL);
+    std::fill(m_levelDamaged.begin(), m_levelDamaged.end(), 1);
+    m_contentVersion++;
+}
+
+void Canvas::markTiles(const SDL_Rect& rect, Uint8 state) {
+    SDL_Rect area = rect;
+    SDL_Rect bounds = {0, 0, m_composite.getWidth(), m_composite.getHeight()};
+    if (!SDL_IntersectRect(&area, &bounds, &area)) return;
+    int tilesX = m_composite.getTilesX();
+    for (int ty = area.y >> TileBuffer::TILE_SHIFT; ty <= (area.y + area.h - 1) >> TileBuffer::TILE_SHIFT; ty++) {
+        for (int tx = area.x >> TileBuffer::TILE_SHIFT; tx <= (area.x + area.w - 1) >> TileBuffer::TILE_SHIFT; tx++) {
+            m_tileState[ty * tilesX + tx] |= state;
+        }
+    }
+}
+
+// An adjustment layer's turn in the compositor: its adjustment runs over target inside clip, as
+// far as the layer's alpha times opacity says. coverage is the layer's composite pixels (or a mip
+// level of them) with its top left corner at x, y in target. Only touches target's tiles in clip.
+static void adjustTarget(TileBuffer& target, const Layer& layer, const TileBuffer& coverage, int x, int y,
+                         const SDL_Rect& clip) {
+    const Adjustment& adjustment = layer.getAdjustment();
+    const int opacity = TileBuffer::opacityToAlpha(layer.getOpacity());
+    SDL_Rect area;
+    SDL_Rect bounds = {x, y, coverage.getWidth(), coverage.getHeight()};
+    SDL_Rect targetBounds = {0, 0, target.getWidth(), target.getHeight()};
+    if (!SDL_IntersectRect(&clip, &bounds, &area) || !SDL_IntersectRect(&area, &targetBounds, &area)) return;
+
+    Uint32 row[TileBuffer::TILE_SIZE];
+    Uint8 weights[TileBuffer::TILE_SIZE];
+    for (int ty = area.y >> TileBuffer::TILE_SHIFT; ty <= (area.y + area.h - 1) >> TileBuffer::TILE_SHIFT; ty++) {
+        for (int tx = area.x >> TileBuffer::TILE_SHIFT; tx <= (area.x + area.w - 1) >> TileBuffer::TILE_SHIFT; tx++) {
+            const int index = ty * target.getTilesX() + tx;
+            const SDL_Rect tileRect = target.getTileRect(index);
+            SDL_Rect part;
+            SDL_IntersectRect(&tileRect, &area, &part);
+
+            // One strength over all of it is the usual case (full, or none where the layer got
+            // erased), and then a single colour tile stays one
+            Uint32 cover = 0;
+            const bool even = coverage.isRegionUniform({part.x - x, part.y - y, part.w, part.h}, cover);
+            const Uint8 strength = even ? (TileBuffer::alphaOf(cover) * opacity + 127) / 255 : 0;
+            if (even && strength == 0) continue;
+            if (even && target.isTileUniform(index) && part.w == tileRect.w && part.h == tileRect.h) {
+                Uint32 color = target.getTileColor(index);
+                if (color == 0) continue;
+                adjustment.applyWeighted(&color, &strength, 1);
+                target.setTileColor(index, color);
+                continue;
+            }
+
+            Uint32* tile = target.editTile(index);
+            for (int py = part.y; py < part.y + part.h; py++) {
+                Uint32* line = tile + (py - tileRect.y) * TileBuffer::TILE_SIZE + (part.x - tileRect.x);
+                if (even && strength == 255) {
+                    adjustment.apply(line, part.w);
+                    continue;
+                }
+                if (even) {
+                    std::fill(weights, weights + part.w, strength);
+                    adjustment.applyWeighted(line, weights, part.w);
+                    continue;
+                }
+                coverage.readRect({part.x - x, py - y, part.w, 1}, row, part.w);
+                for (int i = 0; i < part.w; i++) weights[i] = (TileBuffer::alphaOf(row[i]) * opacity + 127) / 255;
+                adjustment.applyWeighted(line, weights, part.w);
+            }
+        }
+    }
+}
+
+void Canvas::compositeLayer(TileBuffer& target, const Layer& layer, const SDL_Rect& clip) const {
+    if (!layer.isVisible() || !layer.hasPixels()) return;
+    // Zero opacity or nothing but transparent tiles here, can't change a pixel
+    if (layer.isTransparentIn(clip)) {
+        m_cullCounter++;
+        return;
+    }
+    m_blendCounter++;
+
+    if (layer.isAdjustment()) {
+        adjustTarget(target, layer, layer.getCompositePixels(), layer.getX(), layer.getY(), clip);
+        return;
+    }
+    // Masked layers come out of their own cache, so a mask costs nothing here
+    target.composite(layer.getCompositePixels(), layer.getX(), layer.getY(), layer.getBlendMode(),
+                     layer.getOpacity(), clip);
+}
+
+int Canvas::firstVisibleLayer(const SDL_Rect& rect, int begin, int end, int level, const Layer* scope) const {
+    for (int i = end - 1; i > begin; i--) {
+        if (m_layers[i]->getParent() == scope && m_layers[i]->occludes(rect, level)) {
+            m_cullCounter += i - begin;
+            return i;
+        }
+    }
+    return begin;
+}
+
+void Canvas::compositeRange(TileBuffer& target, int begin, int end, const SDL_Rect& clip,
+                            const Layer* scope, const Layer* skip) const {
+    for (int l = begin; l < end; l++) {
+        const Layer& layer = *m_layers[l];
+        // Deeper layers are already in their group's pixels
+        if (layer.getParent() == scope && &layer != skip) {
+            compositeLayer(target, layer, clip);
+        }
+    }
+}
+
+void Canvas::updateGroups() {
+    // Children are always under their group, so going up the stack every group (nested ones
+    // too) has all of its children's damage by the time it gets rebuilt
+    std::vector<SDL_Rect> damage;
+    for (int i = 0; i < static_cast<int>(m_layers.size()); i++) {
+        Layer& layer = *m_layers[i];
+        if (layer.isGroup()) rebuildGroup(i);
+        layer.updateMaskCache();
+        if (Layer* parent = layer.getParent()) {
+            damage.clear();
+            layer.collectDamage(damage);
+            for (const SDL_Rect& rect : damage) {
+                parent->markGroupStale(rect);
+            }
+        }
+    }
+}
+
+void Canvas::rebuildGroup(int index) {
+    Layer& group = *m_layers[index];
+    if (group.getWidth() != m_width || group.getHeight() != m_height || group.getX() != 0 || group.getY() != 0) {
+        group.setPosition(0, 0);
+        group.resize(m_width, m_height); // all stale now
+    }
+    // A hidden group keeps its stale tiles until it's shown again, toggling it costs nothing
+    if (!group.isVisible()) return;
+    std::vector<int> tiles = group.takeStaleGroupTiles();
+    if (tiles.empty()) return;
+
+    int begin = getBlockStart(index);
+    TileBuffer& pixels = group.getPixels();
+    GetThreadPool().parallelFor(static_cast<int>(tiles.size()), [&](int k) {
+        SDL_Rect tileRect = pixels.getTileRect(tiles[k]);
+        pixels.fillRect(tileRect, 0);
+        compositeRange(pixels, firstVisibleLayer(tileRect, begin, index, 0, &group), index, tileRect, &group);
+    });
+}
+
+void Canvas::markLevelDamage(const SDL_Rect& rect) {
+    if (m_levelCompositeLevel <= 0 || m_levelComposite.isEmpty()) return;
+    SDL_Rect area = MipPyramid::levelRect(rect, m_levelCompositeLevel);
+    SDL_Rect bounds = {0, 0, m_levelComposite.getWidth(), m_levelComposite.getHeight()};
+    if (!SDL_IntersectRect(&area, &bounds, &area)) return;
+    int tilesX = m_levelComposite.getTilesX();
+    for (int ty = area.y >> TileBuffer::TILE_SHIFT; ty <= (area.y + area.h - 1) >> TileBuffer::TILE_SHIFT; ty++) {
+        for (int tx = area.x >> TileBuffer::TILE_SHIFT; tx <= (area.x + area.w - 1) >> TileBuffer::TILE_SHIFT; tx++) {
+            m_levelDamaged[ty * tilesX + tx] = 1;
+        }
+    }
+}
+
+void Canvas::compositeAll(TileBuffer& target, const Layer* skip) {
+    // Caches get brought up to date here, the workers only read layers
+    updateGroups();
+    GetThreadPool().parallelFor(target.getTileCount(), [&](int i) {
+        SDL_Rect tileRect = target.getTileRect(i);
+        // An opaque layer replaces what's under it exactly, so starting there gives the same bits
+        int layerCount = static_cast<int>(m_layers.size());
+        compositeRange(target, firstVisibleLayer(tileRect, 0, layerCount), layerCount, tileRect, nullptr, skip);
+    });
+}
+
+void Canvas::compositeLevel(TileBuffer& target, int level, const SDL_Rect& clip) {
+    updateGroups();
+    for (const auto& layer : m_layers) {
+        if (!layer->getParent() && layer->isVisible() && layer->hasPixels()) layer->updateMipmaps();
+    }
+    GetThreadPool().parallelFor(target.getTileCount(), [&](int i) {
+        SDL_Rect tileRect = target.getTileRect(i);
+        if (SDL_IntersectRect(&tileRect, &clip, &tileRect)) {
+            compositeLevelTile(target, level, tileRect);
+        }
+    });
+}
+
+void Canvas::compositeLevelTile(TileBuffer& target, int level, const SDL_Rect& clip) const {
+    int layerCount = static_cast<int>(m_layers.size());
+    for (int l = firstVisibleLayer(clip, 0, layerCount, level); l < layerCount; l++) {
+        const Layer& layer = *m_layers[l];
+        if (layer.getParent() || !layer.isVisible() || !layer.hasPixels()) continue;
+        if (layer.isTransparentIn(clip, level)) {
+            m_cullCounter++;
+            continue;
+        }
+        m_blendCounter++;
+        // Positions get floored to the level grid, off by less than a level pixel
+        if (layer.isAdjustment()) {
+            adjustTarget(target, layer, layer.getMipLevel(level), layer.getX() >> level, layer.getY() >> level, clip);
+            continue;
+        }
+        target.composite(layer.getMipLevel(level), layer.getX() >> level, layer.getY() >> level,
+                         layer.getBlendMode(), layer.getOpacity(), clip);
+    }
+}
+
+Canvas::CompositorBenchmark Canvas::benchmarkCompositor(int runs) {
+    ThreadPool& pool = GetThreadPool();
+    CompositorBenchmark result;
+    result.threads = pool.getThreadCount();
+
+    // Best of `runs`, the first one also pays for allocating the tiles
+    auto timeFlatten = [&](TileBuffer& out) {
+        double best = 0.0;
+        for (int run = 0; run < std::max(1, runs); run++) {
+            out = TileBuffer(m_width, m_height);
+            Uint64 start = SDL_GetPerformanceCounter();
+            compositeAll(out);
+            double ms = (SDL_GetPerformanceCounter() - start) * 1000.0 / SDL_GetPerformanceFrequency();
+            best = run == 0 ? ms : std::min(best, ms);
+        }
+        return best;
+    };
+
+    TileBuffer serial, parallel;
+    pool.setThreadCount(1);
+    result.serialMs = timeFlatten(serial);
+    pool.setThreadCount(result.threads);
+    result.parallelMs = timeFlatten(parallel);
+
+    std::vector<Uint32> a(TileBuffer::TILE_PIXELS), b(TileBuffer::TILE_PIXELS);
+    for (int i = 0; i < serial.getTileCount() && result.identical; i++) {
+        SDL_Rect tileRect = serial.getTileRect(i);
+        serial.readRect(tileRect, a.data(), TileBuffer::TILE_SIZE);
+        parallel.readRect(tileRect, b.data(), TileBuffer::TILE_SIZE);
+        result.identical = std::equal(a.begin(), a.end(), b.begin());
+    }
+    return result;
+}
+
+void Canvas::setPixelDepth(PixelDepth depth) {
+    if (depth == m_pixelDepth) return;
+    m_pixelDepth = depth;
+    // Deep pixels that exist get converted (or dropped for 8-bit), the rest get widened when an
+    // adjustment needs them. The 8-bit tiles stay as they are, so nothing has to be redrawn.
+    for (auto& layer : m_layers) {
+        if (!layer->isGroup()) layer->syncDeep(depth);
+    }
+}
+
+Canvas::DepthBenchmark Canvas::benchmarkPixelDepths(int runs) {
+    DepthBenchmark result;
+    Layer* source = getActiveLayer();
+    if (!source || source->isGroup() || !source->hasPixels()) return result;
+    result.pixels = source->getWidth() * source->getHeight();
+    ToneChain curves;
+    curves.addCurves(0.4f, 0.5f);
+
+    for (int d = 0; d < static_cast<int>(PixelDepth::COUNT); d++) {
+        PixelDepth depth = static_cast<PixelDepth>(d);
+        // Best of `runs`, each on a fresh copy so it pays for widening like a first adjustment does
+        double best = 0.0;
+        for (int run = 0; run < std::max(1, runs); run++) {
+            Layer copy;
+            source->duplicate(copy);
+            copy.setPixels(source->getPixels());
+            Uint64 start = SDL_GetPerformanceCounter();
+            applyTones(copy, depth, curves);
+            forEachColor(copy, depth, shadowsHighlightsOp(0.1f, -0.1f));
+            forEachColor(copy, depth, vibranceOp(0.3f));
+            double ms = (SDL_GetPerformanceCounter() - start) * 1000.0 / SDL_GetPerformanceFrequency();
+            best = run == 0 ? ms : std::min(best, ms);
+            result.residentBytes[d] = copy.getResidentBytes();
+        }
+        result.ms[d] = best;
+        result.megapixelsPerSecond[d] = best > 0.0 ? result.pixels * 3.0 / (best * 1000.0) : 0.0;
+    }
+    return result;
+}
+
+Canvas::FilterBenchmark Canvas::benchmarkFilterPipeline(int runs) {
+    FilterBenchmark result;
+    Layer* source = getActiveLayer();
+    if (!source || source->isGroup() || !source->hasPixels()) return result;
+    result.pixels = source->getWidth() * source->getHeight();
+
+    ToneChain curves;
+    curves.addCurves(0.4f, 0.5f);
+
+    ThreadPool& pool = GetThreadPool();
+    const int previousThreads = pool.getThreadCount();
+    for (int step = 0; step < FilterBenchmark::STEPS; step++) {
+        const int threads = 1 << step;
+        pool.setThreadCount(threads);
+        double best = 0.0;
+        for (int run = 0; run < std::max(1, runs); run++) {
+            Layer copy;
+            source->duplicate(copy);
+            copy.setPixels(source->getPixels());
+            Uint64 start = SDL_GetPerformanceCounter();
+            applyTones(copy, m_pixelDepth, curves);
+            forEachColor(copy, m_pixelDepth, vibranceOp(0.3f));
+            sharpenLayer(copy, 2);
+            motionBlurLayer(copy, 30, 8);
+            double ms = (SDL_GetPerformanceCounter() - start) * 1000.0 / SDL_GetPerformanceFrequency();
+            best = run == 0 ? ms : std::min(best, ms);
+        }
+        result.threads[step] = threads;
+        result.ms[step] = best;
+        result.speedup[step] = best > 0.0 ? result.ms[0] / best : 0.0;
+    }
+    pool.setThreadCount(previousThreads);
+    return result;
+}
+
+Canvas::ToneBenchmark Canvas::benchmarkToneChain(int runs) {
+    ToneBenchmark result;
+    Layer* source = getActiveLayer();
+    if (!source || source->isGroup() || !source->hasPixels()) return result;
+    result.pixels = source->getWidth() * source->getHeight();
+
+    ToneChain steps[5];
+    steps[0].addBrightness(0.05f);
+    steps[1].addContrast(30.0f);
+    steps[2].addGamma(1.2f);
+    steps[3].addCurves(0.4f, 0.5f);
+    steps[4].addColorBalance(0.02f, 0.0f, -0.02f);
+    ToneChain chain;
+    for (const ToneChain& step : steps) chain.append(step);
+
+    // Best of `runs`, each on a fresh copy so the deep pixels get widened like the real thing
+    auto time = [&](auto&& work) {
+        double best = 0.0;
+        for (int run = 0; run < std::max(1, runs); run++) {
+            Layer copy;
+            source->duplicate(copy);
+            copy.setPixels(source->getPixels());
+            Uint64 start = SDL_GetPerformanceCounter();
+            work(copy);
+            double ms = (SDL_GetPerformanceCounter() - start) * 1000.0 / SDL_GetPerformanceFrequency();
+            best = run == 0 ? ms : std::min(best, ms);
+        }
+        return best;
+    };
+    result.singleStepMs = time([&](Layer& layer) { applyTones(layer, m_pixelDepth, steps[0]); });
+    result.fusedMs = time([&](Layer& layer) { applyTones(layer, m_pixelDepth, chain); });
+    result.separateMs = time([&](Layer& layer) {
+        for (const ToneChain& step : steps) applyTones(layer, m_pixelDepth, step);
+    });
+    return result;
+}
+
+void Canvas::updateLevelComposite(int level, const SDL_Rect& visible) {
+    int levelWidth = MipPyramid::levelSize(m_width, level);
+    int levelHeight = MipPyramid::levelSize(m_height, level);
+    if (level != m_levelCompositeLevel || m_levelComposite.getWidth() != levelWidth ||
+        m_levelComposite.getHeight() != levelHeight) {
+        m_levelComposite.resize(levelWidth, levelHeight);
+        m_levelDamaged.assign(m_levelComposite.getTileCount(), 1);
+        m_levelCompositeLevel = level;
+    }
+
+    SDL_Rect levelVisible = MipPyramid::levelRect(visible, level);
+    std::vector<int> tiles;
+    for (int i = 0; i < m_levelComposite.getTileCount(); i++) {
+        SDL_Rect tileRect = m_levelComposite.getTileRect(i);
+        if (m_levelDamaged[i] && SDL_HasIntersection(&tileRect, &levelVisible)) tiles.push_back(i);
+    }
+    if (tiles.empty()) return;
+
+    // Groups are already rebuilt by updateComposite, their pyramids come from those pixels
+    for (const auto& layer : m_layers) {
+        if (!layer->getParent() && layer->isVisible() && layer->hasPixels()) layer->updateMipmaps();
+    }
+    GetThreadPool().parallelFor(static_cast<int>(tiles.size()), [&](int k) {
+        int i = tiles[k];
+        SDL_Rect tileRect = m_levelComposite.getTileRect(i);
+        m_levelComposite.fillRect(tileRect, 0xFFFFFFFF);
+        compositeLevelTile(m_levelComposite, level, tileRect);
+        m_levelDamaged[i] = 0;
+    });
+    m_statsBlended = m_blendCounter;
+    m_statsCulled = m_cullCounter;
+}
+
+void Canvas::updateComposite(const SDL_Rect& visible) {
+    if (m_composite.getWidth() != m_width || m_composite.getHeight() != m_height) {
+        m_composite.resize(m_width, m_height);
+        m_belowCache.resize(m_width, m_height);
+        m_aboveCache.resize(m_width, m_height);
+        m_tileState.assign(m_composite.getTileCount(), TILE_ALL);
+    }
+
+    int layerCount = static_cast<int>(m_layers.size());
+    // Inside a group the split is at the top level group it's in, the group's own pixels are
+    // what changes when the active layer gets painted on
+    int active = getRootIndex(std::clamp(m_activeLayerIndex, 0, layerCount - 1));
+
+    // Different active layer means different ranges, rebuild the caches as tiles get damaged.
+    // Switching layers doesn't change the picture though, so nothing is damaged by it.
+    if (active != m_cachedActiveIndex || m_layers[active].get() != m_cachedActiveLayer) {
+        for (Uint8& state : m_tileState) state |= BELOW_STALE | ABOVE_STALE;
+        m_cachedActiveIndex = active;
+        m_cachedActiveLayer = m_layers[active].get();
+    }
+
+    m_blendCounter = 0;
+    m_cullCounter = 0;
+    updateGroups();
+
+    // Always collect, even for hidden layers, so their dirty bits don't pile up. Damage only
+    // invalidates the cache on the side of the active layer it came from.
+    std::vector<SDL_Rect> damage;
+    for (int i = 0; i < layerCount; i++) {
+        if (m_layers[i]->getParent()) continue; // went to its group in updateGroups
+        damage.clear();
+        m_layers[i]->collectDamage(damage);
+        Uint8 state = TILE_DAMAGED | (i < active ? BELOW_STALE : 0) | (i > active ? ABOVE_STALE : 0);
+        for (const SDL_Rect& rect : damage) {
+            markTiles(rect, state);
+            markLevelDamage(rect);
+        }
+        if (!damage.empty()) m_contentVersion++;
+    }
+
+    int level = getDisplayLevel();
+    if (level > 0) {
+        updateLevelComposite(level, visible);
+        return;
+    }
+
+    // Flattening the layers above only works if "over" is all they do. With blend modes (or an
+    // adjustment layer) the result depends on what's below, so then they're composited one by one instead.
+    bool aboveCacheable = true;
+    for (int i = active + 1; i < layerCount; i++) {
+        const Layer& layer = *m_layers[i];
+        if (!layer.getParent() && layer.isVisible() && (layer.getBlendMode() != 0 || layer.isAdjustment())) {
+            aboveCacheable = false;
+            break;
+        }
+    }
+
+    // Damaged tiles only depend on their own pixels in every buffer, so they go to the pool
+    std::vector<int> tiles;
+    for (int i = 0; i < m_composite.getTileCount(); i++) {
+        if (!(m_tileState[i] & TILE_DAMAGED)) continue;
+        SDL_Rect tileRect = m_composite.getTileRect(i);
+        if (!SDL_HasIntersection(&tileRect, &visible)) continue; // stays damaged until it's in view
+        tiles.push_back(i);
+    }
+
+    if (tiles.empty()) return;
+
+    GetThreadPool().parallelFor(static_cast<int>(tiles.size()), [&](int k) {
+        int i = tiles[k];
+        SDL_Rect tileRect = m_composite.getTileRect(i);
+
+        if (aboveCacheable && (m_tileState[i] & ABOVE_STALE)) {
+            m_aboveCache.fillRect(tileRect, 0);
+            compositeRange(m_aboveCache, firstVisibleLayer(tileRect, active + 1, layerCount), layerCount, tileRect);
+            m_tileState[i] &= ~ABOVE_STALE;
+        }
+
+        // Something above the active layer covers this tile completely, so neither the active
+        // layer nor the below cache matter here. The below cache stays stale until they do.
+        int first = firstVisibleLayer(tileRect, 0, layerCount);
+        if (first > active) {
+            if (aboveCacheable) {
+                m_composite.shareTile(i, m_aboveCache); // opaque here, so it is the composite
+            } else {
+                m_composite.fillRect(tileRect, 0xFFFFFFFF);
+                compositeRange(m_composite, first, layerCount, tileRect);
+            }
+            m_tileState[i] &= ~TILE_DAMAGED;
+            return;
+        }
+
+        if (m_tileState[i] & BELOW_STALE) {
+            m_belowCache.fillRect(tileRect, 0xFFFFFFFF);
+            compositeRange(m_belowCache, first, active, tileRect);
+            m_tileState[i] &= ~BELOW_STALE;
+        }
+
+        // below is shared, not copied, until the active layer actually lands on it
+        m_composite.shareTile(i, m_belowCache);
+        compositeLayer(m_composite, *m_layers[active], tileRect);
+        if (aboveCacheable) {
+            m_composite.compositeOver(m_aboveCache, 0, 0, 1.0f, tileRect);
+        } else {
+            compositeRange(m_composite, active + 1, layerCount, tileRect);
+        }
+        m_tileState[i] &= ~TILE_DAMAGED;
+    });
+
+    m_statsBlended = m_blendCounter;
+    m_statsCulled = m_cullCounter;
+}
+
+void Canvas::uploadTiles(TileBuffer& buffer, SDL_Texture*& texture, const SDL_Rect& visible) {
+    int texWidth = 0, texHeight = 0;
+    if (texture) {
+        SDL_QueryTexture(texture, nullptr, nullptr, &texWidth, &texHeight);
+    }
+    if (!texture || texWidth != buffer.getWidth() || texHeight != buffer.getHeight()) {
+        if (texture) {
+            SDL_DestroyTexture(texture);
+        }
+        texture = SDL_CreateTexture(m_renderer, SDL_PIXELFORMAT_RGBA8888,
+                                    SDL_TEXTUREACCESS_STREAMING, buffer.getWidth(), buffer.getHeight());
+        if (!texture) {
+            std::cerr << "Error creating canvas buffer: " << SDL_GetError() << std::endl;
+            return;
+        }
+        // Only the zoomed out levels are ever drawn smaller than they are
+        if (&buffer != &m_composite) {
+            SDL_SetTextureScaleMode(texture, SDL_ScaleModeLinear);
+        }
+        buffer.markAllDirty(); // fresh texture has garbage in it
+    }
+
+    for (int i = 0; i < buffer.getTileCount(); i++) {
+        if (!buffer.isTileDirty(i, TileBuffer::DIRTY_TEXTURE)) continue;
+        SDL_Rect tileRect = buffer.getTileRect(i);
+        if (!SDL_HasIntersection(&tileRect, &visible)) continue;
+        const Uint32* data = buffer.getTileData(i);
+        if (!data) {
+            // Single colour tile, the texture still wants every pixel of it
+            static std::vector<Uint32> solid(TileBuffer::TILE_PIXELS);
+            std::fill(solid.begin(), solid.end(), buffer.getTileColor(i));
+            data = solid.data();
+        }
+        SDL_UpdateTexture(texture, &tileRect, data, TileBuffer::TILE_SIZE * sizeof(Uint32));
+        buffer.clearTileDirty(i, TileBuffer::DIRTY_TEXTURE);
+    }
 }
 
 void Canvas::drawResizeHandles(SDL_Renderer* renderer) {
@@ -612,78 +1605,24 @@ bool Canvas::handleResizeEvent(const SDL_Event& event, const SDL_Point& mousePos
     return false;
 }
 
-SDL_Surface* Canvas::resizeImage(SDL_Surface* src, int newWidth, int newHeight) {
-    if (!src) return nullptr;
-
-    SDL_Surface* resized = SDL_CreateRGBSurface(0, newWidth, newHeight, 32,
-        0x00FF0000, 0x0000FF00, 0x000000FF, 0xFF000000);
-
-    if (!resized) return nullptr;
-
-    // Nearest neighbor scaling algorithm is quick but results are usually pixelated
-    SDL_LockSurface(src);
-    SDL_LockSurface(resized);
-
-    Uint32* srcPixels = static_cast<Uint32*>(src->pixels);
-    Uint32* dstPixels = static_cast<Uint32*>(resized->pixels);
-
-    float xRatio = static_cast<float>(src->w) / newWidth;
-    float yRatio = static_cast<float>(src->h) / newHeight;
-
-    for (int y = 0; y < newHeight; y++) {
-        for (int x = 0; x < newWidth; x++) {
-            int srcX = static_cast<int>(x * xRatio);
-            int srcY = static_cast<int>(y * yRatio);
-
-            if (srcX < src->w && srcY < src->h) {
-                dstPixels[y * newWidth + x] = srcPixels[srcY * src->w + srcX];
-            }
-        }
-    }
-
-    SDL_UnlockSurface(resized);
-    SDL_UnlockSurface(src);
-
-    return resized;
-}
-
 void Canvas::resizeCanvas(int newWidth, int newHeight) {
+    int oldWidth = m_width;
+    int oldHeight = m_height;
     m_width = newWidth;
     m_height = newHeight;
 
-    if (m_canvasBuffer) {
-        SDL_DestroyTexture(m_canvasBuffer);
-    }
-
-    m_canvasBuffer = SDL_CreateTexture(
-        m_renderer,
-        SDL_PIXELFORMAT_RGBA8888,
-        SDL_TEXTUREACCESS_TARGET,
-        newWidth,
-        newHeight
-    );
-
+    // Stretch every layer with the canvas (nearest neighbour, same as the old RenderCopy did),
+    // position included. Groups get rebuilt from their children at the new size anyway.
     for (auto& layer : m_layers) {
-        if (layer->getTexture()) {
-            SDL_Texture* oldTexture = layer->getTexture();
-            SDL_Texture* newTexture = SDL_CreateTexture(
-                m_renderer,
-                SDL_PIXELFORMAT_RGBA8888,
-                SDL_TEXTUREACCESS_TARGET,
-                newWidth,
-                newHeight
-            );
-
-            if (newTexture) {
-                SDL_SetRenderTarget(m_renderer, newTexture);
-                SDL_SetRenderDrawColor(m_renderer, 0, 0, 0, 0);
-                SDL_RenderClear(m_renderer);
-                SDL_RenderCopy(m_renderer, oldTexture, nullptr, nullptr);
-                SDL_SetRenderTarget(m_renderer, nullptr);
-
-                layer->setTexture(newTexture);
-            }
-        }
+        layer->setCanvasSize(newWidth, newHeight);
+        if (layer->isGroup() || !layer->hasPixels() || oldWidth <= 0 || oldHeight <= 0) continue;
+        SDL_Rect bounds = layer->getBounds();
+        int x0 = static_cast<int>(static_cast<Sint64>(bounds.x) * newWidth / oldWidth);
+        int y0 = static_cast<int>(static_cast<Sint64>(bounds.y) * newHeight / oldHeight);
+        int x1 = static_cast<int>(static_cast<Sint64>(bounds.x + bounds.w) * newWidth / oldWidth);
+        int y1 = static_cast<int>(static_cast<Sint64>(bounds.y + bounds.h) * newHeight / oldHeight);
+        layer->setPixels(layer->getPixels().scaled(std::max(1, x1 - x0), std::max(1, y1 - y0)));
+        layer->setPosition(x0, y0);
     }
 }
 
@@ -695,47 +1634,26 @@ void Canvas::cropImage() {
 
     if (newWidth <= 0 || newHeight <= 0) return;
 
+    // Each layer keeps only its part inside the selection, in whole shared tiles where the
+    // selection happens to line up with them
     for (auto& layer : m_layers) {
-        if (layer->getTexture()) {
-            SDL_Texture* oldTexture = layer->getTexture();
-
-            SDL_Texture* newTexture = SDL_CreateTexture(
-                m_renderer,
-                SDL_PIXELFORMAT_RGBA8888,
-                SDL_TEXTUREACCESS_TARGET,
-                newWidth,
-                newHeight
-            );
-
-            if (newTexture) {
-                SDL_SetRenderTarget(m_renderer, newTexture);
-                SDL_SetRenderDrawColor(m_renderer, 0, 0, 0, 0);
-                SDL_RenderClear(m_renderer);
-
-                SDL_Rect destRect = {-m_selectionRect.x, -m_selectionRect.y, m_width, m_height};
-                SDL_RenderCopy(m_renderer, oldTexture, nullptr, &destRect);
-
-                SDL_SetRenderTarget(m_renderer, nullptr);
-                layer->setTexture(newTexture);
-            }
+        layer->setCanvasSize(newWidth, newHeight);
+        // The mask stays over the same content
+        layer->setMaskPosition(layer->getMaskX() - m_selectionRect.x, layer->getMaskY() - m_selectionRect.y);
+        if (layer->isGroup() || !layer->hasPixels()) continue;
+        SDL_Rect kept;
+        SDL_Rect bounds = layer->getBounds();
+        if (!SDL_IntersectRect(&bounds, &m_selectionRect, &kept)) {
+            layer->setPixels(TileBuffer());
+            continue;
         }
+        layer->setPixels(layer->getPixels().extract({kept.x - bounds.x, kept.y - bounds.y, kept.w, kept.h}));
+        layer->setPosition(kept.x - m_selectionRect.x, kept.y - m_selectionRect.y);
     }
 
     m_width = newWidth;
     m_height = newHeight;
 
-    if (m_canvasBuffer) {
-        SDL_DestroyTexture(m_canvasBuffer);
-    }
-
-    m_canvasBuffer = SDL_CreateTexture(
-        m_renderer,
-        SDL_PIXELFORMAT_RGBA8888,
-        SDL_TEXTUREACCESS_TARGET,
-        newWidth,
-        newHeight
-    );
-
     m_hasSelection = false;
     m_selectionRect = {0, 0, 0, 0};
 }
@@ -746,7 +1664,7 @@ void Canvas::rotateImage(int desiredAngle) {
 
     if (desiredAngle == 0) return;
 
-
+    int normalizedRotation = desiredAngle % 360;
     if (normalizedRotation < 0) normalizedRotation += 360;
 
     // Special handling for 90-degree increments since they're super common
@@ -762,11 +1680,14 @@ void Canvas::rotateImage(int desiredAngle) {
 
     // Process each layer individually - learned this the hard way after trying to batch them
     for (auto& currentLayer : m_layers) {
-        if (!currentLayer || !currentLayer->getTexture()) continue;
+        if (!currentLayer || currentLayer->isGroup() || !currentLayer->hasPixels()) continue;
+
+        // Turns around the canvas centre, so the layer gets spread over the whole canvas first
+        // and trimmed back down afterwards
+        currentLayer->setFrame({0, 0, m_width, m_height});
 
-        SDL_Texture* originalLayerTexture = currentLayer->getTexture();
-        int origWidth, origHeight;
-        SDL_QueryTexture(originalLayerTexture, nullptr, nullptr, &origWidth, &origHeight);
+        int origWidth = currentLayer->getWidth();
+        int origHeight = currentLayer->getHeight();
 
         // Calculate rotated texture bounds 
         double angleInRadians = normalizedRotation * M_PI / 180.0;
@@ -776,44 +1697,17 @@ void Canvas::rotateImage(int desiredAngle) {
         int rotatedTextureWidth = static_cast<int>(origWidth * cosAngle + origHeight * sinAngle);
         int rotatedTextureHeight = static_cast<int>(origWidth * sinAngle + origHeight * cosAngle);
 
-        SDL_Texture* rotatedTexture = SDL_CreateTexture(m_renderer, SDL_PIXELFORMAT_RGBA8888,
-                                                       SDL_TEXTUREACCESS_TARGET,
-                                                       rotatedTextureWidth, rotatedTextureHeight);
-
-        if (!rotatedTexture) {
-            // We just skip this layer rather than crash incase the texture is null.
-            continue;
-        }
-
-        SDL_Texture* previousTarget = SDL_GetRenderTarget(m_renderer);
-        SDL_SetRenderTarget(m_renderer, rotatedTexture);
-
-        SDL_SetRenderDrawBlendMode(m_renderer, SDL_BLENDMODE_NONE);
-        SDL_SetRenderDrawColor(m_renderer, 0, 0, 0, 0);
-        SDL_RenderClear(m_renderer);
-
-        SDL_Point rotationCenter = {rotatedTextureWidth / 2, rotatedTextureHeight / 2};
-        SDL_Rect destinationRect = {
-            rotationCenter.x - origWidth / 2,
-            rotationCenter.y - origHeight / 2,
-            origWidth,
-            origHeight
-        };
-
-        SDL_RenderCopyEx(m_renderer, originalLayerTexture, nullptr, &destinationRect,
-                        static_cast<double>(normalizedRotation), &rotationCenter, SDL_FLIP_NONE);
-
-        SDL_SetRenderTarget(m_renderer, previousTarget);
-
-        currentLayer->setTexture(rotatedTexture);
+        currentLayer->setPixels(currentLayer->getPixels().rotated(normalizedRotation,
+                                                                  rotatedTextureWidth, rotatedTextureHeight));
     }
 
     if (newCanvasWidth != m_width || newCanvasHeight != m_height) {
         m_width = newCanvasWidth;
         m_height = newCanvasHeight;
-
-        m_canvasBuffer = SDL_CreateTexture(m_renderer, SDL_PIXELFORMAT_RGBA8888,
-                                         SDL_TEXTUREACCESS_TARGET, m_width, m_height);
+    }
+    for (auto& currentLayer : m_layers) {
+        currentLayer->setCanvasSize(m_width, m_height);
+        currentLayer->trimToContent();
     }
 
     // Clear any active selection since it's probably invalid now
@@ -835,108 +1729,61 @@ void Canvas::rotateImage(int desiredAngle) {
 
 /**
  * Creates a temporary buffer for safe filter application by copying the active layer's content.
- * This prevents filter crashes by working on a separate texture before applying to the layer.
+ * Filters that look at neighbouring pixels (blur, sharpen, edges) read from this copy and write
+ * their result back in one go, so they never read pixels they already changed.
+ * Layers only cover their content, so a filter that spreads pixels out passes how far (halo)
+ * and the layer grows by that much first.
  */
-void Canvas::createFilterBuffer() {
+void Canvas::createFilterBuffer(int halo) {
     cleanupFilterBuffer(); 
 
     Layer* activeLayer = getActiveLayer();
-    if (!activeLayer) return;
-    m_filterBuffer = SDL_CreateTexture(
-        m_renderer,
-        SDL_PIXELFORMAT_RGBA8888,
-        SDL_TEXTUREACCESS_TARGET,
-        m_width,
-        m_height
-    );
+    if (!activeLayer || !activeLayer->hasPixels()) return;
 
-    if (!m_filterBuffer) return;
+    ParallelFilter::growForHalo(*activeLayer, halo);
 
-    SDL_SetRenderTarget(m_renderer, m_filterBuffer);
-    SDL_RenderCopy(m_renderer, activeLayer->getTexture(), nullptr, nullptr);
-    SDL_SetRenderTarget(m_renderer, nullptr);
+    m_filterWidth = activeLayer->getWidth();
+    m_filterHeight = activeLayer->getHeight();
+    m_filterBuffer.resize(static_cast<size_t>(m_filterWidth) * m_filterHeight);
+    activeLayer->getPixels().readRect({0, 0, m_filterWidth, m_filterHeight}, m_filterBuffer.data(), m_filterWidth);
 }
 
 void Canvas::applyFilterBuffer() {
-    if (!m_filterBuffer) return;
+    if (m_filterBuffer.empty()) return;
 
     Layer* activeLayer = getActiveLayer();
-    if (!activeLayer) return;
+    if (activeLayer && activeLayer->getWidth() == m_filterWidth && activeLayer->getHeight() == m_filterHeight) {
+        // Write the result back into the tiles, only those get re-uploaded next frame.
+        // Anything the filter left fully transparent gets its storage back.
+        activeLayer->getPixels().writeRect({0, 0, m_filterWidth, m_filterHeight}, m_filterBuffer.data(), m_filterWidth);
+        activeLayer->trimToContent();
+    }
 
-    // Replace current texture with buffer texture
-    activeLayer->setTexture(m_filterBuffer);
-    m_filterBuffer = nullptr; // Transfer ownership, don't destroy
+    cleanupFilterBuffer();
 }
 
 void Canvas::cleanupFilterBuffer() {
-    if (m_filterBuffer) {
-        SDL_DestroyTexture(m_filterBuffer);
-        m_filterBuffer = nullptr;
-    }
+    m_filterBuffer.clear();
+    m_filterBuffer.shrink_to_fit();
+    m_filterWidth = 0;
+    m_filterHeight = 0;
 }
 void Canvas::applyGrayscale() {
     if (m_filterInProgress) return;
 
     Layer* activeLayer = getActiveLayer();
-    if (!activeLayer || activeLayer->isLocked()) return;
+    if (!activeLayer || activeLayer->isLocked() || !activeLayer->hasPixels()) return;
 
     Editor::getInstance().saveUndoState();
 
     m_filterInProgress = true;
-    createFilterBuffer();
-
-    SDL_Texture* texture = m_filterBuffer;
-    if (!texture) {
-        m_filterInProgress = false;
-        return;
-    }
-
-    int texWidth, texHeight;
-    if (SDL_QueryTexture(texture, NULL, NULL, &texWidth, &texHeight) != 0) {
-        return;
-    }
-
-    SDL_SetRenderTarget(m_renderer, texture);
-    SDL_Surface* surface = SDL_CreateRGBSurface(0, texWidth, texHeight, 32,
-        0xFF000000, 0x00FF0000, 0x0000FF00, 0x000000FF);
-
-    if (!surface) {
-        SDL_SetRenderTarget(m_renderer, nullptr);
-        return;
-    }
-
-    if (SDL_RenderReadPixels(m_renderer, nullptr, SDL_PIXELFORMAT_RGBA8888, surface->pixels, surface->pitch) != 0) {
-        SDL_FreeSurface(surface);
-        SDL_SetRenderTarget(m_renderer, nullptr);
-        return;
-    }
-
-    SDL_LockSurface(surface);
-    Uint32* pixels = static_cast<Uint32*>(surface->pixels);
-
-    for (int i = 0; i < surface->w * surface->h; i++) {
-        Uint8 r, g, b, a;
-        SDL_GetRGBA(pixels[i], surface->format, &r, &g, &b, &a);
-        Uint8 gray = static_cast<Uint8>(0.299f * r + 0.587f * g + 0.114f * b);
-        pixels[i] = SDL_MapRGBA(surface->format, gray, gray, gray, a);
-    }
 
-    SDL_UnlockSurface(surface);
+    // Per pixel only, so it can run straight on the tiles without a buffer copy
+    forEachColor(*activeLayer, m_pixelDepth, [](auto& r, auto& g, auto& b) {
+        PointOps::luminance(r, r, g, b);
+        g = b = r;
+    });
 
-    SDL_Texture* newTexture = SDL_CreateTextureFromSurface(m_renderer, surface);
-
-    SDL_FreeSurface(surface);
-    SDL_SetRenderTarget(m_renderer, nullptr);
-
-    if (newTexture) {
-        SDL_SetTextureBlendMode(newTexture, SDL_BLENDMODE_BLEND);
-        SDL_SetRenderTarget(m_renderer, m_filterBuffer);
-        SDL_RenderCopy(m_renderer, newTexture, nullptr, nullptr);
-        SDL_SetRenderTarget(m_renderer, nullptr);
-        SDL_DestroyTexture(newTexture);
-    }
-
-    applyFilterBuffer();
     m_lastAppliedFilter = FilterType::GRAYSCALE;
     m_filterInProgress = false;
 }
@@ -946,11 +1793,11 @@ void Canvas::applyGrayscale() {
  * 
  * WARNING: Running grayscale after blur can cause crashes.
  * Implementation features:
- * - Uses correct texture dimensions
+ * - Box, 3-pass box or recursive Gaussian, all cost the same per pixel at any radius
  * - Safely handles edge cases and memory
  * - Preserves alpha channel transparency
  */
-void Canvas::applyBlur(int strength) {
+void Canvas::applyBlur(int radius, BlurMode mode) {
     if (m_filterInProgress) return;
 
     Layer* activeLayer = getActiveLayer();
@@ -960,122 +1807,28 @@ void Canvas::applyBlur(int strength) {
     Editor::getInstance().saveUndoState();
 
     m_filterInProgress = true;
-    createFilterBuffer(); // Create buffer for safe filter application
-    SDL_Texture* texture = m_filterBuffer;
-    if (!texture) {
+    radius = std::min(std::max(radius, 1), MAX_BLUR_RADIUS);
+    const int halo = BlurEngine::getHalo(mode, radius);
+    createFilterBuffer(halo); // Create buffer for safe filter application
+    if (m_filterBuffer.empty()) {
         m_filterInProgress = false;
         return;
     }
 
-    strength = std::min(std::max(strength, 1), 10);
-
-
-    int texWidth, texHeight;
-    if (SDL_QueryTexture(texture, NULL, NULL, &texWidth, &texHeight) != 0) {
-        return;
-    }
-
-    SDL_SetRenderTarget(m_renderer, texture);
-    SDL_Surface* surface = SDL_CreateRGBSurface(0, texWidth, texHeight, 32,
-        0xFF000000, 0x00FF0000, 0x0000FF00, 0x000000FF);
-
-    if (!surface) {
-        SDL_SetRenderTarget(m_renderer, nullptr);
-        return;
-    }
-
-
-    if (SDL_RenderReadPixels(m_renderer, nullptr, SDL_PIXELFORMAT_RGBA8888, surface->pixels, surface->pitch) != 0) {
-        // Special note, please free stuff as soon as it fails because it will give you problems like it did the other day.
-        SDL_FreeSurface(surface);
-        SDL_SetRenderTarget(m_renderer, nullptr);
-        return;
-    }
-
-    // Create a second surface for the blurred result we want
-    SDL_Surface* blurred = SDL_CreateRGBSurface(0, texWidth, texHeight, 32,
-        0xFF000000, 0x00FF0000, 0x0000FF00, 0x000000FF);
-
-    if (!blurred) {
-        SDL_FreeSurface(surface);
-        SDL_SetRenderTarget(m_renderer, nullptr);
-        return;
-    }
-
-    SDL_LockSurface(surface);
-    SDL_LockSurface(blurred);
-
-    Uint32* srcPixels = static_cast<Uint32*>(surface->pixels);
-    Uint32* dstPixels = static_cast<Uint32*>(blurred->pixels);
-
-    int width = surface->w;
-
-    for (int y = 0; y < surface->h; y++) {
-        for (int x = 0; x < width; x++) {
-            int r = 0, g = 0, b = 0, a = 0, count = 0;
-            for (int dy = -strength; dy <= strength; dy++) {
-                for (int dx = -strength; dx <= strength; dx++) {
-                    int nx = x + dx;
-                    int ny = y + dy;
-
-                    if (nx >= 0 && nx < width && ny >= 0 && ny < surface->h) {
-                        // Calculate index safely
-                        int idx = ny * width + nx;
-
-                        // Get pixel components
-                        Uint8 pr, pg, pb, pa;
-                        SDL_GetRGBA(srcPixels[idx], surface->format, &pr, &pg, &pb, &pa);
-
-                        // Accumulate weighted by alpha
-                        r += pr;
-                        g += pg;
-                        b += pb;
-                        a += pa;
-                        count++;
-                    }
-                }
-            }
-
-            // Prevent division by zero
-            if (count > 0) {
-                r /= count; g /= count; b /= count; a /= count;
-                // Write to destination
-                dstPixels[y * width + x] = SDL_MapRGBA(blurred->format,
-                    static_cast<Uint8>(r),
-                    static_cast<Uint8>(g),
-                    static_cast<Uint8>(b),
-                    static_cast<Uint8>(a));
-            }
-        }
-    }
+    // The tiles are premultiplied, so a plain average of all four channels is right: transparent
+    // neighbours add nothing to the colour and soft edges don't go dark
+    BlurEngine::blur(m_filterBuffer.data(), m_filterWidth, m_filterHeight, m_filterWidth, mode, radius);
 
-    SDL_UnlockSurface(blurred);
-    SDL_UnlockSurface(surface);
+    // Averaging one colour gives that colour, put it back exactly so those tiles stay single values
+    const std::vector<Uint8> active = ParallelFilter::tilesNearContent(activeLayer->getPixels(), halo);
+    ParallelFilter::fillUniformTiles(activeLayer->getPixels(), active, m_filterBuffer.data());
 
-    // Create a new texture from the blurred surface
-    SDL_Texture* newTexture = SDL_CreateTextureFromSurface(m_renderer, blurred);
-
-    // LEAK FIX: Clean up the surfaces regardless of texture creation success
-    SDL_FreeSurface(surface); // Inspect this with the other thing. Just ctrl f for special note
-    SDL_FreeSurface(blurred);
-    SDL_SetRenderTarget(m_renderer, nullptr);
-
-    if (newTexture) {
-        // Set blend mode to preserve transparency
-        SDL_SetTextureBlendMode(newTexture, SDL_BLENDMODE_BLEND);
-        // Apply to buffer instead of directly to layer
-        SDL_SetRenderTarget(m_renderer, m_filterBuffer);
-        SDL_RenderCopy(m_renderer, newTexture, nullptr, nullptr);
-        SDL_SetRenderTarget(m_renderer, nullptr);
-        SDL_DestroyTexture(newTexture);
-        }
-
-        // Apply buffer to layer and cleanup
-        applyFilterBuffer();
+    // Apply buffer to layer and cleanup
+    applyFilterBuffer();
 
-        // FIXED: Mark filter completion and track last applied filter
-        m_lastAppliedFilter = FilterType::BLUR;
-        m_filterInProgress = false;
+    // FIXED: Mark filter completion and track last applied filter
+    m_lastAppliedFilter = FilterType::BLUR;
+    m_filterInProgress = false;
 }
 
 void Canvas::applySharpen(int strength) {
@@ -1091,109 +1844,7 @@ void Canvas::applySharpen(int strength) {
     Editor::getInstance().saveUndoState();
 
     m_filterInProgress = true;
-    createFilterBuffer();
-    if (!m_filterBuffer) {
-        m_filterInProgress = false;
-        return;
-    }
-
-    int width, height;
-    SDL_QueryTexture(activeLayer->getTexture(), nullptr, nullptr, &width, &height);
-
-    SDL_Surface* surface = SDL_CreateRGBSurface(0, width, height, 32, 0, 0, 0, 0);
-    if (!surface) {
-        cleanupFilterBuffer();
-        m_filterInProgress = false;
-        return;
-    }
-
-    SDL_SetRenderTarget(m_renderer, activeLayer->getTexture());
-    SDL_RenderReadPixels(m_renderer, nullptr, SDL_PIXELFORMAT_RGBA32, surface->pixels, surface->pitch);
-    SDL_SetRenderTarget(m_renderer, nullptr);
-
-    Uint32* pixels = (Uint32*)surface->pixels;
-
-    SDL_Surface* outputSurface = SDL_CreateRGBSurface(0, width, height, 32, 0, 0, 0, 0);
-    if (!outputSurface) {
-        SDL_FreeSurface(surface);
-        cleanupFilterBuffer();
-        m_filterInProgress = false;
-        return;
-    }
-
-    Uint32* outputPixels = (Uint32*)outputSurface->pixels;
-
-    int kernel[3][3] = {
-        { 0, -1,  0},
-        {-1,  5, -1},
-        { 0, -1,  0}
-    };
-
-    // Apply sharpen filter
-    for (int y = 1; y < height - 1; y++) {
-        for (int x = 1; x < width - 1; x++) {
-            int rSum = 0, gSum = 0, bSum = 0;
-
-            for (int ky = -1; ky <= 1; ky++) {
-                for (int kx = -1; kx <= 1; kx++) {
-                    int px = x + kx;
-                    int py = y + ky;
-
-                    Uint32 pixel = pixels[py * width + px];
-                    Uint8 r, g, b, a;
-                    SDL_GetRGBA(pixel, surface->format, &r, &g, &b, &a);
-
-                    int kernelValue = kernel[ky + 1][kx + 1];
-                    rSum += r * kernelValue;
-                    gSum += g * kernelValue;
-                    bSum += b * kernelValue;
-                }
-            }
-
-            rSum = (rSum * strength) / 4;
-            gSum = (gSum * strength) / 4;
-            bSum = (bSum * strength) / 4;
-
-            rSum = std::max(0, std::min(255, rSum));
-            gSum = std::max(0, std::min(255, gSum));
-            bSum = std::max(0, std::min(255, bSum));
-
-            Uint32 originalPixel = pixels[y * width + x];
-            Uint8 r, g, b, a;
-            SDL_GetRGBA(originalPixel, surface->format, &r, &g, &b, &a);
-
-            outputPixels[y * width + x] = SDL_MapRGBA(outputSurface->format,
-                                                     (Uint8)rSum, (Uint8)gSum, (Uint8)bSum, a);
-        }
-    }
-
-    for (int y = 0; y < height; y++) {
-        if (y == 0 || y == height - 1) {
-            for (int x = 0; x < width; x++) {
-                outputPixels[y * width + x] = pixels[y * width + x];
-            }
-        } else {
-            // Copy left/right edges
-            outputPixels[y * width + 0] = pixels[y * width + 0];
-            outputPixels[y * width + width - 1] = pixels[y * width + width - 1];
-        }
-    }
-
-    // Convert back to texture
-    SDL_SetRenderTarget(m_renderer, m_filterBuffer);
-    SDL_Texture* tempTexture = SDL_CreateTextureFromSurface(m_renderer, outputSurface);
-    if (tempTexture) {
-        SDL_RenderCopy(m_renderer, tempTexture, nullptr, nullptr);
-        SDL_DestroyTexture(tempTexture);
-    }
-    SDL_SetRenderTarget(m_renderer, nullptr);
-
-    // Cleanup
-    SDL_FreeSurface(surface);
-    SDL_FreeSurface(outputSurface);
-
-    // Apply buffer to layer
-    applyFilterBuffer();
+    sharpenLayer(*activeLayer, strength);
 
     // Mark filter completion
     m_lastAppliedFilter = FilterType::NONE;  // Could add SHARPEN type if needed
@@ -1204,7 +1855,7 @@ void Canvas::flipHorizontal(bool wholeCanvas) {
     if (wholeCanvas) {
         // Flip all layers horizontally
         for (auto& layer : m_layers) {
-            if (layer && layer->getTexture()) {
+            if (layer && layer->hasPixels()) {
                 flipLayerHorizontal(layer.get());
             }
         }
@@ -1221,7 +1872,7 @@ void Canvas::flipVertical(bool wholeCanvas) {
     if (wholeCanvas) {
         // Flip all layers vertically
         for (auto& layer : m_layers) {
-            if (layer && layer->getTexture()) {
+            if (layer && layer->hasPixels()) {
                 flipLayerVertical(layer.get());
             }
         }
@@ -1232,297 +1883,54 @@ void Canvas::flipVertical(bool wholeCanvas) {
             flipLayerVertical(activeLayer);
         }
     }
-}
-
-void Canvas::flipLayerHorizontal(Layer* layer) {
-    if (!layer || !layer->getTexture()) return;
-
-    SDL_Texture* texture = layer->getTexture();
-
-    int width, height;
-    if (SDL_QueryTexture(texture, nullptr, nullptr, &width, &height) != 0) {
-        return;
-    }
-    SDL_SetRenderTarget(m_renderer, texture);
-    SDL_Surface* surface = SDL_CreateRGBSurface(0, width, height, 32,
-        0xFF000000, 0x00FF0000, 0x0000FF00, 0x000000FF);
-
-    if (!surface) {
-        SDL_SetRenderTarget(m_renderer, nullptr);
-        return;
-    }
-
-    if (SDL_RenderReadPixels(m_renderer, nullptr, SDL_PIXELFORMAT_RGBA8888,
-                           surface->pixels, surface->pitch) != 0) {
-        SDL_FreeSurface(surface);
-        SDL_SetRenderTarget(m_renderer, nullptr);
-        return;
-    }
-
-    // Create flipped surface
-    SDL_Surface* flipped = SDL_CreateRGBSurface(0, width, height, 32,
-        0xFF000000, 0x00FF0000, 0x0000FF00, 0x000000FF);
-
-    if (!flipped) {
-        SDL_FreeSurface(surface);
-        SDL_SetRenderTarget(m_renderer, nullptr);
-        return;
-    }
-
-    SDL_LockSurface(surface);
-    SDL_LockSurface(flipped);
-
-    Uint32* srcPixels = static_cast<Uint32*>(surface->pixels);
-    Uint32* dstPixels = static_cast<Uint32*>(flipped->pixels);
-
-    // Horizontal flip algorithm: mirror pixels across vertical axis
-    for (int y = 0; y < height; y++) {
-        for (int x = 0; x < width; x++) {
-            int srcIndex = y * width + x;
-            int dstIndex = y * width + (width - 1 - x);
-            dstPixels[dstIndex] = srcPixels[srcIndex];
-        }
-    }
-
-    SDL_UnlockSurface(flipped);
-    SDL_UnlockSurface(surface);
-
-    SDL_Texture* newTexture = SDL_CreateTextureFromSurface(m_renderer, flipped);
-
-    SDL_FreeSurface(surface);
-    SDL_FreeSurface(flipped);
-    SDL_SetRenderTarget(m_renderer, nullptr);
-
-    if (newTexture) {
-        SDL_SetTextureBlendMode(newTexture, SDL_BLENDMODE_BLEND);
-        layer->setTexture(newTexture);
-    }
-}
-
-void Canvas::flipLayerVertical(Layer* layer) {
-    if (!layer || !layer->getTexture()) return;
-
-    SDL_Texture* texture = layer->getTexture();
-
-    int width, height;
-    if (SDL_QueryTexture(texture, nullptr, nullptr, &width, &height) != 0) {
-        return;
-    }
-
-    SDL_SetRenderTarget(m_renderer, texture);
-    SDL_Surface* surface = SDL_CreateRGBSurface(0, width, height, 32,
-        0xFF000000, 0x00FF0000, 0x0000FF00, 0x000000FF);
-
-    if (!surface) {
-        SDL_SetRenderTarget(m_renderer, nullptr);
-        return;
-    }
-
-    if (SDL_RenderReadPixels(m_renderer, nullptr, SDL_PIXELFORMAT_RGBA8888,
-                           surface->pixels, surface->pitch) != 0) {
-        SDL_FreeSurface(surface);
-        SDL_SetRenderTarget(m_renderer, nullptr);
-        return;
-    }
-
-    SDL_Surface* flipped = SDL_CreateRGBSurface(0, width, height, 32,
-        0xFF000000, 0x00FF0000, 0x0000FF00, 0x000000FF);
-
-    if (!flipped) {
-        SDL_FreeSurface(surface);
-        SDL_SetRenderTarget(m_renderer, nullptr);
-        return;
-    }
-
-    SDL_LockSurface(surface);
-    SDL_LockSurface(flipped);
-
-    Uint32* srcPixels = static_cast<Uint32*>(surface->pixels);
-    Uint32* dstPixels = static_cast<Uint32*>(flipped->pixels);
-
-    // Vertical flip algorithm: mirror pixels across horizontal axis
-    for (int y = 0; y < height; y++) {
-        for (int x = 0; x < width; x++) {
-            int srcIndex = y * width + x;
-            int dstIndex = (height - 1 - y) * width + x;
-            dstPixels[dstIndex] = srcPixels[srcIndex];
-        }
-    }
-
-    SDL_UnlockSurface(flipped);
-    SDL_UnlockSurface(surface);
-
-    SDL_Texture* newTexture = SDL_CreateTextureFromSurface(m_renderer, flipped);
-
-    SDL_FreeSurface(surface);
-    SDL_FreeSurface(flipped);
-    SDL_SetRenderTarget(m_renderer, nullptr);
-
-    if (newTexture) {
-        SDL_SetTextureBlendMode(newTexture, SDL_BLENDMODE_BLEND);
-        layer->setTexture(newTexture);
-    }
-}
-
-void Canvas::applyEdgeDetection() {
-    // Edge detection filter inspired by that cool Snapchat-style effect
-    // Credit: https://youtu.be/yjovHQL9K5M?si=TE4vQHno0unWNZPa
-    // Spent way too much time tweaking this to get the look just right
-
-    Layer* currentLayer = getActiveLayer();
-    if (!currentLayer || currentLayer->isLocked()) return;
-
-    SDL_Texture* layerTexture = currentLayer->getTexture();
-    if (!layerTexture) return;
-
-    // Get texture dimensions - always check this first or you'll get weird crashes
-    int imageWidth, imageHeight;
-    if (SDL_QueryTexture(layerTexture, nullptr, nullptr, &imageWidth, &imageHeight) != 0) {
-        return;
-    }
-
-    SDL_SetRenderTarget(m_renderer, layerTexture);
-    SDL_Surface* originalSurface = SDL_CreateRGBSurface(0, imageWidth, imageHeight, 32,
-        0xFF000000, 0x00FF0000, 0x0000FF00, 0x000000FF);
-
-    if (!originalSurface) {
-        SDL_SetRenderTarget(m_renderer, nullptr);
-        return;
-    }
-
-    // Read pixels from texture - this part can be slow on big images
-    if (SDL_RenderReadPixels(m_renderer, nullptr, SDL_PIXELFORMAT_RGBA8888,
-                           originalSurface->pixels, originalSurface->pitch) != 0) {
-        SDL_FreeSurface(originalSurface);
-        SDL_SetRenderTarget(m_renderer, nullptr);
-        return;
-    }
-
-    // Create result surface for edge-detected image
-    SDL_Surface* edgeResult = SDL_CreateRGBSurface(0, imageWidth, imageHeight, 32,
-        0xFF000000, 0x00FF0000, 0x0000FF00, 0x000000FF);
-
-    if (!edgeResult) {
-        SDL_FreeSurface(originalSurface);
-        SDL_SetRenderTarget(m_renderer, nullptr);
-        return;
-    }
-
-    SDL_LockSurface(originalSurface);
-    SDL_LockSurface(edgeResult);
-
-    Uint32* sourcePixels = static_cast<Uint32*>(originalSurface->pixels);
-    Uint32* destPixels = static_cast<Uint32*>(edgeResult->pixels);
-
-    // Sobel edge detection kernels - these are the magic numbers that make it work
-    // Don't ask me why these specific values, I found them in a computer vision textbook
-    int sobelKernelX[3][3] = {{-1, 0, 1},
-                              {-2, 0, 2},
-                              {-1, 0, 1}};
-    int sobelKernelY[3][3] = {{-1, -2, -1},
-                              { 0,  0,  0},
-                              { 1,  2,  1}};
-
-    // Skip the border pixels because Sobel needs a 3x3 neighborhood
-    for (int scanY = 1; scanY < imageHeight - 1; scanY++) {
-        for (int scanX = 1; scanX < imageWidth - 1; scanX++) {
-            int gradientX = 0, gradientY = 0;
-
-            // Apply both Sobel operators to get X and Y gradients
-            for (int kernelY = -1; kernelY <= 1; kernelY++) {
-                for (int kernelX = -1; kernelX <= 1; kernelX++) {
-                    int pixelX = scanX + kernelX;
-                    int pixelY = scanY + kernelY;
-
-                    Uint8 red, green, blue, alpha;
-                    SDL_GetRGBA(sourcePixels[pixelY * imageWidth + pixelX],
-                               originalSurface->format, &red, &green, &blue, &alpha);
-
-                    // Convert RGB to grayscale using standard luminance weights
-                    // These coefficients account for human eye sensitivity to different colors
-                    int grayscaleValue = static_cast<int>(0.299f * red + 0.587f * green + 0.114f * blue);
-
-                    gradientX += grayscaleValue * sobelKernelX[kernelY + 1][kernelX + 1];
-                    gradientY += grayscaleValue * sobelKernelY[kernelY + 1][kernelX + 1];
-                }
-            }
-
-            // Calculate edge magnitude using Pythagorean theorem
-            int edgeMagnitude = static_cast<int>(std::sqrt(gradientX * gradientX + gradientY * gradientY));
-            edgeMagnitude = std::min(255, edgeMagnitude);
+}
 
-            // Invert the result because white edges on black background looks way cooler
-            // than black edges on white - learned this from playing with Instagram filters
-            edgeMagnitude = 255 - edgeMagnitude;
+void Canvas::flipLayerHorizontal(Layer* layer) {
+    if (!layer || !layer->hasPixels()) return;
 
-            // Preserve the original alpha channel so transparency is maintained
-            Uint8 originalAlphaValue;
-            SDL_GetRGBA(sourcePixels[scanY * imageWidth + scanX], originalSurface->format,
-                       nullptr, nullptr, nullptr, &originalAlphaValue);
+    // Horizontal flip: mirror pixels across vertical axis, done on the tiles. The layer only
+    // covers part of the canvas, so its position gets mirrored across the canvas too.
+    layer->getPixels().flipHorizontal();
+    layer->setX(m_width - layer->getX() - layer->getWidth());
+}
 
-            destPixels[scanY * imageWidth + scanX] = SDL_MapRGBA(edgeResult->format,
-                                                                static_cast<Uint8>(edgeMagnitude),
-                                                                static_cast<Uint8>(edgeMagnitude),
-                                                                static_cast<Uint8>(edgeMagnitude),
-                                                                originalAlphaValue);
-        }
-    }
+void Canvas::flipLayerVertical(Layer* layer) {
+    if (!layer || !layer->hasPixels()) return;
 
-    SDL_UnlockSurface(edgeResult);
-    SDL_UnlockSurface(originalSurface);
+    // Vertical flip: mirror pixels across horizontal axis
+    layer->getPixels().flipVertical();
+    layer->setY(m_height - layer->getY() - layer->getHeight());
+}
 
-    SDL_Texture* edgeTexture = SDL_CreateTextureFromSurface(m_renderer, edgeResult);
+void Canvas::applyEdgeDetection() {
+    // Edge detection filter inspired by that cool Snapchat-style effect
+    // Credit: https://youtu.be/yjovHQL9K5M?si=TE4vQHno0unWNZPa
+    // Spent way too much time tweaking this to get the look just right
 
-    SDL_FreeSurface(originalSurface);
-    SDL_FreeSurface(edgeResult);
-    SDL_SetRenderTarget(m_renderer, nullptr);
+    Layer* currentLayer = getActiveLayer();
+    if (!currentLayer || currentLayer->isLocked()) return;
 
-    if (edgeTexture) {
-        SDL_SetTextureBlendMode(edgeTexture, SDL_BLENDMODE_BLEND);
-        currentLayer->setTexture(edgeTexture);
-    }
+    detectEdges(*currentLayer);
 }
 
 void Canvas::adjustContrast(float contrast) {
     Layer* activeLayer = getActiveLayer();
-    if (!activeLayer || activeLayer->isLocked()) return;
+    if (!activeLayer || activeLayer->isLocked() || !activeLayer->hasPixels()) return;
 
     Editor::getInstance().saveUndoState();
 
-    SDL_Texture* texture = activeLayer->getTexture();
-    if (!texture) return;
-
-    SDL_SetRenderTarget(m_renderer, texture);
-    SDL_Surface* surface = SDL_CreateRGBSurface(0, m_width, m_height, 32,
-        0xFF000000, 0x00FF0000, 0x0000FF00, 0x000000FF);
-    SDL_RenderReadPixels(m_renderer, nullptr, SDL_PIXELFORMAT_RGBA8888, surface->pixels, surface->pitch);
-
-    SDL_LockSurface(surface);
-    Uint32* pixels = static_cast<Uint32*>(surface->pixels);
-
-    float factor = (259.0f * (contrast + 255.0f)) / (255.0f * (259.0f - contrast));
-
-    for (int i = 0; i < surface->w * surface->h; i++) {
-        Uint8 r, g, b, a;
-        SDL_GetRGBA(pixels[i], surface->format, &r, &g, &b, &a);
-
-        r = static_cast<Uint8>(std::max(0.0f, std::min(255.0f, factor * (r - 128) + 128)));
-        g = static_cast<Uint8>(std::max(0.0f, std::min(255.0f, factor * (g - 128) + 128)));
-        b = static_cast<Uint8>(std::max(0.0f, std::min(255.0f, factor * (b - 128) + 128)));
-
-        pixels[i] = SDL_MapRGBA(surface->format, r, g, b, a);
-    }
-
-    SDL_UnlockSurface(surface);
-
-    SDL_Texture* newTexture = SDL_CreateTextureFromSurface(m_renderer, surface);
-    SDL_FreeSurface(surface);
+    ToneChain tones;
+    tones.addContrast(contrast);
+    applyTones(*activeLayer, m_pixelDepth, tones);
+}
 
-    if (newTexture) {
-        activeLayer->setTexture(newTexture);
-    }
+void Canvas::applyToneChain(const ToneChain& tones) {
+    Layer* activeLayer = getActiveLayer();
+    if (!activeLayer || activeLayer->isLocked() || !activeLayer->hasPixels() || tones.isEmpty()) return;
 
-    SDL_SetRenderTarget(m_renderer, nullptr);
+    // One undo step for the whole chain, it's one pass over the pixels too
+    Editor::getInstance().saveUndoState();
+    applyTones(*activeLayer, m_pixelDepth, tones);
 }
 
 /**
@@ -1563,194 +1971,71 @@ void Canvas::applyFilter(int filterType) {
 }
 
 void Canvas::addAdjustmentLayer(AdjustmentType type) {
-    (void)type; // Suppress unused parameter warning
-    // Create an adjustment layer
-    addLayer("Adjustment Layer");
-    // In a full implementation, this would create a special adjustment layer
-    // For now, just create a regular layer
+    if (type == AdjustmentType::NONE || type == AdjustmentType::COUNT) return;
+    addLayer(std::string(Adjustment::getTypeName(type)) + " Adjustment");
+    // Coverage only, opaque everywhere. All uniform tiles, so it costs no pixel memory.
+    Layer& layer = *m_layers.back();
+    layer.resize(m_width, m_height);
+    layer.getPixels().fillRect({0, 0, m_width, m_height}, 0xFFFFFFFF);
+    layer.setAdjustment(Adjustment(type, 0.0f));
 }
 
 void Canvas::applyAdjustment(AdjustmentType type, float amount) {
     Layer* activeLayer = getActiveLayer();
-    if (!activeLayer || activeLayer->isLocked()) return;
-
-    SDL_Texture* texture = activeLayer->getTexture();
-    if (!texture) return;
-
-    int width, height;
-    SDL_QueryTexture(texture, nullptr, nullptr, &width, &height);
+    if (!activeLayer || activeLayer->isLocked() || !activeLayer->hasPixels()) return;
 
     #ifdef DEBUG_ADJUSTMENTS
-    printf("Adjusting %dx%d pixels (type=%d)\n", width, height, (int)type);
+    printf("Adjusting %dx%d pixels (type=%d)\n", activeLayer->getWidth(), activeLayer->getHeight(), (int)type);
     #endif
-    SDL_SetRenderTarget(m_renderer, texture);
-    SDL_Surface* surface = SDL_CreateRGBSurface(0, width, height, 32,
-        0x000000FF, 0x0000FF00, 0x00FF0000, 0xFF000000);
-
-    if (!surface) {
-        SDL_SetRenderTarget(m_renderer, nullptr);
-        return;
-    }
-
-    SDL_RenderReadPixels(m_renderer, nullptr, SDL_PIXELFORMAT_RGBA8888, surface->pixels, surface->pitch);
-    Uint32* pixels = static_cast<Uint32*>(surface->pixels);
-    int totalPixels = width * height; // cache this
 
     switch (type) {
         case AdjustmentType::CONTRAST:
             adjustContrast(amount * 255.0f);
             break;
-        case AdjustmentType::BRIGHTNESS: {
-            int brightness = static_cast<int>(amount * 255.0f);
-            // fast path for common case
-            if (brightness == 0) break;
-
-            for (int i = 0; i < totalPixels; i++) {
-                Uint8 r, g, b, a;
-                SDL_GetRGBA(pixels[i], surface->format, &r, &g, &b, &a);
-
-                // clamp is expensive, do it manually
-                int nr = r + brightness;
-                int ng = g + brightness;
-                int nb = b + brightness;
-                r = (nr > 255) ? 255 : (nr < 0) ? 0 : nr;
-                g = (ng > 255) ? 255 : (ng < 0) ? 0 : ng;
-                b = (nb > 255) ? 255 : (nb < 0) ? 0 : nb;
-
-                pixels[i] = SDL_MapRGBA(surface->format, r, g, b, a);
-            }
-            break;
-        }
-        case AdjustmentType::GAMMA: {
-            float gamma = 1.0f + amount;
-            if (gamma <= 0.1f) gamma = 0.1f;
-
-            float invGamma = 1.0f / gamma; // precalc
-            const float inv255 = 1.0f / 255.0f; // const for speed
-
-            for (int i = 0; i < totalPixels; i++) {
-                Uint8 r, g, b, a;
-                SDL_GetRGBA(pixels[i], surface->format, &r, &g, &b, &a);
-
-                // skip transparent pixels for speed
-                if (a == 0) continue;
-
-                float fr = r * inv255;
-                float fg = g * inv255;
-                float fb = b * inv255;
-
-                fr = std::pow(fr, invGamma);
-                fg = std::pow(fg, invGamma);
-                fb = std::pow(fb, invGamma);
-
-                r = static_cast<Uint8>(fr * 255.0f);
-                g = static_cast<Uint8>(fg * 255.0f);
-                b = static_cast<Uint8>(fb * 255.0f);
-
-                pixels[i] = SDL_MapRGBA(surface->format, r, g, b, a);
-            }
+        case AdjustmentType::BRIGHTNESS:
+        case AdjustmentType::GAMMA:
+            // Same thing an adjustment layer runs, at the document's depth. Nothing to do
+            // (brightness under one 8-bit step, gamma 1) comes out as an empty chain.
+            applyTones(*activeLayer, m_pixelDepth, Adjustment(type, amount).getTones());
             break;
-        }
-        case AdjustmentType::HUE_SATURATION: {
-            float hueShift = amount * 360.0f;
+        case AdjustmentType::HUE_SATURATION:
             // TODO: add saturation adjustment too
-
-            for (int i = 0; i < totalPixels; i++) {
-                Uint8 r, g, b, a;
-                SDL_GetRGBA(pixels[i], surface->format, &r, &g, &b, &a);
-
-                // RGB to HSV
-                float fr = r / 255.0f;
-                float fg = g / 255.0f;
-                float fb = b / 255.0f;
-
-                float maxVal = std::max({fr, fg, fb});
-                float minVal = std::min({fr, fg, fb});
-                float delta = maxVal - minVal;
-
-                float hue = 0, sat = 0, val = maxVal;
-
-                if (delta > 0) {
-                    sat = delta / maxVal;
-
-                    if (maxVal == fr) {
-                        hue = 60.0f * (fg - fb) / delta;
-                    } else if (maxVal == fg) {
-                        hue = 60.0f * (2.0f + (fb - fr) / delta);
-                    } else {
-                        hue = 60.0f * (4.0f + (fr - fg) / delta);
-                    }
-
-                    if (hue < 0) hue += 360.0f;
-                }
-
-                // Apply hue shift
-                hue += hueShift;
-                while (hue >= 360.0f) hue -= 360.0f;
-                while (hue < 0.0f) hue += 360.0f;
-
-                // HSV back to RGB
-                float c = val * sat;
-                float x = c * (1.0f - std::abs(std::fmod(hue / 60.0f, 2.0f) - 1.0f));
-                float m = val - c;
-
-                if (hue < 60) { fr = c; fg = x; fb = 0; }
-                else if (hue < 120) { fr = x; fg = c; fb = 0; }
-                else if (hue < 180) { fr = 0; fg = c; fb = x; }
-                else if (hue < 240) { fr = 0; fg = x; fb = c; }
-                else if (hue < 300) { fr = x; fg = 0; fb = c; }
-                else { fr = c; fg = 0; fb = x; }
-
-                r = static_cast<Uint8>((fr + m) * 255);
-                g = static_cast<Uint8>((fg + m) * 255);
-                b = static_cast<Uint8>((fb + m) * 255);
-
-                pixels[i] = SDL_MapRGBA(surface->format, r, g, b, a);
-            }
+            forEachColor(*activeLayer, m_pixelDepth, Adjustment::hueShiftOp(amount * 360.0f));
             break;
-        }
         default:
             break;
     }
-
-    // Write back to texture
-    if (type != AdjustmentType::CONTRAST) {
-        SDL_Texture* newTexture = SDL_CreateTextureFromSurface(m_renderer, surface);
-        if (newTexture) {
-            SDL_RenderCopy(m_renderer, newTexture, nullptr, nullptr);
-            SDL_DestroyTexture(newTexture);
-        }
-    }
-
-    SDL_FreeSurface(surface);
-    SDL_SetRenderTarget(m_renderer, nullptr);
 }
 
 void Canvas::applyGradientMap(SDL_Color startColor, SDL_Color endColor) {
-    // TODO: Broken since refactor - using simple tint as workaround
     Layer* activeLayer = getActiveLayer();
-    if (!activeLayer || activeLayer->isLocked()) return;
+    if (!activeLayer || activeLayer->isLocked() || !activeLayer->hasPixels()) return;
 
     // FIXED: Save undo state before applying gradient map
     Editor::getInstance().saveUndoState();
 
-    // Crude gradient hack - just tint with start color for demo
-    SDL_SetTextureColorMod(activeLayer->getTexture(), startColor.r, startColor.g, startColor.b);
-    (void)endColor; // ignore end color for now
+    // The old texture color mod hack can't work now that the texture is only a cache,
+    // so do the real thing: map luminance onto the start -> end colors.
+    const float start[3] = {startColor.r / 255.0f, startColor.g / 255.0f, startColor.b / 255.0f};
+    const float range[3] = {endColor.r / 255.0f - start[0], endColor.g / 255.0f - start[1], endColor.b / 255.0f - start[2]};
+    forEachColor(*activeLayer, m_pixelDepth, [start, range](auto& r, auto& g, auto& b) {
+        auto t = r;
+        PointOps::luminance(t, r, g, b);
+        r = start[0] + range[0] * t;
+        g = start[1] + range[1] * t;
+        b = start[2] + range[2] * t;
+    });
 }
 
 void Canvas::addMaskToLayer(int layerIndex) {
     if (layerIndex < 0 || layerIndex >= static_cast<int>(m_layers.size())) return;
 
     Layer* layer = m_layers[layerIndex].get();
-    if (!layer || !layer->getTexture()) return;
-
-    // Get layer dimensions
-    int width, height;
-    SDL_QueryTexture(layer->getTexture(), nullptr, nullptr, &width, &height);
+    if (!layer) return;
 
-    // Create empty mask (white = show everything)
-    layer->createEmptyMask(m_renderer, width, height);
+    // Create empty mask (white = show everything). Canvas sized, so it doesn't matter how much of
+    // the canvas the pixels cover right now.
+    layer->createEmptyMask(m_width, m_height);
     layer->setUseMask(true);
 }
 
@@ -1761,7 +2046,7 @@ int Canvas::findLayerAtPoint(int clickX, int clickY) {
 
         // Skip layers that can't be selected
         if (!candidateLayer || !candidateLayer->isVisible() ||
-            candidateLayer->isLocked() || !candidateLayer->getTexture()) {
+            candidateLayer->isLocked() || !candidateLayer->hasPixels()) {
             continue;
         }
 
@@ -1770,15 +2055,13 @@ int Canvas::findLayerAtPoint(int clickX, int clickY) {
         int relativeY = clickY - candidateLayer->getY();
 
         // Quick bounds check first
-        int layerW, layerH;
-        SDL_QueryTexture(candidateLayer->getTexture(), nullptr, nullptr, &layerW, &layerH);
-
-        if (relativeX < 0 || relativeX >= layerW || relativeY < 0 || relativeY >= layerH) {
+        if (relativeX < 0 || relativeX >= candidateLayer->getWidth() ||
+            relativeY < 0 || relativeY >= candidateLayer->getHeight()) {
             continue; // Click is outside this layer's bounds
         }
 
-        // Now do the expensive pixel check
-        if (hasContentAtPoint(candidateLayer->getTexture(), relativeX, relativeY)) {
+        // Pixel check straight from the tiles, no readback any more
+        if (hasContentAtPoint(candidateLayer, relativeX, relativeY)) {
             return layerIdx;
         }
     }
@@ -1822,7 +2105,7 @@ void Canvas::showTransformBox(int layerIndex) {
     if (layerIndex < 0 || layerIndex >= static_cast<int>(m_layers.size())) return;
 
     Layer* targetLayer = m_layers[layerIndex].get();
-    if (!targetLayer || !targetLayer->getTexture()) return;
+    if (!targetLayer || !targetLayer->hasPixels()) return;
 
     m_transformLayerIndex = layerIndex;
     m_transformBoxVisible = true;
@@ -1983,513 +2266,108 @@ void Canvas::applyDirectionalBlur(int angle, int distance) {
     // Motion blur in a specific direction - useful for speed effects
     Layer* activeLayer = getActiveLayer();
     if (!activeLayer || activeLayer->isLocked()) return;
+    if (distance <= 0) return;
 
-    SDL_Texture* texture = activeLayer->getTexture();
-    if (!texture) return;
-
-    // Get texture dimensions
-    int texWidth, texHeight;
-    if (SDL_QueryTexture(texture, NULL, NULL, &texWidth, &texHeight) != 0) {
-        return;
-    }
-
-    // Convert angle to radians and calculate direction vector
-    float radians = angle * M_PI / 180.0f;
-    float dx = cos(radians) * distance;
-    float dy = sin(radians) * distance;
-
-    SDL_SetRenderTarget(m_renderer, texture);
-    SDL_Surface* surface = SDL_CreateRGBSurface(0, texWidth, texHeight, 32,
-        0xFF000000, 0x00FF0000, 0x0000FF00, 0x000000FF);
-
-    if (!surface) {
-        SDL_SetRenderTarget(m_renderer, nullptr);
-        return;
-    }
-
-    // Read current pixels
-    if (SDL_RenderReadPixels(m_renderer, nullptr, SDL_PIXELFORMAT_RGBA8888, surface->pixels, surface->pitch) != 0) {
-        SDL_FreeSurface(surface);
-        SDL_SetRenderTarget(m_renderer, nullptr);
-        return;
-    }
-
-    // Create blurred surface
-    SDL_Surface* blurred = SDL_CreateRGBSurface(0, texWidth, texHeight, 32,
-        0xFF000000, 0x00FF0000, 0x0000FF00, 0x000000FF);
-
-    if (!blurred) {
-        SDL_FreeSurface(surface);
-        SDL_SetRenderTarget(m_renderer, nullptr);
-        return;
-    }
-
-    SDL_LockSurface(surface);
-    SDL_LockSurface(blurred);
-
-    Uint32* srcPixels = static_cast<Uint32*>(surface->pixels);
-    Uint32* dstPixels = static_cast<Uint32*>(blurred->pixels);
-
-    // Apply directional blur
-    for (int y = 0; y < texHeight; y++) {
-        for (int x = 0; x < texWidth; x++) {
-            int r = 0, g = 0, b = 0, a = 0, count = 0;
-
-            // Sample along the direction vector
-            for (int i = -distance; i <= distance; i++) {
-                int nx = x + (int)(dx * i / distance);
-                int ny = y + (int)(dy * i / distance);
-
-                if (nx >= 0 && nx < texWidth && ny >= 0 && ny < texHeight) {
-                    Uint32 pixel = srcPixels[ny * texWidth + nx];
-                    Uint8 pr, pg, pb, pa;
-                    SDL_GetRGBA(pixel, surface->format, &pr, &pg, &pb, &pa);
-
-                    r += pr; g += pg; b += pb; a += pa;
-                    count++;
-                }
-            }
-
-            if (count > 0) {
-                r /= count; g /= count; b /= count; a /= count;
-                dstPixels[y * texWidth + x] = SDL_MapRGBA(blurred->format, r, g, b, a);
-            }
-        }
-    }
-
-    SDL_UnlockSurface(blurred);
-    SDL_UnlockSurface(surface);
-
-    // Update texture
-    SDL_Texture* newTexture = SDL_CreateTextureFromSurface(m_renderer, blurred);
-    SDL_FreeSurface(surface);
-    SDL_FreeSurface(blurred);
-    SDL_SetRenderTarget(m_renderer, nullptr);
-
-    if (newTexture) {
-        SDL_DestroyTexture(texture);
-        activeLayer->setTexture(newTexture);
-    }
+    motionBlurLayer(*activeLayer, angle, distance);
 }
 
 void Canvas::applyShadowsHighlights(float shadows, float highlights) {
     // Separate control for shadows and highlights - more natural than brightness
     Layer* activeLayer = getActiveLayer();
-    if (!activeLayer || activeLayer->isLocked()) return;
-
-    SDL_Texture* texture = activeLayer->getTexture();
-    if (!texture) return;
-
-    int texWidth, texHeight;
-    if (SDL_QueryTexture(texture, NULL, NULL, &texWidth, &texHeight) != 0) {
-        return;
-    }
-
-    SDL_SetRenderTarget(m_renderer, texture);
-    SDL_Surface* surface = SDL_CreateRGBSurface(0, texWidth, texHeight, 32,
-        0xFF000000, 0x00FF0000, 0x0000FF00, 0x000000FF);
-
-    if (!surface) {
-        SDL_SetRenderTarget(m_renderer, nullptr);
-        return;
-    }
-
-    if (SDL_RenderReadPixels(m_renderer, nullptr, SDL_PIXELFORMAT_RGBA8888, surface->pixels, surface->pitch) != 0) {
-        SDL_FreeSurface(surface);
-        SDL_SetRenderTarget(m_renderer, nullptr);
-        return;
-    }
-
-    SDL_LockSurface(surface);
-    Uint32* pixels = static_cast<Uint32*>(surface->pixels);
-
-    for (int i = 0; i < texWidth * texHeight; i++) {
-        Uint8 r, g, b, a;
-        SDL_GetRGBA(pixels[i], surface->format, &r, &g, &b, &a);
+    if (!activeLayer || activeLayer->isLocked() || !activeLayer->hasPixels()) return;
 
-        // Calculate luminance to determine if pixel is shadow or highlight
-        float luminance = (0.299f * r + 0.587f * g + 0.114f * b) / 255.0f;
-
-        float shadowMask = 1.0f - luminance;  // More effect on dark pixels
-        float highlightMask = luminance;      // More effect on bright pixels
-
-        // Apply adjustments
-        float shadowAdj = shadows * shadowMask;
-        float highlightAdj = highlights * highlightMask;
-
-        r = std::clamp(r + (int)(shadowAdj * 255 + highlightAdj * 255), 0, 255);
-        g = std::clamp(g + (int)(shadowAdj * 255 + highlightAdj * 255), 0, 255);
-        b = std::clamp(b + (int)(shadowAdj * 255 + highlightAdj * 255), 0, 255);
-
-        pixels[i] = SDL_MapRGBA(surface->format, r, g, b, a);
-    }
-
-    SDL_UnlockSurface(surface);
-
-    SDL_Texture* newTexture = SDL_CreateTextureFromSurface(m_renderer, surface);
-    SDL_FreeSurface(surface);
-    SDL_SetRenderTarget(m_renderer, nullptr);
-
-    if (newTexture) {
-        SDL_DestroyTexture(texture);
-        activeLayer->setTexture(newTexture);
-    }
+    forEachColor(*activeLayer, m_pixelDepth, shadowsHighlightsOp(shadows, highlights));
 }
 
 void Canvas::applyColorBalance(float r, float g, float b) {
     // RGB channel balance - like the old Photoshop color balance tool
     Layer* activeLayer = getActiveLayer();
-    if (!activeLayer || activeLayer->isLocked()) return;
-
-    SDL_Texture* texture = activeLayer->getTexture();
-    if (!texture) return;
-
-    int texWidth, texHeight;
-    if (SDL_QueryTexture(texture, NULL, NULL, &texWidth, &texHeight) != 0) {
-        return;
-    }
-
-    SDL_SetRenderTarget(m_renderer, texture);
-    SDL_Surface* surface = SDL_CreateRGBSurface(0, texWidth, texHeight, 32,
-        0xFF000000, 0x00FF0000, 0x0000FF00, 0x000000FF);
-
-    if (!surface) {
-        SDL_SetRenderTarget(m_renderer, nullptr);
-        return;
-    }
-
-    if (SDL_RenderReadPixels(m_renderer, nullptr, SDL_PIXELFORMAT_RGBA8888, surface->pixels, surface->pitch) != 0) {
-        SDL_FreeSurface(surface);
-        SDL_SetRenderTarget(m_renderer, nullptr);
-        return;
-    }
-
-    SDL_LockSurface(surface);
-    Uint32* pixels = static_cast<Uint32*>(surface->pixels);
-
-    for (int i = 0; i < texWidth * texHeight; i++) {
-        Uint8 pr, pg, pb, pa;
-        SDL_GetRGBA(pixels[i], surface->format, &pr, &pg, &pb, &pa);
-
-            int nr = std::clamp(pr + (int)(r * 255), 0, 255);
-        int ng = std::clamp(pg + (int)(g * 255), 0, 255);
-        int nb = std::clamp(pb + (int)(b * 255), 0, 255);
-
-        pixels[i] = SDL_MapRGBA(surface->format, nr, ng, nb, pa);
-    }
-
-    SDL_UnlockSurface(surface);
-
-    SDL_Texture* newTexture = SDL_CreateTextureFromSurface(m_renderer, surface);
-    SDL_FreeSurface(surface);
-    SDL_SetRenderTarget(m_renderer, nullptr);
+    if (!activeLayer || activeLayer->isLocked() || !activeLayer->hasPixels()) return;
 
-    if (newTexture) {
-        SDL_DestroyTexture(texture);
-        activeLayer->setTexture(newTexture);
-    }
+    ToneChain tones;
+    tones.addColorBalance(r, g, b);
+    applyTones(*activeLayer, m_pixelDepth, tones);
 }
 
 void Canvas::applyCurves(float input, float output) {
     // Simple curve adjustment - not a full curves tool but useful enough
     Layer* activeLayer = getActiveLayer();
-    if (!activeLayer || activeLayer->isLocked()) return;
-
-    SDL_Texture* texture = activeLayer->getTexture();
-    if (!texture) return;
-
-    int texWidth, texHeight;
-    if (SDL_QueryTexture(texture, NULL, NULL, &texWidth, &texHeight) != 0) {
-        return;
-    }
-
-    SDL_SetRenderTarget(m_renderer, texture);
-    SDL_Surface* surface = SDL_CreateRGBSurface(0, texWidth, texHeight, 32,
-        0xFF000000, 0x00FF0000, 0x0000FF00, 0x000000FF);
-
-    if (!surface) {
-        SDL_SetRenderTarget(m_renderer, nullptr);
-        return;
-    }
-
-    if (SDL_RenderReadPixels(m_renderer, nullptr, SDL_PIXELFORMAT_RGBA8888, surface->pixels, surface->pitch) != 0) {
-        SDL_FreeSurface(surface);
-        SDL_SetRenderTarget(m_renderer, nullptr);
-        return;
-    }
-
-    SDL_LockSurface(surface);
-    Uint32* pixels = static_cast<Uint32*>(surface->pixels);
+    if (!activeLayer || activeLayer->isLocked() || !activeLayer->hasPixels()) return;
 
-    // Curve lookup table - precompute values for performance (see line 1234)
-    Uint8 curve[256];
-    for (int i = 0; i < 256; i++) {
-        float normalized = i / 255.0f;
-
-        float result;
-        if (normalized <= input) {
-            result = (output / input) * normalized;
-        } else {
-            result = output + ((1.0f - output) / (1.0f - input)) * (normalized - input);
-        }
-
-        curve[i] = std::clamp((int)(result * 255), 0, 255);
-    }
-
-    for (int i = 0; i < texWidth * texHeight; i++) {
-        Uint8 r, g, b, a;
-        SDL_GetRGBA(pixels[i], surface->format, &r, &g, &b, &a);
-
-        r = curve[r];
-        g = curve[g];
-        b = curve[b];
-
-        pixels[i] = SDL_MapRGBA(surface->format, r, g, b, a);
-    }
-
-    SDL_UnlockSurface(surface);
-
-    SDL_Texture* newTexture = SDL_CreateTextureFromSurface(m_renderer, surface);
-    SDL_FreeSurface(surface);
-    SDL_SetRenderTarget(m_renderer, nullptr);
-
-    if (newTexture) {
-        SDL_DestroyTexture(texture);
-        activeLayer->setTexture(newTexture);
-    }
+    ToneChain tones;
+    tones.addCurves(input, output);
+    applyTones(*activeLayer, m_pixelDepth, tones);
 }
 
 void Canvas::applyVibrance(float vibrance) {
     // Smart saturation that protects skin tones - better than regular saturation
     Layer* activeLayer = getActiveLayer();
-    if (!activeLayer || activeLayer->isLocked()) return;
-
-    SDL_Texture* texture = activeLayer->getTexture();
-    if (!texture) return;
+    if (!activeLayer || activeLayer->isLocked() || !activeLayer->hasPixels()) return;
 
-    int texWidth, texHeight;
-    if (SDL_QueryTexture(texture, NULL, NULL, &texWidth, &texHeight) != 0) {
-        return;
-    }
-
-    SDL_SetRenderTarget(m_renderer, texture);
-    SDL_Surface* surface = SDL_CreateRGBSurface(0, texWidth, texHeight, 32,
-        0xFF000000, 0x00FF0000, 0x0000FF00, 0x000000FF);
-
-    if (!surface) {
-        SDL_SetRenderTarget(m_renderer, nullptr);
-        return;
-    }
-
-    if (SDL_RenderReadPixels(m_renderer, nullptr, SDL_PIXELFORMAT_RGBA8888, surface->pixels, surface->pitch) != 0) {
-        SDL_FreeSurface(surface);
-        SDL_SetRenderTarget(m_renderer, nullptr);
-        return;
-    }
-
-    SDL_LockSurface(surface);
-    Uint32* pixels = static_cast<Uint32*>(surface->pixels);
-
-    for (int i = 0; i < texWidth * texHeight; i++) {
-        Uint8 r, g, b, a;
-        SDL_GetRGBA(pixels[i], surface->format, &r, &g, &b, &a);
-
-        // Convert to HSV for vibrance adjustment
-        float fr = r / 255.0f;
-        float fg = g / 255.0f;
-        float fb = b / 255.0f;
-
-        float max_val = std::max({fr, fg, fb});
-        float min_val = std::min({fr, fg, fb});
-        float delta = max_val - min_val;
-
-        float saturation = (max_val == 0) ? 0 : delta / max_val;
-
-        // Vibrance effect - less effect on already saturated colors
-        float saturationMask = 1.0f - saturation;
-        float adjustment = vibrance * saturationMask;
-
-        // Apply adjustment (simplified)
-        float mid = (fr + fg + fb) / 3.0f;
-        fr = std::clamp(mid + (fr - mid) * (1.0f + adjustment), 0.0f, 1.0f);
-        fg = std::clamp(mid + (fg - mid) * (1.0f + adjustment), 0.0f, 1.0f);
-        fb = std::clamp(mid + (fb - mid) * (1.0f + adjustment), 0.0f, 1.0f);
-
-        pixels[i] = SDL_MapRGBA(surface->format,
-            (Uint8)(fr * 255), (Uint8)(fg * 255), (Uint8)(fb * 255), a);
-    }
-
-    SDL_UnlockSurface(surface);
-
-    SDL_Texture* newTexture = SDL_CreateTextureFromSurface(m_renderer, surface);
-    SDL_FreeSurface(surface);
-    SDL_SetRenderTarget(m_renderer, nullptr);
-
-    if (newTexture) {
-        SDL_DestroyTexture(texture);
-        activeLayer->setTexture(newTexture);
-    }
+    forEachColor(*activeLayer, m_pixelDepth, vibranceOp(vibrance));
 }
 
 void Canvas::applyTransform() {
     if (m_transformLayerIndex < 0 || m_transformLayerIndex >= static_cast<int>(m_layers.size())) return;
 
     Layer* layer = m_layers[m_transformLayerIndex].get();
-    if (!layer || !layer->getTexture()) return;
-
-    SDL_Texture* originalTexture = layer->getTexture();
-
-    // Get original texture dimensions
-    int originalWidth, originalHeight;
-    SDL_QueryTexture(originalTexture, nullptr, nullptr, &originalWidth, &originalHeight);
-
-    // Calculate position change (simple move)
-    // TODO: might need deltaX/deltaY for more complex transforms later
-    // int deltaX = m_transformRect.x - layer->getX();
-    // int deltaY = m_transformRect.y - layer->getY();
-
-    // Update layer position
-    layer->setPosition(m_transformRect.x, m_transformRect.y);
+    if (!layer || !layer->hasPixels()) return;
 
-    // If no size change, just update position (simple move)
-    if (m_transformRect.w == originalWidth && m_transformRect.h == originalHeight) {
-        updateTransformRect();
+    // The box started out around the content, whatever is in there now goes to the new box
+    SDL_Rect source = calculateLayerBounds(layer);
+    if (source.x == m_transformRect.x && source.y == m_transformRect.y &&
+        source.w == m_transformRect.w && source.h == m_transformRect.h) {
         return;
     }
 
-    SDL_Texture* newTexture = SDL_CreateTexture(m_renderer, SDL_PIXELFORMAT_RGBA8888,
-                                               SDL_TEXTUREACCESS_TARGET,
-                                               m_transformRect.w, m_transformRect.h);
-
-    if (!newTexture) {
-        // Fallback to just updating rect if texture creation fails
+    // Same size is just a move, no resampling
+    if (m_transformRect.w == source.w && m_transformRect.h == source.h) {
+        layer->moveBy(m_transformRect.x - source.x, m_transformRect.y - source.y);
         updateTransformRect();
         return;
     }
 
-    SDL_Texture* originalTarget = SDL_GetRenderTarget(m_renderer);
-    SDL_SetRenderTarget(m_renderer, newTexture);
-
-    SDL_SetRenderDrawColor(m_renderer, 0, 0, 0, 0);
-    SDL_RenderClear(m_renderer);
-
-    // Render original texture scaled to new size
-    SDL_Rect destRect = {0, 0, m_transformRect.w, m_transformRect.h};
-    SDL_RenderCopy(m_renderer, originalTexture, nullptr, &destRect);
-
-    SDL_SetRenderTarget(m_renderer, originalTarget);
-
-    // Set texture properties
-    SDL_SetTextureBlendMode(newTexture, SDL_BLENDMODE_BLEND);
-
-    // Replace the layer's texture with the transformed one
-    layer->setTexture(newTexture);
+    // Resample only the boxed part, the layer becomes exactly the new box
+    SDL_Rect local = {source.x - layer->getX(), source.y - layer->getY(), source.w, source.h};
+    layer->setPixels(layer->getPixels().extract(local).scaled(m_transformRect.w, m_transformRect.h));
+    layer->setPosition(m_transformRect.x, m_transformRect.y);
 
     // Update transform rect to match new layer bounds
     updateTransformRect();
 }
 
-bool Canvas::hasContentAtPoint(SDL_Texture* texture, int x, int y) {
-    if (!texture) return false;
+bool Canvas::hasContentAtPoint(Layer* layer, int x, int y) {
+    if (!layer) return false;
 
-    // Get texture dimensions
-    int textureW, textureH;
-    SDL_QueryTexture(texture, nullptr, nullptr, &textureW, &textureH);
-
-    // Basic bounds check first - no point in doing expensive pixel reads if we're outside
-    if (x < 0 || x >= textureW || y < 0 || y >= textureH) {
+    // Basic bounds check first
+    if (x < 0 || x >= layer->getWidth() || y < 0 || y >= layer->getHeight()) {
         return false;
     }
 
-    // Actually check the pixel at this point - took me a while to get this right
-    // Create a small 1x1 surface to read just the pixel we care about
-    SDL_Surface* pixelSurface = SDL_CreateRGBSurface(0, 1, 1, 32,
-        0xFF000000, 0x00FF0000, 0x0000FF00, 0x000000FF);
-
-    if (!pixelSurface) {
-        // Fallback to bounds-only check if surface creation fails
-        return true;
-    }
-
-    // Set texture as render target and read the specific pixel
-    SDL_Texture* originalTarget = SDL_GetRenderTarget(m_renderer);
-    SDL_SetRenderTarget(m_renderer, texture);
-
-    SDL_Rect sourcePixel = {x, y, 1, 1};
-    bool hasActualContent = false;
-
-    if (SDL_RenderReadPixels(m_renderer, &sourcePixel, SDL_PIXELFORMAT_RGBA8888,
-                           pixelSurface->pixels, pixelSurface->pitch) == 0) {
-
-        SDL_LockSurface(pixelSurface);
-        Uint32* pixelData = static_cast<Uint32*>(pixelSurface->pixels);
-
-        Uint8 r, g, b, alpha;
-        SDL_GetRGBA(pixelData[0], pixelSurface->format, &r, &g, &b, &alpha);
-
-        // Consider anything with alpha > 10 as "content" - completely transparent stuff doesn't count
-        // The threshold of 10 is arbitrary but works well in practice
-        hasActualContent = (alpha > 10);
-
-        SDL_UnlockSurface(pixelSurface);
-    } else {
-        // If pixel reading fails, assume there's content (safer than assuming empty)
-        hasActualContent = true;
-    }
-
-    SDL_SetRenderTarget(m_renderer, originalTarget);
-    SDL_FreeSurface(pixelSurface);
-
-    return hasActualContent;
+    // Consider anything with alpha > 10 as "content" - completely transparent stuff doesn't count
+    // The threshold of 10 is arbitrary but works well in practice
+    return TileBuffer::alphaOf(layer->getPixels().getPixel(x, y)) > 10;
 }
 
 SDL_Rect Canvas::calculateLayerBounds(Layer* layer) {
-    if (!layer || !layer->getTexture()) {
+    if (!layer || !layer->hasPixels()) {
         return {0, 0, 100, 100}; // Reasonable fallback dimensions
     }
 
-    int layerWidth, layerHeight;
-    SDL_QueryTexture(layer->getTexture(), nullptr, nullptr, &layerWidth, &layerHeight);
-
-    // Try to find the actual content bounds by scanning for non-transparent pixels
-    // This is expensive but gives much better selection behavior
-    SDL_Texture* layerTexture = layer->getTexture();
-    int minX = layerWidth, maxX = 0, minY = layerHeight, maxY = 0;
-    bool foundAnyContent = false;
-
-    // Sample every few pixels instead of every single one - good enough and much faster
-    int sampleStep = std::max(1, std::min(layerWidth, layerHeight) / 20); // adaptive sampling
-
-    for (int checkY = 0; checkY < layerHeight; checkY += sampleStep) {
-        for (int checkX = 0; checkX < layerWidth; checkX += sampleStep) {
-            if (hasContentAtPoint(layerTexture, checkX, checkY)) {
-                foundAnyContent = true;
-                minX = std::min(minX, checkX);
-                maxX = std::max(maxX, checkX);
-                minY = std::min(minY, checkY);
-                maxY = std::max(maxY, checkY);
-            }
-        }
-    }
-
-    if (!foundAnyContent) {
-        // No content found, return full texture bounds
-        return {layer->getX(), layer->getY(), layerWidth, layerHeight};
+    // The layer keeps its own content box up to date tile by tile, no scanning here any more
+    SDL_Rect content = layer->getContentBounds();
+    if (content.w <= 0 || content.h <= 0) {
+        // No content found, return full layer bounds
+        return layer->getBounds();
     }
 
     // Add small padding around the content bounds - makes selection feel more natural
     int contentPadding = 5;
-    minX = std::max(0, minX - contentPadding);
-    minY = std::max(0, minY - contentPadding);
-    maxX = std::min(layerWidth - 1, maxX + contentPadding);
-    maxY = std::min(layerHeight - 1, maxY + contentPadding);
-
-    return {
-        layer->getX() + minX,
-        layer->getY() + minY,
-        maxX - minX + 1,
-        maxY - minY + 1
-    };
+    SDL_Rect padded = {content.x - contentPadding, content.y - contentPadding,
+                       content.w + contentPadding * 2, content.h + contentPadding * 2};
+    SDL_Rect bounds = layer->getBounds();
+    SDL_IntersectRect(&padded, &bounds, &padded);
+    return padded;
 }
 
 int Canvas::getTransformHandleAtPoint(int x, int y) {
@@ -2537,10 +2415,7 @@ void Canvas::deselectAll() {
     // Clear old selection system
     m_hasSelection = false;
     m_selectionRect = {0, 0, 0, 0};
-    if (m_selectionTexture) {
-        SDL_DestroyTexture(m_selectionTexture);
-        m_selectionTexture = nullptr;
-    }
+    clearSelectionBuffer();
 
     // Deselect all layers
     for (auto& layer : m_layers) {
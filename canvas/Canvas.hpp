@@ -1,24 +1,22 @@
 #pragma once
 #include <SDL2/SDL.h>
 #include <SDL2/SDL_ttf.h>
+#include "TileBuffer.hpp"
+#include "DeepBuffer.hpp"
+#include "BlurEngine.hpp"
+#include "Adjustment.hpp"
 #include <vector>
 #include <string>
 #include <map>
 #include <memory>
+#include <atomic>
 
 class Layer;
+class ToneChain;
 struct TextState;
 class Tool;
 class Editor;
 
-enum class AdjustmentType {
-    NONE,
-    BRIGHTNESS,
-    CONTRAST,
-    HUE_SATURATION,
-    GAMMA
-};
-
 class Canvas {
 public:
     static Canvas& getInstance();
@@ -27,7 +25,7 @@ public:
     void render();
     
     // Canvas management
-    void setupNewCanvas(int width, int height);
+    void setupNewCanvas(int width, int height, PixelDepth depth = PixelDepth::RGBA8);
     void resizeCanvas(int newWidth, int newHeight);
     bool handleResizeEvent(const SDL_Event& event, const SDL_Point& mousePos);
     void applyInteractiveResize();
@@ -37,21 +35,63 @@ public:
     void addLayer(const std::string& name = "New Layer", bool isTextLayer = false);
     void duplicateLayer(int index);
     void removeLayer(int index);
-    void moveLayer(int fromIndex, int toIndex);
+    void moveLayer(int fromIndex, int toIndex); // a group moves with everything in it
     void renameLayer(int index, const std::string& newName);
-    void createLayerTexture(Layer& layer);
+    void createLayerTexture(Layer& layer); // Sizes the layer's tile store to the canvas, texture is created lazily
+    
+    // Groups. A group and everything in it is one contiguous block of m_layers with the group on
+    // top, so flat indices keep working for everything that doesn't care about groups.
+    void groupLayer(int index);   // puts the layer (or group) into a new group in its place
+    void ungroupLayer(int index); // children go to the group's parent, the group goes away
+    void moveIntoGroup(int index, int groupIndex); // ends up as the group's top child
+    int getBlockStart(int index) const; // lowest index of the layer's block, itself unless it's a group
     
     // File operations
     void importImage(const char* filePath);
     void exportImage(const char* filePath, const char* format);
     
+    // Bits per channel colour adjustments work at. The layers' 8-bit tiles stay what gets painted,
+    // shown and exported, in a deep document they're the rounded copy of each layer's DeepBuffer.
+    PixelDepth getPixelDepth() const { return m_pixelDepth; }
+    void setPixelDepth(PixelDepth depth);
+    // Runs curves -> shadows/highlights -> vibrance on a copy of the active layer at every depth
+    // and measures time and memory per mode
+    struct DepthBenchmark {
+        double ms[static_cast<int>(PixelDepth::COUNT)] = {};
+        double megapixelsPerSecond[static_cast<int>(PixelDepth::COUNT)] = {};
+        size_t residentBytes[static_cast<int>(PixelDepth::COUNT)] = {};
+        int pixels = 0;
+    };
+    DepthBenchmark benchmarkPixelDepths(int runs = 3);
+    // Runs curves -> vibrance -> sharpen -> motion blur on a copy of the active layer with 1, 2,
+    // 4, 8 and 16 threads and times each. Puts the thread count back afterwards.
+    struct FilterBenchmark {
+        static constexpr int STEPS = 5;
+        int threads[STEPS] = {};
+        double ms[STEPS] = {};
+        double speedup[STEPS] = {};
+        int pixels = 0;
+    };
+    FilterBenchmark benchmarkFilterPipeline(int runs = 3);
+    // Brightness -> contrast -> gamma -> curves -> colour balance on a copy of the active layer,
+    // fused into one pass and as five separate ones, plus the first step alone
+    struct ToneBenchmark {
+        double singleStepMs = 0.0;
+        double fusedMs = 0.0;
+        double separateMs = 0.0;
+        int pixels = 0;
+    };
+    ToneBenchmark benchmarkToneChain(int runs = 3);
+    
     // Image manipulations
     void cropImage();
     void rotateImage(int angle);
     void flipHorizontal(bool wholeCanvas = false);
     void flipVertical(bool wholeCanvas = false);
     void applyGrayscale();
-    void applyBlur(int strength);
+    // Radius in pixels, anything up to MAX_BLUR_RADIUS costs the same per pixel
+    static constexpr int MAX_BLUR_RADIUS = 1000;
+    void applyBlur(int radius, BlurMode mode = BlurMode::BOX);
     void applySharpen(int strength = 2);
     void adjustContrast(float contrast);
     void applyFilter(int filterType);
@@ -61,6 +101,12 @@ public:
     void applyColorBalance(float r, float g, float b); // RGB channel balance
     void applyCurves(float input, float output); // Simple curve adjustment
     void applyVibrance(float vibrance); // Smart saturation enhancement
+    // Any number of brightness/contrast/gamma/curves/colour balance steps as one pass and one undo
+    // step. The single adjustments above go through the same path with a chain of one.
+    void applyToneChain(const ToneChain& tones);
+    // A layer that runs the adjustment over everything under it (in its group) while compositing,
+    // nothing gets baked in. Starts out covering the canvas at amount 0, change it with
+    // Layer::setAdjustment and only the composite gets redone. See Layer::isAdjustment.
     void addAdjustmentLayer(AdjustmentType type);
     void applyAdjustment(AdjustmentType type, float amount);
     void applyGradientMap(SDL_Color startColor, SDL_Color endColor);
@@ -89,13 +135,68 @@ public:
     const std::vector<std::unique_ptr<Layer>>& getLayers() const { return m_layers; }
     SDL_Texture* getCanvasBuffer() const { return m_canvasBuffer; }
     
+    // View. The document is shown at m_viewZoom with its top left corner at m_viewOrigin (window
+    // pixels), inside the area the UI leaves for it. Only tiles in view get composited/uploaded.
+    void setViewportArea(const SDL_Rect& area);
+    SDL_Rect getViewportArea() const { return m_viewportArea; }
+    float getZoom() const { return m_viewZoom; }
+    void setZoom(float zoom, float anchorX, float anchorY); // keeps the canvas point under the anchor still
+    void zoomBy(float factor, float anchorX, float anchorY) { setZoom(m_viewZoom * factor, anchorX, anchorY); }
+    void zoomBy(float factor); // around the middle of the view
+    void panBy(float dx, float dy);
+    void fitToView();
+    void resetView(); // 100%, centred
+    void centerViewOn(float canvasX, float canvasY);
+    SDL_FPoint screenToCanvas(float x, float y) const;
+    SDL_FPoint canvasToScreen(float x, float y) const;
+    SDL_Point getMouseCanvasPos() const;
+    SDL_Rect getVisibleCanvasRect() const;
+    // Copy of a mouse event with its coordinates moved into canvas space, other events untouched
+    SDL_Event toCanvasEvent(const SDL_Event& event) const;
+    // Wheel zoom/pan, middle mouse drag and the zoom shortcuts. True if it ate the event.
+    bool handleViewEvent(const SDL_Event& event);
+    
+    // Compositing. Layers report their own changes, these are for things the layers can't see
+    // (a layer getting removed or reordered). Damaged tiles get recomposited on the next render.
+    void damageRect(const SDL_Rect& rect);
+    void damageAll();
+    // Blends one layer (opacity, blend mode, ...) into target inside clip. Everything that
+    // flattens layers uses this, so screen, merge and export can't come out different.
+    void compositeLayer(TileBuffer& target, const Layer& layer, const SDL_Rect& clip) const;
+    // Every layer into target (minus `skip`), for export and merge. Tiles of target are
+    // independent, so they're spread over the thread pool. Comes out bit for bit the same
+    // whatever the thread count.
+    void compositeAll(TileBuffer& target, const Layer* skip = nullptr);
+    // Same thing at 1/2^level size from the layers' mip pyramids, for zoomed out views and the
+    // navigator. clip is in level coordinates. Doesn't touch full size pixels at all.
+    void compositeLevel(TileBuffer& target, int level, const SDL_Rect& clip);
+    // Flattens the document single threaded and on the pool and times both
+    struct CompositorBenchmark {
+        int threads = 1;
+        double serialMs = 0.0;
+        double parallelMs = 0.0;
+        bool identical = true;
+    };
+    CompositorBenchmark benchmarkCompositor(int runs = 3);
+    // Per (layer, tile) blends done and skipped by culling in the last update that recomposited
+    // anything, for the performance panel
+    int getLayersBlended() const { return m_statsBlended; }
+    int getLayersCulled() const { return m_statsCulled; }
+    // Goes up whenever any layer changed, for things that keep their own copy of the picture
+    Uint64 getContentVersion() const { return m_contentVersion; }
+    
     // Selection management
     SDL_Rect getSelectionRect() const { return m_selectionRect; }
     void setSelectionRect(SDL_Rect rect) { m_selectionRect = rect; }
     bool hasSelection() const { return m_hasSelection; }
     void setHasSelection(bool has) { m_hasSelection = has; }
-    SDL_Texture* getSelectionTexture() const { return m_selectionTexture; }
-    void setSelectionTexture(SDL_Texture* texture) { m_selectionTexture = texture; }
+    // Clipboard for copy/paste. It's a copy-on-write snapshot of the whole source layer plus the
+    // rect that was copied, so copying is free and nothing gets duplicated until someone paints.
+    const TileBuffer& getSelectionBuffer() const { return m_selectionBuffer; }
+    SDL_Rect getSelectionBufferRect() const { return m_selectionBufferRect; }
+    void setSelectionBuffer(TileBuffer buffer, SDL_Rect rect) { m_selectionBuffer = std::move(buffer); m_selectionBufferRect = rect; }
+    bool hasSelectionBuffer() const { return !m_selectionBuffer.isEmpty() && m_selectionBufferRect.w > 0 && m_selectionBufferRect.h > 0; }
+    void clearSelectionBuffer() { m_selectionBuffer = TileBuffer(); m_selectionBufferRect = {0, 0, 0, 0}; }
     
     // Transform box state
     bool isTransformBoxVisible() const { return m_transformBoxVisible; }
@@ -109,9 +210,71 @@ private:
     Canvas& operator=(const Canvas&) = delete;
     
     SDL_Renderer* m_renderer = nullptr;
-    SDL_Texture* m_canvasBuffer = nullptr;
+    SDL_Texture* m_canvasBuffer = nullptr; // streaming, mirrors m_composite
+    
+    // Flattened image of all layers on the white background. Only damaged tiles get
+    // recomposited, and only its dirty tiles get uploaded to m_canvasBuffer.
+    TileBuffer m_composite;
+    // Everything under the active layer (on white) and everything over it (on transparent), so a
+    // damaged tile is below + active layer + above no matter how many layers there are. They are
+    // only rebuilt where a layer in their range changed or when the active layer changes.
+    TileBuffer m_belowCache;
+    TileBuffer m_aboveCache;
+    const Layer* m_cachedActiveLayer = nullptr;
+    int m_cachedActiveIndex = -1;
+    enum TileState : Uint8 { TILE_DAMAGED = 1 << 0, BELOW_STALE = 1 << 1, ABOVE_STALE = 1 << 2, TILE_ALL = 0x7 };
+    std::vector<Uint8> m_tileState; // TileState bits per composite tile
+    void markTiles(const SDL_Rect& rect, Uint8 state);
+    void updateComposite(const SDL_Rect& visible);
+    void uploadTiles(TileBuffer& buffer, SDL_Texture*& texture, const SDL_Rect& visible);
+    Uint64 m_contentVersion = 0;
+    
+    // Below 50% the screen shows a 1/2^level composite built from the layer pyramids instead
+    // (no below/above caches, it's small enough not to need them). Damage is tracked for it
+    // separately so zooming in and out doesn't redo either one from scratch.
+    static constexpr int MAX_DISPLAY_LEVEL = 5;
+    int getDisplayLevel() const;
+    TileBuffer m_levelComposite;
+    int m_levelCompositeLevel = 0;
+    std::vector<Uint8> m_levelDamaged; // per m_levelComposite tile
+    SDL_Texture* m_levelTexture = nullptr;
+    void markLevelDamage(const SDL_Rect& rect);
+    void updateLevelComposite(int level, const SDL_Rect& visible);
+    void compositeLevelTile(TileBuffer& target, int level, const SDL_Rect& clip) const;
+    // Lowest layer in [begin, end) that can still show in rect: the topmost one that occludes
+    // it, or begin if none does. Everything under that is skipped.
+    // Only layers directly in `scope` count (nullptr is the top level).
+    int firstVisibleLayer(const SDL_Rect& rect, int begin, int end, int level = 0, const Layer* scope = nullptr) const;
+    // compositeLayer for every layer in [begin, end) directly in scope, except skip
+    void compositeRange(TileBuffer& target, int begin, int end, const SDL_Rect& clip,
+                        const Layer* scope = nullptr, const Layer* skip = nullptr) const;
+    // Rebuilds the stale tiles of every group from its children, bottom up, and hands the
+    // children's damage to their groups. Only top level layers report to the canvas itself.
+    void updateGroups();
+    void rebuildGroup(int index);
+    int getRootIndex(int index) const; // the top level layer/group index is in
+    int indexOf(const Layer* layer) const;
+    void moveBlock(int index, int before, Layer* parent);
+    void damageLayerArea(Layer* parent, const SDL_Rect& rect); // the group's cache, or the canvas
+    mutable std::atomic<int> m_blendCounter{0};
+    mutable std::atomic<int> m_cullCounter{0};
+    int m_statsBlended = 0;
+    int m_statsCulled = 0;
+    
+    // View state, see setViewportArea
+    SDL_Rect m_viewportArea = {0, 0, 0, 0};
+    float m_viewZoom = 1.0f;
+    SDL_FPoint m_viewOrigin = {0.0f, 0.0f};
+    bool m_viewTouched = false; // until the user zooms/pans the canvas sits at the top left at 100%
+    bool m_isPanning = false;
+    static constexpr float MIN_ZOOM = 0.02f;
+    static constexpr float MAX_ZOOM = 64.0f;
+    SDL_FPoint snappedOrigin() const;
+    void beginCanvasSpace(); // overlays draw in canvas coordinates between these two
+    void endCanvasSpace();
     int m_width = 1280;
     int m_height = 720;
+    PixelDepth m_pixelDepth = PixelDepth::RGBA8;
     
     // Layers
     std::vector<std::unique_ptr<Layer>> m_layers;
@@ -126,15 +289,18 @@ private:
     bool m_filterInProgress = false;
     
     // See impl file for explanation as to why we need this.
-    SDL_Texture* m_filterBuffer = nullptr;
-    void createFilterBuffer();
+    std::vector<Uint32> m_filterBuffer;
+    int m_filterWidth = 0;
+    int m_filterHeight = 0;
+    void createFilterBuffer(int halo = 0);
     void applyFilterBuffer();
     void cleanupFilterBuffer();
     
     // Selection state
     SDL_Rect m_selectionRect = {0, 0, 0, 0};
     bool m_hasSelection = false;
-    SDL_Texture* m_selectionTexture = nullptr;
+    TileBuffer m_selectionBuffer;
+    SDL_Rect m_selectionBufferRect = {0, 0, 0, 0};
     
     // Transform box state for smart object selection
     bool m_transformBoxVisible = false;
@@ -151,11 +317,9 @@ private:
     int m_resizeCorner = -1;
     static constexpr int HANDLE_SIZE = 8;
     
-    SDL_Surface* resizeImage(SDL_Surface* src, int newWidth, int newHeight);
-    
     void flipLayerHorizontal(Layer* layer);
     void flipLayerVertical(Layer* layer);
-    bool hasContentAtPoint(SDL_Texture* texture, int x, int y);
+    bool hasContentAtPoint(Layer* layer, int x, int y);
     SDL_Rect calculateLayerBounds(Layer* layer);
     int getTransformHandleAtPoint(int x, int y); // Returns handle index or -1
     void updateTransformRect(); // Update transform box based on layer content
@@ -0,0 +1,471 @@
+#include "DeepBuffer.hpp"
+#include <algorithm>
+#include <cstring>
+
+// Same trick as the blend engine: per-function target attributes, no per-file flags
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#define DEEP_HAS_X86 1
+#include <immintrin.h>
+#define DEEP_SSE2 __attribute__((target("sse2")))
+#define DEEP_F16C __attribute__((target("sse2,f16c")))
+#endif
+
+using Pixel = DeepBuffer::Pixel;
+
+// ---------------------------------------------------------------------------------------------
+// Half floats. Round to nearest even like F16C, including the denormals, so the scalar path
+// gives the same bits.
+
+static Uint32 floatBits(float f) {
+    Uint32 bits;
+    std::memcpy(&bits, &f, sizeof(bits));
+    return bits;
+}
+
+static float bitsFloat(Uint32 bits) {
+    float f;
+    std::memcpy(&f, &bits, sizeof(f));
+    return f;
+}
+
+static Uint16 floatToHalf(float value) {
+    Uint32 f = floatBits(value);
+    Uint32 sign = (f >> 16) & 0x8000;
+    f &= 0x7FFFFFFF;
+    Uint32 half;
+    if (f >= (127u + 16) << 23) {
+        half = f > 0x7F800000u ? 0x7E00 : 0x7C00; // NaN or too big
+    } else if (f < (127u - 14) << 23) {
+        // Denormal: let the FPU do the rounding by adding a number whose ulp is the half's ulp
+        const Uint32 magic = ((127u - 15) + (23 - 10) + 1) << 23;
+        half = floatBits(bitsFloat(f) + bitsFloat(magic)) - magic;
+    } else {
+        Uint32 odd = (f >> 13) & 1;
+        f += (static_cast<Uint32>(15 - 127) << 23) + 0xFFF + odd;
+        half = f >> 13;
+    }
+    return static_cast<Uint16>(half | sign);
+}
+
+static float halfToFloat(Uint16 h) {
+    Uint32 bits = static_cast<Uint32>(h & 0x7FFF) << 13;
+    Uint32 exponent = bits & (0x7C00u << 13);
+    bits += (127u - 15) << 23;
+    if (exponent == 0x7C00u << 13) {
+        bits += (128u - 16) << 23; // Inf/NaN
+    } else if (exponent == 0) {
+        bits += 1u << 23; // denormal, renormalise
+        bits = floatBits(bitsFloat(bits) - bitsFloat(113u << 23));
+    }
+    return bitsFloat(bits | (static_cast<Uint32>(h & 0x8000) << 16));
+}
+
+static constexpr float INV_255 = 1.0f / 255.0f;
+static constexpr float INV_65535 = 1.0f / 65535.0f;
+static constexpr float HALF_MAX = 65504.0f;
+
+// Half of every 8-bit value, c / 255
+static const Uint16* byteToHalf() {
+    static Uint16 table[256];
+    static bool built = [] {
+        for (int c = 0; c < 256; c++) table[c] = floatToHalf(c * INV_255);
+        return true;
+    }();
+    (void)built;
+    return table;
+}
+
+static Uint16 lane(Pixel p, int i) { return static_cast<Uint16>(p >> (i * 16)); }
+
+// ---------------------------------------------------------------------------------------------
+// Scalar. The reference, the SIMD versions below have to match it exactly.
+
+static void widen16Scalar(const Uint32* in, Pixel* out, int count) {
+    for (int i = 0; i < count; i++) {
+        Pixel p = 0;
+        for (int c = 0; c < 4; c++) p |= static_cast<Pixel>(((in[i] >> (c * 8)) & 0xFF) * 257) << (c * 16);
+        out[i] = p;
+    }
+}
+
+static void widen16FScalar(const Uint32* in, Pixel* out, int count) {
+    const Uint16* table = byteToHalf();
+    for (int i = 0; i < count; i++) {
+        Pixel p = 0;
+        for (int c = 0; c < 4; c++) p |= static_cast<Pixel>(table[(in[i] >> (c * 8)) & 0xFF]) << (c * 16);
+        out[i] = p;
+    }
+}
+
+// round(v / 257) is (x - (x >> 8)) >> 8 with x = v + 128, saturated at 65535
+static Uint32 narrow16(Uint32 v) {
+    Uint32 x = std::min(v + 128, 65535u);
+    return (x - (x >> 8)) >> 8;
+}
+
+static void narrow16Scalar(const Pixel* in, Uint32* out, int count) {
+    for (int i = 0; i < count; i++) {
+        Uint32 a = lane(in[i], 0);
+        Uint32 p = narrow16(a);
+        for (int c = 1; c < 4; c++) p |= narrow16(std::min<Uint32>(lane(in[i], c), a)) << (c * 8);
+        out[i] = p;
+    }
+}
+
+static Uint32 narrowFloat(float c) {
+    return static_cast<Uint32>(c * 255.0f + 0.5f);
+}
+
+static void narrow16FScalar(const Pixel* in, Uint32* out, int count) {
+    for (int i = 0; i < count; i++) {
+        float a = std::min(std::max(halfToFloat(lane(in[i], 0)), 0.0f), 1.0f);
+        Uint32 p = narrowFloat(a);
+        for (int c = 1; c < 4; c++) {
+            p |= narrowFloat(std::min(std::max(halfToFloat(lane(in[i], c)), 0.0f), a)) << (c * 8);
+        }
+        out[i] = p;
+    }
+}
+
+static void load16Scalar(const Pixel* in, float* out, int count) {
+    for (int i = 0; i < count; i++) {
+        for (int c = 0; c < 4; c++) out[i * 4 + c] = lane(in[i], c) * INV_65535;
+    }
+}
+
+static void load16FScalar(const Pixel* in, float* out, int count) {
+    for (int i = 0; i < count; i++) {
+        for (int c = 0; c < 4; c++) out[i * 4 + c] = halfToFloat(lane(in[i], c));
+    }
+}
+
+static void store16Scalar(const float* in, Pixel* out, int count) {
+    for (int i = 0; i < count; i++) {
+        Pixel p = 0;
+        for (int c = 0; c < 4; c++) {
+            float v = std::min(std::max(in[i * 4 + c], 0.0f), 1.0f);
+            p |= static_cast<Pixel>(static_cast<Uint32>(v * 65535.0f + 0.5f)) << (c * 16);
+        }
+        out[i] = p;
+    }
+}
+
+static void store16FScalar(const float* in, Pixel* out, int count) {
+    for (int i = 0; i < count; i++) {
+        Pixel p = 0;
+        for (int c = 0; c < 4; c++) {
+            p |= static_cast<Pixel>(floatToHalf(std::min(std::max(in[i * 4 + c], 0.0f), HALF_MAX))) << (c * 16);
+        }
+        out[i] = p;
+    }
+}
+
+// ---------------------------------------------------------------------------------------------
+// SSE2 for 16-bit integer, F16C for half float. Leftovers at the end of a row go scalar.
+
+#ifdef DEEP_HAS_X86
+DEEP_SSE2 static void widen16SSE2(const Uint32* in, Pixel* out, int count) {
+    int i = 0;
+    for (; i + 4 <= count; i += 4) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i));
+        // A byte next to itself is c * 257
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), _mm_unpacklo_epi8(v, v));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i + 2), _mm_unpackhi_epi8(v, v));
+    }
+    widen16Scalar(in + i, out + i, count - i);
+}
+
+DEEP_SSE2 static inline __m128i narrow16Pair(__m128i v) {
+    // Every lane of a pixel gets its alpha, colour = min(colour, alpha). No unsigned 16-bit min
+    // in SSE2, but a - sat(a - b) is the same thing.
+    __m128i alpha = _mm_shufflehi_epi16(_mm_shufflelo_epi16(v, 0), 0);
+    v = _mm_sub_epi16(v, _mm_subs_epu16(v, alpha));
+    __m128i x = _mm_adds_epu16(v, _mm_set1_epi16(128));
+    return _mm_srli_epi16(_mm_sub_epi16(x, _mm_srli_epi16(x, 8)), 8);
+}
+
+DEEP_SSE2 static void narrow16SSE2(const Pixel* in, Uint32* out, int count) {
+    int i = 0;
+    for (; i + 4 <= count; i += 4) {
+        __m128i lo = narrow16Pair(_mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i)));
+        __m128i hi = narrow16Pair(_mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i + 2)));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), _mm_packus_epi16(lo, hi));
+    }
+    narrow16Scalar(in + i, out + i, count - i);
+}
+
+DEEP_SSE2 static void load16SSE2(const Pixel* in, float* out, int count) {
+    const __m128 scale = _mm_set1_ps(INV_65535);
+    const __m128i zero = _mm_setzero_si128();
+    int i = 0;
+    for (; i + 2 <= count; i += 2) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i));
+        _mm_storeu_ps(out + i * 4, _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpacklo_epi16(v, zero)), scale));
+        _mm_storeu_ps(out + i * 4 + 4, _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpackhi_epi16(v, zero)), scale));
+    }
+    load16Scalar(in + i, out + i * 4, count - i);
+}
+
+DEEP_SSE2 static inline __m128i store16Quad(__m128 v) {
+    v = _mm_min_ps(_mm_max_ps(v, _mm_setzero_ps()), _mm_set1_ps(1.0f));
+    __m128i x = _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(v, _mm_set1_ps(65535.0f)), _mm_set1_ps(0.5f)));
+    // No unsigned pack in SSE2: shift into signed range, pack, shift back
+    return _mm_sub_epi32(x, _mm_set1_epi32(32768));
+}
+
+DEEP_SSE2 static void store16SSE2(const float* in, Pixel* out, int count) {
+    int i = 0;
+    for (; i + 2 <= count; i += 2) {
+        __m128i lo = store16Quad(_mm_loadu_ps(in + i * 4));
+        __m128i hi = store16Quad(_mm_loadu_ps(in + i * 4 + 4));
+        __m128i packed = _mm_xor_si128(_mm_packs_epi32(lo, hi), _mm_set1_epi16(static_cast<short>(0x8000)));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), packed);
+    }
+    store16Scalar(in + i * 4, out + i, count - i);
+}
+
+DEEP_F16C static void widen16FF16C(const Uint32* in, Pixel* out, int count) {
+    const __m128 scale = _mm_set1_ps(INV_255);
+    const __m128i zero = _mm_setzero_si128();
+    int i = 0;
+    for (; i + 4 <= count; i += 4) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i));
+        __m128i lo = _mm_unpacklo_epi8(v, zero);
+        __m128i hi = _mm_unpackhi_epi8(v, zero);
+        __m128i h0 = _mm_cvtps_ph(_mm_mul_ps(_mm_cvtepi32_ps(_mm_unpacklo_epi16(lo, zero)), scale), 0);
+        __m128i h1 = _mm_cvtps_ph(_mm_mul_ps(_mm_cvtepi32_ps(_mm_unpackhi_epi16(lo, zero)), scale), 0);
+        __m128i h2 = _mm_cvtps_ph(_mm_mul_ps(_mm_cvtepi32_ps(_mm_unpacklo_epi16(hi, zero)), scale), 0);
+        __m128i h3 = _mm_cvtps_ph(_mm_mul_ps(_mm_cvtepi32_ps(_mm_unpackhi_epi16(hi, zero)), scale), 0);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), _mm_unpacklo_epi64(h0, h1));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i + 2), _mm_unpacklo_epi64(h2, h3));
+    }
+    widen16FScalar(in + i, out + i, count - i);
+}
+
+DEEP_F16C static inline __m128i narrow16FPixel(const Pixel* in) {
+    __m128 v = _mm_cvtph_ps(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(in)));
+    __m128 alpha = _mm_min_ps(_mm_max_ps(_mm_shuffle_ps(v, v, 0), _mm_setzero_ps()), _mm_set1_ps(1.0f));
+    v = _mm_min_ps(_mm_max_ps(v, _mm_setzero_ps()), alpha);
+    return _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(v, _mm_set1_ps(255.0f)), _mm_set1_ps(0.5f)));
+}
+
+DEEP_F16C static void narrow16FF16C(const Pixel* in, Uint32* out, int count) {
+    int i = 0;
+    for (; i + 4 <= count; i += 4) {
+        __m128i lo = _mm_packs_epi32(narrow16FPixel(in + i), narrow16FPixel(in + i + 1));
+        __m128i hi = _mm_packs_epi32(narrow16FPixel(in + i + 2), narrow16FPixel(in + i + 3));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), _mm_packus_epi16(lo, hi));
+    }
+    narrow16FScalar(in + i, out + i, count - i);
+}
+
+DEEP_F16C static void load16FF16C(const Pixel* in, float* out, int count) {
+    int i = 0;
+    for (; i + 2 <= count; i += 2) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i));
+        _mm_storeu_ps(out + i * 4, _mm_cvtph_ps(v));
+        _mm_storeu_ps(out + i * 4 + 4, _mm_cvtph_ps(_mm_unpackhi_epi64(v, v)));
+    }
+    load16FScalar(in + i, out + i * 4, count - i);
+}
+
+DEEP_F16C static void store16FF16C(const float* in, Pixel* out, int count) {
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 top = _mm_set1_ps(HALF_MAX);
+    int i = 0;
+    for (; i + 2 <= count; i += 2) {
+        __m128i lo = _mm_cvtps_ph(_mm_min_ps(_mm_max_ps(_mm_loadu_ps(in + i * 4), zero), top), 0);
+        __m128i hi = _mm_cvtps_ph(_mm_min_ps(_mm_max_ps(_mm_loadu_ps(in + i * 4 + 4), zero), top), 0);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), _mm_unpacklo_epi64(lo, hi));
+    }
+    store16FScalar(in + i * 4, out + i, count - i);
+}
+#endif
+
+// ---------------------------------------------------------------------------------------------
+
+struct DeepKernels {
+    void (*widen[2])(const Uint32*, Pixel*, int) = {widen16Scalar, widen16FScalar};
+    void (*narrow[2])(const Pixel*, Uint32*, int) = {narrow16Scalar, narrow16FScalar};
+    void (*load[2])(const Pixel*, float*, int) = {load16Scalar, load16FScalar};
+    void (*store[2])(const float*, Pixel*, int) = {store16Scalar, store16FScalar};
+    const char* name = "Scalar";
+
+    DeepKernels() {
+#ifdef DEEP_HAS_X86
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("sse2")) {
+            widen[0] = widen16SSE2;
+            narrow[0] = narrow16SSE2;
+            load[0] = load16SSE2;
+            store[0] = store16SSE2;
+            name = "SSE2";
+        }
+        if (__builtin_cpu_supports("sse2") && __builtin_cpu_supports("f16c")) {
+            widen[1] = widen16FF16C;
+            narrow[1] = narrow16FF16C;
+            load[1] = load16FF16C;
+            store[1] = store16FF16C;
+            name = "SSE2 + F16C";
+        }
+#endif
+    }
+};
+
+static const DeepKernels& kernels() {
+    static DeepKernels instance;
+    return instance;
+}
+
+// Index into the kernel tables, 8-bit has no deep pixels to convert
+static int kernelIndex(PixelDepth depth) {
+    return depth == PixelDepth::RGBA16F ? 1 : 0;
+}
+
+void DeepBuffer::widenRow(PixelDepth depth, const Uint32* in, Pixel* out, int count) {
+    if (count > 0) kernels().widen[kernelIndex(depth)](in, out, count);
+}
+
+void DeepBuffer::narrowRow(PixelDepth depth, const Pixel* in, Uint32* out, int count) {
+    if (count > 0) kernels().narrow[kernelIndex(depth)](in, out, count);
+}
+
+void DeepBuffer::loadRow(PixelDepth depth, const Pixel* in, float* out, int count) {
+    if (count > 0) kernels().load[kernelIndex(depth)](in, out, count);
+}
+
+void DeepBuffer::storeRow(PixelDepth depth, const float* in, Pixel* out, int count) {
+    if (count > 0) kernels().store[kernelIndex(depth)](in, out, count);
+}
+
+const char* DeepBuffer::getKernelName() {
+    return kernels().name;
+}
+
+const char* DeepBuffer::getDepthName(PixelDepth depth) {
+    switch (depth) {
+        case PixelDepth::RGBA16: return "16-bit";
+        case PixelDepth::RGBA16F: return "16-bit float";
+        default: return "8-bit";
+    }
+}
+
+// ---------------------------------------------------------------------------------------------
+
+void DeepBuffer::sync(TileBuffer& pixels, PixelDepth depth) {
+    if (depth == PixelDepth::RGBA8 || pixels.isEmpty()) {
+        clear();
+        m_depth = depth;
+        pixels.clearDirty(TileBuffer::DIRTY_DEEP);
+        return;
+    }
+
+    if (pixels.getWidth() != m_width || pixels.getHeight() != m_height) {
+        // Layers only resize when they grow or get trimmed, everything gets widened again
+        m_width = pixels.getWidth();
+        m_height = pixels.getHeight();
+        m_tiles.assign(pixels.getTileCount(), nullptr);
+        m_solid.assign(pixels.getTileCount(), 0);
+        m_state.assign(pixels.getTileCount(), TILE_NONE);
+    } else {
+        for (int i = 0; i < pixels.getTileCount(); i++) {
+            if (pixels.isTileDirty(i, TileBuffer::DIRTY_DEEP)) dropTile(i);
+            else if (depth != m_depth) convertTile(i, m_depth, depth);
+        }
+    }
+    m_depth = depth;
+    pixels.clearDirty(TileBuffer::DIRTY_DEEP);
+}
+
+void DeepBuffer::clear() {
+    m_width = 0;
+    m_height = 0;
+    m_tiles.clear();
+    m_solid.clear();
+    m_state.clear();
+}
+
+void DeepBuffer::dropTile(int index) {
+    m_tiles[index].reset();
+    m_solid[index] = 0;
+    m_state[index] = TILE_NONE;
+}
+
+void DeepBuffer::setTileColor(int index, Pixel color) {
+    m_tiles[index].reset();
+    m_solid[index] = color;
+    m_state[index] = TILE_SOLID;
+}
+
+void DeepBuffer::prepareTile(int index, const TileBuffer& pixels) {
+    if (m_state[index] != TILE_NONE) return;
+    if (pixels.isTileUniform(index)) {
+        Uint32 color = pixels.getTileColor(index);
+        Pixel wide;
+        widenRow(m_depth, &color, &wide, 1);
+        setTileColor(index, wide);
+        return;
+    }
+    // Padding past the image edge is zero on both sides, so the whole tile converts in one go
+    m_tiles[index] = Tile(new Pixel[TileBuffer::TILE_PIXELS]);
+    widenRow(m_depth, pixels.getTileData(index), m_tiles[index].get(), TileBuffer::TILE_PIXELS);
+    m_state[index] = TILE_PIXELS;
+}
+
+Pixel* DeepBuffer::editTile(int index) {
+    Tile& tile = m_tiles[index];
+    if (m_state[index] != TILE_PIXELS) {
+        tile = Tile(new Pixel[TileBuffer::TILE_PIXELS]());
+        int tilesX = (m_width + TileBuffer::TILE_SIZE - 1) / TileBuffer::TILE_SIZE;
+        int x = (index % tilesX) * TileBuffer::TILE_SIZE;
+        int y = (index / tilesX) * TileBuffer::TILE_SIZE;
+        int w = std::min(TileBuffer::TILE_SIZE, m_width - x);
+        int h = std::min(TileBuffer::TILE_SIZE, m_height - y);
+        for (int row = 0; row < h; row++) {
+            std::fill(tile.get() + row * TileBuffer::TILE_SIZE, tile.get() + row * TileBuffer::TILE_SIZE + w, m_solid[index]);
+        }
+        m_solid[index] = 0;
+        m_state[index] = TILE_PIXELS;
+    } else if (tile.use_count() > 1) {
+        Tile copy(new Pixel[TileBuffer::TILE_PIXELS]);
+        std::memcpy(copy.get(), tile.get(), TileBuffer::TILE_PIXELS * sizeof(Pixel));
+        tile = std::move(copy);
+    }
+    return tile.get();
+}
+
+void DeepBuffer::narrowTile(int index, TileBuffer& pixels) const {
+    if (m_state[index] == TILE_SOLID) {
+        Uint32 color;
+        narrowRow(m_depth, &m_solid[index], &color, 1);
+        pixels.setTileColor(index, color);
+    } else if (m_state[index] == TILE_PIXELS) {
+        narrowRow(m_depth, m_tiles[index].get(), pixels.editTile(index), TileBuffer::TILE_PIXELS);
+    }
+    pixels.clearTileDirty(index, TileBuffer::DIRTY_DEEP);
+}
+
+void DeepBuffer::convertTile(int index, PixelDepth from, PixelDepth to) {
+    if (m_state[index] == TILE_NONE) return;
+    float row[TileBuffer::TILE_SIZE * 4];
+    if (m_state[index] == TILE_SOLID) {
+        loadRow(from, &m_solid[index], row, 1);
+        storeRow(to, row, &m_solid[index], 1);
+        return;
+    }
+    Pixel* tile = editTile(index);
+    for (int y = 0; y < TileBuffer::TILE_SIZE; y++) {
+        Pixel* line = tile + y * TileBuffer::TILE_SIZE;
+        loadRow(from, line, row, TileBuffer::TILE_SIZE);
+        storeRow(to, row, line, TileBuffer::TILE_SIZE);
+    }
+}
+
+size_t DeepBuffer::getResidentBytes() const {
+    size_t bytes = 0;
+    for (size_t i = 0; i < m_state.size(); i++) {
+        if (m_state[i] == TILE_PIXELS) bytes += TileBuffer::TILE_PIXELS * sizeof(Pixel);
+        else if (m_state[i] == TILE_SOLID && m_solid[i] != 0) bytes += sizeof(Pixel);
+    }
+    return bytes;
+}
@@ -0,0 +1,83 @@
+#pragma once
+#include <SDL2/SDL.h>
+#include "TileBuffer.hpp"
+#include <memory>
+#include <vector>
+
+// How many bits per channel a document keeps. 8-bit is just the layer tiles, the other two keep
+// a DeepBuffer next to them.
+enum class PixelDepth : int {
+    RGBA8 = 0,
+    RGBA16,  // 16-bit integer, 0-65535
+    RGBA16F, // half float, can go past 1 so brightening and darkening again doesn't clip
+    COUNT
+};
+
+// High bit depth copy of a layer's pixels for documents that aren't 8-bit. The layer's TileBuffer
+// stays the real thing for painting, compositing and the screen, it's the 8-bit cache of this.
+// Colour adjustments run on the deep pixels and write the rounded result back, so a chain of them
+// only gets quantised to 8 bits once instead of after every step.
+// Same tile grid as the layer and sparse the same way: a tile nobody adjusted yet has no deep
+// pixels and gets widened from the 8-bit tile the first time it's needed, a single colour tile is
+// just that colour. A tile that got painted in 8-bit since (TileBuffer::DIRTY_DEEP) is thrown away
+// and widened again, so the two copies never disagree by more than the rounding.
+// Pixels are premultiplied and packed like the 8-bit ones, 16 bits each, R on top and A at the
+// bottom. Tiles are copy on write, duplicating a layer doesn't copy any. They're plain heap
+// memory, TileSwap only deals in 8-bit tiles.
+class DeepBuffer {
+public:
+    using Pixel = Uint64;
+
+    PixelDepth getDepth() const { return m_depth; }
+
+    // Makes this match pixels at `depth`: drops everything on a size change or for 8-bit,
+    // converts to a new depth, and forgets tiles that were painted in 8-bit since. Clears
+    // DIRTY_DEEP on pixels, so this has to be the only consumer of that bit.
+    void sync(TileBuffer& pixels, PixelDepth depth);
+    void clear();
+
+    // Per tile, after sync. hasTile is false until prepareTile widened it.
+    bool hasTile(int index) const { return m_state[index] != TILE_NONE; }
+    bool isTileUniform(int index) const { return m_state[index] == TILE_SOLID; }
+    Pixel getTileColor(int index) const { return m_solid[index]; }
+    void setTileColor(int index, Pixel color);
+    void prepareTile(int index, const TileBuffer& pixels);
+    // Rows are TileBuffer::TILE_SIZE pixels apart. Expands a uniform tile, clones a shared one.
+    Pixel* editTile(int index);
+    // Rounds tile `index` back into pixels and marks it as in sync with them
+    void narrowTile(int index, TileBuffer& pixels) const;
+
+    size_t getResidentBytes() const;
+
+    // Row conversions, SSE2 for 16-bit and F16C for half float when the CPU has them. Same result
+    // bit for bit on every path.
+    // 8-bit to deep is exact for 16-bit integer (c * 257), deep to 8-bit rounds to nearest and
+    // clamps colour to alpha (half float can be brighter than that).
+    static void widenRow(PixelDepth depth, const Uint32* in, Pixel* out, int count);
+    static void narrowRow(PixelDepth depth, const Pixel* in, Uint32* out, int count);
+    // Deep pixels to and from 4 floats each, in memory order like the pixels: a, b, g, r.
+    // 16-bit integer maps 0-65535 to 0-1 and clamps on the way back, half float only clamps
+    // negative values (and anything a half can't hold).
+    static void loadRow(PixelDepth depth, const Pixel* in, float* out, int count);
+    static void storeRow(PixelDepth depth, const float* in, Pixel* out, int count);
+    // "SSE2 + F16C", "SSE2" or "Scalar", whatever the CPU check picked
+    static const char* getKernelName();
+
+    // What a pixel costs on top of the 8-bit tiles
+    static size_t getBytesPerPixel(PixelDepth depth) { return depth == PixelDepth::RGBA8 ? 0 : sizeof(Pixel); }
+    static const char* getDepthName(PixelDepth depth);
+
+private:
+    using Tile = std::shared_ptr<Pixel[]>;
+    enum TileState : Uint8 { TILE_NONE, TILE_SOLID, TILE_PIXELS };
+
+    PixelDepth m_depth = PixelDepth::RGBA8;
+    int m_width = 0;
+    int m_height = 0;
+    std::vector<Tile> m_tiles;
+    std::vector<Pixel> m_solid;
+    std::vector<Uint8> m_state;
+
+    void dropTile(int index);
+    void convertTile(int index, PixelDepth from, PixelDepth to);
+};
@@ -1,11 +1,24 @@
 #include "Layer.hpp"
 #include <SDL2/SDL_image.h>
+#include <algorithm>
 #include <iostream>
+#include <vector>
+#include <climits>
+#include <cstdlib>
+
+// v rounded down/up to the tile grid that has a line at `origin`
+static int snapDown(int v, int origin) {
+    return origin + (((v - origin) >> TileBuffer::TILE_SHIFT) << TileBuffer::TILE_SHIFT);
+}
+
+static int snapUp(int v, int origin) {
+    return snapDown(v + TileBuffer::TILE_SIZE - 1, origin);
+}
 
 Layer::Layer(const std::string& name) 
     : m_name(name), m_opacity(1.0f), m_visible(true), m_locked(false),
       m_blendMode(0), m_selected(false), m_beingDragged(false), m_useMask(false),
-      m_x(0), m_y(0), m_maskDirty(false) {
+      m_x(0), m_y(0) {
 }
 
 Layer::~Layer() {
@@ -13,7 +26,7 @@ Layer::~Layer() {
 }
 
 Layer::Layer(Layer&& other) noexcept
-    : m_texture(other.m_texture),
+    : m_pixels(std::move(other.m_pixels)),
       m_name(std::move(other.m_name)),
       m_opacity(other.m_opacity),
       m_visible(other.m_visible),
@@ -21,15 +34,28 @@ Layer::Layer(Layer&& other) noexcept
       m_blendMode(other.m_blendMode),
       m_selected(other.m_selected),
       m_beingDragged(other.m_beingDragged),
-      m_mask(other.m_mask),
+      m_mask(std::move(other.m_mask)),
       m_useMask(other.m_useMask),
+      m_maskX(other.m_maskX),
+      m_maskY(other.m_maskY),
       m_x(other.m_x),
       m_y(other.m_y),
-      m_maskDirty(other.m_maskDirty) {
+      m_canvasWidth(other.m_canvasWidth),
+      m_canvasHeight(other.m_canvasHeight),
+      m_tileContent(std::move(other.m_tileContent)),
+      m_isGroup(other.m_isGroup),
+      m_expanded(other.m_expanded),
+      m_parent(other.m_parent),
+      m_groupStale(std::move(other.m_groupStale)),
+      m_adjustment(std::move(other.m_adjustment)),
+      m_maskedPixels(std::move(other.m_maskedPixels)),
+      m_mipmaps(std::move(other.m_mipmaps)),
+      m_deep(std::move(other.m_deep)),
+      m_propertiesDirty(other.m_propertiesDirty),
+      m_compositedBounds(other.m_compositedBounds) {
     
     // Reset the moved-from object
-    other.m_texture = nullptr;
-    other.m_mask = nullptr;
+    other.m_mask = LayerMask();
     other.m_x = 0;
     other.m_y = 0;
 }
@@ -39,7 +65,7 @@ Layer& Layer::operator=(Layer&& other) noexcept {
     if (this != &other) {
         cleanup();
         
-        m_texture = other.m_texture;
+        m_pixels = std::move(other.m_pixels);
         m_name = std::move(other.m_name);
         m_opacity = other.m_opacity;
         m_visible = other.m_visible;
@@ -47,241 +73,447 @@ Layer& Layer::operator=(Layer&& other) noexcept {
         m_blendMode = other.m_blendMode;
         m_selected = other.m_selected;
         m_beingDragged = other.m_beingDragged;
-        m_mask = other.m_mask;
+        m_mask = std::move(other.m_mask);
         m_useMask = other.m_useMask;
+        m_maskX = other.m_maskX;
+        m_maskY = other.m_maskY;
         m_x = other.m_x;
         m_y = other.m_y;
-        m_maskDirty = other.m_maskDirty;
+        m_canvasWidth = other.m_canvasWidth;
+        m_canvasHeight = other.m_canvasHeight;
+        m_tileContent = std::move(other.m_tileContent);
+        m_isGroup = other.m_isGroup;
+        m_expanded = other.m_expanded;
+        m_parent = other.m_parent;
+        m_groupStale = std::move(other.m_groupStale);
+        m_adjustment = std::move(other.m_adjustment);
+        m_maskedPixels = std::move(other.m_maskedPixels);
+        m_mipmaps = std::move(other.m_mipmaps);
+        m_deep = std::move(other.m_deep);
+        m_propertiesDirty = other.m_propertiesDirty;
+        m_compositedBounds = other.m_compositedBounds;
         
-        other.m_texture = nullptr;
-        other.m_mask = nullptr;
+        other.m_mask = LayerMask();
         other.m_x = 0;
         other.m_y = 0;
-        other.m_maskDirty = false;
     }
     return *this;
 }
 
-void Layer::setTexture(SDL_Texture* texture) {
-    if (m_texture) {
-        SDL_DestroyTexture(m_texture);
-    }
-    m_texture = texture;
+void Layer::setPixels(TileBuffer pixels) {
+    m_pixels = std::move(pixels);
+    m_pixels.markAllDirty();
+    m_propertiesDirty = true; // size may have changed, treat it like a move
 }
 
-void Layer::setMask(SDL_Texture* mask) {
-    if (m_mask) {
-        SDL_DestroyTexture(m_mask);
-    }
-    m_mask = mask;
-    m_maskDirty = true;
+void Layer::shareDeep(Layer& source) {
+    // source's deep tiles have to be in sync with its pixels for ours to be in sync with ours
+    source.syncDeep(source.m_deep.getDepth());
+    m_deep = source.m_deep;
+    m_pixels.clearDirty(TileBuffer::DIRTY_DEEP);
 }
 
-void Layer::duplicate(Layer& newLayer) const {
-    newLayer.m_name = m_name + " Copy";
-    newLayer.m_opacity = m_opacity;
-    newLayer.m_visible = m_visible;
-    newLayer.m_locked = m_locked;
-    newLayer.m_blendMode = m_blendMode;
-    newLayer.m_selected = false;
-    newLayer.m_beingDragged = false;
-    newLayer.m_useMask = m_useMask;
-    newLayer.m_x = m_x;
-    newLayer.m_y = m_y;
-    newLayer.m_maskDirty = false;
-    
-    // We don't copy the texture or mask here because they should be duplicated at a higher level where the renderer is available
+void Layer::growToCover(const SDL_Rect& rect) {
+    // Never past the canvas, strokes over the edge get clipped like they always did
+    SDL_Rect area = rect;
+    SDL_Rect canvas = {0, 0, m_canvasWidth, m_canvasHeight};
+    if (!SDL_IntersectRect(&area, &canvas, &area) || covers(area)) return;
+
+    int x0 = area.x, y0 = area.y;
+    int x1 = area.x + area.w, y1 = area.y + area.h;
+    // An empty layer can start anywhere, the canvas grid lines its tiles up with the composite's
+    int gridX = 0, gridY = 0;
+    int maxX = m_canvasWidth, maxY = m_canvasHeight;
+    if (hasPixels()) {
+        gridX = m_x;
+        gridY = m_y;
+        x0 = std::min(x0, m_x);
+        y0 = std::min(y0, m_y);
+        x1 = std::max(x1, m_x + m_pixels.getWidth());
+        y1 = std::max(y1, m_y + m_pixels.getHeight());
+        maxX = std::max(maxX, m_x + m_pixels.getWidth());
+        maxY = std::max(maxY, m_y + m_pixels.getHeight());
+    }
+    // The last tile stops at the canvas edge, so a layer painted edge to edge has nothing but
+    // single colour tiles instead of a ragged column of mostly empty ones
+    x0 = snapDown(x0, gridX);
+    y0 = snapDown(y0, gridY);
+    x1 = std::min(snapUp(x1, gridX), maxX);
+    y1 = std::min(snapUp(y1, gridY), maxY);
+    setFrame({x0, y0, x1 - x0, y1 - y0});
 }
 
-void Layer::clear(SDL_Renderer* renderer) {
-    if (!m_texture) return;
-    
-    int width, height;
-    SDL_QueryTexture(m_texture, nullptr, nullptr, &width, &height);
-    
-    SDL_Texture* originalTarget = SDL_GetRenderTarget(renderer);
-    SDL_SetRenderTarget(renderer, m_texture);
-    
-    SDL_SetRenderDrawBlendMode(renderer, SDL_BLENDMODE_NONE);
-    SDL_SetRenderDrawColor(renderer, 0, 0, 0, 0);
-    SDL_RenderClear(renderer);
-    SDL_SetRenderTarget(renderer, originalTarget);
+void Layer::setFrame(const SDL_Rect& rect) {
+    SDL_Rect local = {rect.x - m_x, rect.y - m_y, rect.w, rect.h};
+    if (local.x == 0 && local.y == 0 && rect.w == m_pixels.getWidth() && rect.h == m_pixels.getHeight()) return;
+
+    m_pixels = m_pixels.extract(local);
+    m_propertiesDirty = true;
+    if (rect.w <= 0 || rect.h <= 0) return;
+    m_x = rect.x;
+    m_y = rect.y;
 }
 
-void Layer::createEmptyMask(SDL_Renderer* renderer, int width, int height) {
-    if (m_mask) {
-        SDL_DestroyTexture(m_mask);
-    }
-    
-    m_mask = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_RGBA8888, 
-                               SDL_TEXTUREACCESS_TARGET, width, height);
-    
-    if (!m_mask) {
-        std::cerr << "Failed to create mask texture: " << SDL_GetError() << std::endl;
+void Layer::trimToContent() {
+    if (m_isGroup || !hasPixels()) return;
+    m_pixels.compactTiles();
+
+    SDL_Rect content = getContentBounds();
+    if (content.w <= 0 || content.h <= 0) {
+        setFrame({m_x, m_y, 0, 0});
         return;
     }
-    
-    SDL_SetTextureBlendMode(m_mask, SDL_BLENDMODE_BLEND);
-    
-    SDL_Texture* originalTarget = SDL_GetRenderTarget(renderer);
-    SDL_SetRenderTarget(renderer, m_mask);
-    SDL_SetRenderDrawColor(renderer, 255, 255, 255, 255);
-    SDL_RenderClear(renderer);
-    SDL_SetRenderTarget(renderer, originalTarget);
-    
-    m_maskDirty = true;
+    // Whole tiles of the current grid, so everything that stays is shared and not copied
+    int x0 = snapDown(content.x, m_x);
+    int y0 = snapDown(content.y, m_y);
+    int x1 = std::min(snapUp(content.x + content.w, m_x), m_x + m_pixels.getWidth());
+    int y1 = std::min(snapUp(content.y + content.h, m_y), m_y + m_pixels.getHeight());
+    setFrame({x0, y0, x1 - x0, y1 - y0});
 }
 
-void Layer::clearMask(SDL_Renderer* renderer) {
-    if (!m_mask) return;
+SDL_Rect Layer::getContentBounds() {
+    int count = m_pixels.getTileCount();
+    bool all = m_tileContent.size() != static_cast<size_t>(count);
+    if (all) m_tileContent.assign(count, SDL_Rect{0, 0, 0, 0});
 
-    SDL_Texture* originalTarget = SDL_GetRenderTarget(renderer);
-    SDL_SetRenderTarget(renderer, m_mask);
-    SDL_SetRenderDrawColor(renderer, 255, 255, 255, 255);
-    SDL_RenderClear(renderer);
-    SDL_SetRenderTarget(renderer, originalTarget);
-    
-    m_maskDirty = true;
+    int x0 = INT_MAX, y0 = INT_MAX, x1 = INT_MIN, y1 = INT_MIN;
+    for (int i = 0; i < count; i++) {
+        if (all || m_pixels.isTileDirty(i, TileBuffer::DIRTY_BOUNDS)) {
+            m_tileContent[i] = m_pixels.getTileContentRect(i);
+        }
+        const SDL_Rect& rect = m_tileContent[i];
+        if (rect.w <= 0) continue;
+        x0 = std::min(x0, rect.x);
+        y0 = std::min(y0, rect.y);
+        x1 = std::max(x1, rect.x + rect.w);
+        y1 = std::max(y1, rect.y + rect.h);
+    }
+    m_pixels.clearDirty(TileBuffer::DIRTY_BOUNDS);
+
+    if (x1 < x0) return {m_x, m_y, 0, 0};
+    return {m_x + x0, m_y + y0, x1 - x0, y1 - y0};
 }
 
-void Layer::invertMask(SDL_Renderer* renderer) {
-    if (!m_mask) return;
-    
-    int width, height;
-    SDL_QueryTexture(m_mask, nullptr, nullptr, &width, &height);
-    
-    SDL_Surface* surface = SDL_CreateRGBSurface(0, width, height, 32,
-        0xFF000000, 0x00FF0000, 0x0000FF00, 0x000000FF);
-    
-    if (!surface) return;
-    
-    SDL_Texture* originalTarget = SDL_GetRenderTarget(renderer);
-    SDL_SetRenderTarget(renderer, m_mask);
-    
+void Layer::collectDamage(std::vector<SDL_Rect>& damage) {
+    if (m_propertiesDirty) {
+        // Whatever the layer covered before and covers now has to be recomposited
+        if (m_compositedBounds.w > 0 && m_compositedBounds.h > 0) {
+            damage.push_back(m_compositedBounds);
+        }
+        m_compositedBounds = getBounds();
+        damage.push_back(m_compositedBounds);
+        m_propertiesDirty = false;
+    } else {
+        for (int i = 0; i < m_pixels.getTileCount(); i++) {
+            if (!m_pixels.isTileDirty(i, TileBuffer::DIRTY_COMPOSITE)) continue;
+            SDL_Rect tileRect = m_pixels.getTileRect(i);
+            damage.push_back({tileRect.x + m_x, tileRect.y + m_y, tileRect.w, tileRect.h});
+        }
+    }
+    m_pixels.clearDirty(TileBuffer::DIRTY_COMPOSITE);
+}
 
-    if (SDL_RenderReadPixels(renderer, nullptr, SDL_PIXELFORMAT_RGBA8888, 
-                           surface->pixels, surface->pitch) != 0) {
-        SDL_FreeSurface(surface);
-        SDL_SetRenderTarget(renderer, originalTarget);
+void Layer::updateMaskCache() {
+    if (!isMaskActive()) {
+        // Mask off (or gone), don't keep a second copy of the layer around
+        if (!m_maskedPixels.isEmpty()) m_maskedPixels = TileBuffer();
+        m_pixels.updateCoverage();
         return;
     }
-    SDL_LockSurface(surface);
-    Uint32* pixels = static_cast<Uint32*>(surface->pixels);
-    
-    for (int i = 0; i < surface->w * surface->h; i++) {
-        Uint8 r, g, b, a;
-        SDL_GetRGBA(pixels[i], surface->format, &r, &g, &b, &a);
-        
 
-        r = 255 - r;
-        g = 255 - g;
-        b = 255 - b;
-        
-        pixels[i] = SDL_MapRGBA(surface->format, r, g, b, a);
+    // Mask edits flag the layer tiles they cover, so the dirty bits cover both kinds of change
+    bool rebuildAll = false;
+    if (m_maskedPixels.getWidth() != m_pixels.getWidth() || m_maskedPixels.getHeight() != m_pixels.getHeight()) {
+        m_maskedPixels.resize(m_pixels.getWidth(), m_pixels.getHeight());
+        rebuildAll = true;
     }
-    
-    SDL_UnlockSurface(surface);
-    
 
-    SDL_Texture* newMask = SDL_CreateTextureFromSurface(renderer, surface);
-    SDL_FreeSurface(surface);
-    
-    if (newMask) {
-        SDL_SetTextureBlendMode(newMask, SDL_BLENDMODE_BLEND);
-        SDL_DestroyTexture(m_mask);
-        m_mask = newMask;
-        m_maskDirty = true;
+    for (int i = 0; i < m_pixels.getTileCount(); i++) {
+        if (rebuildAll || m_pixels.isTileDirty(i, TileBuffer::DIRTY_MASKED)) {
+            applyMaskToTile(i);
+        }
     }
-    
-    SDL_SetRenderTarget(renderer, originalTarget);
+    m_pixels.clearDirty(TileBuffer::DIRTY_MASKED);
+    m_maskedPixels.updateCoverage();
 }
 
-void Layer::applyMaskToTexture(SDL_Renderer* renderer) {
-    if (!m_mask || !m_texture) return;
-    
-    int width, height;
-    SDL_QueryTexture(m_texture, nullptr, nullptr, &width, &height);
-    
-    SDL_Texture* tempTexture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_RGBA8888,
-                                                SDL_TEXTUREACCESS_TARGET, width, height);
-    
-    if (!tempTexture) return;
-    
-    SDL_Texture* originalTarget = SDL_GetRenderTarget(renderer);
-    SDL_SetRenderTarget(renderer, tempTexture);
-    
-    SDL_SetRenderDrawColor(renderer, 0, 0, 0, 0);
-    SDL_RenderClear(renderer);
-    
+bool Layer::isTransparentIn(const SDL_Rect& rect, int level) const {
+    if (!m_visible || !hasPixels() || TileBuffer::opacityToAlpha(m_opacity) == 0) return true;
+    SDL_Rect local = {rect.x - (m_x >> level), rect.y - (m_y >> level), rect.w, rect.h};
+    return getMipLevel(level).isRegionTransparent(local);
+}
 
+bool Layer::occludes(const SDL_Rect& rect, int level) const {
+    if (!m_visible || !hasPixels() || m_blendMode != 0 || TileBuffer::opacityToAlpha(m_opacity) != 255) return false;
+    if (isAdjustment()) return false; // opaque pixels, but what's under them still shows
+    SDL_Rect local = {rect.x - (m_x >> level), rect.y - (m_y >> level), rect.w, rect.h};
+    return getMipLevel(level).isRegionOpaque(local);
+}
 
-    SDL_RenderCopy(renderer, m_texture, nullptr, nullptr);
-    
+void Layer::updateMipmaps() {
+    updateMaskCache();
+    // Same dirty bits as the mask cache, so mask edits propagate up as well
+    m_mipmaps.update(getCompositePixels(), m_pixels);
+    m_pixels.clearDirty(TileBuffer::DIRTY_MIPMAP);
+}
 
-    SDL_SetTextureBlendMode(m_mask, SDL_BLENDMODE_MOD);
-    SDL_RenderCopy(renderer, m_mask, nullptr, nullptr);
-    
-    SDL_SetRenderTarget(renderer, originalTarget);
+const TileBuffer& Layer::getMipLevel(int level) const {
+    if (level <= 0 || !m_mipmaps.isBuilt()) return getCompositePixels();
+    return m_mipmaps.getLevel(std::min(level, MipPyramid::MAX_LEVELS));
+}
 
-    SDL_DestroyTexture(m_texture);
-    m_texture = tempTexture;
-    
-    SDL_DestroyTexture(m_mask);
-    m_mask = nullptr;
-    m_useMask = false;
-    m_maskDirty = false;
+bool Layer::isInside(const Layer* group) const {
+    for (const Layer* parent = m_parent; parent; parent = parent->m_parent) {
+        if (parent == group) return true;
+    }
+    return false;
 }
 
-void Layer::renderWithMask(SDL_Renderer* renderer, SDL_Rect destRect, float globalOpacity) {
-    if (!m_texture || !m_visible) return;
-    float finalOpacity = m_opacity * globalOpacity;
-    Uint8 alpha = static_cast<Uint8>(finalOpacity * 255);
-    
-    if (!m_mask || !m_useMask) {
+int Layer::getDepth() const {
+    int depth = 0;
+    for (const Layer* parent = m_parent; parent; parent = parent->m_parent) depth++;
+    return depth;
+}
 
-        SDL_SetTextureAlphaMod(m_texture, alpha);
-        SDL_RenderCopy(renderer, m_texture, nullptr, &destRect);
+void Layer::markGroupStale(const SDL_Rect& rect) {
+    if (m_groupStale.size() != static_cast<size_t>(m_pixels.getTileCount())) {
+        m_groupStale.assign(m_pixels.getTileCount(), 1);
         return;
     }
-    
-    SDL_Texture* tempTexture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_RGBA8888,
-                                                SDL_TEXTUREACCESS_TARGET, 
-                                                destRect.w, destRect.h);
-    
-    if (!tempTexture) {
+    SDL_Rect area = {rect.x - m_x, rect.y - m_y, rect.w, rect.h};
+    SDL_Rect bounds = {0, 0, m_pixels.getWidth(), m_pixels.getHeight()};
+    if (!SDL_IntersectRect(&area, &bounds, &area)) return;
+    int tilesX = m_pixels.getTilesX();
+    for (int ty = area.y >> TileBuffer::TILE_SHIFT; ty <= (area.y + area.h - 1) >> TileBuffer::TILE_SHIFT; ty++) {
+        for (int tx = area.x >> TileBuffer::TILE_SHIFT; tx <= (area.x + area.w - 1) >> TileBuffer::TILE_SHIFT; tx++) {
+            m_groupStale[ty * tilesX + tx] = 1;
+        }
+    }
+}
+
+std::vector<int> Layer::takeStaleGroupTiles() {
+    // A new or resized group has nothing cached yet
+    if (m_groupStale.size() != static_cast<size_t>(m_pixels.getTileCount())) {
+        m_groupStale.assign(m_pixels.getTileCount(), 1);
+    }
+    std::vector<int> tiles;
+    for (int i = 0; i < static_cast<int>(m_groupStale.size()); i++) {
+        if (m_groupStale[i]) {
+            tiles.push_back(i);
+            m_groupStale[i] = 0;
+        }
+    }
+    return tiles;
+}
+
+void Layer::setUseMask(bool use) {
+    if (use == m_useMask) return;
+    m_useMask = use;
+    m_propertiesDirty = true;
+    // The pyramid is built from the masked pixels, it has to follow
+    m_pixels.markAllDirty();
+}
+
+void Layer::setPosition(int x, int y) {
+    if (x == m_x && y == m_y) return;
+    m_x = x;
+    m_y = y;
+    m_propertiesDirty = true;
+    // Different pixels under the mask now
+    if (hasMask()) m_pixels.markAllDirty();
+}
 
-        SDL_SetTextureAlphaMod(m_texture, alpha);
-        SDL_RenderCopy(renderer, m_texture, nullptr, &destRect);
+void Layer::moveBy(int dx, int dy) {
+    if (dx == 0 && dy == 0) return;
+    // Mask and pixels stay lined up, so the masked tiles are still good
+    m_x += dx;
+    m_y += dy;
+    m_maskX += dx;
+    m_maskY += dy;
+    m_propertiesDirty = true;
+}
+
+void Layer::setMaskPosition(int x, int y) {
+    if (x == m_maskX && y == m_maskY) return;
+    // Both where it was and where it is now need masking again
+    maskChanged({0, 0, m_mask.getWidth(), m_mask.getHeight()});
+    m_maskX = x;
+    m_maskY = y;
+    maskChanged({0, 0, m_mask.getWidth(), m_mask.getHeight()});
+}
+
+void Layer::maskChanged(const SDL_Rect& rect) {
+    // Same as painting on those pixels as far as the mask cache and the compositor care
+    m_pixels.markDirty({rect.x + m_maskX - m_x, rect.y + m_maskY - m_y, rect.w, rect.h});
+}
+
+void Layer::applyMaskToTile(int index) {
+    const Uint32* src = m_pixels.getTileData(index);
+    SDL_Rect tileRect = m_pixels.getTileRect(index);
+    SDL_Rect maskRect = {tileRect.x + m_x - m_maskX, tileRect.y + m_y - m_maskY, tileRect.w, tileRect.h};
+
+    // Nothing to mask, or the mask is fully white here: share the tile instead of copying it
+    bool empty = !src && m_pixels.getTileColor(index) == 0;
+    if (empty || m_mask.isUniform(maskRect, 255)) {
+        m_maskedPixels.shareTile(index, m_pixels);
         return;
     }
-    
-    SDL_Texture* originalTarget = SDL_GetRenderTarget(renderer);
-    SDL_SetRenderTarget(renderer, tempTexture);
-    
-    SDL_SetRenderDrawColor(renderer, 0, 0, 0, 0);
-    SDL_RenderClear(renderer);
 
-    SDL_Rect fullRect = {0, 0, destRect.w, destRect.h};
-    SDL_RenderCopy(renderer, m_texture, nullptr, &fullRect);
-    
-    SDL_SetTextureBlendMode(m_mask, SDL_BLENDMODE_MOD);
-    SDL_RenderCopy(renderer, m_mask, nullptr, &fullRect);
+    Uint32* out = m_maskedPixels.editTile(index);
+    if (!src) {
+        // One colour tile, spread it out first and mask it in place
+        m_pixels.readRect(tileRect, out, TileBuffer::TILE_SIZE);
+        src = out;
+    }
+    // The part of the tile's rows the mask reaches, past its edges counts as white
+    int maskX0 = std::clamp(-maskRect.x, 0, tileRect.w);
+    int maskX1 = std::clamp(m_mask.getWidth() - maskRect.x, maskX0, tileRect.w);
+    for (int y = 0; y < tileRect.h; y++) {
+        const Uint32* in = src + y * TileBuffer::TILE_SIZE;
+        Uint32* dst = out + y * TileBuffer::TILE_SIZE;
+        int maskY = maskRect.y + y;
+        if (maskY < 0 || maskY >= m_mask.getHeight()) {
+            std::copy(in, in + tileRect.w, dst);
+            continue;
+        }
+        const Uint8* maskRow = m_mask.getRow(maskY);
+        std::copy(in, in + maskX0, dst);
+        for (int x = maskX0; x < maskX1; x++) {
+            dst[x] = TileBuffer::scalePixel(in[x], maskRow[maskRect.x + x]); // premultiplied, colour fades with alpha
+        }
+        std::copy(in + maskX1, in + tileRect.w, dst + maskX1);
+    }
+}
 
-    SDL_SetRenderTarget(renderer, originalTarget);
-    
-    SDL_SetTextureAlphaMod(tempTexture, alpha);
-    SDL_RenderCopy(renderer, tempTexture, nullptr, &destRect);
-    SDL_DestroyTexture(tempTexture);
+void Layer::setMask(LayerMask mask) {
+    m_mask = std::move(mask);
+    m_propertiesDirty = true;
+    m_pixels.markAllDirty();
 }
 
-void Layer::cleanup() {
-    if (m_texture) {
-        SDL_DestroyTexture(m_texture);
-        m_texture = nullptr;
+void Layer::duplicate(Layer& newLayer) const {
+    newLayer.m_name = m_name + " Copy";
+    newLayer.m_opacity = m_opacity;
+    newLayer.m_visible = m_visible;
+    newLayer.m_locked = m_locked;
+    newLayer.m_blendMode = m_blendMode;
+    newLayer.m_selected = false;
+    newLayer.m_beingDragged = false;
+    newLayer.m_useMask = m_useMask;
+    newLayer.m_x = m_x;
+    newLayer.m_y = m_y;
+    newLayer.m_canvasWidth = m_canvasWidth;
+    newLayer.m_canvasHeight = m_canvasHeight;
+    newLayer.m_isGroup = m_isGroup;
+    newLayer.m_expanded = m_expanded;
+    newLayer.m_adjustment = m_adjustment;
+    // Masks are plain CPU data now so they can just be copied along
+    newLayer.m_mask = m_mask;
+    newLayer.m_maskX = m_maskX;
+    newLayer.m_maskY = m_maskY;
+    
+    // We don't copy the pixels here, the caller shares them (copy on write)
+}
+
+void Layer::clear() {
+    m_pixels.clear();
+}
+
+void Layer::createEmptyMask(int width, int height) {
+    // White = show everything
+    m_maskX = 0;
+    m_maskY = 0;
+    setMask(LayerMask(width, height, 255));
+}
+
+void Layer::clearMask() {
+    if (!hasMask()) return;
+    m_mask.clear(255);
+    maskChanged({0, 0, m_mask.getWidth(), m_mask.getHeight()});
+}
+
+void Layer::fillMask(const SDL_Rect& rect, Uint8 value) {
+    if (!hasMask()) return;
+    SDL_Rect maskRect = {rect.x - m_maskX, rect.y - m_maskY, rect.w, rect.h};
+    m_mask.fillRect(maskRect, value);
+    maskChanged(maskRect);
+}
+
+void Layer::featherMask(int radius) {
+    if (!hasMask() || radius <= 0) return;
+    m_mask.feather(radius);
+    maskChanged({0, 0, m_mask.getWidth(), m_mask.getHeight()});
+}
+
+void Layer::invertMask() {
+    if (!hasMask()) return;
+    m_mask.invert();
+    maskChanged({0, 0, m_mask.getWidth(), m_mask.getHeight()});
+}
+
+void Layer::applyMaskToTexture() {
+    if (!hasMask() || m_pixels.isEmpty()) return;
+    
+    // Exactly what the mask cache does, just permanently
+    for (int i = 0; i < m_pixels.getTileCount(); i++) {
+        SDL_Rect tileRect = m_pixels.getTileRect(i);
+        SDL_Rect maskRect = {tileRect.x + m_x - m_maskX, tileRect.y + m_y - m_maskY, tileRect.w, tileRect.h};
+        if (m_pixels.getTileCoverage(i) == TileBuffer::COVERAGE_EMPTY || m_mask.isUniform(maskRect, 255)) continue;
+        if (m_maskedPixels.isEmpty()) m_maskedPixels.resize(m_pixels.getWidth(), m_pixels.getHeight());
+        applyMaskToTile(i);
+        m_pixels.shareTile(i, m_maskedPixels);
     }
+    m_pixels.compactTiles();
     
-    if (m_mask) {
-        SDL_DestroyTexture(m_mask);
-        m_mask = nullptr;
+    m_mask = LayerMask();
+    m_maskedPixels = TileBuffer();
+    m_useMask = false;
+    m_propertiesDirty = true;
+}
+
+void Layer::cleanup() {
+    m_mask = LayerMask();
+    m_maskedPixels = TileBuffer();
+    m_mipmaps.clear();
+    m_deep.clear();
+}
+
+void LayerPixels::setPixel(int x, int y, Uint32 color) {
+    // Transparent where there's nothing yet doesn't need any room
+    if (TileBuffer::alphaOf(color) != 0) m_layer.ensureCovers({x, y, 1, 1});
+    m_layer.getPixels().setPixel(x - m_layer.getX(), y - m_layer.getY(), color);
+}
+
+void LayerPixels::blendPixel(int x, int y, Uint32 color) {
+    if (TileBuffer::alphaOf(color) == 0) return;
+    m_layer.ensureCovers({x, y, 1, 1});
+    m_layer.getPixels().blendPixel(x - m_layer.getX(), y - m_layer.getY(), color);
+}
+
+void LayerPixels::fillRect(const SDL_Rect& rect, Uint32 color, bool blend) {
+    if (TileBuffer::alphaOf(color) != 0) m_layer.ensureCovers(rect);
+    m_layer.getPixels().fillRect(local(rect), color, blend);
+}
+
+void LayerPixels::drawRect(const SDL_Rect& rect, Uint32 color) {
+    if (TileBuffer::alphaOf(color) != 0) m_layer.ensureCovers(rect);
+    m_layer.getPixels().drawRect(local(rect), color);
+}
+
+void LayerPixels::drawLine(int x0, int y0, int x1, int y1, Uint32 color) {
+    if (TileBuffer::alphaOf(color) != 0) {
+        m_layer.ensureCovers({std::min(x0, x1), std::min(y0, y1), std::abs(x1 - x0) + 1, std::abs(y1 - y0) + 1});
     }
-}
\ No newline at end of file
+    m_layer.getPixels().drawLine(x0 - m_layer.getX(), y0 - m_layer.getY(), x1 - m_layer.getX(), y1 - m_layer.getY(), color);
+}
+
+void LayerPixels::blitSurface(SDL_Surface* surface, const SDL_Rect& destRect, bool blend) {
+    if (!surface) return;
+    m_layer.ensureCovers(destRect);
+    m_layer.getPixels().blitSurface(surface, local(destRect), blend);
+}
+
+void LayerPixels::compositeOver(const TileBuffer& src, int x, int y) {
+    m_layer.ensureCovers({x, y, src.getWidth(), src.getHeight()});
+    m_layer.getPixels().compositeOver(src, x - m_layer.getX(), y - m_layer.getY());
+}
@@ -1,7 +1,13 @@
 #pragma once
 #include <SDL2/SDL.h>
+#include "TileBuffer.hpp"
+#include "LayerMask.hpp"
+#include "MipPyramid.hpp"
+#include "DeepBuffer.hpp"
+#include "Adjustment.hpp"
 #include <string>
 #include <memory>
+#include <vector>
 
 class Layer {
 public:
@@ -14,23 +20,95 @@ public:
     Layer(Layer&& other) noexcept;
     Layer& operator=(Layer&& other) noexcept;
     
-    SDL_Texture* getTexture() const { return m_texture; }
-    void setTexture(SDL_Texture* texture);
+    // The tiles are the real pixels. Layers don't own any GPU textures any more, the canvas
+    // composites them on the CPU and only uploads the flattened result.
+    // They only cover the layer's content (plus some slack up to the next tile), at m_x/m_y on
+    // the canvas, and start out empty. getPixels is layer space, paint through LayerPixels below
+    // to work in canvas space and have the layer grow as needed.
+    TileBuffer& getPixels() { return m_pixels; }
+    const TileBuffer& getPixels() const { return m_pixels; }
+    void setPixels(TileBuffer pixels);
+    void resize(int width, int height) { m_pixels.resize(width, height); m_propertiesDirty = true; }
+    int getWidth() const { return m_pixels.getWidth(); }
+    int getHeight() const { return m_pixels.getHeight(); }
+    bool hasPixels() const { return !m_pixels.isEmpty(); }
+    // What this layer actually costs in RAM, only allocated tiles count (plus the mask, 1 byte/pixel,
+    // the mip pyramid once something asked for it and the deep pixels in a high bit depth document)
+    size_t getResidentBytes() const {
+        return m_pixels.getResidentBytes() + m_mask.getBytes() + m_mipmaps.getResidentBytes() + m_deep.getResidentBytes();
+    }
+    size_t getSharedBytes() const { return m_pixels.getSharedBytes(); }
+    SDL_Rect getBounds() const { return {m_x, m_y, m_pixels.getWidth(), m_pixels.getHeight()}; }
+    
+    // High bit depth pixels for 16-bit documents, see DeepBuffer. syncDeep brings them in line
+    // with the 8-bit tiles (which stay what gets painted, composited and shown) first.
+    DeepBuffer& syncDeep(PixelDepth depth) { m_deep.sync(m_pixels, depth); return m_deep; }
+    const DeepBuffer& getDeep() const { return m_deep; }
+    // After setPixels(source.getPixels()): shares source's deep tiles too instead of widening again
+    void shareDeep(Layer& source);
+    
+    // How far the layer may grow, set by the canvas
+    void setCanvasSize(int width, int height) { m_canvasWidth = width; m_canvasHeight = height; }
+    int getCanvasWidth() const { return m_canvasWidth; }
+    int getCanvasHeight() const { return m_canvasHeight; }
+    // Makes sure the pixels cover rect (canvas space, clipped to the canvas) before it gets
+    // painted. Grows by whole tiles on the layer's own grid, so the old tiles are just shared.
+    void ensureCovers(const SDL_Rect& rect) { if (!covers(rect)) growToCover(rect); }
+    bool covers(const SDL_Rect& rect) const {
+        return rect.x >= m_x && rect.y >= m_y && rect.x + rect.w <= m_x + m_pixels.getWidth() &&
+               rect.y + rect.h <= m_y + m_pixels.getHeight();
+    }
+    // Shrinks the pixels to the tiles that still have something in them (nothing at all if the
+    // layer got erased completely)
+    void trimToContent();
+    // Puts the pixels into a buffer covering rect (canvas space) without moving them on the canvas
+    void setFrame(const SDL_Rect& rect);
+    // Exact canvas space box around the non transparent pixels, w = 0 for an empty layer. Kept
+    // per tile and only redone for tiles that changed, so this is cheap to ask all the time.
+    SDL_Rect getContentBounds();
+    
+    // What the compositor should blend: the pixels with the mask already applied if there is one.
+    // updateMaskCache has to run first, it's cheap when nothing changed. It also caches the tile
+    // coverage the culling below relies on.
+    const TileBuffer& getCompositePixels() const { return isMaskActive() ? m_maskedPixels : m_pixels; }
+    void updateMaskCache();
+    
+    // Culling for the compositor, canvas space rect (level space for level > 0). Both are
+    // conservative, false only means the layer has to be blended.
+    // Nothing of the layer shows in rect: hidden, zero opacity or transparent pixels there
+    bool isTransparentIn(const SDL_Rect& rect, int level = 0) const;
+    // Normal mode, full opacity and opaque over all of rect, so whatever is under it is hidden
+    bool occludes(const SDL_Rect& rect, int level = 0) const;
+    
+    // Composite pixels at 1/2^level size for zoomed out drawing and thumbnails. Level 0 is
+    // getCompositePixels itself. updateMipmaps builds the pyramid on first use and after that only
+    // redoes what's above dirty tiles. getMipLevel doesn't change anything, so compositor threads
+    // can read it. Its origin is the layer position shifted down by the same level.
+    void updateMipmaps();
+    const TileBuffer& getMipLevel(int level) const;
+    Uint64 getMipVersion() const { return m_mipmaps.getVersion(); }
+    
+    // Damage tracking for the compositor. Appends the canvas space rects that changed since the
+    // last call: dirty tiles, or old + new bounds if a property (opacity, position, ...) changed.
+    void collectDamage(std::vector<SDL_Rect>& damage);
     
     const std::string& getName() const { return m_name; }
     void setName(const std::string& name) { m_name = name; }
     
+    // Setters that change how the layer looks flag it so the compositor redraws it
     float getOpacity() const { return m_opacity; }
-    void setOpacity(float opacity) { m_opacity = opacity; }
+    void setOpacity(float opacity) { if (opacity != m_opacity) { m_opacity = opacity; m_propertiesDirty = true; } }
     
     bool isVisible() const { return m_visible; }
-    void setVisible(bool visible) { m_visible = visible; }
+    void setVisible(bool visible) { if (visible != m_visible) { m_visible = visible; m_propertiesDirty = true; } }
     
-    bool isLocked() const { return m_locked; }
+    // Groups count as locked, their pixels get rebuilt from the children so painting on them
+    // would just vanish
+    bool isLocked() const { return m_locked || m_isGroup; }
     void setLocked(bool locked) { m_locked = locked; }
     
     int getBlendMode() const { return m_blendMode; }
-    void setBlendMode(int mode) { m_blendMode = mode; }
+    void setBlendMode(int mode) { if (mode != m_blendMode) { m_blendMode = mode; m_propertiesDirty = true; } }
     
     bool isSelected() const { return m_selected; }
     void setSelected(bool selected) { m_selected = selected; }
@@ -38,34 +116,68 @@ public:
     bool isBeingDragged() const { return m_beingDragged; }
     void setBeingDragged(bool dragged) { m_beingDragged = dragged; }
     
-    SDL_Texture* getMask() const { return m_mask; }
-    void setMask(SDL_Texture* mask);
+    // The mask is an 8-bit plane on the CPU. Edit it through the functions below so the masked
+    // tiles and the canvas get refreshed, none of them touch the GPU.
+    // It has its own canvas space origin instead of following the pixels' frame, so the layer
+    // growing or getting trimmed never crops it.
+    const LayerMask& getMask() const { return m_mask; }
+    void setMask(LayerMask mask);
+    int getMaskX() const { return m_maskX; }
+    int getMaskY() const { return m_maskY; }
+    void setMaskPosition(int x, int y);
     
     bool isUsingMask() const { return m_useMask; }
-    void setUseMask(bool use) { m_useMask = use; }
-    bool hasMask() const { return m_mask != nullptr; }
+    void setUseMask(bool use);
+    bool hasMask() const { return !m_mask.isEmpty(); }
+    bool isMaskActive() const { return hasMask() && m_useMask; }
     
     // Layer position for moving content without texture recreation
     int getX() const { return m_x; }
     int getY() const { return m_y; }
-    void setX(int x) { m_x = x; }
-    void setY(int y) { m_y = y; }
-    void setPosition(int x, int y) { m_x = x; m_y = y; }
-    void moveBy(int dx, int dy) { m_x += dx; m_y += dy; }
-    
-    void createEmptyMask(SDL_Renderer* renderer, int width, int height);
-    void clearMask(SDL_Renderer* renderer);
-    void invertMask(SDL_Renderer* renderer);// 
+    void setX(int x) { setPosition(x, m_y); }
+    void setY(int y) { setPosition(m_x, y); }
+    // Where the pixels' frame sits, the mask stays put. moveBy moves the content, mask included.
+    void setPosition(int x, int y);
+    void moveBy(int dx, int dy);
+    
+    void createEmptyMask(int width, int height); // at the canvas origin
+    void clearMask();
+    void invertMask();
+    void fillMask(const SDL_Rect& rect, Uint8 value); // canvas space rect
+    void featherMask(int radius);
+    
+    void applyMaskToTexture(); // Bakes the mask into the pixels and drops it
+    
+    // Groups (folders). A group's pixels are its children flattened on transparent, canvas
+    // sized. The canvas redoes the tiles markGroupStale flagged before it composites, to
+    // everything above it a group is just a layer, so its opacity, blend mode, mask or visibility
+    // changing never makes the children get blended again.
+    // Children sit right under their group in the canvas' layer list, see Canvas::getBlockStart.
+    bool isGroup() const { return m_isGroup; }
+    void setGroup(bool group) { m_isGroup = group; }
+    Layer* getParent() const { return m_parent; }
+    void setParent(Layer* parent) { if (parent != m_parent) { m_parent = parent; m_propertiesDirty = true; } }
+    bool isInside(const Layer* group) const; // anywhere under it, not just a direct child
+    int getDepth() const;
+    bool isExpanded() const { return m_expanded; }
+    void setExpanded(bool expanded) { m_expanded = expanded; }
+    void markGroupStale(const SDL_Rect& rect); // canvas space
+    std::vector<int> takeStaleGroupTiles();    // and forgets them
+    
+    // Adjustment layers. Instead of blending their pixels over what's under them they run their
+    // adjustment on it while compositing, their alpha (mask included) times opacity says how much.
+    // So the pixels are only coverage: opaque all over by default, paint or mask to limit it.
+    // Where the result went (composite, below cache, group pixels) is the per tile cache of it,
+    // a new adjustment damages the layer like an opacity change and only those tiles get redone.
+    bool isAdjustment() const { return m_adjustment.getType() != AdjustmentType::NONE; }
+    const Adjustment& getAdjustment() const { return m_adjustment; }
+    void setAdjustment(Adjustment adjustment) { m_adjustment = std::move(adjustment); m_propertiesDirty = true; }
     
     void duplicate(Layer& newLayer) const;
-    void clear(SDL_Renderer* renderer);
-    
-    // TODO: Add layer blending modes beyond basic alpha
-    // PERF: Could cache composited result when mask doesn't change
-    void renderWithMask(SDL_Renderer* renderer, SDL_Rect destRect, float globalOpacity = 1.0f);
+    void clear();
     
 private:
-    SDL_Texture* m_texture = nullptr;
+    TileBuffer m_pixels;
     std::string m_name;
     float m_opacity = 1.0f;
     bool m_visible = true;
@@ -73,14 +185,58 @@ private:
     int m_blendMode = 0;
     bool m_selected = false;
     bool m_beingDragged = false;
-    SDL_Texture* m_mask = nullptr;
+    LayerMask m_mask;
     bool m_useMask = false;
+    int m_maskX = 0; // canvas space
+    int m_maskY = 0;
     
     int m_x = 0;
     int m_y = 0;
-    
-    // This is a hack. Track if mask was modified for optimization
-    bool m_maskDirty = false;
+    int m_canvasWidth = 0;
+    int m_canvasHeight = 0;
+    std::vector<SDL_Rect> m_tileContent; // getContentBounds cache, layer space
+    void growToCover(const SDL_Rect& rect);
+    
+    bool m_isGroup = false;
+    bool m_expanded = true;
+    Layer* m_parent = nullptr;
+    std::vector<Uint8> m_groupStale; // per tile, empty or the wrong size means all of them
+    Adjustment m_adjustment;
+    
+    // The pixels with the mask applied. Only tiles that got painted on or had their part of the
+    // mask edited get redone, a tile the mask doesn't touch just shares m_pixels' tile.
+    TileBuffer m_maskedPixels;
+    MipPyramid m_mipmaps;
+    DeepBuffer m_deep;
+    void applyMaskToTile(int index);
+    void maskChanged(const SDL_Rect& rect); // mask space
+    
+    // Compositor bookkeeping, see collectDamage
+    bool m_propertiesDirty = true;
+    SDL_Rect m_compositedBounds = {0, 0, 0, 0};
     
     void cleanup();
-};
\ No newline at end of file
+};
+
+// Canvas space view of a layer for the tools. Reads outside the layer's pixels come back
+// transparent, writes make the layer grow to cover them first. Width/height are the canvas.
+class LayerPixels {
+public:
+    explicit LayerPixels(Layer& layer) : m_layer(layer) {}
+    
+    int getWidth() const { return m_layer.getCanvasWidth(); }
+    int getHeight() const { return m_layer.getCanvasHeight(); }
+    
+    Uint32 getPixel(int x, int y) const { return m_layer.getPixels().getPixel(x - m_layer.getX(), y - m_layer.getY()); }
+    void setPixel(int x, int y, Uint32 color);
+    void blendPixel(int x, int y, Uint32 color);
+    void fillRect(const SDL_Rect& rect, Uint32 color, bool blend = false);
+    void drawRect(const SDL_Rect& rect, Uint32 color);
+    void drawLine(int x0, int y0, int x1, int y1, Uint32 color);
+    void blitSurface(SDL_Surface* surface, const SDL_Rect& destRect, bool blend = true);
+    void compositeOver(const TileBuffer& src, int x, int y);
+    
+private:
+    Layer& m_layer;
+    SDL_Rect local(const SDL_Rect& rect) const { return {rect.x - m_layer.getX(), rect.y - m_layer.getY(), rect.w, rect.h}; }
+};
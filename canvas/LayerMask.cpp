@@ -0,0 +1,134 @@
+#include "LayerMask.hpp"
+#include <algorithm>
+#include <cstring>
+
+// x86-64 always has SSE2 so no runtime check needed here, unlike the AVX2 blend kernels
+#if defined(__SSE2__) || defined(_M_X64)
+#define MASK_HAS_SSE2 1
+#include <emmintrin.h>
+#endif
+
+LayerMask::LayerMask(int width, int height, Uint8 value)
+    : m_width(std::max(0, width)),
+      m_height(std::max(0, height)),
+      m_values(static_cast<size_t>(m_width) * m_height, value) {
+}
+
+Uint8 LayerMask::getValue(int x, int y) const {
+    if (x < 0 || y < 0 || x >= m_width || y >= m_height) return 255;
+    return m_values[static_cast<size_t>(y) * m_width + x];
+}
+
+bool LayerMask::clipRect(SDL_Rect& rect) const {
+    int x0 = std::max(rect.x, 0);
+    int y0 = std::max(rect.y, 0);
+    int x1 = std::min(rect.x + rect.w, m_width);
+    int y1 = std::min(rect.y + rect.h, m_height);
+    rect = {x0, y0, x1 - x0, y1 - y0};
+    return rect.w > 0 && rect.h > 0;
+}
+
+void LayerMask::clear(Uint8 value) {
+    std::memset(m_values.data(), value, m_values.size());
+}
+
+void LayerMask::fillRect(const SDL_Rect& rect, Uint8 value) {
+    SDL_Rect area = rect;
+    if (!clipRect(area)) return;
+    for (int y = area.y; y < area.y + area.h; y++) {
+        std::memset(m_values.data() + static_cast<size_t>(y) * m_width + area.x, value, area.w);
+    }
+}
+
+void LayerMask::invert() {
+    Uint8* values = m_values.data();
+    size_t count = m_values.size();
+    size_t i = 0;
+#ifdef MASK_HAS_SSE2
+    // 255 - v is just v ^ 0xFF, 16 pixels per instruction
+    const __m128i ones = _mm_set1_epi8(static_cast<char>(0xFF));
+    for (; i + 16 <= count; i += 16) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(values + i));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(values + i), _mm_xor_si128(v, ones));
+    }
+#endif
+    for (; i < count; i++) {
+        values[i] = static_cast<Uint8>(~values[i]);
+    }
+}
+
+bool LayerMask::isUniform(const SDL_Rect& rect, Uint8 value) const {
+    SDL_Rect area = rect;
+    bool inside = clipRect(area);
+    // Whatever sticks out of the mask reads as 255
+    if (value != 255 && (!inside || area.w != rect.w || area.h != rect.h)) return false;
+    if (!inside) return true;
+
+    for (int y = area.y; y < area.y + area.h; y++) {
+        const Uint8* row = getRow(y) + area.x;
+        int x = 0;
+#ifdef MASK_HAS_SSE2
+        const __m128i expected = _mm_set1_epi8(static_cast<char>(value));
+        for (; x + 16 <= area.w; x += 16) {
+            __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row + x));
+            if (_mm_movemask_epi8(_mm_cmpeq_epi8(v, expected)) != 0xFFFF) return false;
+        }
+#endif
+        for (; x < area.w; x++) {
+            if (row[x] != value) return false;
+        }
+    }
+    return true;
+}
+
+void LayerMask::feather(int radius) {
+    if (radius <= 0 || isEmpty()) return;
+    std::vector<Uint8> temp(m_values.size());
+    for (int pass = 0; pass < 2; pass++) {
+        boxBlurRows(temp, radius);
+        m_values.swap(temp);
+        boxBlurColumns(temp, radius);
+        m_values.swap(temp);
+    }
+}
+
+// Running sum box blur, constant cost per pixel whatever the radius. Edges are clamped.
+void LayerMask::boxBlurRows(std::vector<Uint8>& out, int radius) const {
+    float scale = 1.0f / (2 * radius + 1);
+    for (int y = 0; y < m_height; y++) {
+        const Uint8* in = getRow(y);
+        Uint8* dst = out.data() + static_cast<size_t>(y) * m_width;
+        Uint32 sum = 0;
+        for (int k = -radius; k <= radius; k++) {
+            sum += in[std::clamp(k, 0, m_width - 1)];
+        }
+        for (int x = 0; x < m_width; x++) {
+            dst[x] = static_cast<Uint8>(sum * scale + 0.5f);
+            sum += in[std::min(x + radius + 1, m_width - 1)];
+            sum -= in[std::max(x - radius, 0)];
+        }
+    }
+}
+
+// Same thing down the columns, but a whole row of column sums at a time so the inner loops are
+// straight runs over x that the compiler turns into SIMD
+void LayerMask::boxBlurColumns(std::vector<Uint8>& out, int radius) const {
+    float scale = 1.0f / (2 * radius + 1);
+    std::vector<Uint32> sums(m_width, 0);
+    for (int k = -radius; k <= radius; k++) {
+        const Uint8* in = getRow(std::clamp(k, 0, m_height - 1));
+        for (int x = 0; x < m_width; x++) sums[x] += in[x];
+    }
+    for (int y = 0; y < m_height; y++) {
+        Uint8* dst = out.data() + static_cast<size_t>(y) * m_width;
+        for (int x = 0; x < m_width; x++) {
+            dst[x] = static_cast<Uint8>(sums[x] * scale + 0.5f);
+        }
+        const Uint8* add = getRow(std::min(y + radius + 1, m_height - 1));
+        const Uint8* sub = getRow(std::max(y - radius, 0));
+        for (int x = 0; x < m_width; x++) {
+            sums[x] += add[x];
+            sums[x] -= sub[x];
+        }
+    }
+}
@@ -0,0 +1,38 @@
+#pragma once
+#include <SDL2/SDL.h>
+#include <vector>
+
+// A layer mask is just coverage, so it's one byte per pixel: 255 shows the layer, 0 hides it.
+// Lives entirely on the CPU, the compositor applies it when it builds the layer's masked tiles.
+// Anything outside the mask (layer got bigger after the mask was made) counts as 255.
+class LayerMask {
+public:
+    LayerMask() = default;
+    LayerMask(int width, int height, Uint8 value = 255);
+
+    int getWidth() const { return m_width; }
+    int getHeight() const { return m_height; }
+    bool isEmpty() const { return m_width <= 0 || m_height <= 0; }
+    size_t getBytes() const { return m_values.size(); }
+
+    Uint8 getValue(int x, int y) const;
+    const Uint8* getRow(int y) const { return m_values.data() + static_cast<size_t>(y) * m_width; }
+
+    void clear(Uint8 value = 255);
+    void fillRect(const SDL_Rect& rect, Uint8 value);
+    void invert();
+    // Softens the edges, two box blur passes so it comes out close to a gaussian
+    void feather(int radius);
+
+    // True if every mask value in rect is `value` (parts outside the mask count as 255)
+    bool isUniform(const SDL_Rect& rect, Uint8 value) const;
+
+private:
+    int m_width = 0;
+    int m_height = 0;
+    std::vector<Uint8> m_values;
+
+    bool clipRect(SDL_Rect& rect) const;
+    void boxBlurRows(std::vector<Uint8>& out, int radius) const;
+    void boxBlurColumns(std::vector<Uint8>& out, int radius) const;
+};
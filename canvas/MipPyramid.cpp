@@ -0,0 +1,115 @@
+#include "MipPyramid.hpp"
+#include <algorithm>
+
+std::atomic<Uint64> MipPyramid::s_nextVersion{1};
+
+SDL_Rect MipPyramid::levelRect(const SDL_Rect& rect, int level) {
+    // Floor the start, round the end up, so the level rect covers every partial pixel
+    int x0 = rect.x >> level;
+    int y0 = rect.y >> level;
+    int x1 = (rect.x + rect.w + (1 << level) - 1) >> level;
+    int y1 = (rect.y + rect.h + (1 << level) - 1) >> level;
+    return {x0, y0, x1 - x0, y1 - y0};
+}
+
+void MipPyramid::clear() {
+    m_levels.clear();
+    m_sourceWidth = 0;
+    m_sourceHeight = 0;
+    m_version = s_nextVersion++;
+}
+
+size_t MipPyramid::getResidentBytes() const {
+    size_t bytes = 0;
+    for (const TileBuffer& level : m_levels) {
+        bytes += level.getResidentBytes();
+    }
+    return bytes;
+}
+
+bool MipPyramid::update(const TileBuffer& source, const TileBuffer& changes) {
+    if (source.isEmpty()) {
+        if (isBuilt()) clear();
+        return false;
+    }
+
+    std::vector<SDL_Rect> dirty;
+    if (!isBuilt() || source.getWidth() != m_sourceWidth || source.getHeight() != m_sourceHeight) {
+        m_sourceWidth = source.getWidth();
+        m_sourceHeight = source.getHeight();
+        m_levels.assign(MAX_LEVELS, TileBuffer());
+        for (int level = 1; level <= MAX_LEVELS; level++) {
+            m_levels[level - 1].resize(levelSize(m_sourceWidth, level), levelSize(m_sourceHeight, level));
+        }
+        dirty.push_back({0, 0, m_sourceWidth, m_sourceHeight});
+    } else {
+        for (int i = 0; i < changes.getTileCount(); i++) {
+            if (changes.isTileDirty(i, TileBuffer::DIRTY_MIPMAP)) {
+                dirty.push_back(changes.getTileRect(i));
+            }
+        }
+    }
+    if (dirty.empty()) return false;
+
+    // A 256 tile becomes 128 pixels on level 1, 64 on level 2... so each level only redoes the
+    // little area above what changed below it
+    const TileBuffer* below = &source;
+    for (int level = 1; level <= MAX_LEVELS; level++) {
+        TileBuffer& current = m_levels[level - 1];
+        for (SDL_Rect& rect : dirty) {
+            rect = levelRect(rect, 1);
+            downsample(*below, current, rect);
+            current.compactTiles(rect); // solid areas stay single colour tiles all the way up
+        }
+        current.updateCoverage(); // the compositor culls on the levels as well
+        below = &current;
+    }
+    m_version = s_nextVersion++;
+    return true;
+}
+
+void MipPyramid::downsample(const TileBuffer& src, TileBuffer& dst, const SDL_Rect& dstRect) {
+    SDL_Rect area = dstRect;
+    SDL_Rect bounds = {0, 0, dst.getWidth(), dst.getHeight()};
+    if (!SDL_IntersectRect(&area, &bounds, &area)) return;
+
+    SDL_Rect srcRect = {area.x * 2, area.y * 2, area.w * 2, area.h * 2};
+    Uint32 color;
+    if (src.isRegionEmpty(srcRect)) {
+        dst.fillRect(area, 0); // drops whole tiles, doesn't allocate
+        return;
+    }
+    if (src.isRegionUniform(srcRect, color)) {
+        dst.fillRect(area, color); // averaging one colour gives that colour
+        return;
+    }
+
+    // Odd sizes: the last column/row of the level has only one source pixel, just reuse it
+    srcRect.w = std::min(srcRect.w, src.getWidth() - srcRect.x);
+    srcRect.h = std::min(srcRect.h, src.getHeight() - srcRect.y);
+    std::vector<Uint32> in(static_cast<size_t>(srcRect.w) * srcRect.h);
+    src.readRect(srcRect, in.data(), srcRect.w);
+
+    std::vector<Uint32> out(static_cast<size_t>(area.w) * area.h);
+    for (int y = 0; y < area.h; y++) {
+        const Uint32* row0 = in.data() + static_cast<size_t>(std::min(y * 2, srcRect.h - 1)) * srcRect.w;
+        const Uint32* row1 = in.data() + static_cast<size_t>(std::min(y * 2 + 1, srcRect.h - 1)) * srcRect.w;
+        Uint32* dstRow = out.data() + static_cast<size_t>(y) * area.w;
+        for (int x = 0; x < area.w; x++) {
+            int x0 = std::min(x * 2, srcRect.w - 1);
+            int x1 = std::min(x * 2 + 1, srcRect.w - 1);
+            Uint32 p[4] = {row0[x0], row0[x1], row1[x0], row1[x1]};
+
+            // Premultiplied, so the plain average is already weighted by alpha. Two channels at a
+            // time: each 8-bit value gets 16 bits of room, four of them can't carry into the next.
+            Uint32 rb = 2 * 0x00010001, ga = 2 * 0x00010001; // rounding
+            for (Uint32 pixel : p) {
+                rb += (pixel >> 8) & 0x00FF00FF;
+                ga += pixel & 0x00FF00FF;
+            }
+            dstRow[x] = (((rb >> 2) & 0x00FF00FF) << 8) | ((ga >> 2) & 0x00FF00FF);
+        }
+    }
+
+    dst.writeRect(area, out.data(), area.w);
+}
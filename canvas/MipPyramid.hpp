@@ -0,0 +1,42 @@
+#pragma once
+#include <SDL2/SDL.h>
+#include "TileBuffer.hpp"
+#include <vector>
+#include <atomic>
+
+// Half size copies of a layer, level 1 is 1/2, level 2 is 1/4 and so on. Zoomed out views,
+// thumbnails and the navigator read a small level instead of going through every full size pixel.
+// Built the first time somebody asks, after that only the parts above changed tiles get redone.
+// Each level is a 2x2 box filter of the one below. The tiles are premultiplied, so transparent
+// pixels don't pull the colour of soft edges towards black without any extra weighting.
+class MipPyramid {
+public:
+    static constexpr int MAX_LEVELS = 8; // 1/256, smaller than anything we ever show
+
+    // Brings the levels up to date with source (level 0). Only tiles flagged DIRTY_MIPMAP in
+    // `changes` (same size as source, usually the layer's own pixels) are propagated, a new size
+    // rebuilds everything. Doesn't clear the flags. Returns true if anything was redone.
+    bool update(const TileBuffer& source, const TileBuffer& changes);
+    void clear();
+
+    // level is 1..MAX_LEVELS, each dimension is the one below halved and rounded up
+    const TileBuffer& getLevel(int level) const { return m_levels[level - 1]; }
+    bool isBuilt() const { return !m_levels.empty(); }
+    static int levelSize(int size, int level) { return std::max(1, (size + (1 << level) - 1) >> level); }
+    // Level rect covering a level 0 rect
+    static SDL_Rect levelRect(const SDL_Rect& rect, int level);
+
+    // Changes every time a level changes, so thumbnails know when to refresh. Unique across all
+    // pyramids, a new layer that lands on a deleted one's address can't look up to date.
+    Uint64 getVersion() const { return m_version; }
+    size_t getResidentBytes() const;
+
+private:
+    std::vector<TileBuffer> m_levels;
+    int m_sourceWidth = 0;
+    int m_sourceHeight = 0;
+    Uint64 m_version = 0;
+    static std::atomic<Uint64> s_nextVersion;
+
+    static void downsample(const TileBuffer& src, TileBuffer& dst, const SDL_Rect& dstRect);
+};
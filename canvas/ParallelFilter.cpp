@@ -0,0 +1,33 @@
+#include "ParallelFilter.hpp"
+#include <algorithm>
+
+std::vector<Uint8> ParallelFilter::tilesNearContent(const TileBuffer& pixels, int halo) {
+    std::vector<Uint8> nearContent(pixels.getTileCount(), NEAR_NOTHING);
+    for (int i = 0; i < pixels.getTileCount(); i++) {
+        SDL_Rect r = pixels.getTileRect(i);
+        SDL_Rect grown = {r.x - halo, r.y - halo, r.w + halo * 2, r.h + halo * 2};
+        Uint32 color;
+        if (pixels.isRegionEmpty(grown)) continue;
+        nearContent[i] = pixels.isRegionUniform(grown, color) ? NEAR_UNIFORM : NEAR_CONTENT;
+    }
+    return nearContent;
+}
+
+void ParallelFilter::fillUniformTiles(const TileBuffer& pixels, const std::vector<Uint8>& nearContent, Uint32* out) {
+    for (int i = 0; i < pixels.getTileCount(); i++) {
+        if (nearContent[i] != NEAR_UNIFORM) continue;
+        SDL_Rect r = pixels.getTileRect(i);
+        for (int y = r.y; y < r.y + r.h; y++) {
+            Uint32* row = out + static_cast<size_t>(y) * pixels.getWidth();
+            std::fill(row + r.x, row + r.x + r.w, pixels.getTileColor(i));
+        }
+    }
+}
+
+void ParallelFilter::growForHalo(Layer& layer, int halo) {
+    if (halo <= 0) return;
+    SDL_Rect content = layer.getContentBounds();
+    if (content.w > 0 && content.h > 0) {
+        layer.ensureCovers({content.x - halo, content.y - halo, content.w + halo * 2, content.h + halo * 2});
+    }
+}
@@ -0,0 +1,87 @@
+#pragma once
+#include <SDL2/SDL.h>
+#include "Layer.hpp"
+#include "TileBuffer.hpp"
+#include "ThreadPool.hpp"
+#include <vector>
+
+// Runs filters over a layer's tiles on the thread pool, one tile per job.
+// Point filters (the colour adjustments) only need forEachTile: tiles don't depend on each other,
+// and editing different tiles from different threads is fine, the compositor does it too.
+// Neighbourhood filters (sharpen, edges, motion blur) go through forEachTileWithHalo. Each job gets
+// its tile plus `halo` pixels around it, copied out of a snapshot of the layer taken before
+// anything got written, so a kernel never sees a tile seam or a neighbour another job already
+// changed. The snapshot is a copy on write TileBuffer, so it only costs a copy of the tiles that
+// actually change, the same as the flat filter buffer did.
+// Filters that need whole rows or columns at once (the separable blur) stay on the flat buffer,
+// BlurEngine spreads those over the pool itself.
+class ParallelFilter {
+public:
+    // Per tile: can anything within `halo` pixels of it be seen? Output pixels in NEAR_NOTHING tiles
+    // only ever see transparent input, so filters can skip them and leave them empty.
+    // Tiles that only see one colour within the halo get NEAR_UNIFORM instead, averaging filters
+    // give back that same colour there and don't need to run.
+    enum : Uint8 { NEAR_NOTHING = 0, NEAR_CONTENT = 1, NEAR_UNIFORM = 2 };
+    static std::vector<Uint8> tilesNearContent(const TileBuffer& pixels, int halo);
+    // Fills the NEAR_UNIFORM tiles of a flat, layer sized buffer with their colour
+    static void fillUniformTiles(const TileBuffer& pixels, const std::vector<Uint8>& nearContent, Uint32* out);
+    // Grows the layer so it has room for content spreading `halo` pixels out
+    static void growForHalo(Layer& layer, int halo);
+
+    // op(tileIndex) for every tile of pixels, in parallel
+    template <typename TileOp>
+    static void forEachTile(const TileBuffer& pixels, TileOp op) {
+        GetThreadPool().parallelFor(pixels.getTileCount(), [&op](int i) { op(i); });
+    }
+
+    // What a neighbourhood kernel gets. Coordinates are layer pixels.
+    struct Block {
+        SDL_Rect rect;     // the tile being written
+        int layerX, layerY;             // where the layer sits on the canvas
+        int canvasWidth, canvasHeight;  // for kernels that treat the image edge specially
+        const Uint32* src; // snapshot pixel (rect.x, rect.y), readable `halo` pixels out on every side
+        int srcPitch;      // outside the layer reads as transparent
+        Uint32* dst;       // rect.w x rect.h, starts out as the tile's own pixels
+        Uint32 read(int x, int y) const { return src[(y - rect.y) * srcPitch + (x - rect.x)]; }
+        Uint32& write(int x, int y) const { return dst[(y - rect.y) * rect.w + (x - rect.x)]; }
+        // Layer pixel (x, y) is inside the canvas, `border` pixels in from its edge
+        bool onCanvas(int x, int y, int border = 0) const {
+            return x + layerX >= border && y + layerY >= border && x + layerX < canvasWidth - border &&
+                   y + layerY < canvasHeight - border;
+        }
+    };
+
+    // kernel(const Block&) for every tile that can see content within halo, in parallel, then
+    // trims the layer. With grow set the layer first gets room for the halo, so every pixel the
+    // kernel can reach is in a tile it runs on. With skipUniform NEAR_UNIFORM tiles are left as they are.
+    template <typename Kernel>
+    static void forEachTileWithHalo(Layer& layer, int halo, bool grow, bool skipUniform, Kernel kernel) {
+        if (!layer.hasPixels()) return;
+        if (grow) growForHalo(layer, halo);
+
+        TileBuffer& pixels = layer.getPixels();
+        const TileBuffer source = pixels;
+        const std::vector<Uint8> nearContent = tilesNearContent(source, halo);
+        std::vector<int> tiles;
+        for (int i = 0; i < source.getTileCount(); i++) {
+            if (nearContent[i] == NEAR_CONTENT || (nearContent[i] == NEAR_UNIFORM && !skipUniform)) tiles.push_back(i);
+        }
+
+        GetThreadPool().parallelFor(static_cast<int>(tiles.size()), [&](int k) {
+            const SDL_Rect rect = source.getTileRect(tiles[k]);
+            const int pitch = rect.w + halo * 2;
+            std::vector<Uint32> src(static_cast<size_t>(pitch) * (rect.h + halo * 2));
+            source.readRect({rect.x - halo, rect.y - halo, pitch, rect.h + halo * 2}, src.data(), pitch);
+            std::vector<Uint32> dst(static_cast<size_t>(rect.w) * rect.h);
+            const Uint32* center = src.data() + halo * pitch + halo;
+            for (int y = 0; y < rect.h; y++) {
+                std::copy(center + y * pitch, center + y * pitch + rect.w, dst.data() + y * rect.w);
+            }
+
+            kernel(Block{rect, layer.getX(), layer.getY(), layer.getCanvasWidth(), layer.getCanvasHeight(),
+                         center, pitch, dst.data()});
+            pixels.writeRect(rect, dst.data(), rect.w);
+        });
+        layer.trimToContent();
+    }
+};
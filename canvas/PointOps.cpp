@@ -0,0 +1,23 @@
+#include "PointOps.hpp"
+
+static PointOps::Kernel detectKernel() {
+#ifdef POINTOPS_HAS_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) return PointOps::Kernel::AVX2;
+    if (__builtin_cpu_supports("sse2")) return PointOps::Kernel::SSE2;
+#endif
+    return PointOps::Kernel::SCALAR;
+}
+
+PointOps::Kernel PointOps::getKernel() {
+    static const Kernel kernel = detectKernel();
+    return kernel;
+}
+
+const char* PointOps::getKernelName() {
+    switch (getKernel()) {
+        case Kernel::AVX2: return "AVX2";
+        case Kernel::SSE2: return "SSE2";
+        default: return "Scalar";
+    }
+}
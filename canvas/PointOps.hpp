@@ -0,0 +1,357 @@
+#pragma once
+#include <SDL2/SDL.h>
+#include <cstring>
+#include <type_traits>
+
+// Same trick as the blend engine: the kernels below pick their instruction set with per-function
+// target attributes, the rest of the program stays plain x86-64
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#define POINTOPS_HAS_X86 1
+#define POINTOPS_INLINE __attribute__((always_inline)) inline
+#define POINTOPS_SSE2 __attribute__((target("sse2"), flatten))
+#define POINTOPS_AVX2 __attribute__((target("avx2"), flatten))
+#else
+#define POINTOPS_INLINE inline
+#endif
+
+// Where the channels sit in a packed pixel, as shifts. A template parameter so the kernels shift
+// by constants. The tiles are 0xRRGGBBAA.
+struct PixelLayoutRGBA8888 {
+    static constexpr int R = 24, G = 16, B = 8, A = 0;
+};
+
+// Vectorised point ops: colour adjustments where an output pixel only depends on the same input
+// pixel. An op is a generic lambda taking straight colour (1 = full intensity) by reference and
+// changing it in place:
+//     [=](auto& r, auto& g, auto& b) { r += offset; g += offset; b += offset; }
+// The kernels call it with 8 pixels per channel (AVX2), 4 (SSE2) or one float (no SIMD, and the
+// end of a row), as GCC vector types. So an op may only use arithmetic, comparisons, ?: and the
+// helpers below, never std:: maths or branches on the values. Then every width does the same
+// float operations and the result is the same bits whichever kernel the CPU check picked.
+// The unpremultiplying, clamping and packing around the op are done here, once per block.
+// The helpers work like ops too: they take vectors by reference and change the first one in place
+// (or write their result into it) instead of returning one. The templates get instantiated outside
+// the AVX2 kernels as well, and there an 8 wide vector passed or returned by value has a different
+// calling convention than inside them (GCC warns, -Wpsabi), through references there is none.
+class PointOps {
+public:
+    enum class Kernel { SCALAR, SSE2, AVX2 };
+    // Decided once from the CPU, like BlendEngine
+    static Kernel getKernel();
+    // "AVX2", "SSE2" or "Scalar"
+    static const char* getKernelName();
+
+    // Runs op on count premultiplied 8-bit pixels in place. Colour gets clamped to 0-1 after op,
+    // alpha is left alone, so fully transparent blocks are skipped.
+    template <typename Layout = PixelLayoutRGBA8888, typename Op>
+    static void runRow8(const Op& op, Uint32* pixels, int count);
+    // Same on premultiplied float pixels laid out like DeepBuffer::loadRow (a, b, g, r). Only
+    // clamps with clamp set (half float keeps colour past 1), pixels with alpha 0 are left as they are.
+    template <typename Op>
+    static void runRowFloat(const Op& op, float* pixels, int count, bool clamp);
+
+    // Helpers for ops, work on floats and vectors alike, v in place. b can be a plain float in min/max.
+    template <typename V, typename W> POINTOPS_INLINE static void min(V& v, const W& b) { v = v < b ? v : b; }
+    template <typename V, typename W> POINTOPS_INLINE static void max(V& v, const W& b) { v = v > b ? v : b; }
+    template <typename V> POINTOPS_INLINE static void clamp(V& v, float lo, float hi) {
+        max(v, lo);
+        min(v, hi);
+    }
+    template <typename V> POINTOPS_INLINE static void abs(V& v) { v = v < 0.0f ? -v : v; }
+    template <typename V> POINTOPS_INLINE static void floor(V& v) {
+        typename LanesOf<V>::I i;
+        V t;
+        toInt(i, v);
+        toFloat(t, i);
+        v = t > v ? t - 1.0f : t;
+    }
+    // Always in [0, m), like the hue wrapping wants
+    template <typename V> POINTOPS_INLINE static void mod(V& v, float m) {
+        V q = v * (1.0f / m);
+        floor(q);
+        v = v - q * m;
+    }
+    template <typename V> POINTOPS_INLINE static void luminance(V& out, const V& r, const V& g, const V& b) { out = 0.299f * r + 0.587f * g + 0.114f * b; }
+    // v^y for v >= 0 (0 for anything else) through log2/exp2 polynomials, about 1e-6 relative
+    template <typename V> POINTOPS_INLINE static void pow(V& v, float y) {
+        V result = v;
+        max(result, 1e-30f);
+        log2(result);
+        result *= y;
+        exp2(result);
+        v = v > 0.0f ? result : 0.0f;
+    }
+    // table[i] is the value at i / (size - 1), v is clamped to 0-1 and interpolated between entries
+    template <typename V> POINTOPS_INLINE static void lookup(V& v, const float* table, int size) {
+        V x = v;
+        clamp(x, 0.0f, 1.0f);
+        x *= static_cast<float>(size - 1);
+        typename LanesOf<V>::I i;
+        toInt(i, x);
+        min(i, size - 2);
+        V t;
+        toFloat(t, i);
+        t = x - t;
+        V lo, hi;
+        if constexpr (std::is_same_v<V, float>) {
+            lo = table[i];
+            hi = table[i + 1];
+        } else {
+            for (int k = 0; k < widthOf<V>(); k++) {
+                lo[k] = table[i[k]];
+                hi[k] = table[i[k] + 1];
+            }
+        }
+        v = lo + (hi - lo) * t;
+    }
+
+private:
+    // Float, int and unsigned lanes of one width (and the same bits as 64-bit lanes)
+    struct ScalarLanes {
+        using F = float;
+        using I = int;
+        using U = Uint32;
+    };
+#ifdef POINTOPS_HAS_X86
+    struct Lanes4 {
+        typedef float F __attribute__((vector_size(16)));
+        typedef int I __attribute__((vector_size(16)));
+        typedef Uint32 U __attribute__((vector_size(16)));
+        typedef Uint64 Q __attribute__((vector_size(16)));
+    };
+    struct Lanes8 {
+        typedef float F __attribute__((vector_size(32)));
+        typedef int I __attribute__((vector_size(32)));
+        typedef Uint32 U __attribute__((vector_size(32)));
+        typedef Uint64 Q __attribute__((vector_size(32)));
+    };
+#endif
+    template <typename V> static constexpr int widthOf() { return static_cast<int>(sizeof(V) / sizeof(float)); }
+    // The lane types a float, int or vector of that width goes with
+#ifdef POINTOPS_HAS_X86
+    template <typename V>
+    using LanesOf = std::conditional_t<sizeof(V) == sizeof(float), ScalarLanes, std::conditional_t<sizeof(V) == 16, Lanes4, Lanes8>>;
+#else
+    template <typename V> using LanesOf = ScalarLanes;
+#endif
+
+    // Conversions, out is the same width as v
+    template <typename V> POINTOPS_INLINE static void toInt(typename LanesOf<V>::I& out, const V& v) {
+        if constexpr (std::is_same_v<V, float>) {
+            out = static_cast<int>(v);
+        } else {
+#ifdef POINTOPS_HAS_X86
+            out = __builtin_convertvector(v, typename LanesOf<V>::I);
+#endif
+        }
+    }
+    // From signed or unsigned lanes, the unsigned ones only ever hold a byte here
+    template <typename I> POINTOPS_INLINE static void toFloat(typename LanesOf<I>::F& out, const I& i) {
+        if constexpr (std::is_same_v<I, int> || std::is_same_v<I, Uint32>) {
+            out = static_cast<float>(static_cast<int>(i));
+        } else {
+#ifdef POINTOPS_HAS_X86
+            out = __builtin_convertvector((typename LanesOf<I>::I)i, typename LanesOf<I>::F);
+#endif
+        }
+    }
+    template <typename V> POINTOPS_INLINE static void toUnsigned(typename LanesOf<V>::U& out, const V& v) {
+        typename LanesOf<V>::I i;
+        toInt(i, v);
+        out = (typename LanesOf<V>::U)i;
+    }
+    // Whether any lane has a bit set, kept in registers (memcmp went through the stack)
+    template <typename U> POINTOPS_INLINE static bool anyBits(const U& v) {
+        if constexpr (std::is_same_v<U, Uint32>) {
+            return v != 0;
+        } else {
+#ifdef POINTOPS_HAS_X86
+            auto q = (typename LanesOf<U>::Q)v;
+            if constexpr (sizeof(U) == 32) q |= __builtin_shufflevector(q, q, 2, 3, 0, 1);
+            return (q[0] | q[1]) != 0;
+#endif
+        }
+    }
+    // Same bits, another lane type
+    template <typename T, typename V> POINTOPS_INLINE static void copyBits(T& out, const V& v) {
+        static_assert(sizeof(T) == sizeof(V));
+        std::memcpy(&out, &v, sizeof(out));
+    }
+
+    // Exponent plus ln of the mantissa moved into [sqrt(1/2), sqrt(2)) as 2 atanh((m - 1) / (m + 1))
+    template <typename V> POINTOPS_INLINE static void log2(V& x) {
+        typename LanesOf<V>::I bits;
+        copyBits(bits, x);
+        V e, m;
+        toFloat(e, ((bits >> 23) & 0xFF) - 127);
+        copyBits(m, (bits & 0x7FFFFF) | 0x3F800000);
+        auto big = m > 1.41421356f;
+        m = big ? m * 0.5f : m;
+        e = big ? e + 1.0f : e;
+        V t = (m - 1.0f) / (m + 1.0f);
+        V t2 = t * t;
+        V ln = t * (2.0f + t2 * (2.0f / 3.0f + t2 * (2.0f / 5.0f + t2 * (2.0f / 7.0f + t2 * (2.0f / 9.0f)))));
+        x = e + ln * 1.44269504f;
+    }
+    // 2^floor(y) straight into the exponent bits, times e^z with z within ln2 / 2 of 0
+    template <typename V> POINTOPS_INLINE static void exp2(V& x) {
+        V y = x;
+        clamp(y, -126.0f, 126.0f);
+        V whole = y;
+        floor(whole);
+        V z = (y - whole - 0.5f) * 0.69314718f;
+        V p = 1.0f + z * (1.0f + z * (1.0f / 2.0f + z * (1.0f / 6.0f + z * (1.0f / 24.0f + z * (1.0f / 120.0f + z * (1.0f / 720.0f))))));
+        typename LanesOf<V>::I i;
+        V scale;
+        toInt(i, whole);
+        copyBits(scale, (i + 127) << 23);
+        x = p * 1.41421356f * scale;
+    }
+
+    template <typename V, typename T> POINTOPS_INLINE static void load(V& v, const T* p) { std::memcpy(&v, p, sizeof(v)); }
+    template <typename T, typename V> POINTOPS_INLINE static void store(T* p, const V& v) { std::memcpy(p, &v, sizeof(v)); }
+
+    template <typename Lanes, typename Layout, typename Op>
+    POINTOPS_INLINE static int row8Blocks(const Op& op, Uint32* pixels, int count);
+    template <typename Lanes, typename Op>
+    POINTOPS_INLINE static int rowFloatBlocks(const Op& op, float* pixels, int count, bool clamp);
+
+#ifdef POINTOPS_HAS_X86
+    template <typename Layout, typename Op>
+    POINTOPS_SSE2 static int row8SSE2(const Op& op, Uint32* pixels, int count) { return row8Blocks<Lanes4, Layout>(op, pixels, count); }
+    template <typename Layout, typename Op>
+    POINTOPS_AVX2 static int row8AVX2(const Op& op, Uint32* pixels, int count) { return row8Blocks<Lanes8, Layout>(op, pixels, count); }
+    template <typename Op>
+    POINTOPS_SSE2 static int rowFloatSSE2(const Op& op, float* pixels, int count, bool clamp) { return rowFloatBlocks<Lanes4>(op, pixels, count, clamp); }
+    template <typename Op>
+    POINTOPS_AVX2 static int rowFloatAVX2(const Op& op, float* pixels, int count, bool clamp) { return rowFloatBlocks<Lanes8>(op, pixels, count, clamp); }
+#endif
+};
+
+// Whole blocks of the lane width, returns how many pixels that covered. The scalar lanes do
+// every pixel, they finish off whatever the vector ones left.
+template <typename Lanes, typename Layout, typename Op>
+POINTOPS_INLINE int PointOps::row8Blocks(const Op& op, Uint32* pixels, int count) {
+    using F = typename Lanes::F;
+    using U = typename Lanes::U;
+    constexpr int W = widthOf<F>();
+    int i = 0;
+    for (; i + W <= count; i += W) {
+        U p;
+        load(p, pixels + i);
+        U alpha = (p >> Layout::A) & 0xFF;
+        if (!anyBits(alpha)) continue;
+
+        // Opaque blocks, the usual case, skip the divide (1 / 255 is the same float either way).
+        // Alpha 0 lanes come out as 0 whatever op does, no need to keep the divide away from them.
+        F a, inv;
+        if (!anyBits(alpha ^ 0xFF)) {
+            toFloat(a, alpha - alpha);
+            a += 255.0f;
+            inv = a - a + 1.0f / 255.0f;
+        } else {
+            toFloat(a, alpha);
+            inv = a;
+            max(inv, 1.0f);
+            inv = 1.0f / inv;
+        }
+        F r, g, b;
+        toFloat(r, (p >> Layout::R) & 0xFF);
+        toFloat(g, (p >> Layout::G) & 0xFF);
+        toFloat(b, (p >> Layout::B) & 0xFF);
+        r *= inv;
+        g *= inv;
+        b *= inv;
+        op(r, g, b);
+
+        if constexpr (W == 1) {
+            clamp(r, 0.0f, 1.0f);
+            clamp(g, 0.0f, 1.0f);
+            clamp(b, 0.0f, 1.0f);
+        } else {
+            // The top end gets clamped after converting, one unsigned min instead of a compare and
+            // blend. Too big to convert comes out as 0x80000000, so that still ends up at alpha.
+            max(r, 0.0f);
+            max(g, 0.0f);
+            max(b, 0.0f);
+        }
+        U outR, outG, outB;
+        toUnsigned(outR, r * a + 0.5f);
+        toUnsigned(outG, g * a + 0.5f);
+        toUnsigned(outB, b * a + 0.5f);
+        if constexpr (W != 1) {
+            min(outR, alpha);
+            min(outG, alpha);
+            min(outB, alpha);
+        }
+        store(pixels + i, (p & (0xFFu << Layout::A)) | (outR << Layout::R) | (outG << Layout::G) | (outB << Layout::B));
+    }
+    return i;
+}
+
+template <typename Lanes, typename Op>
+POINTOPS_INLINE int PointOps::rowFloatBlocks(const Op& op, float* pixels, int count, bool clampColor) {
+    using F = typename Lanes::F;
+    constexpr int W = widthOf<F>();
+    int i = 0;
+    for (; i + W <= count; i += W) {
+        // Interleaved a, b, g, r to one vector per channel
+        F channel[4];
+        for (int c = 0; c < 4; c++) {
+            if constexpr (W == 1) {
+                channel[c] = pixels[i * 4 + c];
+            } else {
+                for (int k = 0; k < W; k++) channel[c][k] = pixels[(i + k) * 4 + c];
+            }
+        }
+
+        F a = channel[0];
+        auto visible = a > 0.0f;
+        F safe = visible ? a : 1.0f;
+        F r = channel[3] / safe, g = channel[2] / safe, b = channel[1] / safe;
+        op(r, g, b);
+        if (clampColor) {
+            clamp(r, 0.0f, 1.0f);
+            clamp(g, 0.0f, 1.0f);
+            clamp(b, 0.0f, 1.0f);
+        }
+        channel[1] = visible ? b * a : channel[1];
+        channel[2] = visible ? g * a : channel[2];
+        channel[3] = visible ? r * a : channel[3];
+
+        for (int c = 1; c < 4; c++) {
+            if constexpr (W == 1) {
+                pixels[i * 4 + c] = channel[c];
+            } else {
+                for (int k = 0; k < W; k++) pixels[(i + k) * 4 + c] = channel[c][k];
+            }
+        }
+    }
+    return i;
+}
+
+template <typename Layout, typename Op>
+void PointOps::runRow8(const Op& op, Uint32* pixels, int count) {
+    int done = 0;
+#ifdef POINTOPS_HAS_X86
+    switch (getKernel()) {
+        case Kernel::AVX2: done = row8AVX2<Layout>(op, pixels, count); break;
+        case Kernel::SSE2: done = row8SSE2<Layout>(op, pixels, count); break;
+        default: break;
+    }
+#endif
+    row8Blocks<ScalarLanes, Layout>(op, pixels + done, count - done);
+}
+
+template <typename Op>
+void PointOps::runRowFloat(const Op& op, float* pixels, int count, bool clamp) {
+    int done = 0;
+#ifdef POINTOPS_HAS_X86
+    switch (getKernel()) {
+        case Kernel::AVX2: done = rowFloatAVX2(op, pixels, count, clamp); break;
+        case Kernel::SSE2: done = rowFloatSSE2(op, pixels, count, clamp); break;
+        default: break;
+    }
+#endif
+    rowFloatBlocks<ScalarLanes>(op, pixels + done * 4, count - done, clamp);
+}
@@ -0,0 +1,117 @@
+#include "ThreadPool.hpp"
+#include <algorithm>
+
+// Set while a thread is running pool work, nested parallelFor calls then just loop inline
+static thread_local bool t_insideJob = false;
+
+ThreadPool& ThreadPool::getInstance() {
+    static ThreadPool instance;
+    return instance;
+}
+
+ThreadPool::ThreadPool() {
+    setThreadCount(0);
+}
+
+ThreadPool::~ThreadPool() {
+    stopWorkers();
+}
+
+bool ThreadPool::isInsideJob() {
+    return t_insideJob;
+}
+
+int ThreadPool::getHardwareThreads() {
+    return std::max(1, static_cast<int>(std::thread::hardware_concurrency()));
+}
+
+void ThreadPool::setThreadCount(int count) {
+    if (count <= 0) count = getHardwareThreads();
+    std::lock_guard<std::mutex> submit(m_submitMutex);
+    if (count == m_threadCount && static_cast<int>(m_workers.size()) == count - 1) return;
+    stopWorkers();
+    m_threadCount = count;
+    startWorkers(count - 1);
+}
+
+void ThreadPool::shutdown() {
+    std::lock_guard<std::mutex> submit(m_submitMutex);
+    stopWorkers();
+    m_threadCount = 1;
+}
+
+void ThreadPool::startWorkers(int count) {
+    m_stopping = false;
+    for (int i = 0; i < count; i++) {
+        // Workers start from the current generation, so a job posted before they get going
+        // still counts as new for them
+        m_workers.emplace_back(&ThreadPool::workerLoop, this, m_generation);
+    }
+}
+
+void ThreadPool::stopWorkers() {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stopping = true;
+    }
+    m_wake.notify_all();
+    for (std::thread& worker : m_workers) {
+        worker.join();
+    }
+    m_workers.clear();
+}
+
+void ThreadPool::parallelFor(int count, const std::function<void(int)>& fn) {
+    if (count <= 0) return;
+    if (m_threadCount <= 1 || count == 1 || t_insideJob) {
+        for (int i = 0; i < count; i++) fn(i);
+        return;
+    }
+
+    std::lock_guard<std::mutex> submit(m_submitMutex);
+    if (m_workers.empty()) {
+        for (int i = 0; i < count; i++) fn(i);
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_job = &fn;
+        m_jobCount = count;
+        m_nextIndex = 0;
+        m_busyWorkers = static_cast<int>(m_workers.size());
+        m_generation++;
+    }
+    m_wake.notify_all();
+
+    runJob();
+
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_done.wait(lock, [this] { return m_busyWorkers == 0; });
+    m_job = nullptr;
+}
+
+void ThreadPool::workerLoop(unsigned seen) {
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_wake.wait(lock, [&] { return m_stopping || m_generation != seen; });
+            if (m_stopping) return;
+            seen = m_generation;
+        }
+
+        runJob();
+
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (--m_busyWorkers == 0) {
+            m_done.notify_one();
+        }
+    }
+}
+
+void ThreadPool::runJob() {
+    t_insideJob = true;
+    for (int i = m_nextIndex++; i < m_jobCount; i = m_nextIndex++) {
+        (*m_job)(i);
+    }
+    t_insideJob = false;
+}
@@ -0,0 +1,58 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// One set of worker threads for everything that splits work into independent pieces (tiles
+// mostly). Nothing here knows about pixels, it just hands out indices.
+// The thread doing the parallelFor works too, so a pool of N threads has N - 1 workers.
+class ThreadPool {
+public:
+    static ThreadPool& getInstance();
+
+    // Total threads including the caller. 0 means one per hardware thread, 1 runs everything inline.
+    void setThreadCount(int count);
+    int getThreadCount() const { return m_threadCount; }
+    static int getHardwareThreads();
+
+    // Calls fn(i) once for every i in [0, count) and returns when all of them are done.
+    // Indices are handed out one at a time, so uneven tiles still balance out. Calls made from
+    // inside a job run inline instead of deadlocking on the pool.
+    void parallelFor(int count, const std::function<void(int)>& fn);
+    // True on any thread that's currently running pool work, the caller of parallelFor included
+    static bool isInsideJob();
+
+    void shutdown();
+
+private:
+    ThreadPool();
+    ~ThreadPool();
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    std::vector<std::thread> m_workers;
+    int m_threadCount = 1;
+
+    std::mutex m_submitMutex; // one parallelFor at a time, the others wait their turn
+    std::mutex m_mutex;
+    std::condition_variable m_wake;
+    std::condition_variable m_done;
+    const std::function<void(int)>* m_job = nullptr;
+    int m_jobCount = 0;
+    std::atomic<int> m_nextIndex{0};
+    int m_busyWorkers = 0;
+    unsigned m_generation = 0;
+    bool m_stopping = false;
+
+    void startWorkers(int count);
+    void stopWorkers();
+    void workerLoop(unsigned seen);
+    void runJob();
+};
+
+inline ThreadPool& GetThreadPool() {
+    return ThreadPool::getInstance();
+}
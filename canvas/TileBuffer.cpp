@@ -0,0 +1,609 @@
+#include "TileBuffer.hpp"
+#include "BlendEngine.hpp"
+#include "TileStore.hpp"
+#include "TileSwap.hpp"
+#include "ThreadPool.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+static_assert(TileSwap::TILE_BYTES == TileBuffer::TILE_PIXELS * sizeof(Uint32), "tile slots have to fit a tile");
+
+TileBuffer::TileBuffer(int width, int height) {
+    resize(width, height);
+}
+
+void TileBuffer::resize(int width, int height) {
+    m_width = std::max(0, width);
+    m_height = std::max(0, height);
+    m_tilesX = (m_width + TILE_SIZE - 1) / TILE_SIZE;
+    m_tilesY = (m_height + TILE_SIZE - 1) / TILE_SIZE;
+
+    // Nothing is allocated until somebody actually draws
+    m_tiles.clear();
+    m_tiles.resize(getTileCount());
+    m_solid.assign(getTileCount(), 0);
+    m_dirty.assign(getTileCount(), DIRTY_ALL);
+    m_coverage.assign(getTileCount(), COVERAGE_UNKNOWN);
+}
+
+void TileBuffer::clear() {
+    for (auto& tile : m_tiles) {
+        tile.reset();
+    }
+    std::fill(m_solid.begin(), m_solid.end(), 0u);
+    markAllDirty();
+}
+
+SDL_Rect TileBuffer::getTileRect(int index) const {
+    int tx = index % m_tilesX;
+    int ty = index / m_tilesX;
+    int x = tx * TILE_SIZE;
+    int y = ty * TILE_SIZE;
+    return {x, y, std::min(TILE_SIZE, m_width - x), std::min(TILE_SIZE, m_height - y)};
+}
+
+Uint32* TileBuffer::editTile(int index) {
+    touchTile(index);
+    Tile& tile = m_tiles[index];
+    if (!tile) {
+        tile = GetTileSwap().allocate(); // zeroed, so transparent
+        if (m_solid[index] != 0) {
+            // Expand the single colour, the padding past the image edge stays zero
+            SDL_Rect tileRect = getTileRect(index);
+            for (int y = 0; y < tileRect.h; y++) {
+                std::fill(tile.get() + y * TILE_SIZE, tile.get() + y * TILE_SIZE + tileRect.w, m_solid[index]);
+            }
+            m_solid[index] = 0;
+        }
+    } else if (tile.use_count() > 1) {
+        // Copy on write: somebody else still looks at this tile, so give us our own
+        Tile copy = GetTileSwap().allocate();
+        std::memcpy(copy.get(), tile.get(), TILE_PIXELS * sizeof(Uint32));
+        tile = std::move(copy);
+    } else {
+        GetTileSwap().prepareWrite(tile.get()); // back into RAM if it got swapped out
+    }
+    return tile.get();
+}
+
+void TileBuffer::setTileColor(int index, Uint32 color) {
+    m_tiles[index].reset(); // if it was shared the other owners keep their reference
+    m_solid[index] = alphaOf(color) == 0 ? 0 : color;
+    touchTile(index);
+}
+
+bool TileBuffer::isRegionEmpty(const SDL_Rect& rect) const {
+    SDL_Rect area = rect;
+    if (!clipRect(area)) return true;
+    for (int ty = area.y >> TILE_SHIFT; ty <= (area.y + area.h - 1) >> TILE_SHIFT; ty++) {
+        for (int tx = area.x >> TILE_SHIFT; tx <= (area.x + area.w - 1) >> TILE_SHIFT; tx++) {
+            int index = ty * m_tilesX + tx;
+            if (m_tiles[index] || m_solid[index] != 0) return false;
+        }
+    }
+    return true;
+}
+
+bool TileBuffer::isRegionUniform(const SDL_Rect& rect, Uint32& color) const {
+    SDL_Rect area = rect;
+    if (!clipRect(area)) return false;
+    bool first = true;
+    for (int ty = area.y >> TILE_SHIFT; ty <= (area.y + area.h - 1) >> TILE_SHIFT; ty++) {
+        for (int tx = area.x >> TILE_SHIFT; tx <= (area.x + area.w - 1) >> TILE_SHIFT; tx++) {
+            int index = ty * m_tilesX + tx;
+            if (m_tiles[index]) return false;
+            if (first) {
+                color = m_solid[index];
+                first = false;
+            } else if (m_solid[index] != color) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+TileBuffer::Coverage TileBuffer::getTileCoverage(int index) const {
+    if (!m_tiles[index]) {
+        Uint8 alpha = alphaOf(m_solid[index]);
+        return alpha == 0 ? COVERAGE_EMPTY : (alpha == 255 ? COVERAGE_OPAQUE : COVERAGE_MIXED);
+    }
+    if (m_coverage[index] != COVERAGE_UNKNOWN) return static_cast<Coverage>(m_coverage[index]);
+    return computeCoverage(index);
+}
+
+void TileBuffer::updateCoverage() {
+    for (int i = 0; i < getTileCount(); i++) {
+        if (m_tiles[i] && m_coverage[i] == COVERAGE_UNKNOWN) {
+            m_coverage[i] = computeCoverage(i);
+        }
+    }
+}
+
+TileBuffer::Coverage TileBuffer::computeCoverage(int index) const {
+    const Uint32* tile = m_tiles[index].get();
+    SDL_Rect tileRect = getTileRect(index);
+    // AND of all alphas is 255 only if everything is opaque, OR is 0 only if nothing is.
+    // Plain loops over a row so the compiler vectorises them, bail out once it's clearly mixed.
+    Uint32 allAlpha = 0xFF, anyAlpha = 0;
+    for (int y = 0; y < tileRect.h; y++) {
+        const Uint32* row = tile + y * TILE_SIZE;
+        for (int x = 0; x < tileRect.w; x++) {
+            allAlpha &= row[x];
+            anyAlpha |= row[x] & 0xFF;
+        }
+        if (anyAlpha != 0 && (allAlpha & 0xFF) != 0xFF) return COVERAGE_MIXED;
+    }
+    if (anyAlpha == 0) return COVERAGE_EMPTY;
+    return (allAlpha & 0xFF) == 0xFF ? COVERAGE_OPAQUE : COVERAGE_MIXED;
+}
+
+bool TileBuffer::isRegionTransparent(const SDL_Rect& rect) const {
+    SDL_Rect area = rect;
+    if (!clipRect(area)) return true;
+    for (int ty = area.y >> TILE_SHIFT; ty <= (area.y + area.h - 1) >> TILE_SHIFT; ty++) {
+        for (int tx = area.x >> TILE_SHIFT; tx <= (area.x + area.w - 1) >> TILE_SHIFT; tx++) {
+            if (getTileCoverage(ty * m_tilesX + tx) != COVERAGE_EMPTY) return false;
+        }
+    }
+    return true;
+}
+
+bool TileBuffer::isRegionOpaque(const SDL_Rect& rect) const {
+    if (rect.w <= 0 || rect.h <= 0) return false;
+    if (rect.x < 0 || rect.y < 0 || rect.x + rect.w > m_width || rect.y + rect.h > m_height) return false;
+    for (int ty = rect.y >> TILE_SHIFT; ty <= (rect.y + rect.h - 1) >> TILE_SHIFT; ty++) {
+        for (int tx = rect.x >> TILE_SHIFT; tx <= (rect.x + rect.w - 1) >> TILE_SHIFT; tx++) {
+            if (getTileCoverage(ty * m_tilesX + tx) != COVERAGE_OPAQUE) return false;
+        }
+    }
+    return true;
+}
+
+SDL_Rect TileBuffer::getTileContentRect(int index) const {
+    SDL_Rect tileRect = getTileRect(index);
+    const Uint32* tile = m_tiles[index].get();
+    if (!tile) return m_solid[index] != 0 ? tileRect : SDL_Rect{tileRect.x, tileRect.y, 0, 0};
+    if (m_coverage[index] == COVERAGE_EMPTY) return {tileRect.x, tileRect.y, 0, 0};
+    if (m_coverage[index] == COVERAGE_OPAQUE) return tileRect;
+
+    int minX = tileRect.w, maxX = -1, minY = tileRect.h, maxY = -1;
+    for (int y = 0; y < tileRect.h; y++) {
+        const Uint32* row = tile + y * TILE_SIZE;
+        int first = 0;
+        while (first < tileRect.w && alphaOf(row[first]) == 0) first++;
+        if (first == tileRect.w) continue;
+        int last = tileRect.w - 1;
+        while (alphaOf(row[last]) == 0) last--;
+        minX = std::min(minX, first);
+        maxX = std::max(maxX, last);
+        minY = std::min(minY, y);
+        maxY = y;
+    }
+    if (maxX < 0) return {tileRect.x, tileRect.y, 0, 0};
+    return {tileRect.x + minX, tileRect.y + minY, maxX - minX + 1, maxY - minY + 1};
+}
+
+void TileBuffer::compactTiles() {
+    for (int i = 0; i < getTileCount(); i++) {
+        compactTile(i);
+    }
+}
+
+void TileBuffer::compactTiles(const SDL_Rect& rect) {
+    SDL_Rect area = rect;
+    if (!clipRect(area)) return;
+    for (int ty = area.y >> TILE_SHIFT; ty <= (area.y + area.h - 1) >> TILE_SHIFT; ty++) {
+        for (int tx = area.x >> TILE_SHIFT; tx <= (area.x + area.w - 1) >> TILE_SHIFT; tx++) {
+            compactTile(ty * m_tilesX + tx);
+        }
+    }
+}
+
+void TileBuffer::compactTile(int index) {
+    const Tile& tile = m_tiles[index];
+    if (!tile) return;
+    // Padding past the image edge is always zero, only the part inside has to match
+    SDL_Rect tileRect = getTileRect(index);
+    Uint32 color = tile[0];
+    for (int y = 0; y < tileRect.h; y++) {
+        const Uint32* row = tile.get() + y * TILE_SIZE;
+        bool same = alphaOf(color) == 0
+            ? std::all_of(row, row + tileRect.w, [](Uint32 p) { return alphaOf(p) == 0; })
+            : std::all_of(row, row + tileRect.w, [color](Uint32 p) { return p == color; });
+        if (!same) return;
+    }
+    setTileColor(index, color);
+}
+
+int TileBuffer::getAllocatedTileCount() const {
+    return static_cast<int>(std::count_if(m_tiles.begin(), m_tiles.end(),
+                                          [](const Tile& tile) { return tile != nullptr; }));
+}
+
+int TileBuffer::getUniformTileCount() const {
+    int count = 0;
+    for (int i = 0; i < getTileCount(); i++) {
+        if (!m_tiles[i] && m_solid[i] != 0) count++;
+    }
+    return count;
+}
+
+int TileBuffer::getSharedTileCount() const {
+    return static_cast<int>(std::count_if(m_tiles.begin(), m_tiles.end(),
+                                          [](const Tile& tile) { return tile && tile.use_count() > 1; }));
+}
+
+int TileBuffer::deduplicate() {
+    std::vector<int> changed;
+    for (int i = 0; i < getTileCount(); i++) {
+        if (m_tiles[i] && isTileDirty(i, DIRTY_DEDUP)) changed.push_back(i);
+        clearTileDirty(i, DIRTY_DEDUP);
+    }
+    if (changed.empty()) return 0;
+
+    // Hashing reads the whole tile, that part goes wide. The lookups are cheap and stay here.
+    std::vector<Uint64> hashes(changed.size());
+    GetThreadPool().parallelFor(static_cast<int>(changed.size()), [&](int k) {
+        hashes[k] = TileStore::hashTile(m_tiles[changed[k]].get());
+    });
+
+    TileStore& store = GetTileStore();
+    int merged = 0;
+    for (size_t k = 0; k < changed.size(); k++) {
+        Tile& tile = m_tiles[changed[k]];
+        Tile known = store.intern(tile, hashes[k]);
+        if (known != tile) {
+            tile = std::move(known);
+            merged++;
+        }
+    }
+    return merged;
+}
+
+Uint32 TileBuffer::getPixel(int x, int y) const {
+    if (x < 0 || y < 0 || x >= m_width || y >= m_height) return 0;
+    int index = tileIndex(x, y);
+    const Tile& tile = m_tiles[index];
+    return tile ? tile[tileOffset(x, y)] : m_solid[index];
+}
+
+void TileBuffer::setPixel(int x, int y, Uint32 color) {
+    if (x < 0 || y < 0 || x >= m_width || y >= m_height) return;
+    int index = tileIndex(x, y);
+    // Writing the colour a uniform tile already has is a no-op, don't expand it for that
+    if (!m_tiles[index] && (color == m_solid[index] || (alphaOf(color) == 0 && m_solid[index] == 0))) return;
+    editTile(index)[tileOffset(x, y)] = color;
+}
+
+void TileBuffer::blendPixel(int x, int y, Uint32 color) {
+    if (x < 0 || y < 0 || x >= m_width || y >= m_height) return;
+    if (alphaOf(color) == 0) return;
+    int index = tileIndex(x, y);
+    if (!m_tiles[index] && blendOver(m_solid[index], color) == m_solid[index]) return;
+    Uint32& dst = editTile(index)[tileOffset(x, y)];
+    dst = blendOver(dst, color);
+}
+
+Uint32 TileBuffer::blendOver(Uint32 dst, Uint32 src, int opacity) {
+    return GetBlendEngine().blendPixel(BLEND_NORMAL, dst, src, opacity);
+}
+
+bool TileBuffer::clipRect(SDL_Rect& rect) const {
+    int x0 = std::max(rect.x, 0);
+    int y0 = std::max(rect.y, 0);
+    int x1 = std::min(rect.x + rect.w, m_width);
+    int y1 = std::min(rect.y + rect.h, m_height);
+    rect = {x0, y0, x1 - x0, y1 - y0};
+    return rect.w > 0 && rect.h > 0;
+}
+
+void TileBuffer::fillRect(const SDL_Rect& rect, Uint32 color, bool blend) {
+    SDL_Rect area = rect;
+    if (!clipRect(area)) return;
+    if (blend && alphaOf(color) == 0) return;
+    if (blend && alphaOf(color) == 255) blend = false;
+
+    // Walk tile by tile so every row is one contiguous run inside a tile
+    for (int ty = area.y >> TILE_SHIFT; ty <= (area.y + area.h - 1) >> TILE_SHIFT; ty++) {
+        for (int tx = area.x >> TILE_SHIFT; tx <= (area.x + area.w - 1) >> TILE_SHIFT; tx++) {
+            int x0 = std::max(area.x, tx * TILE_SIZE);
+            int x1 = std::min(area.x + area.w, (tx + 1) * TILE_SIZE);
+            int y0 = std::max(area.y, ty * TILE_SIZE);
+            int y1 = std::min(area.y + area.h, (ty + 1) * TILE_SIZE);
+            int index = ty * m_tilesX + tx;
+            SDL_Rect tileRect = getTileRect(index);
+            bool wholeTile = x1 - x0 == tileRect.w && y1 - y0 == tileRect.h;
+
+            // Uniform tiles stay uniform when the result is one colour anyway: the whole tile
+            // gets covered, or the part that does comes out the colour it already was
+            if (!m_tiles[index]) {
+                Uint32 result = blend ? blendOver(m_solid[index], color) : (alphaOf(color) == 0 ? 0 : color);
+                if (result == m_solid[index]) continue;
+                if (wholeTile) {
+                    setTileColor(index, result);
+                    continue;
+                }
+            } else if (wholeTile && !blend) {
+                setTileColor(index, color);
+                continue;
+            }
+
+            Uint32* tile = editTile(index);
+
+            for (int y = y0; y < y1; y++) {
+                Uint32* row = tile + tileOffset(x0, y);
+                if (blend) {
+                    for (int i = 0; i < x1 - x0; i++) row[i] = blendOver(row[i], color);
+                } else {
+                    std::fill(row, row + (x1 - x0), color);
+                }
+            }
+        }
+    }
+}
+
+void TileBuffer::drawRect(const SDL_Rect& rect, Uint32 color) {
+    if (rect.w <= 0 || rect.h <= 0) return;
+    fillRect({rect.x, rect.y, rect.w, 1}, color, true);
+    if (rect.h > 1) fillRect({rect.x, rect.y + rect.h - 1, rect.w, 1}, color, true);
+    if (rect.h > 2) {
+        fillRect({rect.x, rect.y + 1, 1, rect.h - 2}, color, true);
+        if (rect.w > 1) fillRect({rect.x + rect.w - 1, rect.y + 1, 1, rect.h - 2}, color, true);
+    }
+}
+
+void TileBuffer::drawLine(int x0, int y0, int x1, int y1, Uint32 color) {
+    // Plain Bresenham, same pixels SDL_RenderDrawLine would give us on the software renderer
+    int dx = std::abs(x1 - x0), sx = x0 < x1 ? 1 : -1;
+    int dy = -std::abs(y1 - y0), sy = y0 < y1 ? 1 : -1;
+    int err = dx + dy;
+
+    while (true) {
+        blendPixel(x0, y0, color);
+        if (x0 == x1 && y0 == y1) break;
+        int e2 = 2 * err;
+        if (e2 >= dy) { err += dy; x0 += sx; }
+        if (e2 <= dx) { err += dx; y0 += sy; }
+    }
+}
+
+void TileBuffer::readRect(const SDL_Rect& rect, Uint32* dst, int dstPitch) const {
+    SDL_Rect area = rect;
+    bool inside = clipRect(area);
+    if (!inside || area.w != rect.w || area.h != rect.h) {
+        // Partly outside the image, outside pixels read back as transparent
+        for (int y = 0; y < rect.h; y++) {
+            std::fill(dst + y * dstPitch, dst + y * dstPitch + rect.w, 0u);
+        }
+        if (!inside) return;
+    }
+
+    for (int y = area.y; y < area.y + area.h; y++) {
+        Uint32* out = dst + (y - rect.y) * dstPitch + (area.x - rect.x);
+        int x = area.x;
+        while (x < area.x + area.w) {
+            int run = std::min(area.x + area.w, ((x >> TILE_SHIFT) + 1) * TILE_SIZE) - x;
+            int index = tileIndex(x, y);
+            const Tile& tile = m_tiles[index];
+            if (!tile) {
+                std::fill(out, out + run, m_solid[index]);
+            } else {
+                GetTileSwap().touch(tile.get());
+                std::memcpy(out, tile.get() + tileOffset(x, y), run * sizeof(Uint32));
+            }
+            out += run;
+            x += run;
+        }
+    }
+}
+
+void TileBuffer::writeRect(const SDL_Rect& rect, const Uint32* src, int srcPitch) {
+    SDL_Rect area = rect;
+    if (!clipRect(area)) return;
+
+    for (int y = area.y; y < area.y + area.h; y++) {
+        const Uint32* in = src + (y - rect.y) * srcPitch + (area.x - rect.x);
+        int x = area.x;
+        while (x < area.x + area.w) {
+            int run = std::min(area.x + area.w, ((x >> TILE_SHIFT) + 1) * TILE_SIZE) - x;
+            int index = tileIndex(x, y);
+            // Don't expand a uniform tile just to write the colour it already has into it
+            Uint32 solid = m_solid[index];
+            bool skip = !m_tiles[index] &&
+                        std::all_of(in, in + run, [solid](Uint32 p) {
+                            return p == solid || (alphaOf(p) == 0 && solid == 0);
+                        });
+            if (!skip) {
+                std::memcpy(editTile(index) + tileOffset(x, y), in, run * sizeof(Uint32));
+            }
+            in += run;
+            x += run;
+        }
+    }
+}
+
+void TileBuffer::blitSurface(SDL_Surface* surface, const SDL_Rect& destRect, bool blend) {
+    if (!surface || destRect.w <= 0 || destRect.h <= 0) return;
+
+    // Convert once up front so the loop below can read packed RGBA8888 directly
+    SDL_Surface* converted = surface;
+    if (surface->format->format != SDL_PIXELFORMAT_RGBA8888) {
+        converted = SDL_ConvertSurfaceFormat(surface, SDL_PIXELFORMAT_RGBA8888, 0);
+        if (!converted) return;
+    }
+
+    SDL_Rect area = destRect;
+    if (clipRect(area)) {
+        SDL_LockSurface(converted);
+        const Uint8* base = static_cast<const Uint8*>(converted->pixels);
+
+        for (int y = area.y; y < area.y + area.h; y++) {
+            int srcY = static_cast<int>((static_cast<Sint64>(y - destRect.y) * converted->h) / destRect.h);
+            const Uint32* srcRow = reinterpret_cast<const Uint32*>(base + srcY * converted->pitch);
+            for (int x = area.x; x < area.x + area.w; x++) {
+                int srcX = static_cast<int>((static_cast<Sint64>(x - destRect.x) * converted->w) / destRect.w);
+                Uint32 pixel = premultiply(srcRow[srcX]);
+                if (blend) {
+                    blendPixel(x, y, pixel);
+                } else {
+                    setPixel(x, y, pixel);
+                }
+            }
+        }
+
+        SDL_UnlockSurface(converted);
+    }
+
+    if (converted != surface) {
+        SDL_FreeSurface(converted);
+    }
+}
+
+void TileBuffer::compositeOver(const TileBuffer& src, int offsetX, int offsetY, float opacity) {
+    compositeOver(src, offsetX, offsetY, opacity, {0, 0, m_width, m_height});
+}
+
+void TileBuffer::compositeOver(const TileBuffer& src, int offsetX, int offsetY, float opacity, const SDL_Rect& clip) {
+    composite(src, offsetX, offsetY, BLEND_NORMAL, opacity, clip);
+}
+
+void TileBuffer::composite(const TileBuffer& src, int offsetX, int offsetY, int blendMode, float opacity, const SDL_Rect& clip) {
+    int alpha = opacityToAlpha(opacity);
+    if (alpha == 0) return;
+
+    const BlendEngine& engine = GetBlendEngine();
+    compositeWith(src, offsetX, offsetY, clip, [&engine, blendMode, alpha](Uint32* dst, const Uint32* in, int count) {
+        engine.blendRow(blendMode, dst, in, count, alpha);
+    });
+}
+
+TileBuffer TileBuffer::extract(const SDL_Rect& rect) const {
+    TileBuffer result(rect.w, rect.h);
+    bool aligned = (rect.x & (TILE_SIZE - 1)) == 0 && (rect.y & (TILE_SIZE - 1)) == 0;
+    for (int i = 0; i < result.getTileCount(); i++) {
+        SDL_Rect tileRect = result.getTileRect(i);
+        SDL_Rect srcRect = {rect.x + tileRect.x, rect.y + tileRect.y, tileRect.w, tileRect.h};
+        if (isRegionEmpty(srcRect)) continue;
+
+        // Grid aligned full tile: just share it, copy on write takes care of the rest.
+        // Partial tiles get copied so the padding outside the rect stays transparent.
+        bool inside = srcRect.x >= 0 && srcRect.y >= 0 &&
+                      srcRect.x + tileRect.w <= m_width && srcRect.y + tileRect.h <= m_height;
+        if (aligned && tileRect.w == TILE_SIZE && tileRect.h == TILE_SIZE && inside) {
+            int index = tileIndex(srcRect.x, srcRect.y);
+            result.m_tiles[i] = m_tiles[index];
+            result.m_solid[i] = m_solid[index];
+            result.m_coverage[i] = m_coverage[index];
+            continue;
+        }
+        // Anything that lands on one colour stays one colour, wherever the grid lines are
+        Uint32 color;
+        if (inside && isRegionUniform(srcRect, color)) {
+            result.setTileColor(i, color);
+            continue;
+        }
+        readRect(srcRect, result.editTile(i), TILE_SIZE);
+    }
+    return result;
+}
+
+TileBuffer TileBuffer::scaled(int newWidth, int newHeight) const {
+    // Nearest neighbour, same as the old resizeImage. Quick but pixelated.
+    TileBuffer result(newWidth, newHeight);
+    if (isEmpty() || result.isEmpty()) return result;
+
+    for (int i = 0; i < result.getTileCount(); i++) {
+        SDL_Rect tileRect = result.getTileRect(i);
+        Uint32* tile = result.editTile(i);
+        for (int y = 0; y < tileRect.h; y++) {
+            int srcY = static_cast<int>((static_cast<Sint64>(tileRect.y + y) * m_height) / newHeight);
+            for (int x = 0; x < tileRect.w; x++) {
+                int srcX = static_cast<int>((static_cast<Sint64>(tileRect.x + x) * m_width) / newWidth);
+                tile[y * TILE_SIZE + x] = getPixel(srcX, srcY);
+            }
+        }
+    }
+    result.compactTiles();
+    return result;
+}
+
+TileBuffer TileBuffer::rotated(double degrees, int newWidth, int newHeight) const {
+    TileBuffer result(newWidth, newHeight);
+    if (isEmpty() || result.isEmpty()) return result;
+
+    // Inverse mapping: for every output pixel rotate back into the source and sample it.
+    // Positive angles turn clockwise on screen (y points down), same as SDL_RenderCopyEx.
+    double radians = degrees * M_PI / 180.0;
+    double cosA = std::cos(radians);
+    double sinA = std::sin(radians);
+    double srcCX = m_width / 2.0;
+    double srcCY = m_height / 2.0;
+    double dstCX = newWidth / 2.0;
+    double dstCY = newHeight / 2.0;
+
+    for (int i = 0; i < result.getTileCount(); i++) {
+        SDL_Rect tileRect = result.getTileRect(i);
+        Uint32* tile = result.editTile(i);
+        for (int y = 0; y < tileRect.h; y++) {
+            double ry = tileRect.y + y + 0.5 - dstCY;
+            for (int x = 0; x < tileRect.w; x++) {
+                double rx = tileRect.x + x + 0.5 - dstCX;
+                double sx = rx * cosA + ry * sinA + srcCX;
+                double sy = -rx * sinA + ry * cosA + srcCY;
+                tile[y * TILE_SIZE + x] = getPixel(static_cast<int>(std::floor(sx)), static_cast<int>(std::floor(sy)));
+            }
+        }
+    }
+    result.compactTiles();
+    return result;
+}
+
+void TileBuffer::flipHorizontal() {
+    TileBuffer result(m_width, m_height);
+    std::vector<Uint32> row(m_width);
+    for (int y = 0; y < m_height; y++) {
+        readRect({0, y, m_width, 1}, row.data(), m_width);
+        std::reverse(row.begin(), row.end());
+        result.writeRect({0, y, m_width, 1}, row.data(), m_width);
+    }
+    result.compactTiles();
+    *this = std::move(result);
+}
+
+void TileBuffer::flipVertical() {
+    TileBuffer result(m_width, m_height);
+    std::vector<Uint32> row(m_width);
+    for (int y = 0; y < m_height; y++) {
+        readRect({0, y, m_width, 1}, row.data(), m_width);
+        result.writeRect({0, m_height - 1 - y, m_width, 1}, row.data(), m_width);
+    }
+    result.compactTiles();
+    *this = std::move(result);
+}
+
+bool TileBuffer::hasDirtyTiles(Uint8 consumer) const {
+    return std::any_of(m_dirty.begin(), m_dirty.end(), [consumer](Uint8 d) { return (d & consumer) != 0; });
+}
+
+void TileBuffer::markDirty(const SDL_Rect& rect) {
+    SDL_Rect area = rect;
+    if (!clipRect(area)) return;
+    for (int ty = area.y >> TILE_SHIFT; ty <= (area.y + area.h - 1) >> TILE_SHIFT; ty++) {
+        for (int tx = area.x >> TILE_SHIFT; tx <= (area.x + area.w - 1) >> TILE_SHIFT; tx++) {
+            touchTile(ty * m_tilesX + tx);
+        }
+    }
+}
+
+void TileBuffer::markAllDirty() {
+    std::fill(m_dirty.begin(), m_dirty.end(), DIRTY_ALL);
+    std::fill(m_coverage.begin(), m_coverage.end(), COVERAGE_UNKNOWN);
+}
+
+void TileBuffer::clearDirty(Uint8 consumer) {
+    for (Uint8& d : m_dirty) {
+        d &= ~consumer;
+    }
+}
@@ -0,0 +1,299 @@
+#pragma once
+#include <SDL2/SDL.h>
+#include "TileSwap.hpp"
+#include <memory>
+#include <algorithm>
+#include <vector>
+
+// CPU side pixel store for a layer. The image is chopped into fixed 256x256 tiles so we can
+// touch (and re-upload) only the parts that actually changed instead of the whole canvas.
+// Pixels are packed exactly like SDL_PIXELFORMAT_RGBA8888 (0xRRGGBBAA) so a tile can go straight
+// into SDL_UpdateTexture without any conversion. Colour is premultiplied by alpha (r, g, b are
+// never above a), so averaging and "over" are plain sums. Straight colour only exists at the
+// edges: images and text coming in, UI colours, export, and point ops that need the real colour.
+// Edge tiles are always allocated full size, anything past the image width/height is just padding.
+// Tiles are sparse: a tile that was never painted (or got fully erased) has no storage at all and
+// reads back as transparent. Only editTile allocates, so a small stroke on a huge canvas costs one tile.
+// The same goes for any tile that's one single colour (backgrounds, big fills): it's stored as just
+// that colour, transparent is simply the colour 0. Reads, fills and compositing handle those in
+// constant time per tile, and editTile only expands one into pixels when something different
+// gets painted on it.
+// Tiles are also reference counted and copy-on-write. Copying a TileBuffer (duplicate layer, undo
+// snapshot, clipboard) just bumps refcounts, and editTile clones a tile only when it's still shared.
+// So a copy costs nothing until one side paints, and then only the tiles it touched get copied.
+// Tile memory comes from TileSwap, which pages tiles nobody used in a while out to disk once
+// there are too many of them. Their pointers stay valid either way.
+class TileBuffer {
+public:
+    static constexpr int TILE_SHIFT = 8;
+    static constexpr int TILE_SIZE = 1 << TILE_SHIFT;
+    static constexpr int TILE_PIXELS = TILE_SIZE * TILE_SIZE;
+
+    // Dirty flags are a bitmask, one bit per consumer. Every write sets all of them and each
+    // consumer clears only its own bit, so they don't steal each other's updates.
+    enum DirtyFlags : Uint8 {
+        DIRTY_TEXTURE = 1 << 0,   // GPU upload
+        DIRTY_COMPOSITE = 1 << 1, // canvas compositor
+        DIRTY_MASKED = 1 << 2,    // layer's cached masked pixels
+        DIRTY_MIPMAP = 1 << 3,    // layer's mip pyramid
+        DIRTY_BOUNDS = 1 << 4,    // layer's content bounds
+        DIRTY_DEDUP = 1 << 5,     // tile store, tile not hashed since it last changed
+        DIRTY_DEEP = 1 << 6,      // layer's high bit depth copy, painted in 8-bit since
+        DIRTY_ALL = 0xFF
+    };
+
+    TileBuffer() = default;
+    TileBuffer(int width, int height);
+
+    // Throws away the old content, new buffer is fully transparent
+    void resize(int width, int height);
+    void clear();
+
+    int getWidth() const { return m_width; }
+    int getHeight() const { return m_height; }
+    int getTilesX() const { return m_tilesX; }
+    int getTilesY() const { return m_tilesY; }
+    int getTileCount() const { return m_tilesX * m_tilesY; }
+    bool isEmpty() const { return m_width <= 0 || m_height <= 0; }
+
+    // Image space rect covered by a tile, already clipped to the image size
+    SDL_Rect getTileRect(int index) const;
+
+    // Raw tile access, rows are TILE_SIZE pixels apart. getTileData is nullptr for a uniform tile
+    // (getTileColor has its colour), editTile expands it into pixels if needed and marks it dirty.
+    const Uint32* getTileData(int index) const {
+        GetTileSwap().touch(m_tiles[index].get());
+        return m_tiles[index].get();
+    }
+    Uint32* editTile(int index);
+    bool isTileAllocated(int index) const { return m_tiles[index] != nullptr; }
+    bool isTileShared(int index) const { return m_tiles[index] && m_tiles[index].use_count() > 1; }
+    bool isTileUniform(int index) const { return m_tiles[index] == nullptr; }
+    Uint32 getTileColor(int index) const { return m_solid[index]; }
+    // Turns the whole tile into one colour and drops its pixels
+    void setTileColor(int index, Uint32 color);
+    // Makes tile `index` share src's tile (copy on write). Both buffers must have the same size.
+    void shareTile(int index, const TileBuffer& src) {
+        m_tiles[index] = src.m_tiles[index];
+        m_solid[index] = src.m_solid[index];
+        m_dirty[index] = DIRTY_ALL;
+        m_coverage[index] = src.m_coverage[index]; // same pixels, same answer
+    }
+    // True when rect only touches tiles that are uniform transparent, i.e. it's guaranteed transparent
+    bool isRegionEmpty(const SDL_Rect& rect) const;
+    // True when the part of rect inside the image only touches uniform tiles of one colour.
+    // Conservative, a tile with pixels never counts even if they all happen to match.
+    bool isRegionUniform(const SDL_Rect& rect, Uint32& color) const;
+
+    // What a tile's alpha looks like, so the compositor can skip layers that can't change anything.
+    // Worked out on demand and cached until the tile is written again.
+    enum Coverage : Uint8 { COVERAGE_EMPTY, COVERAGE_OPAQUE, COVERAGE_MIXED, COVERAGE_UNKNOWN };
+    Coverage getTileCoverage(int index) const;
+    // Caches coverage for every tile that changed. The const getter doesn't store anything (so
+    // worker threads can call it), run this first on buffers the compositor is going to read.
+    void updateCoverage();
+    // Conservative: false just means "maybe". Opaque also needs rect fully inside the buffer.
+    bool isRegionTransparent(const SDL_Rect& rect) const;
+    bool isRegionOpaque(const SDL_Rect& rect) const;
+    // Smallest rect (image space) around the tile's non transparent pixels, w = 0 if there are none
+    SDL_Rect getTileContentRect(int index) const;
+
+    // Drops the pixels of tiles that ended up a single colour (after erasing, filters, fills...),
+    // fully transparent ones go back to being empty
+    void compactTiles();
+    void compactTiles(const SDL_Rect& rect); // only the tiles rect touches
+    int getAllocatedTileCount() const;
+    // Non transparent tiles that are stored as a single colour
+    int getUniformTileCount() const;
+    size_t getResidentBytes() const {
+        return static_cast<size_t>(getAllocatedTileCount()) * TILE_PIXELS * sizeof(Uint32) +
+               static_cast<size_t>(getUniformTileCount()) * sizeof(Uint32);
+    }
+    // Part of the above that's shared with another buffer (other layer, history, clipboard)
+    int getSharedTileCount() const;
+    size_t getSharedBytes() const { return static_cast<size_t>(getSharedTileCount()) * TILE_PIXELS * sizeof(Uint32); }
+    // Swaps every pixel tile that changed since the last call for an identical one from the tile
+    // store, if there is one. Returns how many got merged. Pixels don't change, nothing gets dirty.
+    int deduplicate();
+
+    // Single pixel access. Out of bounds reads return transparent, writes are ignored.
+    // Colours are premultiplied like the storage, see premultiply().
+    Uint32 getPixel(int x, int y) const;
+    void setPixel(int x, int y, Uint32 color);
+    void blendPixel(int x, int y, Uint32 color);
+
+    // Drawing helpers the tools use instead of the SDL renderer
+    void fillRect(const SDL_Rect& rect, Uint32 color, bool blend = false);
+    void drawRect(const SDL_Rect& rect, Uint32 color);
+    void drawLine(int x0, int y0, int x1, int y1, Uint32 color);
+
+    // Copy a rect to/from a flat buffer. Pitch is in pixels, not bytes.
+    void readRect(const SDL_Rect& rect, Uint32* dst, int dstPitch) const;
+    void writeRect(const SDL_Rect& rect, const Uint32* src, int srcPitch);
+
+    // Draws any SDL surface into destRect (nearest neighbour stretch like SDL_RenderCopy).
+    // Surfaces are straight alpha like everything SDL hands us, they get premultiplied here.
+    void blitSurface(SDL_Surface* surface, const SDL_Rect& destRect, bool blend = true);
+
+    // Blends another buffer placed at (offsetX, offsetY) on top with one of the BlendMode kernels
+    void composite(const TileBuffer& src, int offsetX, int offsetY, int blendMode, float opacity, const SDL_Rect& clip);
+    // Source-over, i.e. composite with BLEND_NORMAL
+    void compositeOver(const TileBuffer& src, int offsetX, int offsetY, float opacity = 1.0f);
+    void compositeOver(const TileBuffer& src, int offsetX, int offsetY, float opacity, const SDL_Rect& clip);
+
+    // Generic version: op(dstRow, srcRow, count) for every run of src (placed at offset) inside
+    // clip. A run never crosses a tile edge on either side. Runs where src has no tile or is fully
+    // transparent are skipped, so op has to leave dst alone for a transparent src (every sane
+    // blend mode does). op has to work pixel by pixel too: a uniform tile fully covered by one
+    // uniform colour of src is done with a single op(&dst, &src, 1).
+    template <typename RowOp>
+    void compositeWith(const TileBuffer& src, int offsetX, int offsetY, const SDL_Rect& clip, RowOp op);
+
+    // Tiles that line up with the source grid are shared, not copied. rect may reach past the
+    // edges (negative too), that part comes out transparent, so growing a buffer by whole tiles
+    // is free.
+    TileBuffer extract(const SDL_Rect& rect) const;
+    TileBuffer scaled(int newWidth, int newHeight) const;
+    // Rotates clockwise around the centre into a newWidth x newHeight buffer
+    TileBuffer rotated(double degrees, int newWidth, int newHeight) const;
+    void flipHorizontal();
+    void flipVertical();
+
+    // Dirty tracking so consumers (texture upload, compositor) only redo what changed
+    bool isTileDirty(int index, Uint8 consumer = DIRTY_ALL) const { return (m_dirty[index] & consumer) != 0; }
+    bool hasDirtyTiles(Uint8 consumer = DIRTY_ALL) const;
+    void markDirty(const SDL_Rect& rect);
+    void markAllDirty();
+    void clearDirty(Uint8 consumer = DIRTY_ALL);
+    void clearTileDirty(int index, Uint8 consumer) { m_dirty[index] &= ~consumer; }
+
+    static Uint32 packRGBA(Uint8 r, Uint8 g, Uint8 b, Uint8 a) {
+        return (static_cast<Uint32>(r) << 24) | (static_cast<Uint32>(g) << 16) |
+               (static_cast<Uint32>(b) << 8) | static_cast<Uint32>(a);
+    }
+    static void unpackRGBA(Uint32 pixel, Uint8& r, Uint8& g, Uint8& b, Uint8& a) {
+        r = static_cast<Uint8>(pixel >> 24);
+        g = static_cast<Uint8>(pixel >> 16);
+        b = static_cast<Uint8>(pixel >> 8);
+        a = static_cast<Uint8>(pixel);
+    }
+    static Uint8 alphaOf(Uint32 pixel) { return static_cast<Uint8>(pixel); }
+
+    // All four channels times factor / 255, rounded. Premultiplied pixels fade (layer masks,
+    // opacity) by scaling everything, not just alpha.
+    static Uint32 scalePixel(Uint32 pixel, Uint32 factor) {
+        auto scale = [factor](Uint32 c) {
+            c = c * factor + 128;
+            return (c + (c >> 8)) >> 8;
+        };
+        return (scale(pixel >> 24) << 24) | (scale((pixel >> 16) & 0xFF) << 16) |
+               (scale((pixel >> 8) & 0xFF) << 8) | scale(pixel & 0xFF);
+    }
+    // Straight to premultiplied and back. Both are free for opaque pixels, and anything with
+    // alpha 0 comes out as 0 so transparent stays the one value the sparse tiles look for.
+    static Uint32 premultiply(Uint32 pixel) {
+        Uint32 a = alphaOf(pixel);
+        if (a == 255) return pixel;
+        if (a == 0) return 0;
+        return (scalePixel(pixel, a) & 0xFFFFFF00) | a;
+    }
+    static Uint32 unpremultiply(Uint32 pixel) {
+        Uint32 a = alphaOf(pixel);
+        if (a == 255) return pixel;
+        if (a == 0) return 0;
+        auto unscale = [a](Uint32 c) { return std::min<Uint32>(255, (c * 255 + a / 2) / a); };
+        return (unscale(pixel >> 24) << 24) | (unscale((pixel >> 16) & 0xFF) << 16) |
+               (unscale((pixel >> 8) & 0xFF) << 8) | a;
+    }
+
+    // Layer opacity to the 0-255 the kernels take. composite() uses this, culling has to agree.
+    static int opacityToAlpha(float opacity) { return static_cast<int>(std::clamp(opacity, 0.0f, 1.0f) * 255.0f + 0.5f); }
+
+    // Premultiplied "over", same as the BLEND_NORMAL kernel. opacity is 0-255 and scales the source.
+    static Uint32 blendOver(Uint32 dst, Uint32 src, int opacity = 255);
+
+private:
+    int m_width = 0;
+    int m_height = 0;
+    int m_tilesX = 0;
+    int m_tilesY = 0;
+    using Tile = std::shared_ptr<Uint32[]>;
+    std::vector<Tile> m_tiles; // nullptr = uniform tile, colour in m_solid
+    std::vector<Uint32> m_solid; // colour of each uniform tile, 0 (transparent) for an empty one
+    std::vector<Uint8> m_dirty;
+    std::vector<Uint8> m_coverage; // Coverage per tile, UNKNOWN after any write
+
+    int tileIndex(int x, int y) const { return (y >> TILE_SHIFT) * m_tilesX + (x >> TILE_SHIFT); }
+    static int tileOffset(int x, int y) { return ((y & (TILE_SIZE - 1)) << TILE_SHIFT) + (x & (TILE_SIZE - 1)); }
+    bool clipRect(SDL_Rect& rect) const;
+    Coverage computeCoverage(int index) const;
+    void touchTile(int index) { m_dirty[index] = DIRTY_ALL; m_coverage[index] = COVERAGE_UNKNOWN; }
+    void compactTile(int index);
+};
+
+template <typename RowOp>
+void TileBuffer::compositeWith(const TileBuffer& src, int offsetX, int offsetY, const SDL_Rect& clip, RowOp op) {
+    SDL_Rect area = {offsetX, offsetY, src.m_width, src.m_height};
+    SDL_Rect clipArea = clip;
+    if (!SDL_IntersectRect(&area, &clipArea, &area) || !clipRect(area)) return;
+
+    // One row of a uniform source tile, refilled only when the colour changes
+    Uint32 solidRow[TILE_SIZE];
+    Uint32 solidColor = 0;
+    bool solidFilled = false;
+
+    for (int ty = area.y >> TILE_SHIFT; ty <= (area.y + area.h - 1) >> TILE_SHIFT; ty++) {
+        for (int tx = area.x >> TILE_SHIFT; tx <= (area.x + area.w - 1) >> TILE_SHIFT; tx++) {
+            int index = ty * m_tilesX + tx;
+            SDL_Rect tileRect = getTileRect(index);
+            SDL_Rect part;
+            SDL_IntersectRect(&tileRect, &area, &part);
+
+            // Uniform on both sides over the whole tile: one pixel's worth of work
+            Uint32 color;
+            if (!m_tiles[index] && part.w == tileRect.w && part.h == tileRect.h &&
+                src.isRegionUniform({part.x - offsetX, part.y - offsetY, part.w, part.h}, color)) {
+                if (alphaOf(color) == 0) continue;
+                Uint32 result = m_solid[index];
+                op(&result, &color, 1);
+                setTileColor(index, result);
+                continue;
+            }
+
+            for (int y = part.y; y < part.y + part.h; y++) {
+                int sy = y - offsetY;
+                int x = part.x;
+                while (x < part.x + part.w) {
+                    int sx = x - offsetX;
+                    // A run has to stay inside one destination tile and one source tile
+                    int run = std::min(part.x + part.w, ((x >> TILE_SHIFT) + 1) * TILE_SIZE) - x;
+                    run = std::min(run, TILE_SIZE - (sx & (TILE_SIZE - 1)));
+
+                    int srcIndex = src.tileIndex(sx, sy);
+                    const Uint32* srcTile = src.m_tiles[srcIndex].get();
+                    const Uint32* in = nullptr;
+                    bool transparent = true;
+                    if (srcTile) {
+                        GetTileSwap().touch(srcTile);
+                        in = srcTile + tileOffset(sx, sy);
+                        for (int k = 0; k < run; k++) {
+                            if (alphaOf(in[k]) != 0) { transparent = false; break; }
+                        }
+                    } else if (alphaOf(src.m_solid[srcIndex]) != 0) {
+                        if (!solidFilled || solidColor != src.m_solid[srcIndex]) {
+                            solidColor = src.m_solid[srcIndex];
+                            std::fill(solidRow, solidRow + TILE_SIZE, solidColor);
+                            solidFilled = true;
+                        }
+                        in = solidRow;
+                        transparent = false;
+                    }
+                    if (!transparent) {
+                        op(editTile(index) + tileOffset(x, y), in, run);
+                    }
+                    x += run;
+                }
+            }
+        }
+    }
+}
@@ -0,0 +1,68 @@
+#include "TileStore.hpp"
+#include "TileBuffer.hpp"
+#include <cstring>
+
+TileStore& TileStore::getInstance() {
+    static TileStore instance;
+    return instance;
+}
+
+Uint64 TileStore::hashTile(const Uint32* pixels) {
+    // Four independent multiply-xor lanes over 64 bit words, so it isn't one long dependency chain.
+    // Only used to find candidates, equality is always checked on the pixels themselves.
+    const Uint64 prime = 0x100000001B3ULL;
+    Uint64 lanes[4] = {0xCBF29CE484222325ULL, 0x84222325CBF29CE4ULL, 0x9E3779B97F4A7C15ULL, 0xC2B2AE3D27D4EB4FULL};
+    const Uint8* bytes = reinterpret_cast<const Uint8*>(pixels);
+    const size_t words = TileBuffer::TILE_PIXELS * sizeof(Uint32) / sizeof(Uint64);
+    for (size_t i = 0; i < words; i += 4) {
+        for (int lane = 0; lane < 4; lane++) {
+            Uint64 word;
+            std::memcpy(&word, bytes + (i + lane) * sizeof(Uint64), sizeof(word));
+            lanes[lane] = (lanes[lane] ^ word) * prime;
+        }
+    }
+    Uint64 hash = lanes[0];
+    for (int lane = 1; lane < 4; lane++) {
+        hash = (hash ^ (lanes[lane] >> 29)) * prime + lanes[lane];
+    }
+    return hash;
+}
+
+TileStore::Tile TileStore::intern(const Tile& tile, Uint64 hash) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto range = m_index.equal_range(hash);
+    for (auto it = range.first; it != range.second;) {
+        Tile known = it->second.lock();
+        if (known == tile) return tile; // already the one in the index
+        if (known && std::memcmp(known.get(), tile.get(), TileBuffer::TILE_PIXELS * sizeof(Uint32)) == 0) {
+            m_mergedTiles++;
+            return known;
+        }
+        // Gone, or its only owner painted on it since it went in. Either way it doesn't belong
+        // under this hash any more, a changed tile comes back in under its new one.
+        it = m_index.erase(it);
+    }
+    m_index.emplace(hash, tile);
+    return tile;
+}
+
+TileStore::Stats TileStore::getStats() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    Stats stats;
+    stats.mergedTiles = m_mergedTiles;
+    for (auto it = m_index.begin(); it != m_index.end();) {
+        long owners = it->second.use_count();
+        if (owners == 0) {
+            it = m_index.erase(it);
+            continue;
+        }
+        stats.uniqueTiles++;
+        stats.references += static_cast<int>(owners);
+        ++it;
+    }
+    stats.savedBytes = static_cast<size_t>(stats.references - stats.uniqueTiles) * TileBuffer::TILE_PIXELS * sizeof(Uint32);
+    if (stats.uniqueTiles > 0) {
+        stats.ratio = static_cast<double>(stats.references) / stats.uniqueTiles;
+    }
+    return stats;
+}
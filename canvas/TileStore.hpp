@@ -0,0 +1,48 @@
+#pragma once
+#include <SDL2/SDL.h>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+
+// Content addressed index of every pixel tile layers and history hand to it. Copy on write already
+// shares tiles that came from the same place (duplicate layer, undo snapshot), this catches the
+// ones that ended up identical on their own: a paste of the same region twice, a stroke that got
+// painted over and erased back, undo states on both sides of an edit that was reverted.
+// Identical tiles collapse into one allocation and the copies become plain references to it.
+// The index only holds weak references, it never keeps a tile alive. A tile with a single owner
+// can still be edited in place, so every hit is checked byte for byte and stale entries get dropped.
+class TileStore {
+public:
+    using Tile = std::shared_ptr<Uint32[]>;
+
+    static TileStore& getInstance();
+
+    // Tile with the same pixels as `tile` somebody already holds, or `tile` itself when it's the
+    // first of its kind (it's remembered from then on). hash has to be hashTile(tile).
+    Tile intern(const Tile& tile, Uint64 hash);
+    // Looks at the full TILE_SIZE x TILE_SIZE tile, padding past the image edge included (always 0)
+    static Uint64 hashTile(const Uint32* pixels);
+
+    struct Stats {
+        int uniqueTiles = 0;      // distinct tiles in the index that are still alive
+        int references = 0;       // tile slots pointing at them, across all buffers
+        Uint64 mergedTiles = 0;   // copies collapsed into an existing tile so far
+        size_t savedBytes = 0;    // what the references beyond the first one would cost on their own
+        double ratio = 1.0;       // references / unique tiles
+    };
+    // Walks the index, so call it when the numbers are shown, not per tile. Dead entries go away here.
+    Stats getStats();
+
+private:
+    TileStore() = default;
+    TileStore(const TileStore&) = delete;
+    TileStore& operator=(const TileStore&) = delete;
+
+    std::unordered_multimap<Uint64, std::weak_ptr<Uint32[]>> m_index;
+    Uint64 m_mergedTiles = 0;
+    std::mutex m_mutex;
+};
+
+inline TileStore& GetTileStore() {
+    return TileStore::getInstance();
+}
@@ -0,0 +1,212 @@
+#include "TileSwap.hpp"
+#include "ThreadPool.hpp"
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+TileSwap& TileSwap::getInstance() {
+    // Never destroyed: tiles owned by other singletons (canvas, history) get freed during static
+    // destruction and still have to find their way back here
+    static TileSwap* instance = new TileSwap();
+    return *instance;
+}
+
+TileSwap::TileSwap() {
+#ifndef _WIN32
+    size_t physical = static_cast<size_t>(sysconf(_SC_PHYS_PAGES)) * static_cast<size_t>(sysconf(_SC_PAGE_SIZE));
+    m_budget = physical / 2;
+
+    // Address space only, nothing is backed until a chunk gets committed. 128 GB worth of tiles,
+    // halved until the system lets us have it.
+    for (size_t slots = size_t(1) << 19; slots >= CHUNK_TILES * 16; slots /= 2) {
+        void* arena = mmap(nullptr, slots * TILE_BYTES, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+        if (arena != MAP_FAILED) {
+            m_arena = static_cast<Uint8*>(arena);
+            m_maxSlots = static_cast<int>(slots);
+            break;
+        }
+    }
+    if (m_arena) {
+        m_state = std::make_unique<std::atomic<Uint8>[]>(m_maxSlots);
+        m_lastUse = std::make_unique<std::atomic<Uint32>[]>(m_maxSlots);
+    }
+#endif
+}
+
+TileSwap::Tile TileSwap::allocate() {
+    if (!m_arena) {
+        m_residentTiles++;
+        return Tile(new Uint32[TILE_BYTES / sizeof(Uint32)](), [this](Uint32* tile) {
+            m_residentTiles--;
+            delete[] tile;
+        });
+    }
+
+#ifndef _WIN32
+    int slot = -1;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_freeSlots.empty()) {
+            int committed = m_committed.load();
+            int count = std::min(CHUNK_TILES, m_maxSlots - committed);
+            // Out of address space, which means way past any budget. Heap it is.
+            if (count <= 0) {
+                m_residentTiles++;
+                return Tile(new Uint32[TILE_BYTES / sizeof(Uint32)](), [this](Uint32* tile) {
+                    m_residentTiles--;
+                    delete[] tile;
+                });
+            }
+            void* chunk = mmap(m_arena + static_cast<size_t>(committed) * TILE_BYTES, count * TILE_BYTES,
+                               PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED, -1, 0);
+            if (chunk == MAP_FAILED) throw std::bad_alloc();
+            for (int i = committed + count - 1; i >= committed; i--) {
+                m_freeSlots.push_back(i);
+            }
+            m_committed = committed + count;
+        }
+        slot = m_freeSlots.back();
+        m_freeSlots.pop_back();
+        m_state[slot] = SLOT_RESIDENT;
+    }
+    m_residentTiles++;
+    Uint32* data = slotAddress(slot);
+    touch(data);
+
+    // Over budget: make room now rather than at the next frame, a single big operation (import,
+    // resize of every layer) can allocate a lot in one go. Only where nothing runs in parallel.
+    if (m_budget > 0 && getResidentBytes() > m_budget + m_budget / 8 && !ThreadPool::isInsideJob()) {
+        enforceBudget();
+    }
+    return Tile(data, [this](Uint32* tile) { release(tile); });
+#else
+    return nullptr;
+#endif
+}
+
+void TileSwap::release(Uint32* tile) {
+#ifndef _WIN32
+    int slot = slotOf(tile);
+    std::lock_guard<std::mutex> lock(m_mutex);
+    // A fresh anonymous mapping gives the memory back and reads as zero for the next owner,
+    // whether the slot was in RAM or pointed at the swap file
+    mmap(tile, TILE_BYTES, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED, -1, 0);
+    if (m_state[slot] == SLOT_SWAPPED) {
+        m_swappedTiles--;
+    } else {
+        m_residentTiles--;
+    }
+    m_state[slot] = SLOT_FREE;
+    m_freeSlots.push_back(slot);
+#else
+    (void)tile;
+#endif
+}
+
+void TileSwap::prepareWrite(const Uint32* tile) {
+    if (!inArena(tile)) return;
+    touch(tile);
+#ifndef _WIN32
+    int slot = slotOf(tile);
+    if (m_state[slot] != SLOT_SWAPPED) return; // the usual case, no lock for it
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_state[slot] != SLOT_SWAPPED) return;
+
+    // Back into anonymous memory, same address. Only the owner writes here (shared tiles get
+    // copied before anyone writes), so nobody sees the slot half way.
+    std::vector<Uint32> copy(TILE_BYTES / sizeof(Uint32));
+    std::memcpy(copy.data(), tile, TILE_BYTES);
+    Uint32* data = const_cast<Uint32*>(tile);
+    if (mmap(data, TILE_BYTES, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED, -1, 0) == MAP_FAILED) {
+        throw std::bad_alloc();
+    }
+    std::memcpy(data, copy.data(), TILE_BYTES);
+    m_state[slot] = SLOT_RESIDENT;
+    m_swappedTiles--;
+    m_residentTiles++;
+#endif
+}
+
+void TileSwap::enforceBudget() {
+    m_clock++; // called about once a frame, so stamps roughly count frames
+    if (!m_arena || m_budget == 0 || getResidentBytes() <= m_budget) return;
+
+#ifndef _WIN32
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_swapFile < 0 && !openSwapFile()) return;
+
+    // Oldest first, and a bit below the budget so this doesn't run again on the next tile
+    std::vector<std::pair<Uint32, int>> resident;
+    int committed = m_committed.load();
+    for (int slot = 0; slot < committed; slot++) {
+        if (m_state[slot] == SLOT_RESIDENT) {
+            resident.push_back({m_lastUse[slot].load(std::memory_order_relaxed), slot});
+        }
+    }
+    size_t target = m_budget - m_budget / 8;
+    size_t residentBytes = getResidentBytes();
+    if (residentBytes <= target) return;
+    size_t excess = residentBytes - target;
+    size_t count = std::min(resident.size(), (excess + TILE_BYTES - 1) / TILE_BYTES);
+    std::nth_element(resident.begin(), resident.begin() + count, resident.end());
+    for (size_t i = 0; i < count; i++) {
+        if (!swapOut(resident[i].second)) break;
+    }
+#endif
+}
+
+bool TileSwap::swapOut(int slot) {
+#ifndef _WIN32
+    // Sparse file, grown a chunk at a time, only what actually gets written takes disk space
+    if (slot >= m_fileSlots) {
+        int slots = (slot / CHUNK_TILES + 1) * CHUNK_TILES;
+        if (ftruncate(m_swapFile, static_cast<off_t>(slots) * TILE_BYTES) != 0) return false;
+        m_fileSlots = slots;
+    }
+
+    Uint32* data = slotAddress(slot);
+    off_t offset = static_cast<off_t>(slot) * TILE_BYTES;
+    const Uint8* bytes = reinterpret_cast<const Uint8*>(data);
+    size_t written = 0;
+    while (written < TILE_BYTES) {
+        ssize_t n = pwrite(m_swapFile, bytes + written, TILE_BYTES - written, offset + written);
+        if (n <= 0) return false; // disk full or similar, just stays in RAM
+        written += static_cast<size_t>(n);
+    }
+    // Swap the RAM under the tile for the file, same address and same bytes
+    if (mmap(data, TILE_BYTES, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, m_swapFile, offset) == MAP_FAILED) {
+        return false;
+    }
+    m_state[slot] = SLOT_SWAPPED;
+    m_residentTiles--;
+    m_swappedTiles++;
+    return true;
+#else
+    (void)slot;
+    return false;
+#endif
+}
+
+bool TileSwap::openSwapFile() {
+#ifndef _WIN32
+    const char* dir = std::getenv("TMPDIR");
+    std::string path = std::string(dir && *dir ? dir : "/tmp") + "/paint-swap-XXXXXX";
+    m_swapFile = mkstemp(path.data());
+    if (m_swapFile < 0) {
+        std::cerr << "Could not create tile swap file in " << path << std::endl;
+        m_budget = 0; // don't keep trying every tile
+        return false;
+    }
+    // Gone as soon as we exit, crash included
+    unlink(path.c_str());
+    return true;
+#else
+    return false;
+#endif
+}
@@ -0,0 +1,84 @@
+#pragma once
+#include <SDL2/SDL.h>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+// Where tile pixels actually live. Every tile is a fixed slot in one big reserved address range,
+// so a tile keeps its address for its whole life no matter where its bytes are.
+// Once the resident tiles go over the memory budget the least recently used ones get written to a
+// swap file and their slot is mapped onto that part of the file instead. The pointer stays valid,
+// touching a swapped tile just pages it back in through the kernel, and writing one (editTile)
+// moves it back into RAM for good. So a document bigger than RAM gets slower instead of dying.
+// "Recently used" is approximate: writes, uploads and compositing bump a tile, single pixel
+// reads don't.
+// Without mmap (Windows) or if the reservation fails tiles are plain heap memory that never swaps,
+// the counters still work.
+class TileSwap {
+public:
+    using Tile = std::shared_ptr<Uint32[]>;
+    static constexpr size_t TILE_BYTES = (size_t(1) << 16) * sizeof(Uint32); // TileBuffer::TILE_PIXELS
+
+    static TileSwap& getInstance();
+
+    // Fresh tile, all zero (transparent). Thread safe, the compositor allocates from the workers.
+    // On the main thread it also pages out old tiles if this went over budget.
+    Tile allocate();
+    // Before writing into a tile its owner doesn't share: brings it back into RAM if it was swapped
+    void prepareWrite(const Uint32* tile);
+    // Counts as a use for the LRU. Just a store, fine from any thread and in inner loops.
+    void touch(const Uint32* tile) {
+        if (inArena(tile)) m_lastUse[slotOf(tile)].store(m_clock.load(std::memory_order_relaxed), std::memory_order_relaxed);
+    }
+
+    // Bytes of tiles allowed in RAM, 0 means no limit. Starts at half the physical memory.
+    void setBudget(size_t bytes) { m_budget = bytes; }
+    size_t getBudget() const { return m_budget; }
+    // Pages out the least recently used tiles until the rest fits in the budget. Not while a
+    // parallelFor is running: a tile written during its own swap out would lose that write.
+    void enforceBudget();
+
+    size_t getResidentBytes() const { return static_cast<size_t>(m_residentTiles.load()) * TILE_BYTES; }
+    size_t getSwappedBytes() const { return static_cast<size_t>(m_swappedTiles.load()) * TILE_BYTES; }
+    bool isSwapAvailable() const { return m_arena != nullptr; }
+
+private:
+    TileSwap();
+    TileSwap(const TileSwap&) = delete;
+    TileSwap& operator=(const TileSwap&) = delete;
+
+    enum SlotState : Uint8 { SLOT_FREE, SLOT_RESIDENT, SLOT_SWAPPED };
+    static constexpr int CHUNK_TILES = 64; // address space gets committed 16 MB at a time
+
+    Uint8* m_arena = nullptr; // reserved, only [0, m_committed) slots are usable
+    int m_maxSlots = 0;
+    std::atomic<int> m_committed{0}; // read by touch() on any thread
+    std::vector<int> m_freeSlots;
+    std::unique_ptr<std::atomic<Uint8>[]> m_state; // changed under m_mutex, prepareWrite peeks without it
+    std::unique_ptr<std::atomic<Uint32>[]> m_lastUse;
+    std::atomic<Uint32> m_clock{1};
+    int m_swapFile = -1;
+    int m_fileSlots = 0; // swap file is sized for this many slots (sparse)
+
+    std::atomic<int> m_residentTiles{0};
+    std::atomic<int> m_swappedTiles{0};
+    size_t m_budget = 0;
+    std::mutex m_mutex;
+
+    bool inArena(const Uint32* tile) const {
+        const Uint8* p = reinterpret_cast<const Uint8*>(tile);
+        return m_arena && p >= m_arena && p < m_arena + static_cast<size_t>(m_committed) * TILE_BYTES;
+    }
+    int slotOf(const Uint32* tile) const {
+        return static_cast<int>((reinterpret_cast<const Uint8*>(tile) - m_arena) / TILE_BYTES);
+    }
+    Uint32* slotAddress(int slot) const { return reinterpret_cast<Uint32*>(m_arena + static_cast<size_t>(slot) * TILE_BYTES); }
+    void release(Uint32* tile);
+    bool swapOut(int slot);
+    bool openSwapFile();
+};
+
+inline TileSwap& GetTileSwap() {
+    return TileSwap::getInstance();
+}
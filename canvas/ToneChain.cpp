@@ -0,0 +1,121 @@
+#include "ToneChain.hpp"
+#include <algorithm>
+
+#ifdef POINTOPS_HAS_X86
+#include <immintrin.h>
+#endif
+
+void ToneChain::addBrightness(float offset) {
+    m_steps.push_back({Kind::BRIGHTNESS, {offset, 0.0f, 0.0f, 0.0f}});
+}
+
+void ToneChain::addContrast(float contrast) {
+    float factor = (259.0f * (contrast + 255.0f)) / (255.0f * (259.0f - contrast));
+    m_steps.push_back({Kind::CONTRAST, {factor, 128.0f / 255.0f, 0.0f, 0.0f}});
+}
+
+void ToneChain::addGamma(float gamma) {
+    m_steps.push_back({Kind::GAMMA, {1.0f / gamma, 0.0f, 0.0f, 0.0f}});
+}
+
+void ToneChain::addCurves(float input, float output) {
+    input = std::clamp(input, 0.01f, 0.99f);
+    float lowSlope = output / input;
+    float highSlope = (1.0f - output) / (1.0f - input);
+    m_steps.push_back({Kind::CURVES, {input, output, lowSlope, highSlope}});
+}
+
+void ToneChain::addColorBalance(float r, float g, float b) {
+    m_steps.push_back({Kind::COLOR_BALANCE, {r, g, b, 0.0f}});
+}
+
+void ToneChain::append(const ToneChain& other) {
+    m_steps.insert(m_steps.end(), other.m_steps.begin(), other.m_steps.end());
+}
+
+ToneChain::Table ToneChain::buildTable(int size) const {
+    Table table;
+    table.size = size;
+    for (auto& channel : table.channel) channel.resize(size);
+    // The table only covers 0-1, so clamping between steps is what the integer depths want anyway
+    for (int i = 0; i < size; i++) {
+        float r = static_cast<float>(i) / static_cast<float>(size - 1);
+        float g = r, b = r;
+        apply(r, g, b, true);
+        table.channel[0][i] = r;
+        table.channel[1][i] = g;
+        table.channel[2][i] = b;
+    }
+    if (size == 256) {
+        // Rounded like PointOps rounds an opaque pixel, already shifted into place
+        const int shifts[3] = {PixelLayoutRGBA8888::R, PixelLayoutRGBA8888::G, PixelLayoutRGBA8888::B};
+        for (int c = 0; c < 3; c++) {
+            table.packed[c].resize(size);
+            for (int i = 0; i < size; i++) {
+                table.packed[c][i] = static_cast<Uint32>(table.channel[c][i] * 255.0f + 0.5f) << shifts[c];
+            }
+        }
+    }
+    return table;
+}
+
+#ifdef POINTOPS_HAS_X86
+// Blocks of 8 opaque pixels through the packed tables with gathers, stops at the first block that
+// has a translucent pixel. Returns how many pixels it did.
+__attribute__((target("avx2"))) static int lookupOpaqueAVX2(const Uint32* const packed[3], Uint32* pixels, int count) {
+    using Layout = PixelLayoutRGBA8888;
+    const __m256i byteMask = _mm256_set1_epi32(0xFF);
+    const __m256i alphaMask = _mm256_set1_epi32(static_cast<int>(0xFFu << Layout::A));
+    const int* tr = reinterpret_cast<const int*>(packed[0]);
+    const int* tg = reinterpret_cast<const int*>(packed[1]);
+    const int* tb = reinterpret_cast<const int*>(packed[2]);
+    int i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m256i p = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(pixels + i));
+        if (_mm256_movemask_epi8(_mm256_cmpeq_epi32(_mm256_and_si256(p, alphaMask), alphaMask)) != -1) break;
+        __m256i r = _mm256_i32gather_epi32(tr, _mm256_and_si256(_mm256_srli_epi32(p, Layout::R), byteMask), 4);
+        __m256i g = _mm256_i32gather_epi32(tg, _mm256_and_si256(_mm256_srli_epi32(p, Layout::G), byteMask), 4);
+        __m256i b = _mm256_i32gather_epi32(tb, _mm256_and_si256(_mm256_srli_epi32(p, Layout::B), byteMask), 4);
+        __m256i out = _mm256_or_si256(_mm256_or_si256(r, g), _mm256_or_si256(b, alphaMask));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(pixels + i), out);
+    }
+    return i;
+}
+#endif
+
+void ToneChain::Table::applyRow8(Uint32* pixels, int count) const {
+    using Layout = PixelLayoutRGBA8888;
+    const Uint32* const tables[3] = {packed[0].data(), packed[1].data(), packed[2].data()};
+    auto opaque = [](Uint32 p) { return ((p >> Layout::A) & 0xFF) == 0xFF; };
+#ifdef POINTOPS_HAS_X86
+    const bool gather = PointOps::getKernel() == PointOps::Kernel::AVX2;
+#endif
+    int i = 0;
+    while (i < count) {
+#ifdef POINTOPS_HAS_X86
+        if (gather) {
+            i += lookupOpaqueAVX2(tables, pixels + i, count - i);
+            if (i == count) break;
+        }
+#endif
+        const Uint32 p = pixels[i];
+        if (opaque(p)) {
+            pixels[i] = tables[0][(p >> Layout::R) & 0xFF] | tables[1][(p >> Layout::G) & 0xFF] |
+                        tables[2][(p >> Layout::B) & 0xFF] | 0xFFu << Layout::A;
+            i++;
+            continue;
+        }
+        int end = i + 1;
+        while (end < count && !opaque(pixels[end])) end++;
+        PointOps::runRow8([this](auto& r, auto& g, auto& b) { apply(r, g, b); }, pixels + i, end - i);
+        i = end;
+    }
+}
+
+int ToneChain::getTableSize(PixelDepth depth) {
+    switch (depth) {
+        case PixelDepth::RGBA8: return 256;
+        case PixelDepth::RGBA16: return 65536;
+        default: return 0;
+    }
+}
@@ -0,0 +1,106 @@
+#pragma once
+#include <SDL2/SDL.h>
+#include "DeepBuffer.hpp"
+#include "PointOps.hpp"
+#include <vector>
+
+// Per channel tone adjustments (brightness, contrast, gamma, curves, colour balance) kept as data,
+// so a chain of them can run over the pixels in one pass. Every step maps each channel on its
+// own, which makes the whole chain a function of one value per channel. On the integer depths
+// that function gets tabulated, an entry per value the depth can hold (256 for 8-bit, 65536 for
+// 16-bit), and a pixel costs three lookups however many steps there are. Opaque 8-bit pixels
+// don't even need unpremultiplying, they index a table of output bytes directly.
+// Half float colour can go past 1 where no table reaches, there the steps run one after the other
+// on each pixel instead. Still one pass, just not a constant cost one.
+class ToneChain {
+public:
+    // Values are straight colour, 1 is full intensity
+    void addBrightness(float offset);
+    // Same scale as Canvas::adjustContrast, 0 leaves the image alone
+    void addContrast(float contrast);
+    void addGamma(float gamma);
+    // One control point, straight lines to (0, 0) and (1, 1) on either side of it
+    void addCurves(float input, float output);
+    void addColorBalance(float r, float g, float b);
+    void append(const ToneChain& other);
+
+    bool isEmpty() const { return m_steps.empty(); }
+    int getStepCount() const { return static_cast<int>(m_steps.size()); }
+    void clear() { m_steps.clear(); }
+
+    // Every step on straight colour, works as a PointOps op. With clampSteps colour is clamped to
+    // 0-1 after each step, like separate passes at an integer depth would.
+    template <typename V>
+    void apply(V& r, V& g, V& b, bool clampSteps) const;
+
+    // The chain tabulated for the integer depths, see above. Entry i is the output for i / (size - 1),
+    // anything in between gets interpolated (translucent pixels unpremultiply to those).
+    struct Table {
+        int size = 0;
+        std::vector<float> channel[3]; // r, g, b
+        std::vector<Uint32> packed[3]; // size 256 only, channel as 8 bits already in place in a tile pixel
+        // Runs the table on count premultiplied 8-bit tile pixels in place (needs size 256). Opaque
+        // pixels go through packed, runs of translucent ones through apply on PointOps::runRow8.
+        void applyRow8(Uint32* pixels, int count) const;
+        template <typename V>
+        POINTOPS_INLINE void apply(V& r, V& g, V& b) const {
+            PointOps::lookup(r, channel[0].data(), size);
+            PointOps::lookup(g, channel[1].data(), size);
+            PointOps::lookup(b, channel[2].data(), size);
+        }
+    };
+    // size entries per channel, costs about as much as running the chain on size pixels
+    Table buildTable(int size) const;
+    // Table size for an integer depth, 0 for half float (no table)
+    static int getTableSize(PixelDepth depth);
+
+private:
+    enum class Kind { BRIGHTNESS, CONTRAST, GAMMA, CURVES, COLOR_BALANCE };
+    struct Step {
+        Kind kind;
+        float p[4]; // what they mean depends on kind, see the add* functions
+    };
+    std::vector<Step> m_steps;
+};
+
+template <typename V>
+void ToneChain::apply(V& r, V& g, V& b, bool clampSteps) const {
+    for (const Step& step : m_steps) {
+        switch (step.kind) {
+            case Kind::BRIGHTNESS:
+                r += step.p[0];
+                g += step.p[0];
+                b += step.p[0];
+                break;
+            case Kind::CONTRAST: {
+                const float factor = step.p[0], pivot = step.p[1];
+                r = factor * (r - pivot) + pivot;
+                g = factor * (g - pivot) + pivot;
+                b = factor * (b - pivot) + pivot;
+                break;
+            }
+            case Kind::GAMMA:
+                PointOps::pow(r, step.p[0]);
+                PointOps::pow(g, step.p[0]);
+                PointOps::pow(b, step.p[0]);
+                break;
+            case Kind::CURVES: {
+                const float input = step.p[0], output = step.p[1], lowSlope = step.p[2], highSlope = step.p[3];
+                r = r <= input ? lowSlope * r : output + highSlope * (r - input);
+                g = g <= input ? lowSlope * g : output + highSlope * (g - input);
+                b = b <= input ? lowSlope * b : output + highSlope * (b - input);
+                break;
+            }
+            case Kind::COLOR_BALANCE:
+                r += step.p[0];
+                g += step.p[1];
+                b += step.p[2];
+                break;
+        }
+        if (clampSteps) {
+            PointOps::clamp(r, 0.0f, 1.0f);
+            PointOps::clamp(g, 0.0f, 1.0f);
+            PointOps::clamp(b, 0.0f, 1.0f);
+        }
+    }
+}
@@ -10,32 +10,8 @@
 // To be honest, I do not think we need any comments here as everything should be straight forward.
 // history will just help us with stuff like ctrl + z. Just like chrome tabs you push and pop... wait, that's a queue (the DSA for move back n forth)
 // Regardess, pretty simple.
-HistoryState::HistoryState(SDL_Texture* texture, int layerIndex)
-    : m_texture(texture), m_layerIndex(layerIndex) {
-}
-
-HistoryState::~HistoryState() {
-    if (m_texture) {
-        SDL_DestroyTexture(m_texture);
-        m_texture = nullptr;
-    }
-}
-
-HistoryState::HistoryState(HistoryState&& other) noexcept
-    : m_texture(other.m_texture), m_layerIndex(other.m_layerIndex) {
-    other.m_texture = nullptr;
-}
-
-HistoryState& HistoryState::operator=(HistoryState&& other) noexcept {
-    if (this != &other) {
-        if (m_texture) {
-            SDL_DestroyTexture(m_texture);
-        }
-        m_texture = other.m_texture;
-        m_layerIndex = other.m_layerIndex;
-        other.m_texture = nullptr;
-    }
-    return *this;
+HistoryState::HistoryState(TileBuffer pixels, SDL_Point position, SDL_Point maskPosition, int layerIndex)
+    : m_pixels(std::move(pixels)), m_position(position), m_maskPosition(maskPosition), m_layerIndex(layerIndex) {
 }
 
 Editor& Editor::getInstance() {
@@ -67,19 +43,11 @@ void Editor::saveUndoState() {
     Layer* activeLayer = canvas.getActiveLayer();
     if (!activeLayer) return;
     
-    SDL_Texture* copy = SDL_CreateTexture(
-        canvas.getRenderer(), 
-        SDL_PIXELFORMAT_RGBA8888, 
-        SDL_TEXTUREACCESS_TARGET, 
-        canvas.getWidth(), 
-        canvas.getHeight()
-    );
-    
-    SDL_SetRenderTarget(canvas.getRenderer(), copy);
-    SDL_RenderCopy(canvas.getRenderer(), activeLayer->getTexture(), nullptr, nullptr);
-    SDL_SetRenderTarget(canvas.getRenderer(), nullptr);
-    
-    m_undoStack.push(HistoryState(copy, idx));
+    // Tiles painted since the last snapshot go through the tile store first, so a stroke that
+    // got undone by hand or a region that's identical somewhere else is kept only once
+    activeLayer->getPixels().deduplicate();
+    m_undoStack.push(HistoryState(activeLayer->getPixels(), {activeLayer->getX(), activeLayer->getY()},
+                                    {activeLayer->getMaskX(), activeLayer->getMaskY()}, idx));
     
 
     limitHistorySize();
@@ -116,22 +84,10 @@ void Editor::applyUndo() {
     Layer* activeLayer = canvas.getActiveLayer();
     if (!activeLayer) return;
     
-    SDL_Texture* currentTexture = activeLayer->getTexture();
-    SDL_Texture* copyTexture = SDL_CreateTexture(
-        canvas.getRenderer(), 
-        SDL_PIXELFORMAT_RGBA8888, 
-        SDL_TEXTUREACCESS_TARGET, 
-        canvas.getWidth(), 
-        canvas.getHeight()
-    );
-    
-    if (copyTexture) {
-        SDL_SetRenderTarget(canvas.getRenderer(), copyTexture);
-        SDL_RenderCopy(canvas.getRenderer(), currentTexture, nullptr, nullptr);
-        SDL_SetRenderTarget(canvas.getRenderer(), nullptr);
-        
-        m_redoStack.push(HistoryState(copyTexture, canvas.getActiveLayerIndex()));
-    }
+    activeLayer->getPixels().deduplicate();
+    m_redoStack.push(HistoryState(activeLayer->getPixels(), {activeLayer->getX(), activeLayer->getY()},
+                                    {activeLayer->getMaskX(), activeLayer->getMaskY()},
+                                    canvas.getActiveLayerIndex()));
     
     HistoryState undoState = std::move(m_undoStack.top());
     m_undoStack.pop();
@@ -140,7 +96,9 @@ void Editor::applyUndo() {
     activeLayer = canvas.getActiveLayer();
     
     if (activeLayer) {
-        activeLayer->setTexture(undoState.getTexture());
+        activeLayer->setPixels(undoState.getPixels());
+        activeLayer->setPosition(undoState.getPosition().x, undoState.getPosition().y);
+        activeLayer->setMaskPosition(undoState.getMaskPosition().x, undoState.getMaskPosition().y);
     }
 }
 
@@ -151,22 +109,10 @@ void Editor::applyRedo() {
     Layer* activeLayer = canvas.getActiveLayer();
     if (!activeLayer) return;
     
-    SDL_Texture* currentTexture = activeLayer->getTexture();
-    SDL_Texture* copyTexture = SDL_CreateTexture(
-        canvas.getRenderer(), 
-        SDL_PIXELFORMAT_RGBA8888, 
-        SDL_TEXTUREACCESS_TARGET, 
-        canvas.getWidth(), 
-        canvas.getHeight()
-    );
-    
-    if (copyTexture) {
-        SDL_SetRenderTarget(canvas.getRenderer(), copyTexture);
-        SDL_RenderCopy(canvas.getRenderer(), currentTexture, nullptr, nullptr);
-        SDL_SetRenderTarget(canvas.getRenderer(), nullptr);
-        
-        m_undoStack.push(HistoryState(copyTexture, canvas.getActiveLayerIndex()));
-    }
+    activeLayer->getPixels().deduplicate();
+    m_undoStack.push(HistoryState(activeLayer->getPixels(), {activeLayer->getX(), activeLayer->getY()},
+                                    {activeLayer->getMaskX(), activeLayer->getMaskY()},
+                                    canvas.getActiveLayerIndex()));
     
     HistoryState redoState = std::move(m_redoStack.top());
     m_redoStack.pop();
@@ -175,7 +121,9 @@ void Editor::applyRedo() {
     activeLayer = canvas.getActiveLayer();
     
     if (activeLayer) {
-        activeLayer->setTexture(redoState.getTexture());
+        activeLayer->setPixels(redoState.getPixels());
+        activeLayer->setPosition(redoState.getPosition().x, redoState.getPosition().y);
+        activeLayer->setMaskPosition(redoState.getMaskPosition().x, redoState.getMaskPosition().y);
     }
 }
 
@@ -188,20 +136,18 @@ void Editor::mergeLayers() {
     
     if (!mergedLayer) return;
     
-    SDL_SetRenderTarget(canvas.getRenderer(), mergedLayer->getTexture());
-    
-    for (const auto& layer : canvas.getLayers()) {
-        if (layer->isVisible() && layer.get() != mergedLayer) {
-            SDL_SetTextureAlphaMod(layer->getTexture(), static_cast<Uint8>(layer->getOpacity() * 255));
-            SDL_RenderCopy(canvas.getRenderer(), layer->getTexture(), nullptr, nullptr);
-        }
-    }
-    
-    SDL_SetRenderTarget(canvas.getRenderer(), nullptr);
+    // Blend modes are respected, same kernels the canvas uses to draw them. Composited at canvas
+    // size and then trimmed down to whatever actually came out.
+    TileBuffer merged(canvas.getWidth(), canvas.getHeight());
+    canvas.compositeAll(merged, mergedLayer);
+    mergedLayer->setPixels(std::move(merged));
+    mergedLayer->setPosition(0, 0);
+    mergedLayer->trimToContent();
     
 
-    for (int i = static_cast<int>(canvas.getLayers().size()) - 2; i >= 0; i--) {
-        canvas.removeLayer(i);
+    // Right under the merged layer is always the top of a layer or of a whole group
+    while (canvas.getLayers().size() > 1) {
+        canvas.removeLayer(static_cast<int>(canvas.getLayers().size()) - 2);
     }
     
     canvas.setActiveLayerIndex(0);
@@ -211,11 +157,7 @@ void Editor::clearSelection() {
     Canvas& canvas = Canvas::getInstance();
     canvas.setHasSelection(false);
     canvas.setSelectionRect({0, 0, 0, 0});
-    
-    if (canvas.getSelectionTexture()) {
-        SDL_DestroyTexture(canvas.getSelectionTexture());
-        canvas.setSelectionTexture(nullptr);
-    }
+    canvas.clearSelectionBuffer();
 }
 
 void Editor::copySelection() {
@@ -224,47 +166,31 @@ void Editor::copySelection() {
     
     if (!canvas.hasSelection() || selectionRect.w <= 0 || selectionRect.h <= 0) return;
     
-    if (canvas.getSelectionTexture()) {
-        SDL_DestroyTexture(canvas.getSelectionTexture());
-    }
-    
-    SDL_Texture* selectionTexture = SDL_CreateTexture(
-        canvas.getRenderer(),
-        SDL_PIXELFORMAT_RGBA8888,
-        SDL_TEXTUREACCESS_TARGET,
-        selectionRect.w,
-        selectionRect.h
-    );
-    
-    SDL_SetRenderTarget(canvas.getRenderer(), selectionTexture);
-    
     Layer* activeLayer = canvas.getActiveLayer();
     if (activeLayer) {
-        SDL_RenderCopy(canvas.getRenderer(), activeLayer->getTexture(), &selectionRect, nullptr);
+        // Shares the layer's tiles, no pixels are copied here. The selection is in canvas
+        // coordinates, the layer's tiles start at its own position.
+        SDL_Rect local = {selectionRect.x - activeLayer->getX(), selectionRect.y - activeLayer->getY(),
+                          selectionRect.w, selectionRect.h};
+        canvas.setSelectionBuffer(activeLayer->getPixels(), local);
     }
-    
-    SDL_SetRenderTarget(canvas.getRenderer(), nullptr);
-    
-    canvas.setSelectionTexture(selectionTexture);
 }
 
 void Editor::pasteSelection() {
     Canvas& canvas = Canvas::getInstance();
-    SDL_Texture* selectionTexture = canvas.getSelectionTexture();
-    
-    if (!selectionTexture) return;
+    if (!canvas.hasSelectionBuffer()) return;
     
-    int width, height;
-    SDL_QueryTexture(selectionTexture, nullptr, nullptr, &width, &height);
+    SDL_Rect clipRect = canvas.getSelectionBufferRect();
+    int width = clipRect.w;
+    int height = clipRect.h;
     
     int pasteX = 10, pasteY = 10;
-    SDL_Rect dest = {pasteX, pasteY, width, height};
     
     Layer* activeLayer = canvas.getActiveLayer();
     if (activeLayer) {
-        SDL_SetRenderTarget(canvas.getRenderer(), activeLayer->getTexture());
-        SDL_RenderCopy(canvas.getRenderer(), selectionTexture, nullptr, &dest);
-        SDL_SetRenderTarget(canvas.getRenderer(), nullptr);
+        TileBuffer clipboard = canvas.getSelectionBuffer().extract(clipRect);
+        LayerPixels(*activeLayer).compositeOver(clipboard, pasteX, pasteY);
+        activeLayer->getPixels().deduplicate(); // pasting the same thing again shouldn't cost it again
     }
     
     canvas.setSelectionRect({pasteX, pasteY, width, height});
@@ -280,11 +206,8 @@ void Editor::deleteSelection() {
     Layer* activeLayer = canvas.getActiveLayer();
     if (!activeLayer) return;
     
-    SDL_SetRenderTarget(canvas.getRenderer(), activeLayer->getTexture());
-    SDL_SetRenderDrawBlendMode(canvas.getRenderer(), SDL_BLENDMODE_NONE);
-    SDL_SetRenderDrawColor(canvas.getRenderer(), 0, 0, 0, 0);
-    SDL_RenderFillRect(canvas.getRenderer(), &selectionRect);
-    SDL_SetRenderTarget(canvas.getRenderer(), nullptr);
+    LayerPixels(*activeLayer).fillRect(selectionRect, 0, false);
+    activeLayer->trimToContent();
     
     clearSelection();
 }
@@ -4,27 +4,29 @@
 #include <memory>
 #include <vector>
 #include <string>
+#include "../canvas/TileBuffer.hpp"
 
 class Canvas;
 
+// Snapshot of one layer's pixels. Used to be a render target texture copy,
+// now it's just a copy of the layer's TileBuffer so undo never touches the GPU.
+// The copy shares tiles with the layer (copy-on-write), so a snapshot only costs
+// memory for the tiles that get painted on afterwards.
 class HistoryState {
 public:
-    HistoryState(SDL_Texture* texture, int layerIndex);
-    ~HistoryState();
-    
-
-    HistoryState(const HistoryState&) = delete;
-    HistoryState& operator=(const HistoryState&) = delete;
-    
+    HistoryState(TileBuffer pixels, SDL_Point position, SDL_Point maskPosition, int layerIndex);
 
-    HistoryState(HistoryState&& other) noexcept;
-    HistoryState& operator=(HistoryState&& other) noexcept;
-    
-    SDL_Texture* getTexture() const { return m_texture; }
+    const TileBuffer& getPixels() const { return m_pixels; }
+    // Layers only cover their content, so where that content sat is part of the state too
+    SDL_Point getPosition() const { return m_position; }
+    // The mask has its own origin, moving the layer moves it along
+    SDL_Point getMaskPosition() const { return m_maskPosition; }
     int getLayerIndex() const { return m_layerIndex; }
-    
+
 private:
-    SDL_Texture* m_texture = nullptr;
+    TileBuffer m_pixels;
+    SDL_Point m_position = {0, 0};
+    SDL_Point m_maskPosition = {0, 0};
     int m_layerIndex = -1;
 };
 
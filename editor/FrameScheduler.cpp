@@ -0,0 +1,92 @@
+#include "FrameScheduler.hpp"
+#include <algorithm>
+
+FrameScheduler& FrameScheduler::getInstance() {
+    static FrameScheduler instance;
+    return instance;
+}
+
+void FrameScheduler::init() {
+    // Our own event type, only used to kick SDL_WaitEventTimeout when another thread wants a frame
+    m_wakeEventType = SDL_RegisterEvents(1);
+    m_startCounter = SDL_GetPerformanceCounter();
+    m_windowStartCounter = m_startCounter;
+    m_windowIdleCounter = 0;
+    m_pendingFrames = 1;
+}
+
+void FrameScheduler::requestRedraw(int frames) {
+    int previous = m_pendingFrames.load();
+    while (previous < frames && !m_pendingFrames.compare_exchange_weak(previous, frames)) {
+    }
+
+    // Loop might be asleep, poke it. If it's awake the event is just ignored.
+    if (previous == 0 && m_wakeEventType != static_cast<Uint32>(-1)) {
+        SDL_Event wake = {};
+        wake.type = m_wakeEventType;
+        SDL_PushEvent(&wake);
+    }
+}
+
+void FrameScheduler::requestRedrawAfter(Uint32 ms) {
+    Uint32 deadline = SDL_GetTicks() + std::max<Uint32>(ms, 1);
+    if (m_redrawDeadline == 0 || deadline < m_redrawDeadline) {
+        m_redrawDeadline = deadline;
+    }
+}
+
+bool FrameScheduler::waitEvent(SDL_Event& event) {
+    if (m_continuous || m_pendingFrames > 0) {
+        return SDL_PollEvent(&event) != 0;
+    }
+
+    Uint32 timeout = IDLE_TIMEOUT_MS;
+    if (m_redrawDeadline != 0) {
+        Uint32 now = SDL_GetTicks();
+        timeout = m_redrawDeadline > now ? std::min(timeout, m_redrawDeadline - now) : 0;
+    }
+
+    // This is where the CPU time goes back to everybody else
+    Uint64 sleepStart = SDL_GetPerformanceCounter();
+    int gotEvent = timeout > 0 ? SDL_WaitEventTimeout(&event, static_cast<int>(timeout)) : SDL_PollEvent(&event);
+    m_windowIdleCounter += SDL_GetPerformanceCounter() - sleepStart;
+    updateIdleWindow();
+
+    return gotEvent != 0;
+}
+
+bool FrameScheduler::beginFrame() {
+    if (m_redrawDeadline != 0 && SDL_GetTicks() >= m_redrawDeadline) {
+        m_redrawDeadline = 0;
+        requestRedraw();
+    }
+    if (!m_continuous && m_pendingFrames <= 0) {
+        return false;
+    }
+    if (m_pendingFrames > 0) m_pendingFrames--;
+    m_frameStartCounter = SDL_GetPerformanceCounter();
+    return true;
+}
+
+void FrameScheduler::endFrame() {
+    Uint64 now = SDL_GetPerformanceCounter();
+    m_frameMs = static_cast<float>((now - m_frameStartCounter) * 1000.0 / SDL_GetPerformanceFrequency());
+    m_framesRendered++;
+    updateIdleWindow();
+}
+
+Uint64 FrameScheduler::getFramesSkipped() const {
+    double elapsedMs = (SDL_GetPerformanceCounter() - m_startCounter) * 1000.0 / SDL_GetPerformanceFrequency();
+    Uint64 reference = static_cast<Uint64>(elapsedMs / REFERENCE_FRAME_MS);
+    return reference > m_framesRendered ? reference - m_framesRendered : 0;
+}
+
+void FrameScheduler::updateIdleWindow() {
+    // Idle share over roughly the last second
+    Uint64 now = SDL_GetPerformanceCounter();
+    Uint64 elapsed = now - m_windowStartCounter;
+    if (elapsed < SDL_GetPerformanceFrequency()) return;
+    m_idlePercent = 100.0f * static_cast<float>(std::min(m_windowIdleCounter, elapsed)) / static_cast<float>(elapsed);
+    m_windowStartCounter = now;
+    m_windowIdleCounter = 0;
+}
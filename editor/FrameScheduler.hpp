@@ -0,0 +1,67 @@
+#pragma once
+#include <SDL2/SDL.h>
+#include <atomic>
+
+// Decides when the main loop actually draws. We used to redraw everything every 16ms whether
+// anything happened or not, which keeps a core busy for a picture that never changes.
+// Now the loop sleeps in SDL_WaitEventTimeout until there's input or somebody asks for a frame.
+class FrameScheduler {
+public:
+    static FrameScheduler& getInstance();
+
+    void init();
+
+    // Safe from any thread (background jobs). Asks for the next `frames` frames to be drawn and
+    // wakes the main loop up if it's sleeping. ImGui wants a couple of frames after input to
+    // settle hover/active states, hence more than one.
+    void requestRedraw(int frames = 1);
+    // Main thread only. Draw a frame once `ms` milliseconds have passed, for things that animate.
+    void requestRedrawAfter(Uint32 ms);
+
+    // Main loop. Blocks until there's an event (returns true) or a frame is due (returns false).
+    bool waitEvent(SDL_Event& event);
+    bool isWakeEvent(const SDL_Event& event) const { return event.type == m_wakeEventType; }
+    // True if this iteration should draw, false means the frame is skipped
+    bool beginFrame();
+    void endFrame();
+
+    // Old behaviour, redraw all the time. Handy for comparing.
+    bool isContinuous() const { return m_continuous; }
+    void setContinuous(bool continuous) { m_continuous = continuous; requestRedraw(); }
+
+    // Stats for the performance panel
+    Uint64 getFramesRendered() const { return m_framesRendered; }
+    // Frames the old fixed 60 fps loop would have drawn that we didn't
+    Uint64 getFramesSkipped() const;
+    float getIdlePercent() const { return m_idlePercent; } // share of wall time spent asleep
+    float getFrameMs() const { return m_frameMs; }
+
+private:
+    FrameScheduler() = default;
+    ~FrameScheduler() = default;
+    FrameScheduler(const FrameScheduler&) = delete;
+    FrameScheduler& operator=(const FrameScheduler&) = delete;
+
+    static constexpr Uint32 IDLE_TIMEOUT_MS = 500; // wake up now and then to refresh the stats
+    static constexpr double REFERENCE_FRAME_MS = 16.0; // what the old loop slept per frame
+
+    std::atomic<int> m_pendingFrames{1};
+    Uint32 m_wakeEventType = static_cast<Uint32>(-1);
+    Uint32 m_redrawDeadline = 0; // SDL_GetTicks time, 0 = none
+    bool m_continuous = false;
+
+    // Timing, all in SDL_GetPerformanceCounter units
+    Uint64 m_startCounter = 0;
+    Uint64 m_frameStartCounter = 0;
+    Uint64 m_windowStartCounter = 0;
+    Uint64 m_windowIdleCounter = 0;
+    Uint64 m_framesRendered = 0;
+    float m_idlePercent = 0.0f;
+    float m_frameMs = 0.0f;
+
+    void updateIdleWindow();
+};
+
+inline FrameScheduler& GetFrameScheduler() {
+    return FrameScheduler::getInstance();
+}
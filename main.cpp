@@ -30,17 +30,29 @@ int main() {
     canvas.init(renderer);
     GetToolManager().init();
     GetEditor().init();
+    FrameScheduler& scheduler = GetFrameScheduler();
+    scheduler.init();
 
 
     bool quit = false;
     SDL_Event event;
     while (!quit) {
-        while (SDL_PollEvent(&event)) {
+        // Sleeps in here until there's input or something asked for a frame
+        bool haveEvent = scheduler.waitEvent(event);
+        for (; haveEvent; haveEvent = SDL_PollEvent(&event)) {
+            if (scheduler.isWakeEvent(event)) continue;
+            scheduler.requestRedraw(3);
+
             ImGui_ImplSDL2_ProcessEvent(&event);
-            SDL_Point mousePos = {event.button.x, event.button.y};
 
             if (!ImGui::GetIO().WantCaptureMouse) {
-                if (canvas.handleResizeEvent(event, mousePos)) {
+                // Zoom/pan first, then everything else sees canvas coordinates
+                if (canvas.handleViewEvent(event)) {
+                    continue;
+                }
+                SDL_Event canvasEvent = canvas.toCanvasEvent(event);
+                SDL_Point mousePos = {canvasEvent.button.x, canvasEvent.button.y};
+                if (canvas.handleResizeEvent(canvasEvent, mousePos)) {
                     continue;
                 }
                 GetToolManager().handleSDLEvent(event);
@@ -51,6 +63,8 @@ int main() {
             }
         }
 
+        if (!scheduler.beginFrame()) continue;
+
         ImGui_ImplSDLRenderer2_NewFrame();
         ImGui_ImplSDL2_NewFrame();
         ImGui::NewFrame();
@@ -63,7 +77,10 @@ int main() {
         ImGui_ImplSDLRenderer2_RenderDrawData(ImGui::GetDrawData());
 
         SDL_RenderPresent(renderer);
-        SDL_Delay(16);
+        scheduler.endFrame();
+        if (scheduler.isContinuous()) {
+            SDL_Delay(16);
+        }
     }
 
     Paint::CleanupImGui();
@@ -4,8 +4,10 @@
 #include <string>
 #include <vector>
 #include <memory>
+#include "../canvas/TileBuffer.hpp"
 
 class Canvas;
+class LayerPixels;
 
 class Tool {
 public:
@@ -52,6 +54,12 @@ protected:
             static_cast<Uint8>(color.w * 255)
         };
     }
+
+    // Same thing but packed (and premultiplied) for the layer TileBuffer
+    Uint32 toPixel(const ImVec4& color) const {
+        SDL_Color c = toSDLColor(color);
+        return TileBuffer::premultiply(TileBuffer::packRGBA(c.r, c.g, c.b, c.a));
+    }
 };
 
 // I tried a few different approaches here but settled on this inheritance model.
@@ -152,7 +160,6 @@ public:
     
 private:
     void floodFill(int x, int y, ImVec4 fillColor, ImVec4 targetColor = ImVec4(0,0,0,0));
-    SDL_Texture* newTexture = nullptr; // See line 950 in the Toomanagers
 };
 
 class TextTool : public Tool {
@@ -293,7 +300,9 @@ private:
     ImVec4 m_secondaryColor;
     GradientType m_type;
     
-    void drawGradient(SDL_Renderer* renderer, ImVec2 start, ImVec2 end, ImVec4 startColor, ImVec4 endColor);
+    // target set = bake into the layer, nullptr = just preview with the renderer
+    void drawGradient(SDL_Renderer* renderer, ImVec2 start, ImVec2 end, ImVec4 startColor, ImVec4 endColor,
+                      LayerPixels* target = nullptr);
 };
 
 class HealingTool : public Tool {
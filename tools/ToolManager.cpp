@@ -46,9 +46,12 @@ void ToolManager::cleanup() {
     m_tools.clear();
 }
 
-void ToolManager::handleSDLEvent(const SDL_Event& event) {
+void ToolManager::handleSDLEvent(const SDL_Event& windowEvent) {
     if (!m_currentTool) return;
 
+    // Tools work in canvas pixels, whatever the zoom and pan are
+    SDL_Event event = GetCanvas().toCanvasEvent(windowEvent);
+
     switch (event.type) {
         case SDL_MOUSEBUTTONDOWN:
             m_currentTool->handleMouseDown(event);
@@ -173,7 +176,6 @@ GradientTool* ToolManager::getGradientTool() const {
     return nullptr;
 }
 
-.
 
 void PencilTool::handleMouseDown(const SDL_Event& event) {
     m_isDrawing = true;
@@ -184,27 +186,20 @@ void PencilTool::handleMouseDown(const SDL_Event& event) {
     Layer* activeLayer = canvas.getActiveLayer();
 
     if (activeLayer && !activeLayer->isLocked()) {
-        SDL_Renderer* renderer = canvas.getRenderer();
-        SDL_SetRenderTarget(renderer, activeLayer->getTexture());
+        LayerPixels pixels(*activeLayer);
 
-        SDL_SetRenderDrawColor(renderer,
-            static_cast<Uint8>(m_color.x * 255),
-            static_cast<Uint8>(m_color.y * 255),
-            static_cast<Uint8>(m_color.z * 255),
-            static_cast<Uint8>(m_color.w * 255));
+        Uint32 color = toPixel(m_color);
 
         const int radius = m_size / 2;
         for (int y = -radius; y <= radius; y++) {
             for (int x = -radius; x <= radius; x++) {
                 if (x*x + y*y <= radius*radius) {
-                    SDL_RenderDrawPoint(renderer,
+                    pixels.blendPixel(
                         static_cast<int>(m_currentPos.x) + x,
-                        static_cast<int>(m_currentPos.y) + y);
+                        static_cast<int>(m_currentPos.y) + y, color);
                 }
             }
         }
-
-        SDL_SetRenderTarget(renderer, nullptr);
     }
 
     
@@ -220,14 +215,9 @@ void PencilTool::handleMouseMove(const SDL_Event& event) {
     Layer* activeLayer = canvas.getActiveLayer();
 
     if (activeLayer && !activeLayer->isLocked()) {
-        SDL_Renderer* renderer = canvas.getRenderer();
-        SDL_SetRenderTarget(renderer, activeLayer->getTexture());
+        LayerPixels pixels(*activeLayer);
 
-        SDL_SetRenderDrawColor(renderer,
-            static_cast<Uint8>(m_color.x * 255),
-            static_cast<Uint8>(m_color.y * 255),
-            static_cast<Uint8>(m_color.z * 255),
-            static_cast<Uint8>(m_color.w * 255));
+        Uint32 color = toPixel(m_color);
 
         const int radius = m_size / 2;
         const float dist = std::sqrt(
@@ -241,9 +231,9 @@ void PencilTool::handleMouseMove(const SDL_Event& event) {
                     for (int y = -radius; y <= radius; y++) {
                         for (int x = -radius; x <= radius; x++) {
                             if (x*x + y*y <= radius*radius) {
-                                SDL_RenderDrawPoint(renderer,
+                                pixels.blendPixel(
                                     static_cast<int>(newPos.x) + x,
-                                    static_cast<int>(newPos.y) + y);
+                                    static_cast<int>(newPos.y) + y, color);
                             }
                         }
                     }
@@ -257,9 +247,9 @@ void PencilTool::handleMouseMove(const SDL_Event& event) {
                         for (int dy = -radius; dy <= radius; dy++) {
                             for (int dx = -radius; dx <= radius; dx++) {
                                 if (dx*dx + dy*dy <= radius*radius) {
-                                    SDL_RenderDrawPoint(renderer,
+                                    pixels.blendPixel(
                                         static_cast<int>(x) + dx,
-                                        static_cast<int>(y) + dy);
+                                        static_cast<int>(y) + dy, color);
                                 }
                             }
                         }
@@ -279,9 +269,9 @@ void PencilTool::handleMouseMove(const SDL_Event& event) {
                             for (int dx = -radius; dx <= radius; dx++) {
                                 if (dx*dx + dy*dy <= radius*radius) {
                                     if (rand() % 3 == 0) {
-                                        SDL_RenderDrawPoint(renderer,
+                                        pixels.blendPixel(
                                             static_cast<int>(x) + dx,
-                                            static_cast<int>(y) + dy);
+                                            static_cast<int>(y) + dy, color);
                                     }
                                 }
                             }
@@ -304,15 +294,11 @@ void PencilTool::handleMouseMove(const SDL_Event& event) {
                                 if (distance <= radius) {
                                     float alpha = 1.0f - (distance / radius);
 
-                                    SDL_SetRenderDrawColor(renderer,
-                                        static_cast<Uint8>(m_color.x * 255),
-                                        static_cast<Uint8>(m_color.y * 255),
-                                        static_cast<Uint8>(m_color.z * 255),
-                                        static_cast<Uint8>(m_color.w * alpha * 255));
+                                    Uint32 softColor = toPixel(ImVec4(m_color.x, m_color.y, m_color.z, m_color.w * alpha));
 
-                                    SDL_RenderDrawPoint(renderer,
+                                    pixels.blendPixel(
                                         static_cast<int>(x) + dx,
-                                        static_cast<int>(y) + dy);
+                                        static_cast<int>(y) + dy, softColor);
                                 }
                             }
                         }
@@ -322,8 +308,6 @@ void PencilTool::handleMouseMove(const SDL_Event& event) {
         }
 
 
-
-        SDL_SetRenderTarget(renderer, nullptr);
     }
 
     m_currentPos = newPos;
@@ -341,8 +325,8 @@ void PencilTool::render(SDL_Renderer* renderer) {
         const int radius = m_size / 2;
 
 
-        int mouseX, mouseY;
-        SDL_GetMouseState(&mouseX, &mouseY);
+        SDL_Point mouse = GetCanvas().getMouseCanvasPos();
+        int mouseX = mouse.x, mouseY = mouse.y;
 
 
         for (int angle = 0; angle < 360; angle += 5) {
@@ -364,11 +348,7 @@ void EraserTool::handleMouseDown(const SDL_Event& event) {
     Layer* activeLayer = canvas.getActiveLayer();
 
     if (activeLayer && !activeLayer->isLocked()) {
-        SDL_Renderer* renderer = canvas.getRenderer();
-        SDL_SetRenderTarget(renderer, activeLayer->getTexture());
-
-        SDL_SetRenderDrawBlendMode(renderer, SDL_BLENDMODE_NONE);
-        SDL_SetRenderDrawColor(renderer, 0, 0, 0, 0);
+        LayerPixels pixels(*activeLayer);
 
         const int radius = m_size / 2;
         SDL_Rect rect = {
@@ -377,9 +357,7 @@ void EraserTool::handleMouseDown(const SDL_Event& event) {
             m_size,
             m_size
         };
-        SDL_RenderFillRect(renderer, &rect);
-
-        SDL_SetRenderTarget(renderer, nullptr);
+        pixels.fillRect(rect, 0, false);
     }
 
     Editor::getInstance().saveUndoState();
@@ -394,11 +372,7 @@ void EraserTool::handleMouseMove(const SDL_Event& event) {
     Layer* activeLayer = canvas.getActiveLayer();
 
     if (activeLayer && !activeLayer->isLocked()) {
-        SDL_Renderer* renderer = canvas.getRenderer();
-        SDL_SetRenderTarget(renderer, activeLayer->getTexture());
-
-        SDL_SetRenderDrawBlendMode(renderer, SDL_BLENDMODE_NONE);
-        SDL_SetRenderDrawColor(renderer, 0, 0, 0, 0);
+        LayerPixels pixels(*activeLayer);
 
         const int radius = m_size / 2;
         const float dist = std::sqrt(
@@ -413,7 +387,7 @@ void EraserTool::handleMouseMove(const SDL_Event& event) {
                 m_size,
                 m_size
             };
-            SDL_RenderFillRect(renderer, &rect);
+            pixels.fillRect(rect, 0, false);
         } else {
             const float step = 1.0f / dist;
             for (float t = 0; t <= 1.0f; t += step) {
@@ -426,11 +400,9 @@ void EraserTool::handleMouseMove(const SDL_Event& event) {
                     m_size,
                     m_size
                 };
-                SDL_RenderFillRect(renderer, &rect);
+                pixels.fillRect(rect, 0, false);
             }
         }
-
-        SDL_SetRenderTarget(renderer, nullptr);
     }
 
     m_currentPos = newPos;
@@ -438,6 +410,13 @@ void EraserTool::handleMouseMove(const SDL_Event& event) {
 
 void EraserTool::handleMouseUp(const SDL_Event&) {
     m_isDrawing = false;
+
+    // Give back the memory of any tile the stroke wiped out completely, and shrink the layer
+    // back down to what's left
+    Layer* activeLayer = GetCanvas().getActiveLayer();
+    if (activeLayer) {
+        activeLayer->trimToContent();
+    }
 }
 
 
@@ -462,14 +441,9 @@ void LineTool::handleMouseUp(const SDL_Event&) {
     Layer* activeLayer = canvas.getActiveLayer();
 
     if (activeLayer && !activeLayer->isLocked()) {
-        SDL_Renderer* renderer = canvas.getRenderer();
-        SDL_SetRenderTarget(renderer, activeLayer->getTexture());
+        LayerPixels pixels(*activeLayer);
 
-        SDL_SetRenderDrawColor(renderer,
-            static_cast<Uint8>(m_color.x * 255),
-            static_cast<Uint8>(m_color.y * 255),
-            static_cast<Uint8>(m_color.z * 255),
-            static_cast<Uint8>(m_color.w * 255));
+        Uint32 color = toPixel(m_color);
 
 
         for (int lineNum = 0; lineNum < m_lineCount; lineNum++) {
@@ -490,9 +464,9 @@ void LineTool::handleMouseUp(const SDL_Event&) {
                 for (int y = -radius; y <= radius; y++) {
                     for (int x = -radius; x <= radius; x++) {
                         if (x*x + y*y <= radius*radius) {
-                            SDL_RenderDrawPoint(renderer,
+                            pixels.blendPixel(
                                 static_cast<int>(start.x) + x,
-                                static_cast<int>(start.y) + y);
+                                static_cast<int>(start.y) + y, color);
                         }
                     }
                 }
@@ -505,17 +479,15 @@ void LineTool::handleMouseUp(const SDL_Event&) {
                     for (int cy = -radius; cy <= radius; cy++) {
                         for (int cx = -radius; cx <= radius; cx++) {
                             if (cx*cx + cy*cy <= radius*radius) {
-                                SDL_RenderDrawPoint(renderer,
+                                pixels.blendPixel(
                                     static_cast<int>(x) + cx,
-                                    static_cast<int>(y) + cy);
+                                    static_cast<int>(y) + cy, color);
                             }
                         }
                     }
                 }
             }
         }
-
-        SDL_SetRenderTarget(renderer, nullptr);
     }
 
     m_isDrawing = false;
@@ -597,14 +569,9 @@ void RectangleTool::handleMouseUp(const SDL_Event&) {
     Layer* activeLayer = canvas.getActiveLayer();
 
     if (activeLayer && !activeLayer->isLocked()) {
-        SDL_Renderer* renderer = canvas.getRenderer();
-        SDL_SetRenderTarget(renderer, activeLayer->getTexture());
+        LayerPixels pixels(*activeLayer);
 
-        SDL_SetRenderDrawColor(renderer,
-            static_cast<Uint8>(m_color.x * 255),
-            static_cast<Uint8>(m_color.y * 255),
-            static_cast<Uint8>(m_color.z * 255),
-            static_cast<Uint8>(m_color.w * 255));
+        Uint32 color = toPixel(m_color);
 
         int x = std::min(static_cast<int>(m_startPos.x), static_cast<int>(m_currentPos.x));
         int y = std::min(static_cast<int>(m_startPos.y), static_cast<int>(m_currentPos.y));
@@ -613,15 +580,13 @@ void RectangleTool::handleMouseUp(const SDL_Event&) {
         SDL_Rect rect = {x, y, w, h};
 
         if (m_filled) {
-            SDL_RenderFillRect(renderer, &rect);
+            pixels.fillRect(rect, color, true);
         } else {
             for (int i = 0; i < m_size; i++) {
                 SDL_Rect border = {x - i, y - i, w + i * 2, h + i * 2};
-                SDL_RenderDrawRect(renderer, &border);
+                pixels.drawRect(border, color);
             }
         }
-
-        SDL_SetRenderTarget(renderer, nullptr);
     }
 
     m_isDrawing = false;
@@ -674,8 +639,7 @@ void CircleTool::handleMouseUp(const SDL_Event&) {
     Layer* activeLayer = canvas.getActiveLayer();
 
     if (activeLayer && !activeLayer->isLocked()) {
-        SDL_Renderer* renderer = canvas.getRenderer();
-        SDL_SetRenderTarget(renderer, activeLayer->getTexture());
+        LayerPixels pixels(*activeLayer);
 
         float dx = m_currentPos.x - m_startPos.x;
         float dy = m_currentPos.y - m_startPos.y;
@@ -683,17 +647,13 @@ void CircleTool::handleMouseUp(const SDL_Event&) {
         int centerX = static_cast<int>(m_startPos.x);
         int centerY = static_cast<int>(m_startPos.y);
 
-        SDL_SetRenderDrawColor(renderer,
-            static_cast<Uint8>(m_color.x * 255),
-            static_cast<Uint8>(m_color.y * 255),
-            static_cast<Uint8>(m_color.z * 255),
-            static_cast<Uint8>(m_color.w * 255));
+        Uint32 color = toPixel(m_color);
 
         if (m_filled) {
             for (int y = -radius; y <= radius; y++) {
                 for (int x = -radius; x <= radius; x++) {
                     if (x*x + y*y <= radius*radius) {
-                        SDL_RenderDrawPoint(renderer, centerX + x, centerY + y);
+                        pixels.blendPixel(centerX + x, centerY + y, color);
                     }
                 }
             }
@@ -706,14 +666,12 @@ void CircleTool::handleMouseUp(const SDL_Event&) {
                     for (int x = -r; x <= r; x++) {
                         int distSq = x*x + y*y;
                         if (distSq <= r*r && distSq >= (r-1)*(r-1)) {
-                            SDL_RenderDrawPoint(renderer, centerX + x, centerY + y);
+                            pixels.blendPixel(centerX + x, centerY + y, color);
                         }
                     }
                 }
             }
         }
-
-        SDL_SetRenderTarget(renderer, nullptr);
     }
 
     m_isDrawing = false;
@@ -781,14 +739,9 @@ void TriangleTool::handleMouseUp(const SDL_Event&) {
     Layer* activeLayer = canvas.getActiveLayer();
 
     if (activeLayer && !activeLayer->isLocked()) {
-        SDL_Renderer* renderer = canvas.getRenderer();
-        SDL_SetRenderTarget(renderer, activeLayer->getTexture());
+        LayerPixels pixels(*activeLayer);
 
-        SDL_SetRenderDrawColor(renderer,
-            static_cast<Uint8>(m_color.x * 255),
-            static_cast<Uint8>(m_color.y * 255),
-            static_cast<Uint8>(m_color.z * 255),
-            static_cast<Uint8>(m_color.w * 255));
+        Uint32 color = toPixel(m_color);
 
         int x1 = static_cast<int>(m_startPos.x);
         int y1 = static_cast<int>(m_startPos.y);
@@ -801,15 +754,13 @@ void TriangleTool::handleMouseUp(const SDL_Event&) {
 
         for (int i = 0; i < m_size; i++) {
             int offset = i - m_size/2;
-            SDL_RenderDrawLine(renderer, x1 + offset, y1, x3 + offset, y3);
-            SDL_RenderDrawLine(renderer, x3 + offset, y3, x2 + offset, y2);
-            SDL_RenderDrawLine(renderer, x2 + offset, y2, x1 + offset, y1);
-            SDL_RenderDrawLine(renderer, x1, y1 + offset, x3, y3 + offset);
-            SDL_RenderDrawLine(renderer, x3, y3 + offset, x2, y2 + offset);
-            SDL_RenderDrawLine(renderer, x2, y2 + offset, x1, y1 + offset);
+            pixels.drawLine(x1 + offset, y1, x3 + offset, y3, color);
+            pixels.drawLine(x3 + offset, y3, x2 + offset, y2, color);
+            pixels.drawLine(x2 + offset, y2, x1 + offset, y1, color);
+            pixels.drawLine(x1, y1 + offset, x3, y3 + offset, color);
+            pixels.drawLine(x3, y3 + offset, x2, y2 + offset, color);
+            pixels.drawLine(x2, y2 + offset, x1, y1 + offset, color);
         }
-
-        SDL_SetRenderTarget(renderer, nullptr);
     }
 
     m_isDrawing = false;
@@ -858,42 +809,20 @@ void FillTool::floodFill(int x, int y, ImVec4 fillColor, ImVec4 /* targetColor *
     Canvas& canvas = GetCanvas();
     Layer* activeLayer = canvas.getActiveLayer();
 
+    // An empty layer is fine here, filling its nothing covers the whole canvas
     if (!activeLayer || activeLayer->isLocked()) return;
-    SDL_Renderer* renderer = canvas.getRenderer();
-    SDL_Texture* texture = activeLayer->getTexture();
-
-    if (!texture) return;
 
-    int width, height;
-    SDL_QueryTexture(texture, nullptr, nullptr, &width, &height);
+    // Straight on the tiles now, no more read back + re-upload of the whole layer per fill
+    LayerPixels pixels(*activeLayer);
+    int width = pixels.getWidth();
+    int height = pixels.getHeight();
 
     if (x < 0 || x >= width || y < 0 || y >= height) return;
 
-    SDL_SetRenderTarget(renderer, texture);
-    SDL_Surface* surface = SDL_CreateRGBSurface(0, width, height, 32,
-        0x000000FF, 0x0000FF00, 0x00FF0000, 0xFF000000);
-
-    if (!surface) {
-        SDL_SetRenderTarget(renderer, nullptr);
-        return;
-    }
-
-    SDL_RenderReadPixels(renderer, nullptr, SDL_PIXELFORMAT_RGBA8888, surface->pixels, surface->pitch);
+    Uint32 targetColor = pixels.getPixel(x, y);
+    Uint32 newColor = toPixel(fillColor);
 
-    Uint32* pixels = static_cast<Uint32*>(surface->pixels);
-    Uint32 targetColor = pixels[y * width + x];
-
-    Uint8 r = static_cast<Uint8>(fillColor.x * 255);
-    Uint8 g = static_cast<Uint8>(fillColor.y * 255);
-    Uint8 b = static_cast<Uint8>(fillColor.z * 255);
-    Uint8 a = static_cast<Uint8>(fillColor.w * 255);
-    Uint32 newColor = (a << 24) | (b << 16) | (g << 8) | r;
-
-    if (targetColor == newColor) {
-        SDL_FreeSurface(surface);
-        SDL_SetRenderTarget(renderer, nullptr);
-        return;
-    }
+    if (targetColor == newColor) return;
 
     std::vector<std::pair<int, int>> stack;
     stack.push_back({x, y});
@@ -903,42 +832,33 @@ void FillTool::floodFill(int x, int y, ImVec4 fillColor, ImVec4 /* targetColor *
         stack.pop_back();
 
         if (cx < 0 || cx >= width || cy < 0 || cy >= height) continue;
-        if (pixels[cy * width + cx] != targetColor) continue;
+        if (pixels.getPixel(cx, cy) != targetColor) continue;
 
         int left = cx;
-        while (left > 0 && pixels[cy * width + (left - 1)] == targetColor) {
+        while (left > 0 && pixels.getPixel(left - 1, cy) == targetColor) {
             left--;
         }
         int right = cx;
-        while (right < width - 1 && pixels[cy * width + (right + 1)] == targetColor) {
+        while (right < width - 1 && pixels.getPixel(right + 1, cy) == targetColor) {
             right++;
         }
 
         // Fill the horizontal line
-            for (int i = left; i <= right; i++) {
-                pixels[cy * width + i] = newColor;
-        }
+        pixels.fillRect({left, cy, right - left + 1, 1}, newColor, false);
 
         // Add pixels above and below to the stack
-            for (int i = left; i <= right; i++) {
-            if (cy > 0 && pixels[(cy - 1) * width + i] == targetColor) {
+        for (int i = left; i <= right; i++) {
+            if (cy > 0 && pixels.getPixel(i, cy - 1) == targetColor) {
                 stack.push_back({i, cy - 1});
             }
-            if (cy < height - 1 && pixels[(cy + 1) * width + i] == targetColor) {
+            if (cy < height - 1 && pixels.getPixel(i, cy + 1) == targetColor) {
                 stack.push_back({i, cy + 1});
             }
         }
     }
 
-    newTexture = SDL_CreateTextureFromSurface(renderer, surface);
-    SDL_FreeSurface(surface);
-
-    if (newTexture) {
-        SDL_RenderCopy(renderer, newTexture, nullptr, nullptr);
-        SDL_DestroyTexture(newTexture);
-    }
-
-    SDL_SetRenderTarget(renderer, nullptr);
+    // Whole tiles the fill covered are one colour now, store them as just that
+    activeLayer->getPixels().compactTiles();
 }
 
 
@@ -1060,10 +980,7 @@ void SelectionTool::cancel() {
     if (canvas.hasSelection()) {
         canvas.setHasSelection(false);
         canvas.setSelectionRect({0, 0, 0, 0});
-        if (canvas.getSelectionTexture()) {
-            SDL_DestroyTexture(canvas.getSelectionTexture());
-            canvas.setSelectionTexture(nullptr);
-        }
+        canvas.clearSelectionBuffer();
     }
 }
 
@@ -1079,43 +996,15 @@ void FloodSelectionTool::handleMouseDown(const SDL_Event& event) {
     int x = event.button.x;
     int y = event.button.y;
 
-    SDL_Renderer* renderer = canvas.getRenderer();
-    SDL_Texture* texture = activeLayer->getTexture();
-
-    if (!texture) return;
-
-    SDL_SetRenderTarget(renderer, texture);
-
-    int width, height;
-    SDL_QueryTexture(texture, nullptr, nullptr, &width, &height);
-
-    if (x < 0 || x >= width || y < 0 || y >= height) {
-        SDL_SetRenderTarget(renderer, nullptr);
-        return;
-    }
-
-    SDL_Surface* surface = SDL_CreateRGBSurface(0, width, height, 32,
-        0x000000FF, 0x0000FF00, 0x00FF0000, 0xFF000000);
-
-    if (!surface) {
-        SDL_SetRenderTarget(renderer, nullptr);
-        return;
-    }
-
-    SDL_RenderReadPixels(renderer, nullptr, SDL_PIXELFORMAT_RGBA8888, surface->pixels, surface->pitch);
+    if (!activeLayer->hasPixels()) return;
 
-    Uint32* pixels = static_cast<Uint32*>(surface->pixels);
-    Uint32 targetColorRaw = pixels[y * width + x];
+    const LayerPixels pixels(*activeLayer);
 
-    ImVec4 targetColor = {
-        ((targetColorRaw & 0xFF) / 255.0f),
-        (((targetColorRaw >> 8) & 0xFF) / 255.0f),
-        (((targetColorRaw >> 16) & 0xFF) / 255.0f),
-        (((targetColorRaw >> 24) & 0xFF) / 255.0f)
-    };
+    if (x < 0 || x >= pixels.getWidth() || y < 0 || y >= pixels.getHeight()) return;
 
-    SDL_FreeSurface(surface);
-    SDL_SetRenderTarget(renderer, nullptr);
+    Uint8 tr, tg, tb, ta;
+    TileBuffer::unpackRGBA(TileBuffer::unpremultiply(pixels.getPixel(x, y)), tr, tg, tb, ta);
+    ImVec4 targetColor = {tr / 255.0f, tg / 255.0f, tb / 255.0f, ta / 255.0f};
 
     clearSelection();
     floodSelect(x, y, targetColor);
@@ -1151,28 +1040,12 @@ void FloodSelectionTool::floodSelect(int x, int y, ImVec4 targetColor) {
 
     if (!activeLayer) return;
 
-    SDL_Renderer* renderer = canvas.getRenderer();
-    SDL_Texture* texture = activeLayer->getTexture();
-
-    if (!texture) return;
-
-    int width, height;
-    SDL_QueryTexture(texture, nullptr, nullptr, &width, &height);
+    const LayerPixels pixels(*activeLayer);
+    int width = pixels.getWidth();
+    int height = pixels.getHeight();
 
     if (x < 0 || x >= width || y < 0 || y >= height) return;
 
-    SDL_SetRenderTarget(renderer, texture);
-    SDL_Surface* surface = SDL_CreateRGBSurface(0, width, height, 32,
-        0x000000FF, 0x0000FF00, 0x00FF0000, 0xFF000000);
-
-    if (!surface) {
-        SDL_SetRenderTarget(renderer, nullptr);
-        return;
-    }
-
-    SDL_RenderReadPixels(renderer, nullptr, SDL_PIXELFORMAT_RGBA8888, surface->pixels, surface->pitch);
-
-    Uint32* pixels = static_cast<Uint32*>(surface->pixels);
     std::vector<std::vector<bool>> visited(height, std::vector<bool>(width, false));
 
     
@@ -1186,13 +1059,9 @@ void FloodSelectionTool::floodSelect(int x, int y, ImVec4 targetColor) {
         if (cx < 0 || cx >= width || cy < 0 || cy >= height) continue;
         if (visited[cy][cx]) continue;
 
-        Uint32 currentColorRaw = pixels[cy * width + cx];
-        ImVec4 currentColor = {
-            ((currentColorRaw & 0xFF) / 255.0f),
-            (((currentColorRaw >> 8) & 0xFF) / 255.0f),
-            (((currentColorRaw >> 16) & 0xFF) / 255.0f),
-            (((currentColorRaw >> 24) & 0xFF) / 255.0f)
-        };
+        Uint8 r, g, b, a;
+        TileBuffer::unpackRGBA(TileBuffer::unpremultiply(pixels.getPixel(cx, cy)), r, g, b, a);
+        ImVec4 currentColor = {r / 255.0f, g / 255.0f, b / 255.0f, a / 255.0f};
 
         if (!isColorSimilar(currentColor, targetColor)) continue;
 
@@ -1206,9 +1075,6 @@ void FloodSelectionTool::floodSelect(int x, int y, ImVec4 targetColor) {
         stack.push_back({cx, cy + 1});
     }
 
-    SDL_FreeSurface(surface);
-    SDL_SetRenderTarget(renderer, nullptr);
-
     if (!m_selectedPixels.empty()) {
         int minX = width, maxX = 0;
         int minY = height, maxY = 0;
@@ -1241,10 +1107,7 @@ void FloodSelectionTool::clearSelection() {
     Canvas& canvas = GetCanvas();
     canvas.setHasSelection(false);
     canvas.setSelectionRect({0, 0, 0, 0});
-    if (canvas.getSelectionTexture()) {
-        SDL_DestroyTexture(canvas.getSelectionTexture());
-        canvas.setSelectionTexture(nullptr);
-    }
+    canvas.clearSelectionBuffer();
 }
 
 void FloodSelectionTool::deleteSelectedPixels() {
@@ -1257,43 +1120,13 @@ void FloodSelectionTool::deleteSelectedPixels() {
 
     Editor::getInstance().saveUndoState();
 
-    SDL_Renderer* renderer = canvas.getRenderer();
-    SDL_Texture* texture = activeLayer->getTexture();
-
-    if (!texture) return;
-
-    int width, height;
-    SDL_QueryTexture(texture, nullptr, nullptr, &width, &height);
-
-    SDL_SetRenderTarget(renderer, texture);
-    SDL_Surface* surface = SDL_CreateRGBSurface(0, width, height, 32,
-        0x000000FF, 0x0000FF00, 0x00FF0000, 0xFF000000);
-
-    if (!surface) {
-        SDL_SetRenderTarget(renderer, nullptr);
-        return;
-    }
-
-    SDL_RenderReadPixels(renderer, nullptr, SDL_PIXELFORMAT_RGBA8888, surface->pixels, surface->pitch);
-
-    Uint32* pixels = static_cast<Uint32*>(surface->pixels);
+    LayerPixels pixels(*activeLayer);
 
-    // Delete selected pixels by making them transparent
+    // Delete selected pixels by making them transparent (setPixel ignores out of bounds)
     for (const auto& pixel : m_selectedPixels) {
-        if (pixel.x >= 0 && pixel.x < width && pixel.y >= 0 && pixel.y < height) {
-            pixels[pixel.y * width + pixel.x] = 0x00000000;
-        }
-    }
-
-    SDL_Texture* newTexture = SDL_CreateTextureFromSurface(renderer, surface);
-
-    SDL_FreeSurface(surface);
-    SDL_SetRenderTarget(renderer, nullptr);
-
-    if (newTexture) {
-        SDL_SetTextureBlendMode(newTexture, SDL_BLENDMODE_BLEND);
-        activeLayer->setTexture(newTexture);
+        pixels.setPixel(pixel.x, pixel.y, 0x00000000);
     }
+    activeLayer->trimToContent();
 
     clearSelection();
 }
@@ -1450,7 +1283,6 @@ void TextTool::renderTextBoxToLayer(const TextBox& textBox) {
         return;
     }
 
-    SDL_Renderer* renderer = canvas.getRenderer();
     Layer* targetLayer = layers[textBox.layerIndex].get();
 
     if (!targetLayer || targetLayer->isLocked()) {
@@ -1494,21 +1326,9 @@ void TextTool::renderTextBoxToLayer(const TextBox& textBox) {
         return;
     }
 
-    SDL_Texture* textTexture = SDL_CreateTextureFromSurface(renderer, textSurface);
-    SDL_FreeSurface(textSurface);
-
-    if (!textTexture) {
-        if (!textBox.fontPath.empty() && font != canvas.getFont(textBox.fontSize, textBox.bold, textBox.italic)) {
-            TTF_CloseFont(font);
-        }
-        return;
-    }
-
-    SDL_SetRenderTarget(renderer, targetLayer->getTexture());
     SDL_Rect destRect = textBox.rect;
-    SDL_RenderCopy(renderer, textTexture, nullptr, &destRect);
-    SDL_DestroyTexture(textTexture);
-    SDL_SetRenderTarget(renderer, nullptr);
+    LayerPixels(*targetLayer).blitSurface(textSurface, destRect, true);
+    SDL_FreeSurface(textSurface);
 
     if (!textBox.fontPath.empty() && font != canvas.getFont(textBox.fontSize, textBox.bold, textBox.italic)) {
         TTF_CloseFont(font);
@@ -1605,12 +1425,8 @@ void GradientTool::handleMouseUp(const SDL_Event&) {
     Layer* activeLayer = canvas.getActiveLayer();
 
     if (activeLayer && !activeLayer->isLocked()) {
-        SDL_Renderer* renderer = canvas.getRenderer();
-        SDL_SetRenderTarget(renderer, activeLayer->getTexture());
-
-    drawGradient(renderer, m_startPos, m_currentPos, m_color, m_secondaryColor);
-
-        SDL_SetRenderTarget(renderer, nullptr);
+        LayerPixels pixels(*activeLayer);
+        drawGradient(canvas.getRenderer(), m_startPos, m_currentPos, m_color, m_secondaryColor, &pixels);
     }
 
     m_isDrawing = false;
@@ -1621,7 +1437,8 @@ void GradientTool::render(SDL_Renderer* renderer) {
     drawGradient(renderer, m_startPos, m_currentPos, m_color, m_secondaryColor);
 }
 
-void GradientTool::drawGradient(SDL_Renderer* renderer, ImVec2 start, ImVec2 end, ImVec4 startColor, ImVec4 endColor) {
+void GradientTool::drawGradient(SDL_Renderer* renderer, ImVec2 start, ImVec2 end, ImVec4 startColor, ImVec4 endColor,
+                                LayerPixels* target) {
     
     float dx = end.x - start.x;
         float dy = end.y - start.y;
@@ -1661,8 +1478,12 @@ void GradientTool::drawGradient(SDL_Renderer* renderer, ImVec2 start, ImVec2 end
                         Uint8 b = static_cast<Uint8>((startColor.z * (1.0f - projDist) + endColor.z * projDist) * 255);
                         Uint8 a = static_cast<Uint8>((startColor.w * (1.0f - projDist) + endColor.w * projDist) * 255);
 
-                        SDL_SetRenderDrawColor(renderer, r, g, b, a);
-                        SDL_RenderDrawPoint(renderer, x, y);
+                        if (target) {
+                            target->blendPixel(x, y, TileBuffer::premultiply(TileBuffer::packRGBA(r, g, b, a)));
+                        } else {
+                            SDL_SetRenderDrawColor(renderer, r, g, b, a);
+                            SDL_RenderDrawPoint(renderer, x, y);
+                        }
                     }
                 }
                 break;
@@ -1685,8 +1506,12 @@ void GradientTool::drawGradient(SDL_Renderer* renderer, ImVec2 start, ImVec2 end
                         Uint8 b = static_cast<Uint8>((startColor.z * (1.0f - t) + endColor.z * t) * 255);
                         Uint8 a = static_cast<Uint8>((startColor.w * (1.0f - t) + endColor.w * t) * 255);
 
-                        SDL_SetRenderDrawColor(renderer, r, g, b, a);
-                        SDL_RenderDrawPoint(renderer, x, y);
+                        if (target) {
+                            target->blendPixel(x, y, TileBuffer::premultiply(TileBuffer::packRGBA(r, g, b, a)));
+                        } else {
+                            SDL_SetRenderDrawColor(renderer, r, g, b, a);
+                            SDL_RenderDrawPoint(renderer, x, y);
+                        }
                     }
                 }
                 break;
@@ -1711,8 +1536,12 @@ void GradientTool::drawGradient(SDL_Renderer* renderer, ImVec2 start, ImVec2 end
                         Uint8 b = static_cast<Uint8>((startColor.z * (1.0f - t) + endColor.z * t) * 255);
                         Uint8 a = static_cast<Uint8>((startColor.w * (1.0f - t) + endColor.w * t) * 255);
 
-                        SDL_SetRenderDrawColor(renderer, r, g, b, a);
-                        SDL_RenderDrawPoint(renderer, x, y);
+                        if (target) {
+                            target->blendPixel(x, y, TileBuffer::premultiply(TileBuffer::packRGBA(r, g, b, a)));
+                        } else {
+                            SDL_SetRenderDrawColor(renderer, r, g, b, a);
+                            SDL_RenderDrawPoint(renderer, x, y);
+                        }
                     }
                 }
                 break;
@@ -2064,21 +1893,13 @@ void HealingTool::applyHealingAt(int x, int y) {
 
     if (!activeLayer || activeLayer->isLocked()) return;
 
-    SDL_Renderer* renderer = canvas.getRenderer();
-    SDL_Texture* texture = activeLayer->getTexture();
-
-    int width, height;
-    SDL_QueryTexture(texture, nullptr, nullptr, &width, &height);
+    LayerPixels pixels(*activeLayer);
+    int width = pixels.getWidth();
+    int height = pixels.getHeight();
 
     if (x < 0 || x >= width || y < 0 || y >= height) return;
 
-    SDL_SetRenderTarget(renderer, texture);
-    SDL_Surface* surface = SDL_CreateRGBSurface(0, width, height, 32,
-        0xFF000000, 0x00FF0000, 0x0000FF00, 0x000000FF);
-    SDL_RenderReadPixels(renderer, nullptr, SDL_PIXELFORMAT_RGBA8888, surface->pixels, surface->pitch);
-
     const int radius = m_size / 2;
-    Uint32* pixels = static_cast<Uint32*>(surface->pixels);
 
     int sampleCount = 0;
     int redSum = 0, greenSum = 0, blueSum = 0, alphaSum = 0;
@@ -2093,9 +1914,8 @@ void HealingTool::applyHealingAt(int x, int y) {
             if (sx < 0 || sx >= width || sy < 0 || sy >= height) continue;
             if (abs(dx) < radius/2 && abs(dy) < radius/2) continue;
 
-            Uint32 pixel = pixels[sy * width + sx];
             Uint8 r, g, b, a;
-            SDL_GetRGBA(pixel, surface->format, &r, &g, &b, &a);
+            TileBuffer::unpackRGBA(pixels.getPixel(sx, sy), r, g, b, a);
 
             redSum += r;
             greenSum += g;
@@ -2128,9 +1948,8 @@ void HealingTool::applyHealingAt(int x, int y) {
                 float blend = 1.0f - (dist / radius);
 
                 // Get current pixel
-                Uint32 pixel = pixels[py * width + px];
                 Uint8 r, g, b, a;
-                SDL_GetRGBA(pixel, surface->format, &r, &g, &b, &a);
+                TileBuffer::unpackRGBA(pixels.getPixel(px, py), r, g, b, a);
 
                 // Blend with average color
                 r = static_cast<Uint8>(r * (1.0f - blend) + avgRed * blend);
@@ -2139,18 +1958,10 @@ void HealingTool::applyHealingAt(int x, int y) {
                 a = static_cast<Uint8>(a * (1.0f - blend) + avgAlpha * blend);
 
                 // Update pixel
-                pixels[py * width + px] = SDL_MapRGBA(surface->format, r, g, b, a);
+                pixels.setPixel(px, py, TileBuffer::packRGBA(r, g, b, a));
             }
         }
     }
-
-    // Update the texture with the modified pixel data
-    SDL_Texture* newTexture = SDL_CreateTextureFromSurface(renderer, surface);
-    SDL_FreeSurface(surface);
-
-    // Set the new texture to the layer
-    activeLayer->setTexture(newTexture);
-    SDL_SetRenderTarget(renderer, nullptr);
 }
 
 
@@ -2173,6 +1984,7 @@ void CloneStampTool::handleMouseDown(const SDL_Event& event) {
         m_isDrawing = true;
         m_isCloning = true;
         m_startPos = ImVec2(event.button.x, event.button.y);
+        Editor::getInstance().saveUndoState();
         cloneAt(event.button.x, event.button.y);
     }
 }
@@ -2225,10 +2037,7 @@ void CloneStampTool::setSourcePoint(int x, int y) {
 void CloneStampTool::cloneAt(int x, int y) {
     Canvas& canvas = GetCanvas();
     Layer* activeLayer = canvas.getActiveLayer();
-    if (!activeLayer) return;
-
-    SDL_Renderer* renderer = canvas.getRenderer();
-    if (!renderer) return;
+    if (!activeLayer || activeLayer->isLocked() || !activeLayer->hasPixels()) return;
 
     int offsetX = x - (int)m_startPos.x;
     int offsetY = y - (int)m_startPos.y;
@@ -2236,11 +2045,14 @@ void CloneStampTool::cloneAt(int x, int y) {
     int sourceX = m_sourcePoint.x + offsetX;
     int sourceY = m_sourcePoint.y + offsetY;
 
-    SDL_Texture* sourceTexture = activeLayer->getTexture();
-    if (!sourceTexture) return;
-    SDL_SetRenderTarget(renderer, activeLayer->getTexture());
+    // This never actually copied anything while it lived on the GPU, with the pixels on the CPU
+    // it's just a read + blend per brush pixel
+    LayerPixels pixels(*activeLayer);
+    int width = pixels.getWidth();
+    int height = pixels.getHeight();
 
     int brushRadius = m_size / 2;
+    if (brushRadius <= 0) return;
 
     // Copy pixels from source to destination in circular pattern
     for (int dy = -brushRadius; dy <= brushRadius; dy++) {
@@ -2255,21 +2067,16 @@ void CloneStampTool::cloneAt(int x, int y) {
             int dstY = y + dy;
 
             // Bounds checking
-            if (srcX < 0 || srcX >= canvas.getWidth() || srcY < 0 || srcY >= canvas.getHeight()) continue;
-            if (dstX < 0 || dstX >= canvas.getWidth() || dstY < 0 || dstY >= canvas.getHeight()) continue;
-
-            SDL_Rect srcRect = {srcX, srcY, 1, 1};
-            SDL_Rect dstRect = {dstX, dstY, 1, 1};
+            if (srcX < 0 || srcX >= width || srcY < 0 || srcY >= height) continue;
+            if (dstX < 0 || dstX >= width || dstY < 0 || dstY >= height) continue;
 
             // Calculate opacity based on distance from center for smooth brushing
             float opacity = 1.0f - (dist / brushRadius);
-            SDL_SetTextureAlphaMod(sourceTexture, (Uint8)(opacity * 255));
+            Uint32 blended = TileBuffer::blendOver(pixels.getPixel(dstX, dstY), pixels.getPixel(srcX, srcY),
+                                                   static_cast<int>(opacity * 255));
+            pixels.setPixel(dstX, dstY, blended);
         }
     }
-
-    // Reset alpha mod
-    SDL_SetTextureAlphaMod(sourceTexture, 255);
-    SDL_SetRenderTarget(renderer, nullptr);
 }
 
 void CloneStampTool::drawSourcePreview(SDL_Renderer* renderer) {
@@ -2,7 +2,15 @@
 #include "../canvas/Canvas.hpp"
 #include "../tools/Tool.hpp"
 #include "../editor/Editor.hpp"
+#include "../editor/FrameScheduler.hpp"
+#include "../canvas/BlendEngine.hpp"
+#include "../canvas/DeepBuffer.hpp"
 #include "../canvas/Layer.hpp"
+#include "../canvas/MipPyramid.hpp"
+#include "../canvas/PointOps.hpp"
+#include "../canvas/ThreadPool.hpp"
+#include "../canvas/TileStore.hpp"
+#include "../canvas/TileSwap.hpp"
 #include "../imgui/imgui.h"
 #include "../tinyfiledialogs/tinyfiledialogs.h"
 #include <cstring>
@@ -54,6 +62,7 @@ bool UI::init(SDL_Window* window, SDL_Renderer* renderer) {
     }
 
     setupTheme();
+    m_renderer = renderer;
 
     if (!ImGui_ImplSDL2_InitForSDLRenderer(window, renderer)) {
         std::cerr << "ImGui SDL2 init failed" << std::endl;
@@ -136,6 +145,12 @@ void UI::setupTheme() {
 }
 
 void UI::cleanup() {
+    for (auto& entry : m_layerThumbnails) {
+        destroyThumbnail(entry.second);
+    }
+    m_layerThumbnails.clear();
+    destroyThumbnail(m_navigator);
+
     if (m_initialized) {
         ImGui_ImplSDLRenderer2_Shutdown();
         ImGui_ImplSDL2_Shutdown();
@@ -154,6 +169,11 @@ void UI::render() {
 
     renderMenuBar();
 
+    // Whatever the menu bar and sidebar don't cover is where the canvas gets drawn
+    const int menuBarHeight = static_cast<int>(ImGui::GetFrameHeight());
+    GetCanvas().setViewportArea({0, menuBarHeight, static_cast<int>(canvasWidth),
+                                 static_cast<int>(windowHeight) - menuBarHeight});
+
     ImGui::SetNextWindowPos(ImVec2(canvasWidth, 0));
     ImGui::SetNextWindowSize(ImVec2(sidebarWidth, windowHeight * 0.25f));
     ImGui::Begin("Tools", nullptr, ImGuiWindowFlags_NoResize | ImGuiWindowFlags_NoMove |
@@ -196,6 +216,8 @@ void UI::render() {
     if (m_showCurvesDialog) renderCurvesDialog();
     if (m_showVibranceDialog) renderVibranceDialog();
     if (m_showHelpDialog) renderHelpDialog();
+    if (m_showPerformancePanel) renderPerformancePanel();
+    if (m_showNavigator) renderNavigator();
     if (m_showAboutDialog) {
         ImGui::OpenPopup("About");
         m_showAboutDialog = false;
@@ -226,6 +248,10 @@ void UI::renderMenuBar() {
             renderEditMenu();
             ImGui::EndMenu();
         }
+        if (ImGui::BeginMenu("View")) {
+            renderViewMenu();
+            ImGui::EndMenu();
+        }
         if (ImGui::BeginMenu("Layer")) {
             renderLayerMenu();
             ImGui::EndMenu();
@@ -350,6 +376,17 @@ void UI::renderLayerMenu() {
 }
 
 void UI::renderFilterMenu() {
+    if (ImGui::BeginMenu("Bit Depth")) {
+        Canvas& canvas = GetCanvas();
+        for (int d = 0; d < static_cast<int>(PixelDepth::COUNT); d++) {
+            PixelDepth depth = static_cast<PixelDepth>(d);
+            if (ImGui::MenuItem(DeepBuffer::getDepthName(depth), nullptr, canvas.getPixelDepth() == depth)) {
+                canvas.setPixelDepth(depth);
+            }
+        }
+        ImGui::EndMenu();
+    }
+    ImGui::Separator();
     if (ImGui::MenuItem("Grayscale")) {
         Canvas& canvas = GetCanvas();
         Editor::getInstance().saveUndoState();
@@ -431,6 +468,273 @@ void UI::renderHelpMenu() {
     }
 }
 
+void UI::renderViewMenu() {
+    Canvas& canvas = GetCanvas();
+
+    if (ImGui::MenuItem("Zoom In", "Ctrl++")) {
+        canvas.zoomBy(1.25f);
+    }
+    if (ImGui::MenuItem("Zoom Out", "Ctrl+-")) {
+        canvas.zoomBy(0.8f);
+    }
+    if (ImGui::MenuItem("Fit to Window", "Ctrl+0")) {
+        canvas.fitToView();
+    }
+    if (ImGui::MenuItem("Actual Size", "Ctrl+1")) {
+        canvas.resetView();
+    }
+    ImGui::Text("Zoom: %.0f%%", canvas.getZoom() * 100.0f);
+
+    ImGui::Separator();
+    ImGui::MenuItem("Navigator", nullptr, &m_showNavigator);
+    ImGui::MenuItem("Performance", nullptr, &m_showPerformancePanel);
+}
+
+int UI::previewLevel(int width, int height, int maxSize) {
+    int level = 0;
+    int size = std::max(width, height);
+    while (level < MipPyramid::MAX_LEVELS && MipPyramid::levelSize(size, level + 1) >= maxSize) {
+        level++;
+    }
+    return level;
+}
+
+bool UI::uploadThumbnail(Thumbnail& thumbnail, const TileBuffer& pixels) {
+    if (!m_renderer || pixels.isEmpty()) return false;
+    if (!thumbnail.texture || thumbnail.width != pixels.getWidth() || thumbnail.height != pixels.getHeight()) {
+        destroyThumbnail(thumbnail);
+        thumbnail.texture = SDL_CreateTexture(m_renderer, SDL_PIXELFORMAT_RGBA8888, SDL_TEXTUREACCESS_STATIC,
+                                              pixels.getWidth(), pixels.getHeight());
+        if (!thumbnail.texture) return false;
+        // Tiles are premultiplied, so the texture blends as one. Also keeps linear filtering from
+        // dragging black in from transparent pixels.
+        SDL_SetTextureBlendMode(thumbnail.texture, SDL_ComposeCustomBlendMode(
+            SDL_BLENDFACTOR_ONE, SDL_BLENDFACTOR_ONE_MINUS_SRC_ALPHA, SDL_BLENDOPERATION_ADD,
+            SDL_BLENDFACTOR_ONE, SDL_BLENDFACTOR_ONE_MINUS_SRC_ALPHA, SDL_BLENDOPERATION_ADD));
+        SDL_SetTextureScaleMode(thumbnail.texture, SDL_ScaleModeLinear);
+        thumbnail.width = pixels.getWidth();
+        thumbnail.height = pixels.getHeight();
+    }
+    std::vector<Uint32> data(static_cast<size_t>(thumbnail.width) * thumbnail.height);
+    pixels.readRect({0, 0, thumbnail.width, thumbnail.height}, data.data(), thumbnail.width);
+    SDL_UpdateTexture(thumbnail.texture, nullptr, data.data(), thumbnail.width * sizeof(Uint32));
+    return true;
+}
+
+void UI::destroyThumbnail(Thumbnail& thumbnail) {
+    if (thumbnail.texture) {
+        SDL_DestroyTexture(thumbnail.texture);
+    }
+    thumbnail = Thumbnail();
+}
+
+void UI::renderLayerThumbnail(Layer& layer) {
+    Thumbnail& thumbnail = m_layerThumbnails[&layer];
+    if (layer.hasPixels()) {
+        // At least level 1 so there's always a pyramid version to compare against
+        int level = std::max(1, previewLevel(layer.getWidth(), layer.getHeight(), THUMBNAIL_SIZE));
+        layer.updateMipmaps();
+        const TileBuffer& preview = layer.getMipLevel(level);
+        Uint64 version = layer.getMipVersion();
+        if (version != thumbnail.version) {
+            uploadThumbnail(thumbnail, preview);
+            thumbnail.version = version;
+        }
+    }
+
+    float scale = thumbnail.texture ? std::min(static_cast<float>(THUMBNAIL_SIZE) / thumbnail.width,
+                                               static_cast<float>(THUMBNAIL_SIZE) / thumbnail.height) : 0.0f;
+    ImVec2 pos = ImGui::GetCursorScreenPos();
+    ImDrawList* drawList = ImGui::GetWindowDrawList();
+    drawList->AddRectFilled(pos, ImVec2(pos.x + THUMBNAIL_SIZE, pos.y + THUMBNAIL_SIZE), IM_COL32(200, 200, 200, 255));
+    if (thumbnail.texture) {
+        ImVec2 size(thumbnail.width * scale, thumbnail.height * scale);
+        ImVec2 min(pos.x + (THUMBNAIL_SIZE - size.x) / 2, pos.y + (THUMBNAIL_SIZE - size.y) / 2);
+        drawList->AddImage((ImTextureID)(intptr_t)thumbnail.texture, min, ImVec2(min.x + size.x, min.y + size.y));
+    }
+    ImGui::Dummy(ImVec2(THUMBNAIL_SIZE, THUMBNAIL_SIZE));
+}
+
+void UI::renderNavigator() {
+    Canvas& canvas = GetCanvas();
+    if (canvas.getWidth() <= 0 || canvas.getHeight() <= 0) return;
+
+    if (ImGui::Begin("Navigator", &m_showNavigator, ImGuiWindowFlags_AlwaysAutoResize)) {
+        // Flattened from the layer pyramids, never from the full size pixels. Only redone when
+        // something on the canvas actually changed.
+        int level = previewLevel(canvas.getWidth(), canvas.getHeight(), NAVIGATOR_SIZE);
+        int levelWidth = MipPyramid::levelSize(canvas.getWidth(), level);
+        int levelHeight = MipPyramid::levelSize(canvas.getHeight(), level);
+        if (!m_navigator.texture || m_navigator.version != canvas.getContentVersion() ||
+            m_navigator.width != levelWidth || m_navigator.height != levelHeight) {
+            TileBuffer preview(levelWidth, levelHeight);
+            preview.fillRect({0, 0, levelWidth, levelHeight}, 0xFFFFFFFF);
+            canvas.compositeLevel(preview, level, {0, 0, levelWidth, levelHeight});
+            uploadThumbnail(m_navigator, preview);
+            m_navigator.version = canvas.getContentVersion();
+        }
+
+        float scale = std::min(static_cast<float>(NAVIGATOR_SIZE) / canvas.getWidth(),
+                               static_cast<float>(NAVIGATOR_SIZE) / canvas.getHeight());
+        ImVec2 size(canvas.getWidth() * scale, canvas.getHeight() * scale);
+        ImVec2 pos = ImGui::GetCursorScreenPos();
+        if (m_navigator.texture) {
+            ImGui::Image((ImTextureID)(intptr_t)m_navigator.texture, size);
+        }
+
+        // What's on screen right now, click or drag to move it
+        SDL_Rect visible = canvas.getVisibleCanvasRect();
+        ImGui::GetWindowDrawList()->AddRect(ImVec2(pos.x + visible.x * scale, pos.y + visible.y * scale),
+                                            ImVec2(pos.x + (visible.x + visible.w) * scale,
+                                                   pos.y + (visible.y + visible.h) * scale),
+                                            IM_COL32(255, 60, 60, 255));
+        ImGui::SetCursorScreenPos(pos);
+        ImGui::InvisibleButton("##navigator", size);
+        if (ImGui::IsItemActive()) {
+            ImVec2 mouse = ImGui::GetMousePos();
+            canvas.centerViewOn((mouse.x - pos.x) / scale, (mouse.y - pos.y) / scale);
+        }
+        ImGui::Text("Zoom: %.0f%%", canvas.getZoom() * 100.0f);
+    }
+    ImGui::End();
+}
+
+// Human readable memory size for the layer and performance panels
+static std::string formatBytes(size_t bytes) {
+    char buffer[32];
+    if (bytes >= 1024 * 1024) {
+        snprintf(buffer, sizeof(buffer), "%.1f MB", bytes / (1024.0 * 1024.0));
+    } else if (bytes >= 1024) {
+        snprintf(buffer, sizeof(buffer), "%.1f KB", bytes / 1024.0);
+    } else {
+        snprintf(buffer, sizeof(buffer), "%zu B", bytes);
+    }
+    return buffer;
+}
+
+void UI::renderPerformancePanel() {
+    FrameScheduler& scheduler = GetFrameScheduler();
+
+    ImGui::SetNextWindowSize(ImVec2(280, 0), ImGuiCond_FirstUseEver);
+    if (ImGui::Begin("Performance", &m_showPerformancePanel)) {
+        ImGui::Text("Idle: %.1f%%", scheduler.getIdlePercent());
+        ImGui::Text("Last frame: %.2f ms", scheduler.getFrameMs());
+        ImGui::Text("Frames rendered: %llu", static_cast<unsigned long long>(scheduler.getFramesRendered()));
+        ImGui::Text("Frames skipped: %llu", static_cast<unsigned long long>(scheduler.getFramesSkipped()));
+        ImGui::Text("Blend kernels: %s", GetBlendEngine().getKernelName());
+        ImGui::Text("Point op kernels: %s", PointOps::getKernelName());
+
+        bool continuous = scheduler.isContinuous();
+        if (ImGui::Checkbox("Redraw continuously", &continuous)) {
+            scheduler.setContinuous(continuous);
+        }
+        if (ImGui::IsItemHovered()) {
+            ImGui::SetTooltip("The old loop: redraw every frame even when nothing changes");
+        }
+
+        Canvas& canvas = GetCanvas();
+        ImGui::Text("Layer blends: %d (culled %d)", canvas.getLayersBlended(), canvas.getLayersCulled());
+        if (ImGui::IsItemHovered()) {
+            ImGui::SetTooltip("Per layer and tile, last time anything was recomposited. Culled ones were\n"
+                              "transparent there or hidden under an opaque layer.");
+        }
+
+        ImGui::Separator();
+        TileSwap& swap = GetTileSwap();
+        ImGui::Text("Tiles in RAM: %s", formatBytes(swap.getResidentBytes()).c_str());
+        ImGui::Text("Tiles swapped: %s", formatBytes(swap.getSwappedBytes()).c_str());
+        if (swap.isSwapAvailable()) {
+            int budgetMB = static_cast<int>(swap.getBudget() >> 20);
+            if (ImGui::DragInt("Memory budget (MB)", &budgetMB, 16.0f, 0, 1 << 20)) {
+                swap.setBudget(static_cast<size_t>(std::max(budgetMB, 0)) << 20);
+            }
+            if (ImGui::IsItemHovered()) {
+                ImGui::SetTooltip("Past this the least recently used tiles go to a swap file on disk.\n"
+                                  "0 keeps everything in RAM.");
+            }
+        }
+
+        ImGui::Separator();
+        ThreadPool& pool = GetThreadPool();
+        int threads = pool.getThreadCount();
+        if (ImGui::SliderInt("Worker threads", &threads, 1, ThreadPool::getHardwareThreads())) {
+            pool.setThreadCount(threads);
+        }
+        if (ImGui::Button("Benchmark compositor")) {
+            Canvas::CompositorBenchmark result = GetCanvas().benchmarkCompositor();
+            char text[160];
+            snprintf(text, sizeof(text), "1 thread: %.1f ms\n%d threads: %.1f ms (%.1fx)\nOutput %s",
+                     result.serialMs, result.threads, result.parallelMs,
+                     result.parallelMs > 0.0 ? result.serialMs / result.parallelMs : 0.0,
+                     result.identical ? "identical" : "DIFFERENT");
+            m_benchmarkResult = text;
+        }
+        if (!m_benchmarkResult.empty()) {
+            ImGui::TextUnformatted(m_benchmarkResult.c_str());
+        }
+
+        ImGui::Separator();
+        ImGui::Text("Bit depth: %s (%s)", DeepBuffer::getDepthName(canvas.getPixelDepth()), DeepBuffer::getKernelName());
+        if (ImGui::Button("Benchmark bit depths")) {
+            Canvas::DepthBenchmark result = canvas.benchmarkPixelDepths();
+            m_depthBenchmarkResult.clear();
+            for (int d = 0; d < static_cast<int>(PixelDepth::COUNT) && result.pixels > 0; d++) {
+                PixelDepth depth = static_cast<PixelDepth>(d);
+                char line[160];
+                snprintf(line, sizeof(line), "%s: %.1f ms, %.0f MP/s, %s (%zu B/px)\n", DeepBuffer::getDepthName(depth),
+                         result.ms[d], result.megapixelsPerSecond[d], formatBytes(result.residentBytes[d]).c_str(),
+                         4 + DeepBuffer::getBytesPerPixel(depth));
+                m_depthBenchmarkResult += line;
+            }
+            if (result.pixels == 0) m_depthBenchmarkResult = "Needs an active layer with pixels";
+        }
+        if (ImGui::IsItemHovered()) {
+            ImGui::SetTooltip("Curves, shadows/highlights and vibrance on a copy of the active layer");
+        }
+        if (!m_depthBenchmarkResult.empty()) {
+            ImGui::TextUnformatted(m_depthBenchmarkResult.c_str());
+        }
+
+        ImGui::Separator();
+        if (ImGui::Button("Benchmark filter threads")) {
+            Canvas::FilterBenchmark result = canvas.benchmarkFilterPipeline();
+            m_filterBenchmarkResult.clear();
+            for (int step = 0; step < Canvas::FilterBenchmark::STEPS && result.pixels > 0; step++) {
+                char line[96];
+                snprintf(line, sizeof(line), "%2d threads: %.1f ms (%.1fx)\n", result.threads[step], result.ms[step],
+                         result.speedup[step]);
+                m_filterBenchmarkResult += line;
+            }
+            if (result.pixels == 0) m_filterBenchmarkResult = "Needs an active layer with pixels";
+        }
+        if (ImGui::IsItemHovered()) {
+            ImGui::SetTooltip("Curves, vibrance, sharpen and motion blur on a copy of the active layer");
+        }
+        if (!m_filterBenchmarkResult.empty()) {
+            ImGui::TextUnformatted(m_filterBenchmarkResult.c_str());
+        }
+
+        ImGui::Separator();
+        if (ImGui::Button("Benchmark tone chain")) {
+            Canvas::ToneBenchmark result = canvas.benchmarkToneChain();
+            char line[160];
+            snprintf(line, sizeof(line), "1 step: %.1f ms\n5 steps fused: %.1f ms\n5 separate passes: %.1f ms",
+                     result.singleStepMs, result.fusedMs, result.separateMs);
+            m_toneBenchmarkResult = result.pixels > 0 ? line : "Needs an active layer with pixels";
+        }
+        if (ImGui::IsItemHovered()) {
+            ImGui::SetTooltip("Brightness, contrast, gamma, curves and colour balance on a copy of the active layer");
+        }
+        if (!m_toneBenchmarkResult.empty()) {
+            ImGui::TextUnformatted(m_toneBenchmarkResult.c_str());
+        }
+    }
+    ImGui::End();
+
+    // Keep the numbers ticking while the panel is open, twice a second is plenty
+    scheduler.requestRedrawAfter(500);
+}
+
 void UI::renderToolPanel() {
     ToolManager& toolManager = GetToolManager();
 
@@ -638,17 +942,63 @@ void UI::renderLayerPanel() {
     Canvas& canvas = GetCanvas();
     const auto& layers = canvas.getLayers();
 
+    // Layers are sparse, so show what they really cost next to what a dense canvas would
+    size_t totalResident = 0;
+    for (const auto& layer : layers) {
+        totalResident += layer->getResidentBytes();
+    }
+    size_t denseBytes = static_cast<size_t>(canvas.getWidth()) * canvas.getHeight() *
+                        (4 + DeepBuffer::getBytesPerPixel(canvas.getPixelDepth())) * layers.size();
+    ImGui::TextDisabled("Memory: %s (dense: %s)", formatBytes(totalResident).c_str(), formatBytes(denseBytes).c_str());
+    // Identical tiles across layers, history and clipboard are stored once
+    TileStore::Stats dedup = GetTileStore().getStats();
+    ImGui::TextDisabled("Tiles: %d unique, %.2fx shared, %s saved (%llu merged)", dedup.uniqueTiles, dedup.ratio,
+                        formatBytes(dedup.savedBytes).c_str(), static_cast<unsigned long long>(dedup.mergedTiles));
+    ImGui::Separator();
+
+    // Thumbnails of layers that are gone
+    for (auto it = m_layerThumbnails.begin(); it != m_layerThumbnails.end();) {
+        bool alive = std::any_of(layers.begin(), layers.end(),
+                                 [&](const std::unique_ptr<Layer>& layer) { return layer.get() == it->first; });
+        if (alive) {
+            ++it;
+        } else {
+            destroyThumbnail(it->second);
+            it = m_layerThumbnails.erase(it);
+        }
+    }
+
     // Display layers in reverse order (top layer first in UI)
     for (int i = layers.size() - 1; i >= 0; i--) {
         const auto& layer = layers[i];
 
+        // Children of a collapsed group (at any level up) aren't listed
+        bool collapsed = false;
+        for (const Layer* parent = layer->getParent(); parent && !collapsed; parent = parent->getParent()) {
+            collapsed = !parent->isExpanded();
+        }
+        if (collapsed) continue;
+
         ImGui::PushID(i);
 
+        float indent = 16.0f * layer->getDepth();
+        if (indent > 0.0f) ImGui::Indent(indent);
+
+        if (layer->isGroup()) {
+            if (ImGui::SmallButton(layer->isExpanded() ? "-" : "+")) {
+                layer->setExpanded(!layer->isExpanded());
+            }
+            ImGui::SameLine();
+        }
+
+        renderLayerThumbnail(*layer);
+        ImGui::SameLine();
+
         bool isActive = (i == canvas.getActiveLayerIndex());
 
         ImGui::PushStyleVar(ImGuiStyleVar_SelectableTextAlign, ImVec2(0.0f, 0.5f));
 
-        std::string layerLabel = ">> " + layer->getName();
+        std::string layerLabel = (layer->isGroup() ? "[] " : layer->isAdjustment() ? "fx " : ">> ") + layer->getName();
         if (ImGui::Selectable(layerLabel.c_str(), isActive, ImGuiSelectableFlags_AllowDoubleClick)) {
             canvas.setActiveLayerIndex(i);
         }
@@ -662,10 +1012,12 @@ void UI::renderLayerPanel() {
         if (ImGui::BeginDragDropTarget()) {
             if (const ImGuiPayload* payload = ImGui::AcceptDragDropPayload("LAYER_REORDER")) {
                 int sourceLayer = *(const int*)payload->Data;
+                // Dropping on a group puts it inside, dropping on its own group takes it back out
                 if (sourceLayer != i) {
-                    canvas.moveLayer(sourceLayer, i);
-                    if (canvas.getActiveLayerIndex() == sourceLayer) {
-                        canvas.setActiveLayerIndex(i);
+                    if (layer->isGroup() && layers[sourceLayer]->getParent() != layer.get()) {
+                        canvas.moveIntoGroup(sourceLayer, i);
+                    } else {
+                        canvas.moveLayer(sourceLayer, i);
                     }
                 }
             }
@@ -691,18 +1043,21 @@ void UI::renderLayerPanel() {
             ImGui::PopStyleColor();
         }
 
-        ImGui::SameLine();
+        // Groups can't be painted on anyway, nothing to lock
+        if (!layer->isGroup()) {
+            ImGui::SameLine();
 
-        bool isLocked = layer->isLocked();
-        if (isLocked) {
-            ImGui::PushStyleColor(ImGuiCol_Button, ImVec4(0.8f, 0.6f, 0.2f, 1.0f));
-            if (ImGui::SmallButton("Lock")) {
-                layer->setLocked(false);
-            }
-            ImGui::PopStyleColor();
-        } else {
-            if (ImGui::SmallButton("Unlock")) {
-                layer->setLocked(true);
+            bool isLocked = layer->isLocked();
+            if (isLocked) {
+                ImGui::PushStyleColor(ImGuiCol_Button, ImVec4(0.8f, 0.6f, 0.2f, 1.0f));
+                if (ImGui::SmallButton("Lock")) {
+                    layer->setLocked(false);
+                }
+                ImGui::PopStyleColor();
+            } else {
+                if (ImGui::SmallButton("Unlock")) {
+                    layer->setLocked(true);
+                }
             }
         }
 
@@ -716,7 +1071,7 @@ void UI::renderLayerPanel() {
         ImGui::PopItemWidth();
 
         ImGui::Indent(20);
-        const char* blendModeItems[] = { "Normal", "Multiply", "Screen", "Overlay", "Darken", "Lighten", "Color Dodge", "Color Burn", "Hard Light", "Soft Light", "Difference", "Exclusion" };
+        const char* blendModeItems[] = { "Normal", "Multiply", "Screen", "Overlay", "Darken", "Lighten", "Color Dodge", "Color Burn", "Hard Light", "Soft Light", "Difference", "Exclusion", "Add" };
         int blendMode = layer->getBlendMode();
 
         ImGui::PushItemWidth(140);
@@ -724,7 +1079,16 @@ void UI::renderLayerPanel() {
             layer->setBlendMode(blendMode);
         }
         ImGui::PopItemWidth();
+        ImGui::SameLine();
+        size_t sharedBytes = layer->getSharedBytes();
+        if (sharedBytes > 0) {
+            ImGui::TextDisabled("%s (%s shared)", formatBytes(layer->getResidentBytes()).c_str(),
+                                formatBytes(sharedBytes).c_str());
+        } else {
+            ImGui::TextDisabled("%s", formatBytes(layer->getResidentBytes()).c_str());
+        }
         ImGui::Unindent(20);
+        if (indent > 0.0f) ImGui::Unindent(indent);
 
         if (i > 0) {
             ImGui::Separator();
@@ -750,6 +1114,53 @@ void UI::renderLayerPanel() {
     if (ImGui::Button("Duplicate")) {
         canvas.duplicateLayer(canvas.getActiveLayerIndex());
     }
+
+    ImGui::SameLine();
+
+    if (ImGui::Button("Group")) {
+        canvas.groupLayer(canvas.getActiveLayerIndex());
+    }
+
+    Layer* activeLayer = canvas.getActiveLayer();
+    if (activeLayer && activeLayer->isGroup()) {
+        ImGui::SameLine();
+        if (ImGui::Button("Ungroup")) {
+            canvas.ungroupLayer(canvas.getActiveLayerIndex());
+        }
+    }
+
+    // Adjustment layers. Changing the amount only redoes the composite, nothing is baked in.
+    ImGui::Separator();
+    // Same order as AdjustmentType, minus NONE
+    const char* adjustmentTypes[] = {"Brightness", "Contrast", "Hue", "Gamma"};
+    int adjustmentItem = m_newAdjustmentType - 1;
+    ImGui::PushItemWidth(120);
+    if (ImGui::Combo("##adjustmenttype", &adjustmentItem, adjustmentTypes, IM_ARRAYSIZE(adjustmentTypes))) {
+        m_newAdjustmentType = adjustmentItem + 1;
+    }
+    ImGui::PopItemWidth();
+    ImGui::SameLine();
+    if (ImGui::Button("Add Adjustment")) {
+        canvas.addAdjustmentLayer(static_cast<AdjustmentType>(m_newAdjustmentType));
+        activeLayer = canvas.getActiveLayer();
+    }
+
+    if (activeLayer && activeLayer->isAdjustment()) {
+        const Adjustment& adjustment = activeLayer->getAdjustment();
+        float amount = adjustment.getAmount();
+        // Same ranges as the dialogs that bake them in, hue is in turns
+        float low = -1.0f, high = 1.0f;
+        if (adjustment.getType() == AdjustmentType::HUE_SATURATION) {
+            low = -0.5f;
+            high = 0.5f;
+        } else if (adjustment.getType() == AdjustmentType::GAMMA) {
+            low = -0.9f;
+            high = 2.0f;
+        }
+        if (ImGui::SliderFloat(Adjustment::getTypeName(adjustment.getType()), &amount, low, high)) {
+            activeLayer->setAdjustment(Adjustment(adjustment.getType(), amount));
+        }
+    }
 }
 
 void UI::renderTextEditorModal() {
@@ -992,12 +1403,14 @@ void UI::renderGradientProperties() {
 }
 
 void UI::renderNewCanvasDialog() {
-    ImGui::SetNextWindowSize(ImVec2(300, 150));
-    ImGui::SetNextWindowPos(ImVec2(ImGui::GetIO().DisplaySize.x * 0.5f - 150, ImGui::GetIO().DisplaySize.y * 0.5f - 75));
+    ImGui::SetNextWindowSize(ImVec2(300, 175));
+    ImGui::SetNextWindowPos(ImVec2(ImGui::GetIO().DisplaySize.x * 0.5f - 150, ImGui::GetIO().DisplaySize.y * 0.5f - 88));
 
     if (ImGui::Begin("New Canvas", &m_showNewCanvasDialog, ImGuiWindowFlags_NoResize)) {
         ImGui::InputInt("Width", &m_newCanvasWidth, 50);
         ImGui::InputInt("Height", &m_newCanvasHeight, 50);
+        const char* depths[] = {"8-bit", "16-bit", "16-bit float"};
+        ImGui::Combo("Bit depth", &m_newCanvasDepth, depths, IM_ARRAYSIZE(depths));
 
         // Constrain to reasonable values
         m_newCanvasWidth = std::max(1, std::min(m_newCanvasWidth, 4096));
@@ -1005,7 +1418,7 @@ void UI::renderNewCanvasDialog() {
 
         if (ImGui::Button("Create", ImVec2(120, 0))) {
             Canvas& canvas = GetCanvas();
-            canvas.setupNewCanvas(m_newCanvasWidth, m_newCanvasHeight);
+            canvas.setupNewCanvas(m_newCanvasWidth, m_newCanvasHeight, static_cast<PixelDepth>(m_newCanvasDepth));
             m_showNewCanvasDialog = false;
         }
 
@@ -1156,15 +1569,18 @@ void UI::renderGammaDialog() {
 void UI::renderBlurDialog() {
     Canvas& canvas = GetCanvas();
 
-    ImGui::SetNextWindowSize(ImVec2(300, 120));
-    ImGui::SetNextWindowPos(ImVec2(ImGui::GetIO().DisplaySize.x * 0.5f - 150, ImGui::GetIO().DisplaySize.y * 0.5f - 60));
+    ImGui::SetNextWindowSize(ImVec2(320, 145));
+    ImGui::SetNextWindowPos(ImVec2(ImGui::GetIO().DisplaySize.x * 0.5f - 160, ImGui::GetIO().DisplaySize.y * 0.5f - 72));
 
     if (ImGui::Begin("Blur Filter", &m_showBlurDialog, ImGuiWindowFlags_NoResize)) {
-        ImGui::SliderInt("Strength", &m_blurStrength, 1, 10);
+        const char* modes[] = {"Box", "Gaussian (3 box passes)", "Gaussian"};
+        ImGui::Combo("Type", &m_blurMode, modes, IM_ARRAYSIZE(modes));
+        // Every radius costs the same, logarithmic so the small ones are still easy to hit
+        ImGui::SliderInt("Radius", &m_blurStrength, 1, 500, "%d px", ImGuiSliderFlags_Logarithmic);
 
         if (ImGui::Button("Apply", ImVec2(120, 0))) {
             // WARNING: Using blur then grayscale can cause segfaults
-            canvas.applyBlur(m_blurStrength);
+            canvas.applyBlur(m_blurStrength, static_cast<BlurMode>(m_blurMode));
             m_showBlurDialog = false;
         }
 
@@ -2,10 +2,14 @@
 #include <SDL2/SDL.h>
 #include "../imgui/imgui.h"
 #include "../tools/Tool.hpp"
+#include "../canvas/TileBuffer.hpp"
+#include <unordered_map>
+#include <string>
 
 class Canvas;
 class ToolManager;
 class Editor;
+class Layer;
 
 class UI {
 public:
@@ -54,6 +58,27 @@ private:
     void renderVibranceDialog();
     void renderHelpDialog();
     void renderAboutDialog();
+    void renderPerformancePanel();
+    void renderNavigator();
+    
+    // Small previews for the layer panel and the navigator. They're read from the mip pyramids
+    // and only re-uploaded when the version they were made from moves.
+    struct Thumbnail {
+        SDL_Texture* texture = nullptr;
+        int width = 0;
+        int height = 0;
+        Uint64 version = 0;
+    };
+    static constexpr int THUMBNAIL_SIZE = 32;
+    static constexpr int NAVIGATOR_SIZE = 200;
+    // Smallest pyramid level that's still at least maxSize, linear filtering does the rest
+    static int previewLevel(int width, int height, int maxSize);
+    bool uploadThumbnail(Thumbnail& thumbnail, const TileBuffer& pixels);
+    void destroyThumbnail(Thumbnail& thumbnail);
+    void renderLayerThumbnail(Layer& layer);
+    SDL_Renderer* m_renderer = nullptr;
+    std::unordered_map<const Layer*, Thumbnail> m_layerThumbnails;
+    Thumbnail m_navigator;
 
     bool m_initialized = false;
     bool m_showNewCanvasDialog = false;
@@ -70,15 +95,24 @@ private:
     bool m_showColorBalanceDialog = false;
     bool m_showCurvesDialog = false;
     bool m_showVibranceDialog = false;
+    bool m_showPerformancePanel = false;
+    bool m_showNavigator = false;
+    std::string m_benchmarkResult; // last compositor benchmark, shown in the performance panel
+    std::string m_depthBenchmarkResult; // same for the bit depth one
+    std::string m_filterBenchmarkResult; // and the filter thread scaling one
+    std::string m_toneBenchmarkResult; // and fused vs separate tone adjustments
 
     // Dialog values
     int m_newCanvasWidth = 1280;
     int m_newCanvasHeight = 720;
+    int m_newCanvasDepth = 0; // PixelDepth
     float m_contrastValue = 0.0f;
     float m_saturationValue = 0.0f;
     float m_brightnessValue = 0.0f;
     float m_gammaValue = 0.0f;
     int m_blurStrength = 1;
+    int m_blurMode = 0; // BlurMode
+    int m_newAdjustmentType = 1; // AdjustmentType for the next adjustment layer
 
     // Color grading values
     int m_directionalBlurAngle = 0;